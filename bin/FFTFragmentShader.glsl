@@ -3,14 +3,44 @@ varying vec3 Eye_tangent_space;
 varying vec2 texCoord;
 varying vec4 reflectionTexCoord;
 uniform sampler2D normalMap_texture;
+uniform sampler2D normalMap_texture1;
+uniform sampler2D normalMap_texture2;
+uniform sampler2D normalMap_texture3;
 uniform sampler2D reflection_texture;
+uniform sampler2D displacement_texture;
+uniform sampler2D displacement_texture1;
+uniform sampler2D displacement_texture2;
+uniform sampler2D displacement_texture3;
+uniform float displacement_scale;
+uniform vec4 cascade_scale; // texture repeats of each cascade per reference patch
+uniform vec4 cascade_weight; // 0 for unused cascades
+
+// slope of a cascade normal map, slopes of the bands add up while normals do not
+vec2 cascadeSlope(sampler2D normalMap, vec2 coord)
+{
+	vec3 n = texture2D(normalMap, coord).xyz * 2 - vec3(1.0f);
+	return n.xy / max(n.z, 0.1f);
+}
 
 void main()
 {
 	const vec4 ambientColor = vec4(0.2f, 0.6f, 1.0f, 1.0f);
 	const vec4 diffuseColor = vec4(0.2f, 0.6f, 1.0f, 1.0f);
 
-	vec3 fftNormal = normalize(texture2D(normalMap_texture, (texCoord*0.009f) ).xyz * 2 - vec3(1.0f));
+	// choppy waves: shade the point of the patch that the summed horizontal displacement moved here
+	vec2 patchCoord = texCoord*0.009f;
+	vec2 displacement = cascade_weight.x*texture2D(displacement_texture, patchCoord*cascade_scale.x).xz
+					  + cascade_weight.y*texture2D(displacement_texture1, patchCoord*cascade_scale.y).xz
+					  + cascade_weight.z*texture2D(displacement_texture2, patchCoord*cascade_scale.z).xz
+					  + cascade_weight.w*texture2D(displacement_texture3, patchCoord*cascade_scale.w).xz;
+	patchCoord -= displacement*displacement_scale;
+
+	vec2 slope = cascade_weight.x*cascadeSlope(normalMap_texture, patchCoord*cascade_scale.x)
+			   + cascade_weight.y*cascadeSlope(normalMap_texture1, patchCoord*cascade_scale.y)
+			   + cascade_weight.z*cascadeSlope(normalMap_texture2, patchCoord*cascade_scale.z)
+			   + cascade_weight.w*cascadeSlope(normalMap_texture3, patchCoord*cascade_scale.w);
+
+	vec3 fftNormal = normalize(vec3(slope, 1.0f));
 	vec2 reflCoord = (reflectionTexCoord.xy / reflectionTexCoord.w) * 0.5f + vec2(0.5f, 0.5f);
 	reflCoord.xy += fftNormal.xy*0.02f;
 
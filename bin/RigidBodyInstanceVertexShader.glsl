@@ -0,0 +1,21 @@
+#version 120
+
+// per instance body to world transform, one column per attribute
+attribute vec4 instanceColumn0;
+attribute vec4 instanceColumn1;
+attribute vec4 instanceColumn2;
+attribute vec4 instanceColumn3;
+
+void main()
+{
+	mat4 instanceTransform = mat4(instanceColumn0, instanceColumn1, instanceColumn2, instanceColumn3);
+
+	gl_Position = gl_ModelViewProjectionMatrix*(instanceTransform*gl_Vertex);
+
+	// light 0 as the fixed function pipeline, directional light and rigid transforms only
+	vec3 normal = normalize(gl_NormalMatrix*(mat3(instanceTransform)*gl_Normal));
+	vec3 lightDirection = normalize(gl_LightSource[0].position.xyz);
+
+	gl_FrontColor = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient
+		+ max(dot(normal, lightDirection), 0.0)*gl_FrontLightProduct[0].diffuse;
+}
@@ -7,6 +7,7 @@ varying float Xvertex;
 varying float Zvertex;
 uniform sampler2D normalMap_texture;
 uniform sampler2D reflection_texture;
+uniform float normalMap_scale; // repeats of the first FFT cascade per reference patch
 
 
 void main()
@@ -32,7 +33,7 @@ void main()
 
 
 	normalize(normal);
-	vec3 fftNormal = normalize(texture2D(normalMap_texture, (texCoord*0.009f) ).xyz * 2 - vec3(1.0f));
+	vec3 fftNormal = normalize(texture2D(normalMap_texture, (texCoord*0.009f*normalMap_scale) ).xyz * 2 - vec3(1.0f));
 	
 	vec2 reflCoord = (reflectionTexCoord.xy / reflectionTexCoord.w) *0.5f + vec2(0.5f, 0.5f);
 	
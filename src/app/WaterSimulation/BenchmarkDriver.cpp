@@ -0,0 +1,1020 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "BenchmarkDriver.h"
+#include "FloatingBodySystem.h"
+#include "RigidBody.h"
+#include "HullVoxelProxy.h"
+#include "FFTOcean.h"
+#include "PiersonMoskowitzSpectrum.h"
+#include "HeightFieldRecorder.h"
+#include "HeightFieldReader.h"
+
+#include "base/util/SystemUtil.h"
+#include "base/util/TimeUtil.h"
+
+#include <iomanip>
+#include <float.h>
+
+const float BenchmarkDriver::FRAME_TIME = 1.0f/60.0f;
+const float BenchmarkDriver::TEST_TIME_STEP = 3.7f;
+const float BenchmarkDriver::MAX_VARIANCE_ERROR = 0.1f;
+
+BenchmarkDriver::BenchmarkDriver()
+{
+}
+
+BenchmarkDriver::~BenchmarkDriver()
+{
+}
+
+/**
+ * Runs every grid size from MIN_GRIDSIZE to MAX_GRIDSIZE with 1, 2, 4, ... threads and prints
+ * the time per frame and the speedup over one thread
+ *
+ * @param  numFrames  measured frames per configuration.
+ * @param  maxThreads  largest thread count, 0 uses all processors.
+ */
+void BenchmarkDriver::run(unsigned int numFrames, int maxThreads)
+{
+	if(maxThreads <= 0) {
+		maxThreads = SystemUtil::getNumProcessors();
+	}
+
+	const int previousNumThreads = FFTSimulation::getNumThreads();
+
+	std::vector<int> threadCounts;
+	for(int numThreads=1; numThreads<maxThreads; numThreads*=2) {
+		threadCounts.push_back(numThreads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::cout << "FFT benchmark: " << numFrames << " frames, up to " << maxThreads << " threads, " << SystemUtil::getCPUName() << std::endl;
+	std::cout << "  grid threads  update ms  normals ms   total ms  speedup" << std::endl;
+
+#if defined(GS_USE_FFTW)
+	const unsigned int maxGridSize = MAX_GRIDSIZE;
+#else
+	const unsigned int maxGridSize = std::min((unsigned int)MAX_GRIDSIZE, (unsigned int)BuiltinFFT::MAX_GRIDSIZE);
+#endif
+
+	for(unsigned int gridSize=MIN_GRIDSIZE; gridSize<=maxGridSize; gridSize*=2) {
+
+		double singleThreadTime = 0.0;
+
+		for(unsigned int i=0; i<threadCounts.size(); i++) {
+
+			const int numThreads = threadCounts[i];
+			const Timing timing = measure((unsigned short)gridSize, numThreads, numFrames);
+			const double totalTime = timing.updateTime + timing.normalsTime;
+
+			if(numThreads == 1) {
+				singleThreadTime = totalTime;
+			}
+
+			std::cout << std::fixed << std::setprecision(3)
+				<< std::setw(6) << gridSize << std::setw(8) << numThreads
+				<< std::setw(11) << timing.updateTime*1000.0 << std::setw(12) << timing.normalsTime*1000.0
+				<< std::setw(11) << totalTime*1000.0 << std::setw(8) << std::setprecision(2) << singleThreadTime/totalTime << "x" << std::endl;
+		}
+	}
+
+	std::cout.unsetf(std::ios::floatfield);
+	FFTSimulation::setNumThreads(previousNumThreads);
+}
+
+/**
+ * Times the update of every grid size the builtin FFT supports with both engines, the normals are the
+ * same code for both and left out. Without GS_USE_FFTW only the builtin engine is measured.
+ *
+ * @param  numFrames  measured frames per configuration.
+ * @param  numThreads  threads of the update, 0 uses all processors.
+ */
+void BenchmarkDriver::compareEngines(unsigned int numFrames, int numThreads)
+{
+	if(numThreads <= 0) {
+		numThreads = SystemUtil::getNumProcessors();
+	}
+
+	const FFTSimulation::FFTEngine previousEngine = FFTSimulation::getFFTEngine();
+	const int previousNumThreads = FFTSimulation::getNumThreads();
+
+	std::cout << "FFT engines: " << numFrames << " frames, " << numThreads << " threads" << std::endl;
+	std::cout << "  grid    fftw ms  builtin ms  speedup" << std::endl;
+
+	for(unsigned int gridSize=MIN_GRIDSIZE; gridSize<=BuiltinFFT::MAX_GRIDSIZE; gridSize*=2) {
+
+		FFTSimulation::setFFTEngine(FFTSimulation::FFT_ENGINE_BUILTIN);
+		const double builtinTime = measure((unsigned short)gridSize, numThreads, numFrames).updateTime;
+
+		std::cout << std::fixed << std::setprecision(3) << std::setw(6) << gridSize;
+
+#if defined(GS_USE_FFTW)
+		FFTSimulation::setFFTEngine(FFTSimulation::FFT_ENGINE_FFTW);
+		const double fftwTime = measure((unsigned short)gridSize, numThreads, numFrames).updateTime;
+
+		std::cout << std::setw(11) << fftwTime*1000.0 << std::setw(12) << builtinTime*1000.0
+			<< std::setw(8) << std::setprecision(2) << fftwTime/builtinTime << "x" << std::endl;
+#else
+		std::cout << std::setw(11) << "-" << std::setw(12) << builtinTime*1000.0 << std::setw(9) << "-" << std::endl;
+#endif
+	}
+
+	std::cout.unsetf(std::ios::floatfield);
+	FFTSimulation::setFFTEngine(previousEngine);
+	FFTSimulation::setNumThreads(previousNumThreads);
+}
+
+/**
+ * Checks the transform of every grid size the builtin FFT supports with every available engine against the
+ * naive DFT of FFTSimulation::computeTransformError. The DFT is too slow for every startup, so the check runs
+ * here only, in release builds too, where the SIMD paths and the threaded update are what ships.
+ *
+ * @param  numTimes  simulation times checked per grid size and engine, a few seconds apart.
+ * @param  numThreads  threads of the update, 0 uses all processors.
+ * @return  true if no field differs by more than FFTSimulation::MAX_TRANSFORM_ERROR.
+ */
+bool BenchmarkDriver::testTransforms(unsigned int numTimes, int numThreads)
+{
+	if(numThreads <= 0) {
+		numThreads = SystemUtil::getNumProcessors();
+	}
+
+	const FFTSimulation::FFTEngine previousEngine = FFTSimulation::getFFTEngine();
+	const int previousNumThreads = FFTSimulation::getNumThreads();
+
+	std::vector<FFTSimulation::FFTEngine> engines;
+	engines.push_back(FFTSimulation::FFT_ENGINE_BUILTIN);
+#if defined(GS_USE_FFTW)
+	engines.push_back(FFTSimulation::FFT_ENGINE_FFTW);
+#endif
+
+	FFTSimulation::setNumThreads(numThreads);
+
+	std::cout << "FFT transform test: " << numTimes << " times, " << numThreads << " threads" << std::endl;
+	std::cout << "  grid  engine  max error" << std::endl;
+
+	bool passed = true;
+
+	for(unsigned int gridSize=BuiltinFFT::MIN_GRIDSIZE; gridSize<=BuiltinFFT::MAX_GRIDSIZE; gridSize*=2) {
+		for(unsigned int e=0; e<engines.size(); e++) {
+
+			FFTSimulation::setFFTEngine(engines[e]);
+
+			FFTSimulation* pFftSimulation = new FFTSimulation((unsigned short)gridSize);
+			pFftSimulation->setRandomSeed(1);
+			pFftSimulation->initFFTSimulation();
+
+			float maxError = 0.0f;
+			for(unsigned int t=0; t<numTimes; t++) {
+				maxError = std::max(maxError, pFftSimulation->computeTransformError(t*TEST_TIME_STEP));
+			}
+
+			delete pFftSimulation;
+
+			const bool ok = (maxError < FFTSimulation::MAX_TRANSFORM_ERROR);
+			passed = passed && ok;
+
+			std::cout << std::setw(6) << gridSize << std::setw(8) << ((engines[e] == FFTSimulation::FFT_ENGINE_BUILTIN) ? "builtin" : "fftw")
+				<< std::setw(11) << std::scientific << std::setprecision(2) << maxError << (ok ? "  ok" : "  FAILED") << std::endl;
+		}
+	}
+
+	std::cout.unsetf(std::ios::floatfield);
+	FFTSimulation::setFFTEngine(previousEngine);
+	FFTSimulation::setNumThreads(previousNumThreads);
+
+	return passed;
+}
+
+/**
+ * Compares the height variance of the generated surface with the integral of the wave spectrum over the bins of
+ * the grid, for a Pierson-Moskowitz sea and separately for the default Phillips spectrum. The variance of one
+ * surface scatters with the few strong bins around the peak, so it is averaged over several seeds and times.
+ *
+ * @param  numSeeds  surfaces per spectrum, each sampled at NUM_VARIANCE_TIMES times.
+ * @return  true if every averaged variance is within MAX_VARIANCE_ERROR of the integral.
+ */
+bool BenchmarkDriver::testSpectrumVariance(unsigned int numSeeds)
+{
+	PiersonMoskowitzSpectrum piersonMoskowitz(10.0f);
+	PhillipsSpectrum phillips;
+
+	std::cout << "Spectrum variance test: " << numSeeds << " seeds, " << NUM_VARIANCE_TIMES << " times each" << std::endl;
+	std::cout << "  spectrum           grid  patch  variance  integral   error" << std::endl;
+
+	const bool piersonMoskowitzPassed = checkSpectrumVariance("pierson-moskowitz", &piersonMoskowitz, 256, 1024.0f, numSeeds);
+	const bool phillipsPassed = checkSpectrumVariance("phillips", &phillips, FFTSimulation::GRIDSIZE, FFTSimulation::PATCH_SIZE, numSeeds);
+
+	return piersonMoskowitzPassed && phillipsPassed;
+}
+
+bool BenchmarkDriver::checkSpectrumVariance(const char* name, IWaveSpectrum* pWaveSpectrum, unsigned short gridSize, float patchSize, unsigned int numSeeds)
+{
+	// sum of S(k)*dk^2 over the bins the simulation draws
+	const float waveNumberStep = 2.0f*float(GS_PI)/patchSize;
+	double integral = 0.0;
+
+	for(int i=0; i<gridSize; i++) {
+		for(int j=0; j<gridSize; j++) {
+			const int waveNumberX = (i <= gridSize/2) ? i : i - gridSize;
+			const int waveNumberZ = (j <= gridSize/2) ? j : j - gridSize;
+			integral += pWaveSpectrum->getDensity(waveNumberStep*waveNumberX, waveNumberStep*waveNumberZ);
+		}
+	}
+	integral *= waveNumberStep*waveNumberStep;
+
+	const unsigned int numCells = gridSize*gridSize;
+	double variance = 0.0;
+
+	for(unsigned int seed=1; seed<=numSeeds; seed++) {
+
+		FFTSimulation* pFftSimulation = new FFTSimulation(gridSize, patchSize);
+		pFftSimulation->setWaveSpectrum(pWaveSpectrum);
+		pFftSimulation->setRandomSeed(seed);
+		pFftSimulation->initFFTSimulation();
+
+		for(unsigned int t=0; t<NUM_VARIANCE_TIMES; t++) {
+
+			pFftSimulation->update(t*TEST_TIME_STEP);
+			const float* pFields = pFftSimulation->getFields();
+
+			double sum = 0.0, sumSquared = 0.0;
+			for(unsigned int i=0; i<numCells; i++) {
+				const double height = pFields[FFTSimulation::NUM_FIELDS*i + FFTSimulation::FIELD_HEIGHT];
+				sum += height;
+				sumSquared += height*height;
+			}
+
+			variance += sumSquared/numCells - (sum/numCells)*(sum/numCells);
+		}
+
+		delete pFftSimulation;
+	}
+
+	variance /= numSeeds*NUM_VARIANCE_TIMES;
+
+	const double error = (integral > 0.0) ? variance/integral - 1.0 : 1.0;
+	const bool ok = (fabs(error) < MAX_VARIANCE_ERROR);
+
+	std::cout << "  " << std::left << std::setw(17) << name << std::right << std::setw(6) << gridSize
+		<< std::fixed << std::setprecision(0) << std::setw(7) << patchSize << std::setprecision(4) << std::setw(10) << variance << std::setw(10) << integral
+		<< std::setprecision(1) << std::setw(7) << error*100.0 << "%" << (ok ? "  ok" : "  FAILED") << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+
+	return ok;
+}
+
+/**
+ * Times the floating body update with 1, 2, 4, ... threads. Half of the crates and planks float in the SWE grid,
+ * where they settle and fall asleep until the next drop disturbs the water, the other half on the FFT waves
+ * around it, where they stay awake. The water itself is not timed.
+ *
+ * @param  pPortScene  ground of the SWE grid.
+ * @param  numBodies  bodies per run.
+ * @param  numTicks  measured ticks per thread count.
+ * @param  maxThreads  largest thread count, 0 uses all processors.
+ */
+void BenchmarkDriver::runFloatingBodies(PortScene* pPortScene, int numBodies, unsigned int numTicks, int maxThreads)
+{
+	if(maxThreads <= 0) {
+		maxThreads = SystemUtil::getNumProcessors();
+	}
+
+	std::vector<int> threadCounts;
+	for(int numThreads=1; numThreads<maxThreads; numThreads*=2) {
+		threadCounts.push_back(numThreads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::cout << "Floating body benchmark: " << numBodies << " bodies, " << numTicks << " ticks, up to " << maxThreads << " threads" << std::endl;
+	std::cout << "  threads  update ms  awake  speedup" << std::endl;
+
+	const Vector3 cameraView(0.0f, WaterSimulation::TOTAL_HEIGHT, 0.0f);
+	const float gridRadius = 0.4f*WaterSimulation::NUM_CELLS*WaterSimulation::CELL_EDGE;
+	double singleThreadTime = 0.0;
+
+	for(unsigned int t=0; t<threadCounts.size(); t++) {
+
+		// same water and bodies for every thread count
+		WaterSimulation* pWaterSimulation = new WaterSimulation(pPortScene);
+		pWaterSimulation->setRandomSeed(1);
+		pWaterSimulation->initializeGrid();
+
+		FFTOcean* pOpenSea = new FFTOcean();
+		pOpenSea->initialize(1);
+		pWaterSimulation->setOpenSea(pOpenSea);
+
+		FloatingBodySystem* pBodies = new FloatingBodySystem(*pWaterSimulation);
+		pBodies->setNumThreads(threadCounts[t]);
+
+		const int shapes[2] = {pBodies->addBoxShape(Vector3(0.5f, 0.4f, 0.5f), 2), pBodies->addBoxShape(Vector3(1.0f, 0.1f, 0.25f), 2)};
+		RandomGenerator random(1);
+
+		for(int i=0; i<numBodies; i++) {
+
+			// even bodies inside the SWE grid, odd ones on a ring outside of it
+			const float angle = random.getFloat(0.0f, 6.2831853f);
+			const float radius = (i%2 == 0) ? gridRadius*sqrt(random.getFloat()) : random.getFloat(1.5f*gridRadius, 3.0f*gridRadius);
+			const Vector3 position(radius*cos(angle), WaterSimulation::TOTAL_HEIGHT, radius*sin(angle));
+
+			pBodies->addBody(shapes[i%2], random.getFloat(0.3f, 0.8f), position, Quaternion(random.getFloat(0.0f, 6.2831853f), Vector3(0.0f, 1.0f, 0.0f)));
+		}
+
+		double updateTime = 0.0;
+		double numAwakeBodies = 0.0;
+
+		for(unsigned int tick=0; tick<numTicks; tick++) {
+
+			if(tick%DROP_INTERVAL == 0) {
+				const float angle = random.getFloat(0.0f, 6.2831853f);
+				const float radius = gridRadius*sqrt(random.getFloat());
+				pWaterSimulation->addDrop(radius*cos(angle), radius*sin(angle));
+			}
+
+			pOpenSea->update(tick*FRAME_TIME);
+			pWaterSimulation->update(cameraView);
+
+			const double startTime = TimeUtil::getTime();
+			pBodies->update();
+			updateTime += TimeUtil::getTime() - startTime;
+
+			numAwakeBodies += pBodies->getNumAwakeBodies();
+		}
+
+		updateTime /= std::max(numTicks, 1u);
+		numAwakeBodies /= std::max(numTicks, 1u);
+
+		if(t == 0) {
+			singleThreadTime = updateTime;
+		}
+
+		std::cout << std::fixed << std::setprecision(3) << std::setw(9) << threadCounts[t] << std::setw(11) << updateTime*1000.0
+			<< std::setw(7) << std::setprecision(0) << numAwakeBodies << std::setw(8) << std::setprecision(2) << singleThreadTime/updateTime << "x" << std::endl;
+
+		delete pBodies;
+		delete pWaterSimulation;
+		delete pOpenSea;
+	}
+
+	std::cout.unsetf(std::ios::floatfield);
+}
+
+/**
+ * Lets a crate settle in calm SWE water until it falls asleep, then drops into the cell under it and checks that
+ * the disturbed water wakes it within WAKE_TICKS. The water has no open sea, so nothing else moves it.
+ *
+ * @param  pPortScene  ground of the SWE grid.
+ * @param  numSettleTicks  most ticks the crate may take to fall asleep.
+ * @return  true if the crate fell asleep and the drop woke it.
+ */
+bool BenchmarkDriver::testBodyWaking(PortScene* pPortScene, unsigned int numSettleTicks)
+{
+	const Vector3 cameraView(0.0f, WaterSimulation::TOTAL_HEIGHT, 0.0f);
+	const float gridRadius = 0.4f*WaterSimulation::NUM_CELLS*WaterSimulation::CELL_EDGE;
+
+	WaterSimulation* pWaterSimulation = new WaterSimulation(pPortScene);
+	pWaterSimulation->setRandomSeed(1);
+	pWaterSimulation->initializeGrid();
+
+	FloatingBodySystem* pBodies = new FloatingBodySystem(*pWaterSimulation);
+	const int crate = pBodies->addBoxShape(Vector3(0.5f, 0.4f, 0.5f), 2);
+
+	// first point of a spiral over the grid with water deep enough for the crate
+	Vector3 position(0.0f, WaterSimulation::TOTAL_HEIGHT, 0.0f);
+	for(int i=0; i<1000; i++) {
+		const float radius = gridRadius*i/1000.0f;
+		position = Vector3(radius*cos(0.1f*i), WaterSimulation::TOTAL_HEIGHT, radius*sin(0.1f*i));
+		if(pPortScene->getGroundHeight(position[0], position[2]) < WaterSimulation::TOTAL_HEIGHT - 2.0f) {
+			break;
+		}
+	}
+
+	pBodies->addBody(crate, 0.5f, position, Quaternion(0.0f, Vector3(0.0f, 1.0f, 0.0f)));
+
+	unsigned int tick = 0;
+	for(; (tick < numSettleTicks) && ((tick == 0) || (pBodies->getNumAwakeBodies() > 0)); tick++) {
+		pWaterSimulation->update(cameraView);
+		pBodies->update();
+	}
+
+	const bool fellAsleep = (pBodies->getNumAwakeBodies() == 0);
+	bool woke = false;
+	unsigned int wakeTick = 0;
+
+	if(fellAsleep) {
+
+		Vector3 crateCentre;
+		pBodies->getTransform(0).copyTranslation(crateCentre);
+		pWaterSimulation->addDrop(crateCentre[0], crateCentre[2]);
+
+		for(; (wakeTick < WAKE_TICKS) && !woke; wakeTick++) {
+			pWaterSimulation->update(cameraView);
+			pBodies->update();
+			woke = (pBodies->getNumAwakeBodies() > 0);
+		}
+	}
+
+	std::cout << "Body waking test: crate at (" << position[0] << ", " << position[2] << ") "
+		<< (fellAsleep ? "fell asleep after " : "still awake after ") << tick << " ticks";
+	if(fellAsleep) {
+		std::cout << ", " << (woke ? "woke " : "still asleep ") << wakeTick << " ticks after the drop";
+	}
+	std::cout << ((fellAsleep && woke) ? "  ok" : "  FAILED") << std::endl;
+
+	delete pBodies;
+	delete pWaterSimulation;
+
+	return fellAsleep && woke;
+}
+
+/**
+ * Evaluates the boat hull at random poses on a field of crossing waves, with the exact per triangle buoyancy and
+ * with voxel proxies of decreasing voxel size, and prints the mean errors of the proxies and the time per
+ * evaluation. The water heights are computed outside of the timing, the water below the exact model is one height
+ * per triangle, so on coarse hulls part of the difference is the exact model's own sampling of the waves. Volume
+ * errors are relative to the exact volume, centre of buoyancy errors relative to the hull length, torque errors
+ * relative to force times hull length.
+ *
+ * @param  numPoses  poses per model, heave over the hull height, up to 20 degrees heel and 10 degrees pitch.
+ */
+void BenchmarkDriver::compareBuoyancyModels(unsigned int numPoses)
+{
+	ObjReader objReader;
+	HullTriangleCache hull;
+
+	if(!RigidBody::loadHull(objReader, hull) || (numPoses == 0)) {
+		std::cout << "Buoyancy comparison: no hull" << std::endl;
+		return;
+	}
+
+	Vector3 minimum = objReader.m_vertices[0];
+	Vector3 maximum = minimum;
+
+	for(unsigned int i=1; i<objReader.m_vertices.size(); i++) {
+		for(int c=0; c<3; c++) {
+			minimum[c] = std::min(minimum[c], objReader.m_vertices[i][c]);
+			maximum[c] = std::max(maximum[c], objReader.m_vertices[i][c]);
+		}
+	}
+
+	const Vector3 extent(maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2]);
+	const float length = std::max(extent[0], std::max(extent[1], extent[2]));
+	const float waterLevel = WaterSimulation::TOTAL_HEIGHT;
+	const float waveAmplitude = 0.1f*extent[1];
+	const float waveNumber = 6.2831853f/length;
+	const float degrees = 3.14159265f/180.0f;
+
+	// same poses for all models
+	RandomGenerator random(1);
+	std::vector<RigidBodyIntegrator::State> poses(numPoses);
+
+	for(unsigned int p=0; p<numPoses; p++) {
+
+		Quaternion orientation(random.getFloat(0.0f, 6.2831853f), Vector3(0.0f, 1.0f, 0.0f));
+		orientation.mult(Quaternion(random.getFloat(-20.0f, 20.0f)*degrees, Vector3(0.0f, 0.0f, 1.0f)));
+		orientation.mult(Quaternion(random.getFloat(-10.0f, 10.0f)*degrees, Vector3(1.0f, 0.0f, 0.0f)));
+		orientation.normalise();
+
+		const Vector3 translate(random.getFloat(-length, length), waterLevel - 0.5f*(minimum[1] + maximum[1]) + random.getFloat(-0.5f, 0.5f)*extent[1],
+			random.getFloat(-length, length));
+		RigidBodyIntegrator::initializeState(poses[p], translate, orientation);
+	}
+
+	std::vector<HullTriangleCache::Buoyancy> exact(numPoses);
+	std::vector<float> positionsX(hull.getPaddedSize()), positionsZ(hull.getPaddedSize()), waterHeights(hull.getPaddedSize());
+	double exactTime = 0.0;
+
+	for(unsigned int p=0; p<numPoses; p++) {
+
+		double startTime = TimeUtil::getTime();
+		hull.fillWorldCentroids(poses[p].transform, &positionsX[0], &positionsZ[0]);
+		exactTime += TimeUtil::getTime() - startTime;
+
+		for(int i=0; i<hull.getNumTriangles(); i++) {
+			waterHeights[i] = waterLevel + waveAmplitude*sin(waveNumber*positionsX[i])*cos(0.7f*waveNumber*positionsZ[i]);
+		}
+
+		startTime = TimeUtil::getTime();
+		hull.computeBuoyancy(&waterHeights[0], RigidBodyIntegrator::getUp(poses[p]), poses[p].translate[1], exact[p], NULL);
+		exactTime += TimeUtil::getTime() - startTime;
+	}
+
+	std::cout << "Buoyancy comparison: " << numPoses << " poses, hull length " << length << std::endl;
+	std::cout << "  voxel size  samples   volume %  centre %  torque %  us/eval" << std::endl;
+	std::cout << std::fixed << std::setprecision(3) << "       exact" << std::setw(9) << hull.getNumTriangles()
+		<< std::setw(11) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(9) << exactTime*1.0e6/numPoses << std::endl;
+
+	float voxelSize = RigidBody::DEFAULT_VOXEL_FRACTION*std::min(extent[0], std::min(extent[1], extent[2]));
+
+	for(unsigned int v=0; v<NUM_VOXEL_SIZES; v++, voxelSize*=0.5f) {
+
+		HullVoxelProxy voxels;
+		voxels.build(hull, voxelSize);
+
+		const int numSamples = voxels.getNumSamples();
+		positionsX.resize(numSamples);
+		positionsZ.resize(numSamples);
+		waterHeights.resize(numSamples);
+
+		double voxelTime = 0.0;
+		double volumeError = 0.0, centreError = 0.0, torqueError = 0.0;
+		unsigned int numSubmerged = 0;
+
+		for(unsigned int p=0; (p<numPoses) && (numSamples > 0); p++) {
+
+			HullTriangleCache::Buoyancy buoyancy;
+
+			double startTime = TimeUtil::getTime();
+			voxels.fillWorldPositions(poses[p].transform, &positionsX[0], &positionsZ[0]);
+			voxelTime += TimeUtil::getTime() - startTime;
+
+			for(int i=0; i<numSamples; i++) {
+				waterHeights[i] = waterLevel + waveAmplitude*sin(waveNumber*positionsX[i])*cos(0.7f*waveNumber*positionsZ[i]);
+			}
+
+			startTime = TimeUtil::getTime();
+			voxels.computeBuoyancy(&waterHeights[0], RigidBodyIntegrator::getUp(poses[p]), poses[p].translate[1], buoyancy, NULL);
+			voxelTime += TimeUtil::getTime() - startTime;
+
+			if(exact[p].volume <= 0.0f) {
+				continue;
+			}
+
+			Vector3 centreDifference = buoyancy.centreOfBuoyancy;
+			centreDifference.sub(exact[p].centreOfBuoyancy);
+			Vector3 torqueDifference = buoyancy.pressureTorque;
+			torqueDifference.sub(exact[p].pressureTorque);
+
+			volumeError += fabs(buoyancy.volume - exact[p].volume)/exact[p].volume;
+			centreError += centreDifference.calcMagnitude()/length;
+			torqueError += torqueDifference.calcMagnitude()/(exact[p].pressureForce.calcMagnitude()*length);
+			numSubmerged++;
+		}
+
+		numSubmerged = std::max(numSubmerged, 1u);
+
+		std::cout << std::setw(12) << voxelSize << std::setw(9) << numSamples << std::setw(11) << 100.0*volumeError/numSubmerged
+			<< std::setw(10) << 100.0*centreError/numSubmerged << std::setw(10) << 100.0*torqueError/numSubmerged
+			<< std::setw(9) << voxelTime*1.0e6/numPoses << std::endl;
+	}
+
+	std::cout.unsetf(std::ios::floatfield);
+}
+
+/**
+ * Runs RigidBody::computeConvexHull on random, duplicate, collinear and grid inputs, checks every hull and prints
+ * the time per hull. A hull passes if it is strictly convex and clockwise, contains all points, has the expected
+ * number of vertices where that is known, and repeated calls reuse its storage.
+ *
+ * @param  numRepeats  timed hulls per input.
+ * @return  true if all hulls pass.
+ */
+bool BenchmarkDriver::testConvexHull(unsigned int numRepeats)
+{
+	const char* names[] = {"random", "circle", "grid", "line", "duplicates", "square edges", "two points", "triangle edges", "large ring"};
+	const int numCases = sizeof(names)/sizeof(names[0]);
+
+	RandomGenerator random(1);
+	std::vector<Vector3> input, points, hull;
+	bool passed = true;
+
+	numRepeats = std::max(numRepeats, 1u);
+
+	std::cout << "Convex hull test: " << numRepeats << " repeats" << std::endl;
+	std::cout << "            input  points  hull  expected     us/hull  result" << std::endl;
+
+	for(int c=0; c<numCases; c++) {
+
+		input.clear();
+		int expectedSize = -1;
+
+		switch(c) {
+		case 0:
+			for(int i=0; i<1000; i++) {
+				input.push_back(Vector3(random.getFloat(-10.0f, 10.0f), 0.0f, random.getFloat(-10.0f, 10.0f)));
+			}
+			break;
+		case 1:
+			for(int i=0; i<64; i++) {
+				input.push_back(Vector3(10.0f*cos(i*6.2831853f/64), 0.0f, 10.0f*sin(i*6.2831853f/64)));
+				input.push_back(Vector3(random.getFloat(-5.0f, 5.0f), 0.0f, random.getFloat(-5.0f, 5.0f)));
+			}
+			expectedSize = 64;
+			break;
+		case 2:
+			for(int i=0; i<32*32; i++) {
+				input.push_back(Vector3(0.5f*(i%32), 0.0f, 0.5f*(i/32)));
+			}
+			expectedSize = 4;
+			break;
+		case 3:
+			for(int i=0; i<500; i++) {
+				const float t = random.getFloat(-1.0f, 1.0f);
+				input.push_back(Vector3(4.0f*t, 0.0f, -2.0f*t));
+			}
+			expectedSize = 0;
+			break;
+		case 4:
+			input.assign(100, Vector3(3.0f, 1.0f, -2.0f));
+			expectedSize = 0;
+			break;
+		case 5:
+			for(int i=0; i<400; i++) {
+				const float t = (float)(random.getNext()%20);
+				const float edge[4][2] = {{t, 0.0f}, {20.0f, t}, {20.0f - t, 20.0f}, {0.0f, 20.0f - t}};
+				input.push_back(Vector3(edge[i%4][0], 0.0f, edge[i%4][1]));
+			}
+			input.push_back(Vector3(0.0f, 0.0f, 0.0f));
+			input.push_back(Vector3(20.0f, 0.0f, 0.0f));
+			input.push_back(Vector3(20.0f, 0.0f, 20.0f));
+			input.push_back(Vector3(0.0f, 0.0f, 20.0f));
+			expectedSize = 4;
+			break;
+		case 6:
+			input.push_back(Vector3(1.0f, 0.0f, 1.0f));
+			input.push_back(Vector3(2.0f, 0.0f, 5.0f));
+			expectedSize = 0;
+			break;
+		case 7:
+			for(int i=0; i<=30; i++) {
+				const float t = i/30.0f;
+				input.push_back(Vector3(8.0f*t, 0.0f, 0.0f));
+				input.push_back(Vector3(8.0f - 4.0f*t, 0.0f, 6.0f*t));
+				input.push_back(Vector3(4.0f - 4.0f*t, 0.0f, 6.0f - 6.0f*t));
+			}
+			expectedSize = 3;
+			break;
+		default:
+			for(int i=0; i<100000; i++) {
+				const float angle = random.getFloat(0.0f, 6.2831853f);
+				const float radius = random.getFloat(9.0f, 10.0f);
+				input.push_back(Vector3(radius*cos(angle), 0.0f, radius*sin(angle)));
+			}
+			break;
+		}
+
+		// first call grows the buffers, the timed calls must not reallocate them
+		points = input;
+		RigidBody::computeConvexHull(points, hull);
+		const size_t pointsCapacity = points.capacity();
+		const size_t hullCapacity = hull.capacity();
+
+		double time = 0.0;
+
+		for(unsigned int r=0; r<numRepeats; r++) {
+
+			points.assign(input.begin(), input.end());
+
+			const double startTime = TimeUtil::getTime();
+			RigidBody::computeConvexHull(points, hull);
+			time += TimeUtil::getTime() - startTime;
+		}
+
+		const bool reused = (points.capacity() == pointsCapacity) && (hull.capacity() == hullCapacity);
+		const bool ok = reused && checkConvexHull(input, hull, expectedSize);
+		passed = passed && ok;
+
+		std::cout << std::setw(17) << names[c] << std::setw(8) << input.size() << std::setw(6) << hull.size() << std::setw(10);
+
+		if(expectedSize >= 0) {
+			std::cout << expectedSize;
+		} else {
+			std::cout << "-";
+		}
+
+		std::cout << std::fixed << std::setprecision(3) << std::setw(12) << time*1.0e6/numRepeats << "  " << (ok ? "ok" : "FAILED") << std::endl;
+		std::cout.unsetf(std::ios::floatfield);
+	}
+
+	return passed;
+}
+
+/**
+ * Sweeps random clouds of NUM_SWEEP_POINTS points through the triangles of the tree, about the size and step of a
+ * boat near the port, and compares the earliest crossing with testing every triangle. The vertices collected in
+ * the box around each cloud are compared with counting them over all triangles.
+ *
+ * @return  false if a query finds another crossing or another number of vertices than the brute force test.
+ */
+bool BenchmarkDriver::testCollisionTree(const TriangleBVH& tree, unsigned int numQueries)
+{
+	Vector3 minimum, maximum;
+
+	if(!tree.getBounds(minimum, maximum) || (numQueries == 0)) {
+		std::cout << "Collision test: no triangles" << std::endl;
+		return false;
+	}
+
+	const float extent = std::max(maximum[0] - minimum[0], std::max(maximum[1] - minimum[1], maximum[2] - minimum[2]));
+	const float cloudSize = 0.02f*extent;
+
+	RandomGenerator random(1);
+	std::vector<Vector3> start(NUM_SWEEP_POINTS), end(NUM_SWEEP_POINTS);
+	double treeTime = 0.0, bruteForceTime = 0.0;
+	unsigned int numHits = 0, numMismatches = 0, numVertexMismatches = 0;
+	std::vector<Vector3> vertices;
+
+	for(unsigned int q=0; q<numQueries; q++) {
+
+		const Vector3 centre(random.getFloat(minimum[0], maximum[0]), random.getFloat(minimum[1], maximum[1]), random.getFloat(minimum[2], maximum[2]));
+		const Vector3 step(random.getFloat(-cloudSize, cloudSize), random.getFloat(-cloudSize, cloudSize), random.getFloat(-cloudSize, cloudSize));
+
+		for(int i=0; i<NUM_SWEEP_POINTS; i++) {
+			start[i].set(centre[0] + random.getFloat(-cloudSize, cloudSize), centre[1] + random.getFloat(-cloudSize, cloudSize),
+				centre[2] + random.getFloat(-cloudSize, cloudSize));
+			end[i].add(start[i], step);
+		}
+
+		TriangleBVH::Hit hit;
+
+		double startTime = TimeUtil::getTime();
+		const bool treeHit = tree.sweepPoints(&start[0], &end[0], NUM_SWEEP_POINTS, hit);
+		treeTime += TimeUtil::getTime() - startTime;
+
+		startTime = TimeUtil::getTime();
+		const float bruteForceFraction = sweepPointsBruteForce(tree, &start[0], &end[0], NUM_SWEEP_POINTS);
+		bruteForceTime += TimeUtil::getTime() - startTime;
+
+		const bool bruteForceHit = (bruteForceFraction <= 1.0f);
+
+		if(treeHit) {
+			numHits++;
+		}
+
+		if((treeHit != bruteForceHit) || (treeHit && (fabs(hit.fraction - bruteForceFraction) > 1.0e-4f))) {
+			numMismatches++;
+		}
+
+		// vertices in the box of the cloud, as RigidBody::collidePort collects them
+		Vector3 boxMinimum(centre), boxMaximum(centre);
+		boxMinimum.madd(Vector3(1.0f, 1.0f, 1.0f), -2.0f*cloudSize);
+		boxMaximum.madd(Vector3(1.0f, 1.0f, 1.0f), 2.0f*cloudSize);
+		tree.collectVertices(boxMinimum, boxMaximum, vertices);
+
+		if(vertices.size() != countVerticesInBox(tree, boxMinimum, boxMaximum)) {
+			numVertexMismatches++;
+		}
+	}
+
+	std::cout << "Collision test: " << tree.getNumTriangles() << " triangles, " << tree.getNumNodes() << " nodes, "
+		<< numQueries << " queries of " << NUM_SWEEP_POINTS << " points" << std::endl;
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << "  hits " << numHits << ", mismatches " << numMismatches << ", vertex query mismatches " << numVertexMismatches << std::endl;
+	std::cout << "  tree " << treeTime*1.0e6/numQueries << " us/query, all triangles " << bruteForceTime*1.0e6/numQueries
+		<< " us/query, speedup " << bruteForceTime/std::max(treeTime, 1.0e-9) << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << "  " << ((numMismatches + numVertexMismatches == 0) ? "ok" : "FAILED") << std::endl;
+
+	return (numMismatches + numVertexMismatches) == 0;
+}
+
+/**
+ * Records numFrames of a moving test surface with velocities in every encoding, then reads the frames forward,
+ * backward and in random order and compares them with the recorded values
+ *
+ * @param  filename  scratch file, removed afterwards.
+ * @return  false if a frame is missing or differs by more than the quantisation step.
+ */
+bool BenchmarkDriver::testHeightFieldRecording(const char* filename, unsigned int numFrames)
+{
+	const char* encodingNames[] = {"raw", "quantized", "delta"};
+	const unsigned int numCells = WaterSimulation::NUM_GRIDS;
+	const unsigned int keyFrameInterval = 16; // the grid moves every GRID_MOVE_INTERVAL frames, which also starts a key frame
+
+	std::vector<float> expected(3*numCells), decoded(3*numCells);
+	RandomGenerator random(1);
+	bool passed = true;
+
+	numFrames = std::max(numFrames, 1u);
+
+	std::cout << "Height field test: " << numFrames << " frames of " << WaterSimulation::NUM_CELLS << "x" << WaterSimulation::NUM_CELLS
+		<< ", key frame interval " << keyFrameInterval << std::endl;
+	std::cout << "     encoding   bytes/frame   max error  us/frame random  result" << std::endl;
+
+	for(int encoding=HeightFieldRecorder::ENCODING_RAW; encoding<=HeightFieldRecorder::ENCODING_DELTA; encoding++) {
+
+		HeightFieldRecorder recorder;
+
+		if(!recorder.open(filename, WaterSimulation::NUM_CELLS, WaterSimulation::NUM_CELLS, WaterSimulation::CELL_EDGE, WaterSimulation::TOTAL_HEIGHT,
+			true, (HeightFieldRecorder::Encoding)encoding, keyFrameInterval)) {
+			return false;
+		}
+
+		for(unsigned int frame=0; frame<numFrames; frame++) {
+			fillTestHeightField(frame, &expected[0], &expected[numCells], &expected[2*numCells]);
+			recorder.appendFrame(frame*FRAME_TIME, getTestOriginX(frame), getTestOriginZ(frame), &expected[0], &expected[numCells], &expected[2*numCells]);
+		}
+
+		recorder.close();
+
+		HeightFieldReader reader;
+		bool ok = reader.open(filename) && (reader.getNumFrames() == numFrames);
+		float maxError = 0.0f;
+		double randomTime = 0.0;
+		size_t fileSize = 0;
+
+		// forward, backward, then random order
+		for(unsigned int pass=0; ok && (pass<3); pass++) {
+			for(unsigned int i=0; ok && (i<numFrames); i++) {
+
+				const unsigned int frame = (pass == 0) ? i : ((pass == 1) ? numFrames - 1 - i : random.getNext()%numFrames);
+
+				const double startTime = TimeUtil::getTime();
+				ok = reader.readFrame(frame, &decoded[0], &decoded[numCells], &decoded[2*numCells]);
+
+				if(pass == 2) {
+					randomTime += TimeUtil::getTime() - startTime;
+				}
+
+				const HeightFieldRecorder::FrameHeader* pFrameHeader = ok ? reader.getFrameHeader(frame) : NULL;
+				ok = ok && (pFrameHeader->frame == frame) && (pFrameHeader->originX == getTestOriginX(frame)) && (pFrameHeader->originZ == getTestOriginZ(frame));
+
+				fillTestHeightField(frame, &expected[0], &expected[numCells], &expected[2*numCells]);
+
+				for(unsigned int j=0; ok && (j<3*numCells); j++) {
+					maxError = std::max(maxError, fabs(decoded[j] - expected[j]));
+				}
+			}
+		}
+
+		if(ok) {
+			FILE* pFile = fopen(filename, "rb");
+			if(pFile != NULL) {
+				fseek(pFile, 0, SEEK_END);
+				fileSize = (size_t)ftell(pFile);
+				fclose(pFile);
+			}
+		}
+
+		// raw frames are exact, quantised ones round to the nearest step
+		const float tolerance = (encoding == HeightFieldRecorder::ENCODING_RAW) ? 0.0f : 0.5f*HeightFieldRecorder::HEIGHT_STEP + 1.0e-5f;
+		ok = ok && (maxError <= tolerance);
+		passed = passed && ok;
+
+		std::cout << std::setw(13) << encodingNames[encoding] << std::setw(14) << fileSize/numFrames << std::setw(12) << maxError
+			<< std::fixed << std::setprecision(3) << std::setw(18) << randomTime*1.0e6/numFrames << "  " << (ok ? "ok" : "FAILED") << std::endl;
+		std::cout.unsetf(std::ios::floatfield);
+
+		reader.close();
+	}
+
+	remove(filename);
+
+	return passed;
+}
+
+BenchmarkDriver::Timing BenchmarkDriver::measure(unsigned short gridSize, int numThreads, unsigned int numFrames)
+{
+	FFTSimulation::setNumThreads(numThreads);
+
+	FFTSimulation* pFftSimulation = new FFTSimulation(gridSize);
+	pFftSimulation->setRandomSeed(1);
+	pFftSimulation->initFFTSimulation();
+
+	unsigned char* pNormals = new unsigned char[gridSize*gridSize*4];
+
+	// first frames fault in the pages and start the thread pools
+	for(unsigned int frame=0; frame<NUM_WARMUP_FRAMES; frame++) {
+		pFftSimulation->update(frame*FRAME_TIME);
+		pFftSimulation->calculateAndFillNormals(pNormals);
+	}
+
+	Timing timing;
+	timing.updateTime = 0.0;
+	timing.normalsTime = 0.0;
+
+	for(unsigned int frame=0; frame<numFrames; frame++) {
+
+		const double startTime = TimeUtil::getTime();
+		pFftSimulation->update((NUM_WARMUP_FRAMES + frame)*FRAME_TIME);
+
+		const double updateTime = TimeUtil::getTime();
+		pFftSimulation->calculateAndFillNormals(pNormals);
+
+		timing.updateTime += updateTime - startTime;
+		timing.normalsTime += TimeUtil::getTime() - updateTime;
+	}
+
+	timing.updateTime /= std::max(numFrames, 1u);
+	timing.normalsTime /= std::max(numFrames, 1u);
+
+	delete[] pNormals;
+	delete pFftSimulation;
+
+	return timing;
+}
+
+bool BenchmarkDriver::checkConvexHull(const std::vector<Vector3>& points, const std::vector<Vector3>& hull, int expectedSize)
+{
+	const int hullSize = (int)hull.size();
+
+	if((expectedSize >= 0) && (hullSize != expectedSize)) {
+		return false;
+	}
+
+	for(int i=0; i<hullSize; i++) {
+
+		const Vector3& p0 = hull[i];
+		const Vector3& p1 = hull[(i + 1)%hullSize];
+		const Vector3& p2 = hull[(i + 2)%hullSize];
+
+		// strictly clockwise in x and z
+		if((p1.v[0] - p0.v[0])*(p2.v[2] - p0.v[2]) - (p2.v[0] - p0.v[0])*(p1.v[2] - p0.v[2]) >= 0.0f) {
+			return false;
+		}
+
+		// no point outside of the edge, with a tolerance relative to the edge length
+		const float edgeX = p1.v[0] - p0.v[0];
+		const float edgeZ = p1.v[2] - p0.v[2];
+		const float tolerance = 1.0e-4f*sqrt(edgeX*edgeX + edgeZ*edgeZ);
+
+		for(unsigned int j=0; j<points.size(); j++) {
+			if(edgeX*(points[j].v[2] - p0.v[2]) - (points[j].v[0] - p0.v[0])*edgeZ > tolerance) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// earliest crossing of the segments with any triangle of the tree without the hierarchy, above 1 if none
+float BenchmarkDriver::sweepPointsBruteForce(const TriangleBVH& tree, const Vector3* pStart, const Vector3* pEnd, int numPoints)
+{
+	float fraction = FLT_MAX;
+	const int numTriangles = tree.getNumTriangles();
+
+	for(int t=0; t<numTriangles; t++) {
+
+		Vector3 v0, v1, v2, edge1, edge2;
+		tree.getTriangle(t, v0, v1, v2);
+		edge1.sub(v1, v0);
+		edge2.sub(v2, v0);
+
+		for(int i=0; i<numPoints; i++) {
+
+			Vector3 direction, p, s, q;
+			direction.sub(pEnd[i], pStart[i]);
+			p.crossProduct(direction, edge2);
+
+			const float determinant = edge1.dotProduct(p);
+
+			if(fabs(determinant) <= TriangleBVH::MIN_DETERMINANT) {
+				continue;
+			}
+
+			s.sub(pStart[i], v0);
+			q.crossProduct(s, edge1);
+
+			const float u = s.dotProduct(p)/determinant;
+			const float v = direction.dotProduct(q)/determinant;
+			const float crossing = edge2.dotProduct(q)/determinant;
+
+			if((u >= 0.0f) && (v >= 0.0f) && (u + v <= 1.0f) && (crossing >= 0.0f) && (crossing <= 1.0f)) {
+				fraction = std::min(fraction, crossing);
+			}
+		}
+	}
+
+	return fraction;
+}
+
+// vertices of all triangles inside the box, one per triangle they belong to
+size_t BenchmarkDriver::countVerticesInBox(const TriangleBVH& tree, const Vector3& minimum, const Vector3& maximum)
+{
+	size_t count = 0;
+
+	for(int t=0; t<tree.getNumTriangles(); t++) {
+
+		Vector3 corners[3];
+		tree.getTriangle(t, corners[0], corners[1], corners[2]);
+
+		for(int k=0; k<3; k++) {
+			if((corners[k][0] >= minimum[0]) && (corners[k][0] <= maximum[0]) && (corners[k][1] >= minimum[1]) && (corners[k][1] <= maximum[1])
+				&& (corners[k][2] >= minimum[2]) && (corners[k][2] <= maximum[2])) {
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+// smooth travelling waves and velocities, deterministic per frame so readers can compare in any order
+void BenchmarkDriver::fillTestHeightField(unsigned int frame, float* pHeights, float* pXVelocities, float* pZVelocities)
+{
+	for(int j=0; j<WaterSimulation::NUM_CELLS; j++) {
+		for(int i=0; i<WaterSimulation::NUM_CELLS; i++) {
+
+			const int index = i + j*WaterSimulation::NUM_CELLS;
+			const float phase = 0.2f*i - 0.15f*j + 0.1f*frame;
+
+			pHeights[index] = WaterSimulation::TOTAL_HEIGHT + 0.5f*sin(phase)*cos(0.05f*j - 0.03f*frame);
+			pXVelocities[index] = 0.8f*cos(phase);
+			pZVelocities[index] = -0.6f*sin(0.1f*i + 0.07f*frame);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/** \class BenchmarkDriver
+ * Measures the FFT ocean update (spectrum, transform and normals) over grid sizes and thread counts
+ * without rendering, to see how the threaded update scales, and compares the FFTW plan with the builtin FFT.
+ * The transform test checks both engines against a naive DFT in any build, the spectrum variance test checks
+ * that the generated heights have the variance of their wave spectrum.
+ * The floating body benchmark times the FloatingBodySystem update over thread counts, the waking test checks that
+ * a drop into the SWE grid wakes a sleeping body. The buoyancy comparison measures the error and cost of the
+ * voxelised boat hull against the exact per triangle buoyancy and the convex hull test checks and times the
+ * waterline hull on degenerate and collinear inputs. The collision test
+ * compares swept point queries against the port's TriangleBVH with testing every triangle, the height field test
+ * records a moving surface with every encoding and reads it back in random order through HeightFieldReader.
+ *
+ * @author  Rahul Mukhi
+ * @date 06/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "WaterSimulation.h"
+#include "FFTSimulation.h"
+#include "TriangleBVH.h"
+
+class BenchmarkDriver
+{
+public:
+	BenchmarkDriver();
+	~BenchmarkDriver();
+
+	static const unsigned short MIN_GRIDSIZE = 128;
+	static const unsigned short MAX_GRIDSIZE = 1024;
+	static const unsigned int NUM_WARMUP_FRAMES = 3;
+	static const float FRAME_TIME; // simulated seconds per frame
+	static const float TEST_TIME_STEP; // simulated seconds between the checked times of the transform test
+	static const unsigned int DROP_INTERVAL = 30; // ticks between drops into the SWE grid in the floating body benchmark
+	static const unsigned int WAKE_TICKS = 30; // ticks a drop under a sleeping body may take to wake it
+	static const unsigned int NUM_VOXEL_SIZES = 4; // halving from a quarter of the hull's smallest extent in the buoyancy comparison
+	static const int NUM_SWEEP_POINTS = 64; // points per query of the collision test, about the vertices of a boat hull
+	static const unsigned int GRID_MOVE_INTERVAL = 25; // frames between moves of the grid origin in the height field test
+	static const unsigned int NUM_VARIANCE_TIMES = 4; // surfaces per seed in the spectrum variance test
+	static const float MAX_VARIANCE_ERROR; // relative deviation of the averaged height variance from the spectrum integral
+
+	void run(unsigned int numFrames, int maxThreads);
+	void compareEngines(unsigned int numFrames, int numThreads);
+	bool testTransforms(unsigned int numTimes, int numThreads);
+	bool testSpectrumVariance(unsigned int numSeeds);
+	void runFloatingBodies(PortScene* pPortScene, int numBodies, unsigned int numTicks, int maxThreads);
+	bool testBodyWaking(PortScene* pPortScene, unsigned int numSettleTicks);
+	void compareBuoyancyModels(unsigned int numPoses);
+	bool testConvexHull(unsigned int numRepeats);
+	bool testCollisionTree(const TriangleBVH& tree, unsigned int numQueries);
+	bool testHeightFieldRecording(const char* filename, unsigned int numFrames);
+
+private:
+
+	struct Timing
+	{
+		double updateTime;  // spectrum and FFT per frame in seconds
+		double normalsTime; // normal packing per frame in seconds
+	};
+
+	Timing measure(unsigned short gridSize, int numThreads, unsigned int numFrames);
+	bool checkSpectrumVariance(const char* name, IWaveSpectrum* pWaveSpectrum, unsigned short gridSize, float patchSize, unsigned int numSeeds);
+	bool checkConvexHull(const std::vector<Vector3>& points, const std::vector<Vector3>& hull, int expectedSize);
+	float sweepPointsBruteForce(const TriangleBVH& tree, const Vector3* pStart, const Vector3* pEnd, int numPoints);
+	size_t countVerticesInBox(const TriangleBVH& tree, const Vector3& minimum, const Vector3& maximum);
+	void fillTestHeightField(unsigned int frame, float* pHeights, float* pXVelocities, float* pZVelocities);
+
+	inline static float getTestOriginX(unsigned int frame)
+	{
+		return WaterSimulation::CELL_EDGE*(frame/GRID_MOVE_INTERVAL);
+	}
+
+	inline static float getTestOriginZ(unsigned int frame)
+	{
+		return -WaterSimulation::CELL_EDGE*(frame/GRID_MOVE_INTERVAL);
+	}
+};
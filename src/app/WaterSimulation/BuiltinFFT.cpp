@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "BuiltinFFT.h"
+
+#include "base/util/DebugUtil.h"
+
+BuiltinFFT::BuiltinFFT()
+{
+	m_gridSize = 0;
+	m_numFields = 0;
+	m_numThreads = 1;
+	m_numColumnBlocks = 0;
+	m_pColumnsReal = NULL;
+	m_pColumnsImag = NULL;
+}
+
+BuiltinFFT::~BuiltinFFT()
+{
+	release();
+}
+
+void BuiltinFFT::release()
+{
+	SimdUtil::alignedFree(m_pColumnsReal);
+	SimdUtil::alignedFree(m_pColumnsImag);
+	m_pColumnsReal = NULL;
+	m_pColumnsImag = NULL;
+	m_gridSize = 0;
+}
+
+bool BuiltinFFT::isSizeSupported(unsigned short gridSize)
+{
+	return (gridSize >= MIN_GRIDSIZE) && (gridSize <= MAX_GRIDSIZE) && ((gridSize & (gridSize - 1)) == 0);
+}
+
+/**
+ * Precomputes the twiddles and allocates the column buffers
+ *
+ * @param  gridSize  transform size, see isSizeSupported().
+ * @param  numFields  number of interleaved spectra and fields.
+ * @param  numThreads  threads of execute(), the column and row passes are split into independent blocks.
+ */
+void BuiltinFFT::initialize(unsigned short gridSize, int numFields, int numThreads)
+{
+	release();
+
+	GS_ASSERT(isSizeSupported(gridSize) && (numFields > 0));
+
+	m_gridSize = gridSize;
+	m_numFields = numFields;
+	m_numThreads = std::max(numThreads, 1);
+	m_numColumnBlocks = (gridSize/2 + 1 + 3)/4;
+
+	// the table of the largest size is big enough for all of them
+	m_twiddleReal.resize(FixedSizeFFT<MAX_GRIDSIZE>::NUM_TWIDDLES);
+	m_twiddleImag.resize(FixedSizeFFT<MAX_GRIDSIZE>::NUM_TWIDDLES);
+
+	switch(gridSize) {
+		case 16: FixedSizeFFT<16>::fillTwiddles(&m_twiddleReal[0], &m_twiddleImag[0]); break;
+		case 32: FixedSizeFFT<32>::fillTwiddles(&m_twiddleReal[0], &m_twiddleImag[0]); break;
+		case 64: FixedSizeFFT<64>::fillTwiddles(&m_twiddleReal[0], &m_twiddleImag[0]); break;
+		case 128: FixedSizeFFT<128>::fillTwiddles(&m_twiddleReal[0], &m_twiddleImag[0]); break;
+		case 256: FixedSizeFFT<256>::fillTwiddles(&m_twiddleReal[0], &m_twiddleImag[0]); break;
+		case 512: FixedSizeFFT<512>::fillTwiddles(&m_twiddleReal[0], &m_twiddleImag[0]); break;
+		GS_NO_DEFAULT
+	}
+
+	const size_t columnsSize = sizeof(float)*numFields*4*m_numColumnBlocks*gridSize;
+	m_pColumnsReal = (float*)SimdUtil::alignedMalloc(columnsSize);
+	m_pColumnsImag = (float*)SimdUtil::alignedMalloc(columnsSize);
+}
+
+/**
+ * Transforms all spectra, the input is not modified (the FFTW c2r plan overwrites it)
+ *
+ * @param  pSpectrum  numFields interleaved half spectra, (real, imag) per value.
+ * @param  pFields  receives numFields interleaved fields.
+ */
+void BuiltinFFT::execute(const float* pSpectrum, float* pFields)
+{
+	executeItems(pSpectrum, pFields, 0, getNumItems());
+}
+
+// column items of all fields followed by the row items of all field pairs
+int BuiltinFFT::getNumItems()
+{
+	return m_numFields*m_numColumnBlocks + ((m_numFields + 1)/2)*(m_gridSize/4);
+}
+
+/**
+ * Runs a part of the transform, so one transform can be spread over several calls. Every item is
+ * four FFTs of gridSize values, the row items read the results of all column items.
+ *
+ * @param  begin, end  items in the order of getNumItems(), calls must cover them in ascending order.
+ */
+void BuiltinFFT::executeItems(const float* pSpectrum, float* pFields, int begin, int end)
+{
+	switch(m_gridSize) {
+		case 16: executeItems<16>(pSpectrum, pFields, begin, end); break;
+		case 32: executeItems<32>(pSpectrum, pFields, begin, end); break;
+		case 64: executeItems<64>(pSpectrum, pFields, begin, end); break;
+		case 128: executeItems<128>(pSpectrum, pFields, begin, end); break;
+		case 256: executeItems<256>(pSpectrum, pFields, begin, end); break;
+		case 512: executeItems<512>(pSpectrum, pFields, begin, end); break;
+		GS_NO_DEFAULT
+	}
+}
+
+template <unsigned int N> void BuiltinFFT::executeItems(const float* pSpectrum, float* pFields, int begin, int end)
+{
+	const int numColumnItems = m_numFields*m_numColumnBlocks;
+	const int columnEnd = std::min(end, numColumnItems);
+
+	#pragma omp parallel for num_threads(m_numThreads) if((m_numThreads > 1) && (columnEnd - begin > 1))
+	for(int item=begin; item<columnEnd; item++) {
+		transformColumns<N>(pSpectrum, item/m_numColumnBlocks, item%m_numColumnBlocks);
+	}
+
+	const int rowBegin = std::max(begin, numColumnItems) - numColumnItems;
+	const int rowEnd = end - numColumnItems;
+
+	#pragma omp parallel for num_threads(m_numThreads) if((m_numThreads > 1) && (rowEnd - rowBegin > 1))
+	for(int item=rowBegin; item<rowEnd; item++) {
+		transformRows<N>(pFields, 2*(item/(N/4)), item%(N/4));
+	}
+}
+
+// inverse FFT along the rows index i of four neighbouring half spectrum columns
+template <unsigned int N> void BuiltinFFT::transformColumns(const float* pSpectrum, int field, int block)
+{
+	typedef FixedSizeFFT<N> FFT;
+	typedef typename FFT::Lanes Lanes;
+
+	Lanes real[N], imag[N], tempReal[N], tempImag[N];
+
+	const int halfSize = N/2 + 1;
+	const int firstColumn = 4*block;
+	const int valueStride = 2*m_numFields;
+
+	for(unsigned int i=0; i<N; i++) {
+
+		float columnReal[4], columnImag[4];
+
+		for(int l=0; l<4; l++) {
+			const int column = firstColumn + l;
+
+			if(column < halfSize) {
+				const float* pValue = pSpectrum + valueStride*(i*halfSize + column) + 2*field;
+				columnReal[l] = pValue[0];
+				columnImag[l] = pValue[1];
+			} else {
+				columnReal[l] = 0.0f;
+				columnImag[l] = 0.0f;
+			}
+		}
+
+		real[i] = FFT::set(columnReal[0], columnReal[1], columnReal[2], columnReal[3]);
+		imag[i] = FFT::set(columnImag[0], columnImag[1], columnImag[2], columnImag[3]);
+	}
+
+	FFT::inverse(&m_twiddleReal[0], &m_twiddleImag[0], real, imag, tempReal, tempImag);
+
+	// 4x4 transposes turn lanes = columns into lanes = rows, stored column major
+	Lanes* pColumnsReal = (Lanes*)(m_pColumnsReal + (field*4*m_numColumnBlocks + firstColumn)*N);
+	Lanes* pColumnsImag = (Lanes*)(m_pColumnsImag + (field*4*m_numColumnBlocks + firstColumn)*N);
+
+	for(unsigned int i=0; i<N; i+=4) {
+
+		FFT::transpose(real[i], real[i+1], real[i+2], real[i+3]);
+		FFT::transpose(imag[i], imag[i+1], imag[i+2], imag[i+3]);
+
+		for(unsigned int l=0; l<4; l++) {
+			pColumnsReal[(l*N + i)/4] = real[i+l];
+			pColumnsImag[(l*N + i)/4] = imag[i+l];
+		}
+	}
+}
+
+// c2r transforms along the columns index j of four neighbouring rows, fields a and b as one complex FFT of a + i*b
+template <unsigned int N> void BuiltinFFT::transformRows(float* pFields, int field, int rowBlock)
+{
+	typedef FixedSizeFFT<N> FFT;
+	typedef typename FFT::Lanes Lanes;
+
+	Lanes real[N], imag[N], tempReal[N], tempImag[N];
+
+	const int firstRow = 4*rowBlock;
+	const int columnStride = 4*m_numColumnBlocks*N;
+	const bool hasSecondField = (field + 1 < m_numFields);
+	const Lanes zero = FFT::set(0.0f, 0.0f, 0.0f, 0.0f);
+
+	// value of column j for the four rows
+	const Lanes* pReal = (const Lanes*)(m_pColumnsReal + field*columnStride + firstRow);
+	const Lanes* pImag = (const Lanes*)(m_pColumnsImag + field*columnStride + firstRow);
+	const Lanes* pSecondReal = (const Lanes*)(m_pColumnsReal + (hasSecondField ? field + 1 : field)*columnStride + firstRow);
+	const Lanes* pSecondImag = (const Lanes*)(m_pColumnsImag + (hasSecondField ? field + 1 : field)*columnStride + firstRow);
+	const unsigned int step = N/4;
+
+	for(unsigned int j=0; j<=N/2; j++) {
+
+		const Lanes aReal = pReal[j*step];
+		const Lanes aImag = pImag[j*step];
+		const Lanes bReal = hasSecondField ? pSecondReal[j*step] : zero;
+		const Lanes bImag = hasSecondField ? pSecondImag[j*step] : zero;
+
+		if((j == 0) || (j == N/2)) {
+			// real in a Hermitian row, c2r ignores the imaginary parts
+			real[j] = aReal;
+			imag[j] = bReal;
+			continue;
+		}
+
+		// Z(j) = A(j) + i*B(j), Z(N-j) = conj(A(j)) + i*conj(B(j))
+		real[j] = FFT::sub(aReal, bImag);
+		imag[j] = FFT::add(aImag, bReal);
+		real[N-j] = FFT::add(aReal, bImag);
+		imag[N-j] = FFT::sub(bReal, aImag);
+	}
+
+	FFT::inverse(&m_twiddleReal[0], &m_twiddleImag[0], real, imag, tempReal, tempImag);
+
+	for(unsigned int j=0; j<N; j++) {
+
+		float rowsReal[4], rowsImag[4];
+		FFT::store(rowsReal, real[j]);
+		FFT::store(rowsImag, imag[j]);
+
+		for(int l=0; l<4; l++) {
+			float* pValue = pFields + m_numFields*((firstRow + l)*N + j) + field;
+			pValue[0] = rowsReal[l];
+
+			if(hasSecondField) {
+				pValue[1] = rowsImag[l];
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+/** \class BuiltinFFT
+ * In-tree replacement for the batched FFTW c2r plan of FFTSimulation, so the ocean builds without FFTW.
+ * Transforms numFields interleaved Hermitian half spectra (gridSize x (gridSize/2+1) complex values) into
+ * interleaved real fields (gridSize x gridSize), not normalized, the same layout and result as the FFTW plan.
+ * Columns are transformed four at a time with FixedSizeFFT and written through 4x4 register transposes into
+ * column major blocks, so the row pass loads four rows with one aligned load. The row pass transforms two
+ * fields with one complex FFT (a + i*b). Power of two sizes from MIN_GRIDSIZE to MAX_GRIDSIZE.
+ *
+ * @author  Rahul Mukhi
+ * @date 13/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "base/math/FixedSizeFFT.h"
+
+#include <vector>
+
+class BuiltinFFT
+{
+public:
+	BuiltinFFT();
+	~BuiltinFFT();
+
+	static const unsigned short MIN_GRIDSIZE = 16;
+	static const unsigned short MAX_GRIDSIZE = 512;
+
+	static bool isSizeSupported(unsigned short gridSize);
+
+	void initialize(unsigned short gridSize, int numFields, int numThreads);
+	void execute(const float* pSpectrum, float* pFields);
+	int getNumItems();
+	void executeItems(const float* pSpectrum, float* pFields, int begin, int end);
+
+	inline bool isInitialized()
+	{
+		return m_gridSize > 0;
+	}
+
+private:
+
+	unsigned short m_gridSize;
+	int m_numFields;
+	int m_numThreads;
+	int m_numColumnBlocks; // blocks of 4 columns covering the gridSize/2+1 columns of the half spectrum
+
+	std::vector<float> m_twiddleReal, m_twiddleImag;
+
+	// column pass results per field, 4*m_numColumnBlocks columns of gridSize values each, 16 byte aligned
+	float* m_pColumnsReal;
+	float* m_pColumnsImag;
+
+	void release();
+
+	template <unsigned int N> void executeItems(const float* pSpectrum, float* pFields, int begin, int end);
+	template <unsigned int N> void transformColumns(const float* pSpectrum, int field, int block);
+	template <unsigned int N> void transformRows(float* pFields, int field, int rowBlock);
+};
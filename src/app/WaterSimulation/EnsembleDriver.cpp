@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "EnsembleDriver.h"
+
+#include "base/util/TimeUtil.h"
+
+#if defined(_OPENMP)
+	#include <omp.h>
+#endif
+
+const float EnsembleDriver::TICK_TIME = 1.0f/60.0f;
+
+EnsembleDriver::EnsembleDriver(PortScene* pPortScene)
+{
+	m_pPortScene = pPortScene;
+}
+
+EnsembleDriver::~EnsembleDriver()
+{
+	deleteInstances();
+}
+
+void EnsembleDriver::deleteInstances()
+{
+	for(unsigned int i=0; i<m_instances.size(); i++) {
+		delete m_instances[i]->pBoat;
+		delete m_instances[i]->pCamera;
+		delete m_instances[i]->pFftSimulation;
+		delete m_instances[i]->pWaterSimulation;
+		delete m_instances[i];
+	}
+
+	m_instances.clear();
+}
+
+void EnsembleDriver::initialize(int numInstances, unsigned int seed)
+{
+	deleteInstances();
+
+	// instances already run in parallel, threads inside an instance would only oversubscribe
+	FFTSimulation::setNumThreads(1);
+
+	// sequential, FFTW planning and the obj loader are not thread safe
+	RandomGenerator random(seed);
+
+	for(int i=0; i<numInstances; i++) {
+
+		Instance* pInstance = new Instance();
+
+		pInstance->pWaterSimulation = new WaterSimulation(m_pPortScene);
+		pInstance->pWaterSimulation->setRandomSeed(random.getNext());
+		pInstance->pWaterSimulation->initializeGrid();
+
+		const float windAngle = random.getFloat(0.0f, 6.2831853f);
+
+		pInstance->pFftSimulation = new FFTSimulation();
+		pInstance->pFftSimulation->setRandomSeed(random.getNext());
+		pInstance->pFftSimulation->setWind(random.getFloat(2.0f, 8.0f), cos(windAngle), sin(windAngle));
+		pInstance->pFftSimulation->initFFTSimulation();
+
+		pInstance->pCamera = new Camera();
+		pInstance->pBoat = new RigidBody(*pInstance->pWaterSimulation, *pInstance->pCamera);
+
+		pInstance->random.setSeed(random.getNext());
+		pInstance->turnKey = 0;
+		pInstance->nextTurnTick = 0;
+
+		m_instances.push_back(pInstance);
+	}
+}
+
+void EnsembleDriver::run(unsigned int numTicks)
+{
+	const int numInstances = (int)m_instances.size();
+
+	int numThreads = 1;
+#if defined(_OPENMP)
+	numThreads = omp_get_max_threads();
+#endif
+
+	std::cout << "Ensemble: " << numInstances << " instances, " << numTicks << " ticks, " << numThreads << " threads" << std::endl;
+
+	const double startTime = TimeUtil::getTime();
+
+	// instances are independent, so each thread runs whole instances and no synchronisation per tick is needed
+	#pragma omp parallel for schedule(dynamic, 1)
+	for(int i=0; i<numInstances; i++) {
+		for(unsigned int tick=0; tick<numTicks; tick++) {
+			update(m_instances[i], tick);
+		}
+	}
+
+	const double totalTime = std::max(TimeUtil::getTime() - startTime, 1.0e-6);
+
+	const double sweCellUpdates = double(numInstances)*double(numTicks)*double(WaterSimulation::NUM_GRIDS);
+	const double fftCellUpdates = double(numInstances)*double(numTicks)*double(FFTSimulation::GRIDSIZE*FFTSimulation::GRIDSIZE);
+
+	std::cout << "Ensemble: " << totalTime << " s, " << double(numInstances)*double(numTicks)/totalTime << " instance ticks/s" << std::endl;
+	std::cout << "  SWE " << sweCellUpdates/totalTime << " cell-updates/s, FFT " << fftCellUpdates/totalTime << " cell-updates/s, total "
+		<< (sweCellUpdates + fftCellUpdates)/totalTime << " cell-updates/s" << std::endl;
+}
+
+void EnsembleDriver::update(Instance* pInstance, unsigned int tick)
+{
+	steerBoat(pInstance, tick);
+
+	pInstance->pCamera->moveCamera();
+	pInstance->pWaterSimulation->update(pInstance->pCamera->getCameraView());
+	pInstance->pFftSimulation->update(float(tick)*TICK_TIME);
+	pInstance->pBoat->rigidBodyInteraction();
+}
+
+void EnsembleDriver::steerBoat(Instance* pInstance, unsigned int tick)
+{
+	// full throttle, the rudder changes between left, right and straight every 1 to 4 seconds
+	if(tick == 0) {
+		unsigned char throttle = 'w';
+		pInstance->pBoat->pressNormalKey(throttle);
+	}
+
+	if(tick < pInstance->nextTurnTick) {
+		return;
+	}
+
+	if(pInstance->turnKey != 0) {
+		pInstance->pBoat->releaseNormalKey(pInstance->turnKey);
+	}
+
+	const unsigned int choice = pInstance->random.getNext()%3;
+	pInstance->turnKey = (choice == 0) ? 'a' : ((choice == 1) ? 'd' : 0);
+
+	if(pInstance->turnKey != 0) {
+		pInstance->pBoat->pressNormalKey(pInstance->turnKey);
+	}
+
+	pInstance->nextTurnTick = tick + 60 + pInstance->random.getNext()%180;
+}
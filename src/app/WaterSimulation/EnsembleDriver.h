@@ -0,0 +1,54 @@
+/** \class EnsembleDriver
+ * Runs many independent water simulations (SWE, FFT and boat) in one process for offline studies.
+ * All instances share the read only PortScene, each has its own seed, wind and boat path.
+ *
+ * @author  Rahul Mukhi
+ * @date 22/05/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "PortScene.h"
+#include "WaterSimulation.h"
+#include "FFTSimulation.h"
+#include "RigidBody.h"
+#include "Camera.h"
+
+#include "base/math/RandomGenerator.h"
+
+#include <vector>
+
+class EnsembleDriver
+{
+public:
+	EnsembleDriver(PortScene* pPortScene);
+	~EnsembleDriver();
+
+	static const float TICK_TIME; // simulated seconds per tick for the FFT animation
+
+	void initialize(int numInstances, unsigned int seed);
+	void run(unsigned int numTicks);
+
+private:
+
+	struct Instance
+	{
+		WaterSimulation* pWaterSimulation;
+		FFTSimulation* pFftSimulation;
+		Camera* pCamera;
+		RigidBody* pBoat;
+
+		RandomGenerator random; // boat path
+		unsigned char turnKey;
+		unsigned int nextTurnTick;
+	};
+
+	PortScene* m_pPortScene;
+	std::vector<Instance*> m_instances;
+
+	void update(Instance* pInstance, unsigned int tick);
+	void steerBoat(Instance* pInstance, unsigned int tick);
+	void deleteInstances();
+};
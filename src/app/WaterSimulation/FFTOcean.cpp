@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "FFTOcean.h"
+
+const float FFTOcean::CASCADE_RATIO = 4.0f;
+const float FFTOcean::BAND_SPLIT_FACTOR = 4.0f;
+const float FFTOcean::DEFAULT_REPEAT_PERIOD = 10.0f;
+const float FFTOcean::WORLD_TEXTURE_SCALE = 0.009f;
+const float FFTOcean::DEFAULT_FRAME_TIME = 1.0f/60.0f;
+unsigned int FFTOcean::m_numCacheFrames = 0;
+float FFTOcean::m_repeatPeriod = FFTOcean::DEFAULT_REPEAT_PERIOD;
+std::string FFTOcean::m_cacheFilePrefix;
+unsigned int FFTOcean::m_updateDivider = 1;
+
+FFTOcean::FFTOcean()
+{
+	m_numCascades = 0;
+	m_time = 0.0f;
+	m_pWaveSpectrum = NULL;
+	m_divider = 1;
+	m_frameTime = DEFAULT_FRAME_TIME;
+	m_keysValid = false;
+}
+
+FFTOcean::~FFTOcean()
+{
+	deleteCascades();
+}
+
+void FFTOcean::deleteCascades()
+{
+	for(int i=0; i<m_numCascades; i++) {
+		delete m_pCascades[i];
+		delete m_pCaches[i];
+	}
+
+	m_numCascades = 0;
+}
+
+/**
+ * Creates the cascades. A single cascade is the original PATCH_SIZE patch with the full spectrum, more
+ * cascades add one larger patch below it and smaller ones above. Cascade i keeps the wave numbers from
+ * where cascade i-1 stops up to BAND_SPLIT_FACTOR fundamentals of cascade i+1 (at most its own Nyquist
+ * wave number), the last one keeps everything above.
+ *
+ * @param  numCascades  1 to MAX_CASCADES.
+ * @param  gridSize  FFT size of every cascade.
+ */
+void FFTOcean::initialize(int numCascades, unsigned short gridSize)
+{
+	deleteCascades();
+
+	GS_ASSERT((numCascades >= 1) && (numCascades <= MAX_CASCADES));
+
+	float patchSize = (numCascades == 1) ? FFTSimulation::PATCH_SIZE : FFTSimulation::PATCH_SIZE*CASCADE_RATIO;
+	float minWaveNumber = 0.0f;
+
+	for(int i=0; i<numCascades; i++) {
+
+		float maxWaveNumber = FLT_MAX;
+
+		if(i+1 < numCascades) {
+			const float nyquistWaveNumber = float(GS_PI)*gridSize/patchSize;
+			maxWaveNumber = std::min(BAND_SPLIT_FACTOR*2.0f*float(GS_PI)*CASCADE_RATIO/patchSize, nyquistWaveNumber);
+		}
+
+		m_pCascades[i] = new FFTSimulation(gridSize, patchSize);
+		m_pCascades[i]->setBand(minWaveNumber, maxWaveNumber);
+		m_pCascades[i]->setWaveSpectrum(m_pWaveSpectrum);
+
+		if(m_numCacheFrames > 0) {
+			m_pCascades[i]->setRepeatPeriod(m_repeatPeriod);
+		}
+
+		m_pCascades[i]->initFFTSimulation();
+
+		m_pCaches[i] = NULL;
+		m_cachedFieldsValid[i] = false;
+		initAnimationCache(i);
+
+		const unsigned int numValues = FFTSimulation::NUM_FIELDS*gridSize*gridSize;
+		const unsigned int numKeyValues = (m_updateDivider > 1) ? numValues : 0;
+		m_keyFields[i][0].assign(numKeyValues, 0.0f);
+		m_keyFields[i][1].assign(numKeyValues, 0.0f);
+		m_blendedFields[i].assign(numKeyValues, 0.0f);
+
+		minWaveNumber = maxWaveNumber;
+		patchSize /= CASCADE_RATIO;
+	}
+
+	m_numCascades = numCascades;
+	m_divider = m_updateDivider;
+	m_keysValid = false;
+}
+
+/**
+ * Switches the sea state of all cascades. The h0 tables are regenerated (or loaded with the h0 cache),
+ * animation caches are rebuilt, the FFT plans are kept.
+ *
+ * @param  pWaveSpectrum  spectrum used by all cascades, NULL for the default one. Not owned.
+ */
+void FFTOcean::setWaveSpectrum(IWaveSpectrum* pWaveSpectrum)
+{
+	m_pWaveSpectrum = pWaveSpectrum;
+
+	for(int i=0; i<m_numCascades; i++) {
+
+		m_pCascades[i]->setWaveSpectrum(pWaveSpectrum);
+		m_pCascades[i]->initFFTSimulation();
+
+		delete m_pCaches[i];
+		m_pCaches[i] = NULL;
+		m_cachedFieldsValid[i] = false;
+		initAnimationCache(i);
+	}
+
+	m_keysValid = false;
+}
+
+void FFTOcean::initAnimationCache(int cascade)
+{
+	if(m_numCacheFrames == 0) {
+		return;
+	}
+
+	OceanAnimationCache* pCache = new OceanAnimationCache();
+
+	std::ostringstream filename;
+	filename << m_cacheFilePrefix << "_" << cascade << ".dat";
+
+	const bool useFile = !m_cacheFilePrefix.empty();
+
+	if(!useFile || !pCache->load(filename.str().c_str(), m_pCascades[cascade], m_numCacheFrames)) {
+
+		if(!pCache->build(m_pCascades[cascade], m_numCacheFrames)) {
+			delete pCache;
+			return;
+		}
+
+		if(useFile) {
+			pCache->save(filename.str().c_str());
+		}
+	}
+
+	m_pCaches[cascade] = pCache;
+}
+
+void FFTOcean::update(float time)
+{
+	for(int i=0; i<m_numCascades; i++) {
+		if((m_pCaches[i] == NULL) && (m_divider <= 1)) {
+			m_pCascades[i]->update(time);
+		}
+		m_cachedFieldsValid[i] = false;
+	}
+
+	if(m_divider > 1) {
+		updateDecimated(time);
+	}
+
+	m_time = time;
+}
+
+void FFTOcean::updateDecimated(float time)
+{
+	// the keys are useless after a jump in time, e.g. a replay restarting
+	if(!m_keysValid || (time < m_keyTimes[0]) || (time > m_nextKeyTime)) {
+		resetKeys(time);
+		blendKeys(time);
+		return;
+	}
+
+	if(time > m_time) {
+		m_frameTime = time - m_time;
+	}
+
+	// the finished update replaces the older key once the frames have passed the newer one
+	if((m_keyFrame == m_divider) && (time >= m_keyTimes[1])) {
+		for(int i=0; i<m_numCascades; i++) {
+			if(isDecimated(i)) {
+				m_keyFields[i][0].swap(m_keyFields[i][1]);
+			}
+		}
+		storeKey(1);
+
+		m_keyTimes[0] = m_keyTimes[1];
+		m_keyTimes[1] = m_nextKeyTime;
+		startNextKey();
+	}
+
+	// the steps done grow linearly to all steps in the last frame of the interval
+	if(m_keyFrame < m_divider) {
+		m_keyFrame++;
+		const unsigned int numStepsDone = (m_numKeySteps*m_keyFrame + m_divider - 1)/m_divider;
+		runKeySteps(m_numKeyStepsDone, numStepsDone);
+		m_numKeyStepsDone = numStepsDone;
+	}
+
+	blendKeys(time);
+}
+
+// computes both keys at once, the only frame with the full cost of two updates
+void FFTOcean::resetKeys(float time)
+{
+	const float keyInterval = m_divider*m_frameTime;
+
+	m_keyTimes[0] = time;
+	m_keyTimes[1] = time + keyInterval;
+
+	for(int key=0; key<2; key++) {
+		for(int i=0; i<m_numCascades; i++) {
+			if(isDecimated(i)) {
+				m_pCascades[i]->update(m_keyTimes[key]);
+			}
+		}
+		storeKey(key);
+	}
+
+	startNextKey();
+	m_keysValid = true;
+}
+
+void FFTOcean::startNextKey()
+{
+	m_nextKeyTime = m_keyTimes[1] + m_divider*m_frameTime;
+	m_keyFrame = 0;
+	m_numKeyStepsDone = 0;
+	m_numKeySteps = 0;
+
+	for(int i=0; i<m_numCascades; i++) {
+		if(isDecimated(i)) {
+			m_numKeySteps += m_pCascades[i]->getNumUpdateSteps();
+		}
+	}
+}
+
+// steps of the update for m_nextKeyTime, numbered through the simulated cascades
+void FFTOcean::runKeySteps(unsigned int begin, unsigned int end)
+{
+	unsigned int firstStep = 0;
+
+	for(int i=0; (i<m_numCascades) && (firstStep<end); i++) {
+
+		if(!isDecimated(i)) {
+			continue;
+		}
+
+		const unsigned int numSteps = m_pCascades[i]->getNumUpdateSteps();
+		const unsigned int stepBegin = std::max(begin, firstStep);
+		const unsigned int stepEnd = std::min(end, firstStep + numSteps);
+
+		if(stepBegin < stepEnd) {
+			m_pCascades[i]->runUpdateSteps(m_nextKeyTime, stepBegin - firstStep, stepEnd - firstStep);
+		}
+
+		firstStep += numSteps;
+	}
+}
+
+void FFTOcean::storeKey(int key)
+{
+	for(int i=0; i<m_numCascades; i++) {
+		if(isDecimated(i)) {
+			const float* pFields = m_pCascades[i]->getFields();
+			std::copy(pFields, pFields + m_keyFields[i][key].size(), m_keyFields[i][key].begin());
+		}
+	}
+}
+
+// linear blend of the two keys, the frame times in between are at most m_divider frames apart
+void FFTOcean::blendKeys(float time)
+{
+	const float weight = std::min(std::max((time - m_keyTimes[0])/(m_keyTimes[1] - m_keyTimes[0]), 0.0f), 1.0f);
+#if defined(_OPENMP)
+	const int numThreads = FFTSimulation::getNumThreads();
+#endif
+
+	for(int i=0; i<m_numCascades; i++) {
+
+		if(!isDecimated(i)) {
+			continue;
+		}
+
+		const float* GS_RESTRICT pKey0 = &m_keyFields[i][0][0];
+		const float* GS_RESTRICT pKey1 = &m_keyFields[i][1][0];
+		float* GS_RESTRICT pBlended = &m_blendedFields[i][0];
+		const int numValues = (int)m_blendedFields[i].size();
+
+		#pragma omp parallel for num_threads(numThreads) if(numThreads > 1)
+		for(int j=0; j<numValues; j++) {
+			pBlended[j] = pKey0[j] + weight*(pKey1[j] - pKey0[j]);
+		}
+	}
+}
+
+// fields of the cascade at the time of the last update
+const float* FFTOcean::getCurrentFields(int cascade)
+{
+	if(m_pCaches[cascade] != NULL) {
+		if(!m_cachedFieldsValid[cascade]) {
+			const unsigned short gridSize = m_pCascades[cascade]->getGridSize();
+			m_cachedFields[cascade].resize(FFTSimulation::NUM_FIELDS*gridSize*gridSize);
+			m_pCaches[cascade]->fillFields(m_time, &m_cachedFields[cascade][0]);
+			m_cachedFieldsValid[cascade] = true;
+		}
+		return &m_cachedFields[cascade][0];
+	}
+
+	if(isDecimated(cascade)) {
+		return &m_blendedFields[cascade][0];
+	}
+
+	return m_pCascades[cascade]->getFields();
+}
+
+// normal map of the cascade at the time of the last update
+void FFTOcean::fillNormals(int cascade, unsigned char* pNormals)
+{
+	if(m_pCaches[cascade] != NULL) {
+		m_pCaches[cascade]->fillNormals(m_time, pNormals);
+	} else if(isDecimated(cascade)) {
+		m_pCascades[cascade]->calculateAndFillNormals(&m_blendedFields[cascade][0], pNormals);
+	} else {
+		m_pCascades[cascade]->calculateAndFillNormals(pNormals);
+	}
+}
+
+// displacement map of the cascade at the time of the last update
+void FFTOcean::fillDisplacements(int cascade, float* pDisplacements)
+{
+	if(m_pCaches[cascade] != NULL) {
+		m_pCaches[cascade]->fillDisplacements(m_time, m_pCascades[cascade]->getChoppiness(), pDisplacements);
+	} else if(isDecimated(cascade)) {
+		m_pCascades[cascade]->fillDisplacements(&m_blendedFields[cascade][0], pDisplacements);
+	} else {
+		m_pCascades[cascade]->fillDisplacements(pDisplacements);
+	}
+}
+
+void FFTOcean::setChoppiness(float choppiness)
+{
+	for(int i=0; i<m_numCascades; i++) {
+		m_pCascades[i]->setChoppiness(choppiness);
+	}
+}
+
+/**
+ * Height, displacement, slope and orbital velocity of the summed cascades at a batch of world positions, at the time of the
+ * last update. The shaders show the patch at WORLD_TEXTURE_SCALE with world x along the texture columns
+ * (field z) and world z along the rows (field x), the results are scaled from patch units to world units
+ * the same way. Cached cascades are sampled from their decoded frames, decimated ones from the blended updates.
+ *
+ * @param  pX, pZ  count world positions.
+ * @param  samples  output arrays in world units and axes, NULL skips an output.
+ */
+void FFTOcean::sampleSurface(const float* pX, const float* pZ, unsigned int count, const FFTSimulation::SurfaceSamples& samples)
+{
+	// patch units per world unit, the same for every cascade
+	const float worldScale = WORLD_TEXTURE_SCALE*FFTSimulation::PATCH_SIZE;
+
+	FFTSimulation::SurfaceSamples fieldSamples;
+	fieldSamples.pHeights = samples.pHeights;
+	fieldSamples.pDisplacementsX = samples.pDisplacementsZ;
+	fieldSamples.pDisplacementsZ = samples.pDisplacementsX;
+	fieldSamples.pSlopesX = samples.pSlopesZ;
+	fieldSamples.pSlopesZ = samples.pSlopesX;
+	fieldSamples.pVelocitiesX = samples.pVelocitiesZ;
+	fieldSamples.pVelocitiesZ = samples.pVelocitiesX;
+
+	for(int i=0; i<m_numCascades; i++) {
+
+		FFTSimulation* pCascade = m_pCascades[i];
+		const float* pFields = getCurrentFields(i);
+
+		// world positions go in directly, the patch shrinks by worldScale
+		FFTSimulation::sampleFields(pFields, pCascade->getGridSize(), pCascade->getPatchSize()/worldScale, pCascade->getChoppiness()/worldScale,
+			pZ, pX, count, fieldSamples, i > 0);
+	}
+
+	if((m_numCascades > 0) && (samples.pHeights != NULL)) {
+		for(unsigned int i=0; i<count; i++) {
+			samples.pHeights[i] /= worldScale;
+		}
+	}
+}
@@ -0,0 +1,132 @@
+/** \class FFTOcean
+ * Distant water made of up to MAX_CASCADES FFT simulations with decreasing patch sizes. Each cascade keeps
+ * its own band of wave numbers, so large patches add swell that hides the tiling and small patches add
+ * detail, for a fraction of the cost of one large grid. The cascades are combined when shading.
+ * With an animation cache the cascades loop after a repeat period and are played back from precomputed frames.
+ * With an update divider k the simulated cascades compute an update only every k frames, spread evenly over
+ * those frames, and the frames in between blend the two latest complete updates.
+ *
+ * @author  Rahul Mukhi
+ * @date 08/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "FFTSimulation.h"
+#include "OceanAnimationCache.h"
+
+#include <string>
+#include <vector>
+
+class FFTOcean
+{
+public:
+	FFTOcean();
+	~FFTOcean();
+
+	static const int MAX_CASCADES = 4;
+	static const float CASCADE_RATIO;     // patch size ratio of neighbouring cascades
+	static const float BAND_SPLIT_FACTOR; // bands switch at this many fundamental wave numbers of the smaller cascade
+
+	static const float DEFAULT_REPEAT_PERIOD; // seconds
+	static const float DEFAULT_FRAME_TIME; // seconds, key interval of the update divider until a frame time was measured
+	static const float WORLD_TEXTURE_SCALE; // repeats of a FFTSimulation::PATCH_SIZE patch per world unit, as in the water shaders
+
+	void initialize(int numCascades, unsigned short gridSize = FFTSimulation::GRIDSIZE);
+	void update(float time);
+	void setChoppiness(float choppiness);
+	void setWaveSpectrum(IWaveSpectrum* pWaveSpectrum);
+	void fillNormals(int cascade, unsigned char* pNormals);
+	void fillDisplacements(int cascade, float* pDisplacements);
+	void sampleSurface(const float* pX, const float* pZ, unsigned int count, const FFTSimulation::SurfaceSamples& samples);
+
+	/**
+	 * Oceans initialised afterwards loop after period seconds and precompute numFrames frames per cascade,
+	 * 0 frames simulates every frame. With a file prefix the frames are loaded from or saved to
+	 * <prefix>_<cascade>.dat.
+	 */
+	inline static void setAnimationCache(unsigned int numFrames, float period, const char* filePrefix)
+	{
+		m_numCacheFrames = numFrames;
+		m_repeatPeriod = period;
+		m_cacheFilePrefix = (filePrefix != NULL) ? filePrefix : "";
+	}
+
+	/**
+	 * Oceans initialised afterwards compute the simulated cascades for every divider-th frame only, 1 updates
+	 * every frame. Each frame runs 1/divider of the steps of the next update, the frames show the fields
+	 * blended between the two previous updates.
+	 */
+	inline static void setUpdateDivider(unsigned int divider)
+	{
+		m_updateDivider = std::max(divider, 1u);
+	}
+
+	inline int getNumCascades()
+	{
+		return m_numCascades;
+	}
+
+	inline FFTSimulation* getCascade(int i)
+	{
+		return m_pCascades[i];
+	}
+
+	// texture coordinate scale of cascade i relative to a FFTSimulation::PATCH_SIZE patch
+	inline float getCascadeScale(int i)
+	{
+		return FFTSimulation::PATCH_SIZE/m_pCascades[i]->getPatchSize();
+	}
+
+	inline float getChoppiness()
+	{
+		return (m_numCascades > 0) ? m_pCascades[0]->getChoppiness() : FFTSimulation::CHOPPINESS;
+	}
+
+private:
+
+	static unsigned int m_numCacheFrames;
+	static float m_repeatPeriod;
+	static std::string m_cacheFilePrefix;
+	static unsigned int m_updateDivider;
+
+	FFTSimulation* m_pCascades[MAX_CASCADES];
+	OceanAnimationCache* m_pCaches[MAX_CASCADES]; // NULL if the cascade is simulated every frame
+	int m_numCascades;
+	float m_time;
+	IWaveSpectrum* m_pWaveSpectrum; // NULL for the default spectrum of FFTSimulation
+
+	// fields of cached cascades decoded for sampleSurface, once per update
+	std::vector<float> m_cachedFields[MAX_CASCADES];
+	bool m_cachedFieldsValid[MAX_CASCADES];
+
+	// update divider: fields of the simulated cascades at m_keyTimes[0] and m_keyTimes[1] and their blend at
+	// m_time, the cascades themselves hold the partial update for m_nextKeyTime
+	unsigned int m_divider;
+	std::vector<float> m_keyFields[MAX_CASCADES][2];
+	std::vector<float> m_blendedFields[MAX_CASCADES];
+	float m_keyTimes[2];
+	float m_nextKeyTime;
+	float m_frameTime;
+	unsigned int m_keyFrame; // frames of the next update done
+	unsigned int m_numKeySteps; // update steps of all simulated cascades
+	unsigned int m_numKeyStepsDone;
+	bool m_keysValid;
+
+	inline bool isDecimated(int cascade)
+	{
+		return (m_divider > 1) && (m_pCaches[cascade] == NULL);
+	}
+
+	void deleteCascades();
+	void initAnimationCache(int cascade);
+	void updateDecimated(float time);
+	void resetKeys(float time);
+	void startNextKey();
+	void runKeySteps(unsigned int begin, unsigned int end);
+	void storeKey(int key);
+	void blendKeys(float time);
+	const float* getCurrentFields(int cascade);
+};
@@ -4,79 +4,436 @@
 
 #include "FFTSimulation.h"
 
-const float FFTSimulation::WINDSPEED = 3.0f;
-const float FFTSimulation::A = 3.0f;
-const float FFTSimulation::WAVELENGTH = 4.0f;
-const float FFTSimulation::GRAVITY = 9.81f;
-const float FFTSimulation::PI = 3.14159f;
-const float FFTSimulation::CELL_DISTANCE = 100.0f;
+#include "base/Prerequisites.h"
+#include "base/io/MappedFile.h"
+#include "base/util/SystemUtil.h"
+#include "base/util/TimeUtil.h"
 
-FFTSimulation::FFTSimulation()
+const float FFTSimulation::PI = 3.14159f;
+const float FFTSimulation::NORMAL_SLOPE_SCALE = 1.0f;
+const float FFTSimulation::PATCH_SIZE = 256.0f;
+const float FFTSimulation::TIME_SCALE = 1000.0f/300.0f;
+const float FFTSimulation::MAX_TRANSFORM_ERROR = 1.0e-4f;
+const float FFTSimulation::CHOPPINESS = 1.0f;
+FFTSimulation::PlannerMode FFTSimulation::m_plannerMode = FFTSimulation::PLANNER_ESTIMATE;
+#if defined(GS_USE_FFTW)
+FFTSimulation::FFTEngine FFTSimulation::m_fftEngine = FFTSimulation::FFT_ENGINE_FFTW;
+#else
+FFTSimulation::FFTEngine FFTSimulation::m_fftEngine = FFTSimulation::FFT_ENGINE_BUILTIN;
+#endif
+int FFTSimulation::m_numThreads = 1;
+bool FFTSimulation::m_fftwThreadsInitialized = false;
+bool FFTSimulation::m_h0CacheEnabled = false;
+const unsigned int FFTSimulation::H0_CACHE_MAGIC = GS_MAKEFOURCC('W', 'S', 'H', '0');
+
+FFTSimulation::FFTSimulation(unsigned short gridSize, float patchSize) :
+	m_gridSize(gridSize),
+	m_patchSize(patchSize),
+	m_minWaveNumber(0.0f),
+	m_maxWaveNumber(FLT_MAX),
+	m_repeatPeriod(0.0f),
+	m_choppiness(CHOPPINESS),
+	m_pWaveSpectrum(&m_defaultWaveSpectrum),
+	m_seed((unsigned int)rand())
+#if defined(GS_USE_FFTW)
+	, m_FftPlan(NULL)
+#endif
 {
-	m_windDirection.x = 1.0f;		m_windDirection.y = .0f;
-
-	m_pFftIn = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*GRIDSIZE*GRIDSIZE);
-	m_pFftOut = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex)*GRIDSIZE*GRIDSIZE);
+	GS_ASSERT(gridSize >= 2 && (gridSize % 2) == 0);
+
+	const int numCoefficients = m_gridSize*getHalfGridSize();
+
+	m_pH0SumReal = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pH0SumImag = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pH0DiffReal = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pH0DiffImag = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pOmega = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pWaveDirX = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pWaveDirZ = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pWaveNumberX = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+	m_pWaveNumberZ = (float*)SimdUtil::alignedMalloc(sizeof(float)*numCoefficients);
+
+	m_pSpectrum = (float*)SimdUtil::alignedMalloc(sizeof(float)*2*NUM_FIELDS*numCoefficients);
+	m_pFields = (float*)SimdUtil::alignedMalloc(sizeof(float)*NUM_FIELDS*m_gridSize*m_gridSize);
+
+#if defined(GS_USE_FFTW)
+	for(int field=0; field<NUM_FIELDS; field++) {
+		m_FieldPlans[field] = NULL;
+	}
+#endif
 }
 
 FFTSimulation::~FFTSimulation()
 {
-	fftwf_destroy_plan(m_FftPlan);
-	fftwf_free(m_pFftIn);
-	fftwf_free(m_pFftOut);
+#if defined(GS_USE_FFTW)
+	if(m_FftPlan != NULL) {
+		fftwf_destroy_plan(m_FftPlan);
+	}
+
+	for(int field=0; field<NUM_FIELDS; field++) {
+		if(m_FieldPlans[field] != NULL) {
+			fftwf_destroy_plan(m_FieldPlans[field]);
+		}
+	}
+#endif
+	SimdUtil::alignedFree(m_pSpectrum);
+	SimdUtil::alignedFree(m_pFields);
+	SimdUtil::alignedFree(m_pH0SumReal);
+	SimdUtil::alignedFree(m_pH0SumImag);
+	SimdUtil::alignedFree(m_pH0DiffReal);
+	SimdUtil::alignedFree(m_pH0DiffImag);
+	SimdUtil::alignedFree(m_pOmega);
+	SimdUtil::alignedFree(m_pWaveDirX);
+	SimdUtil::alignedFree(m_pWaveDirZ);
+	SimdUtil::alignedFree(m_pWaveNumberX);
+	SimdUtil::alignedFree(m_pWaveNumberZ);
 }
 
 void FFTSimulation::initFFTSimulation()
 {
-	m_FftPlan = fftwf_plan_dft_1d(GRIDSIZE*GRIDSIZE, m_pFftIn, m_pFftOut, FFTW_BACKWARD, FFTW_ESTIMATE);
+	// all fields are real, so their spectra are Hermitian (H(-k) = conj(H(k))) and only
+	// the gridSize x (gridSize/2+1) half spectra are stored and transformed
+	if(!hasTransform()) {
+		createPlan();
+	}
+
+	const int halfSize = getHalfGridSize();
+	std::vector<Vec2> h0(m_gridSize*m_gridSize);
+
+	// with a repeat period every omega is a multiple of the base frequency, so all waves are back in phase after it
+	const float baseOmega = (m_repeatPeriod > 0.0f) ? 2*PI/(m_repeatPeriod*TIME_SCALE) : 0.0f;
 
-	for(int i=0; i<GRIDSIZE; i++) {
-		for(int j=0; j<GRIDSIZE; j++)
+	if(!m_h0CacheEnabled || !loadH0(h0)) {
+
+		generateH0(h0);
+
+		if(m_h0CacheEnabled) {
+			saveH0(h0);
+		}
+	}
+
+	// combine h0(k) with h0(-k) here, update() then builds H(k) without touching the other half.
+	// Everything except the phase omega*t is constant over time.
+	for(int i=0; i<m_gridSize; i++) {
+		for(int j=0; j<halfSize; j++)
 		{
-			const int index = i*GRIDSIZE + j;
+			const int index = i*halfSize + j;
+			const Vec2& h0Pos = h0[i*m_gridSize + j];
+			const Vec2& h0Neg = h0[((m_gridSize - i) % m_gridSize)*m_gridSize + (m_gridSize - j) % m_gridSize];
+
+			m_pH0SumReal[index] = h0Pos.x + h0Neg.x;
+			m_pH0SumImag[index] = h0Pos.y + h0Neg.y;
+			m_pH0DiffReal[index] = h0Pos.x - h0Neg.x;
+			m_pH0DiffImag[index] = h0Pos.y - h0Neg.y;
+
+			const float waveNumberX = 2*PI*getWaveNumber(i)/m_patchSize;
+			const float waveNumberZ = 2*PI*j/m_patchSize;
 
-			m_waveDirection.x = 2*PI*(i - GRIDSIZE/2.0f)/L;
-			m_waveDirection.y = 2*PI*(j - GRIDSIZE/2.0f)/L;
+			const float waveLength = sqrt(waveNumberX*waveNumberX + waveNumberZ*waveNumberZ);
 
-			m_amplitudePos[index] = calculateH0(1);
-			m_amplitudeNeg[index] = calculateH0(-1);
+			m_pOmega[index] = m_pWaveSpectrum->getOmega(waveLength);
 
+			// at least one base frequency, long waves would otherwise stand still
+			if((baseOmega > 0.0f) && (waveLength > 0.0f)) {
+				m_pOmega[index] = std::max(floor(m_pOmega[index]/baseOmega + 0.5f), 1.0f)*baseOmega;
+			}
+
+			// derivative spectra are odd, their Nyquist terms would not be Hermitian and are dropped
+			if((waveLength > 0.0f) && (2*i != m_gridSize) && (2*j != m_gridSize)) {
+				m_pWaveDirX[index] = waveNumberX/waveLength;
+				m_pWaveDirZ[index] = waveNumberZ/waveLength;
+				m_pWaveNumberX[index] = waveNumberX;
+				m_pWaveNumberZ[index] = waveNumberZ;
+			} else {
+				m_pWaveDirX[index] = 0.0f;
+				m_pWaveDirZ[index] = 0.0f;
+				m_pWaveNumberX[index] = 0.0f;
+				m_pWaveNumberZ[index] = 0.0f;
+			}
 		}
 	}
-	
 }
 
-FFTSimulation::Vec2 FFTSimulation::calculateH0(short mul)
+/**
+ * Sets the worker threads of FFTSimulations initialised afterwards. Like the planner mode this is process
+ * wide, FFTW keeps the thread count of its planner in global state
+ *
+ * @param  numThreads  number of threads, 0 uses all processors.
+ */
+void FFTSimulation::setNumThreads(int numThreads)
 {
-	Vec2 v = gaussian(0.0f,1.0f);
-	float phillips = calculatePhillipsSpectrum(mul);
+	if(numThreads <= 0) {
+		numThreads = SystemUtil::getNumProcessors();
+	}
 
-	float factor = sqrt(phillips/2);
+	m_numThreads = numThreads;
+}
 
-	v.x *= factor;
-	v.y *= factor;
+/**
+ * Selects the transform of FFTSimulations initialised afterwards. Sizes the built-in FFT does not support
+ * still use FFTW
+ *
+ * @param  engine  FFT_ENGINE_FFTW is only available with GS_USE_FFTW.
+ */
+void FFTSimulation::setFFTEngine(FFTEngine engine)
+{
+#if !defined(GS_USE_FFTW)
+	if(engine == FFT_ENGINE_FFTW) {
+		std::cout << "FFT: built without FFTW, using the built-in FFT" << std::endl;
+		engine = FFT_ENGINE_BUILTIN;
+	}
+#endif
 
-	return v;
-	
+	m_fftEngine = engine;
+}
+
+void FFTSimulation::createPlan()
+{
+	if((m_fftEngine == FFT_ENGINE_BUILTIN) && BuiltinFFT::isSizeSupported(m_gridSize)) {
+		m_builtinFFT.initialize(m_gridSize, NUM_FIELDS, m_numThreads);
+		return;
+	}
+
+#if defined(GS_USE_FFTW)
+	if((m_numThreads > 1) && !m_fftwThreadsInitialized) {
+		m_fftwThreadsInitialized = (fftwf_init_threads() != 0);
+	}
+
+	if(m_fftwThreadsInitialized) {
+		fftwf_plan_with_nthreads(m_numThreads);
+	}
+
+	// the steps of runUpdateSteps, estimated since they only run with a decimated update (estimating does not touch the buffers)
+	for(int field=0; field<NUM_FIELDS; field++) {
+		m_FieldPlans[field] = planFieldTransform(field, FFTW_ESTIMATE);
+	}
+
+	if(m_plannerMode == PLANNER_ESTIMATE) {
+		m_FftPlan = planTransform(FFTW_ESTIMATE);
+		return;
+	}
+
+	const unsigned int flags = (m_plannerMode == PLANNER_PATIENT) ? FFTW_PATIENT : FFTW_MEASURE;
+	const std::string wisdomFilename = getWisdomFilename();
+
+	// one wisdom file per key, so forget what other sizes left behind (existing plans are not affected)
+	fftwf_forget_wisdom();
+
+	if(fftwf_import_wisdom_from_filename(wisdomFilename.c_str())) {
+		m_FftPlan = planTransform(flags | FFTW_WISDOM_ONLY);
+	}
+
+	if(m_FftPlan != NULL) {
+		return;
+	}
+
+	// measuring overwrites the buffers, they are filled after planning
+	const double startTime = TimeUtil::getTime();
+	m_FftPlan = planTransform(flags);
+
+	std::cout << "FFT: planned " << m_gridSize << "x" << m_gridSize << " in " << TimeUtil::getTime() - startTime << " s, saving wisdom to " << wisdomFilename << std::endl;
+
+	if(!fftwf_export_wisdom_to_filename(wisdomFilename.c_str())) {
+		std::cout << "FFT: could not write " << wisdomFilename << std::endl;
+	}
+#else
+	GS_ASSERT_WITH_MSG(false, "grid size not supported by the built-in FFT and FFTW is not compiled in");
+#endif
+}
+
+void FFTSimulation::executeTransform()
+{
+	if(m_builtinFFT.isInitialized()) {
+		m_builtinFFT.execute(m_pSpectrum, m_pFields);
+		return;
+	}
+
+#if defined(GS_USE_FFTW)
+	fftwf_execute(m_FftPlan);
+#endif
+}
+
+#if defined(GS_USE_FFTW)
+
+fftwf_plan FFTSimulation::planTransform(unsigned int flags)
+{
+	// one batch of NUM_FIELDS transforms over interleaved spectra and fields (stride NUM_FIELDS, distance 1),
+	// so FFTW walks the memory once for all fields
+	const int size[2] = {m_gridSize, m_gridSize};
+
+	return fftwf_plan_many_dft_c2r(2, size, NUM_FIELDS, (fftwf_complex*)m_pSpectrum, NULL, NUM_FIELDS, 1, m_pFields, NULL, NUM_FIELDS, 1, flags);
+}
+
+// the transform of a single field out of the interleaved arrays, one of the batch of planTransform
+fftwf_plan FFTSimulation::planFieldTransform(int field, unsigned int flags)
+{
+	const int size[2] = {m_gridSize, m_gridSize};
+
+	return fftwf_plan_many_dft_c2r(2, size, 1, (fftwf_complex*)m_pSpectrum + field, NULL, NUM_FIELDS, 1, m_pFields + field, NULL, NUM_FIELDS, 1, flags);
+}
+
+/**
+ * Wisdom is only valid for the transform size, the planner flags, the thread count and the processor it was measured on
+ *
+ * @return file name in the working directory, e.g. "fftwWisdom_c2r_64x64x5_measure_t1_Intel_R_Core_TM_i7_2600_CPU_3_40GHz.dat".
+ */
+std::string FFTSimulation::getWisdomFilename()
+{
+	std::ostringstream filename;
+
+	filename << "fftwWisdom_c2r_" << m_gridSize << "x" << m_gridSize << "x" << (int)NUM_FIELDS << "_" << ((m_plannerMode == PLANNER_PATIENT) ? "patient" : "measure")
+		<< "_t" << m_numThreads << "_" << SystemUtil::getCPUKey() << ".dat";
+
+	return filename.str();
+}
+#endif
+
+/**
+ * Restricts the spectrum to a band of wave numbers, so cascades with different patch sizes
+ * do not add the same waves twice
+ *
+ * @param  minWaveNumber  smallest |k| kept (inclusive).
+ * @param  maxWaveNumber  largest |k| kept (exclusive).
+ */
+void FFTSimulation::setBand(float minWaveNumber, float maxWaveNumber)
+{
+	m_minWaveNumber = minWaveNumber;
+	m_maxWaveNumber = maxWaveNumber;
+}
+
+/**
+ * Quantizes the dispersion to multiples of 2*PI/period, the animation then loops after period seconds
+ * and can be precomputed (see OceanAnimationCache)
+ *
+ * @param  period  repeat period in seconds, 0 keeps the exact dispersion.
+ */
+void FFTSimulation::setRepeatPeriod(float period)
+{
+	m_repeatPeriod = std::max(period, 0.0f);
+}
+
+void FFTSimulation::setWind(float windSpeed, float directionX, float directionZ)
+{
+	m_defaultWaveSpectrum.setWind(windSpeed, directionX, directionZ);
+}
+
+void FFTSimulation::setWaveSpectrum(IWaveSpectrum* pWaveSpectrum)
+{
+	m_pWaveSpectrum = (pWaveSpectrum != NULL) ? pWaveSpectrum : &m_defaultWaveSpectrum;
+}
+
+/**
+ * Draws h0(k) = (xi_r + i*xi_i)*sqrt(S(k)/4)*dk for every bin of the full spectrum, xi are standard normal
+ * and dk = 2*PI/patchSize is the spacing of the wave numbers, so heights are in meters for every patch size.
+ * H(k) adds h0(k) and conj(h0(-k)), E|H(k)|^2 = S(k)*dk^2 and the height variance is the integral of S.
+ * The random sequence restarts at the seed, so all spectra get the same waves.
+ */
+void FFTSimulation::generateH0(std::vector<Vec2>& h0)
+{
+	const float waveNumberStep = 2*PI/m_patchSize;
+
+	m_random.setSeed(m_seed);
+
+	for(int i=0; i<m_gridSize; i++) {
+		for(int j=0; j<m_gridSize; j++)
+		{
+			const float waveNumberX = waveNumberStep*getWaveNumber(i);
+			const float waveNumberZ = waveNumberStep*getWaveNumber(j);
+			const float waveLength = sqrt(waveNumberX*waveNumberX + waveNumberZ*waveNumberZ);
+
+			Vec2& value = h0[i*m_gridSize + j];
+			value = gaussian(0.0f, 1.0f);
+
+			// drawn anyway so the band does not change the random sequence of the other bins
+			if((waveLength < m_minWaveNumber) || (waveLength >= m_maxWaveNumber)) {
+				value.x = 0.0f;
+				value.y = 0.0f;
+				continue;
+			}
+
+			const float amplitude = sqrt(0.25f*m_pWaveSpectrum->getDensity(waveNumberX, waveNumberZ))*waveNumberStep;
+
+			value.x *= amplitude;
+			value.y *= amplitude;
+		}
+	}
+}
+
+FFTSimulation::H0CacheHeader FFTSimulation::getH0CacheHeader()
+{
+	H0CacheHeader header;
+	memset(&header, 0, sizeof(header));
+
+	header.magic = H0_CACHE_MAGIC;
+	header.version = H0_CACHE_VERSION;
+	header.gridSize = m_gridSize;
+	header.seed = m_seed;
+	header.keyHash = hashKey(m_pWaveSpectrum->getKey());
+	header.patchSize = m_patchSize;
+	header.minWaveNumber = m_minWaveNumber;
+	header.maxWaveNumber = m_maxWaveNumber;
+
+	return header;
+}
+
+std::string FFTSimulation::getH0Filename()
+{
+	const H0CacheHeader header = getH0CacheHeader();
+
+	std::ostringstream filename;
+	filename << "h0Cache_" << m_gridSize << "_" << std::hex << header.keyHash << "_" << hashKey(std::string((const char*)&header, sizeof(header))) << ".dat";
+
+	return filename.str();
+}
+
+bool FFTSimulation::loadH0(std::vector<Vec2>& h0)
+{
+	MappedFile file;
+
+	if(!file.open(getH0Filename().c_str(), MappedFile::ACCESS_READ)) {
+		return false;
+	}
+
+	// the file name is only a hash, the header has to match exactly
+	const H0CacheHeader header = getH0CacheHeader();
+	const size_t dataSize = h0.size()*sizeof(Vec2);
+
+	if((file.getSize() != sizeof(H0CacheHeader) + dataSize) || (memcmp(file.getData(), &header, sizeof(H0CacheHeader)) != 0)) {
+		return false;
+	}
+
+	memcpy(&h0[0], file.getData() + sizeof(H0CacheHeader), dataSize);
+
+	return true;
 }
 
-float FFTSimulation::calculatePhillipsSpectrum(short mul)
+void FFTSimulation::saveH0(const std::vector<Vec2>& h0)
 {
-	m_waveDirection.x *= mul;
-	m_waveDirection.y *= mul;
+	const std::string filename = getH0Filename();
+	const H0CacheHeader header = getH0CacheHeader();
+	const size_t dataSize = h0.size()*sizeof(Vec2);
 
-	float cosineFactor = m_waveDirection.x*m_windDirection.x + m_waveDirection.y*m_windDirection.y;
+	MappedFile file;
 
-	float Ph = A*exp((-1.0f * GRAVITY * GRAVITY) / (WAVELENGTH * WAVELENGTH * WINDSPEED * WINDSPEED * WINDSPEED * WINDSPEED));
-	Ph /= WAVELENGTH * WAVELENGTH * WAVELENGTH * WAVELENGTH * WAVELENGTH;
-	Ph *= cosineFactor*cosineFactor;
+	if(!file.open(filename.c_str(), MappedFile::ACCESS_READ_WRITE, sizeof(H0CacheHeader) + dataSize)) {
+		std::cout << "FFT: could not write " << filename << std::endl;
+		return;
+	}
 
-	/*float l = 1.0f;
-	float modifyFactor = exp(-(WAVELENGTH*WAVELENGTH)*l*l);
+	memcpy(file.getData(), &header, sizeof(H0CacheHeader));
+	memcpy(file.getData() + sizeof(H0CacheHeader), &h0[0], dataSize);
+}
 
-	//Ph *= modifyFactor;*/
+// FNV-1a of a cache key
+unsigned int FFTSimulation::hashKey(const std::string& key)
+{
+	unsigned int hash = 2166136261u;
 
-	return Ph;
+	for(size_t i=0; i<key.size(); i++) {
+		hash = (hash ^ (unsigned char)key[i])*16777619u;
+	}
+
+	return hash;
 }
 
 FFTSimulation::Vec2 FFTSimulation::gaussian(float mean, float stdDeviation)
@@ -101,110 +458,473 @@ FFTSimulation::Vec2 FFTSimulation::gaussian(float mean, float stdDeviation)
 	return v;
 }
 
-void FFTSimulation::update()
+void FFTSimulation::update(float time)
 {
-	float time = glutGet(GLUT_ELAPSED_TIME)/300.0f;
+	fillSpectrum(time);
 
-	float omega, waveDirLength;
+	executeTransform();
+}
 
-	for(int i=0; i<GRIDSIZE; i++)
-		for(int j=0; j<GRIDSIZE; j++)
-		{
-			const int index = i*GRIDSIZE + j;
+// spectrum blocks followed by the items of the built-in FFT, or one FFTW transform per field
+unsigned int FFTSimulation::getNumUpdateSteps()
+{
+	const unsigned int numTransformSteps = m_builtinFFT.isInitialized() ? (unsigned int)m_builtinFFT.getNumItems() : (unsigned int)NUM_FIELDS;
 
-			m_waveDirection.x = 2*PI*(i - GRIDSIZE/2.0f)/L;
-			m_waveDirection.y = 2*PI*(j - GRIDSIZE/2.0f)/L;
+	return getNumSpectrumBlocks() + numTransformSteps;
+}
 
-			waveDirLength = sqrt(m_waveDirection.x*m_waveDirection.x + m_waveDirection.y*m_waveDirection.y);
-			omega = sqrt(GRAVITY*waveDirLength);
+/**
+ * Runs a part of update(), so the update of one frame can be spread over several frames. The fields are
+ * complete after the last step, before they mix old and new values.
+ *
+ * @param  time  the same for all steps of one update.
+ * @param  begin, end  steps of getNumUpdateSteps(), calls must cover them in ascending order.
+ */
+void FFTSimulation::runUpdateSteps(float time, unsigned int begin, unsigned int end)
+{
+	const unsigned int numSpectrumBlocks = getNumSpectrumBlocks();
 
-			float omegaT = omega*time;
+	if(begin < numSpectrumBlocks) {
+		fillSpectrum(time, begin, std::min(end, numSpectrumBlocks));
+	}
 
-			m_pFftIn[index][0]= (m_amplitudePos[index].x + m_amplitudeNeg[index].x)*cos(omegaT) - (m_amplitudePos[index].y + m_amplitudeNeg[index].y)*sin(omegaT);
-			m_pFftIn[index][1] = (m_amplitudePos[index].y - m_amplitudeNeg[index].y)*cos(omegaT) + (m_amplitudePos[index].x - m_amplitudeNeg[index].x)*sin(omegaT);
+	if(end <= numSpectrumBlocks) {
+		return;
+	}
+
+	const unsigned int transformBegin = std::max(begin, numSpectrumBlocks) - numSpectrumBlocks;
+	const unsigned int transformEnd = end - numSpectrumBlocks;
+
+	if(m_builtinFFT.isInitialized()) {
+		m_builtinFFT.executeItems(m_pSpectrum, m_pFields, transformBegin, transformEnd);
+		return;
+	}
+
+#if defined(GS_USE_FFTW)
+	for(unsigned int field=transformBegin; field<transformEnd; field++) {
+		fftwf_execute(m_FieldPlans[field]);
+	}
+#endif
+}
+
+int FFTSimulation::getNumSpectrumBlocks()
+{
+	const int numCoefficients = m_gridSize*getHalfGridSize();
+
+	return (numCoefficients + SPECTRUM_BLOCK_SIZE - 1)/SPECTRUM_BLOCK_SIZE;
+}
+
+void FFTSimulation::fillSpectrum(float time)
+{
+	fillSpectrum(time, 0, getNumSpectrumBlocks());
+}
+
+void FFTSimulation::fillSpectrum(float time, int beginBlock, int endBlock)
+{
+	// time in seconds, passed in so replays animate independent of the wall clock
+	const float scaledTime = time*TIME_SCALE;
+
+	const int numCoefficients = m_gridSize*getHalfGridSize();
+
+	#pragma omp parallel for num_threads(m_numThreads) if((m_numThreads > 1) && (endBlock - beginBlock > 1))
+	for(int block=beginBlock; block<endBlock; block++) {
+		fillSpectrumBlock(scaledTime, block*SPECTRUM_BLOCK_SIZE, std::min((block+1)*SPECTRUM_BLOCK_SIZE, numCoefficients));
+	}
+}
+
+void FFTSimulation::fillSpectrumBlock(float scaledTime, int begin, int end)
+{
+	const int stride = 2*NUM_FIELDS;
+	float* GS_RESTRICT pSpectrum = m_pSpectrum;
+	int index = begin;
+
+	// H(k) = h0(k)*exp(i*omega*t) + conj(h0(-k))*exp(-i*omega*t)
+	//      = (sumReal*cos - sumImag*sin) + i*(diffImag*cos + diffReal*sin)
+	// displacement D(k) = -i*k/|k|*H(k), slope S(k) = i*k*H(k), velocity V(k) = -i*k/|k|*dH/dt with
+	// dH/dt = omega*(-(sumReal*sin + sumImag*cos) + i*(diffReal*cos - diffImag*sin)), per second of unscaled time
+#if defined(GS_SSE2)
+	const __m128 time4 = _mm_set1_ps(scaledTime);
+	const __m128 timeScale4 = _mm_set1_ps(TIME_SCALE);
+	const __m128 zero = _mm_setzero_ps();
+
+	for(; index+4 <= end; index += 4)
+	{
+		const __m128 omega = _mm_load_ps(m_pOmega + index);
+		__m128 sinOmegaT, cosOmegaT;
+		SimdUtil::sinCos4(_mm_mul_ps(omega, time4), &sinOmegaT, &cosOmegaT);
+
+		const __m128 sumReal = _mm_load_ps(m_pH0SumReal + index);
+		const __m128 sumImag = _mm_load_ps(m_pH0SumImag + index);
+		const __m128 diffReal = _mm_load_ps(m_pH0DiffReal + index);
+		const __m128 diffImag = _mm_load_ps(m_pH0DiffImag + index);
+
+		const __m128 real = _mm_sub_ps(_mm_mul_ps(sumReal, cosOmegaT), _mm_mul_ps(sumImag, sinOmegaT));
+		const __m128 imag = _mm_add_ps(_mm_mul_ps(diffImag, cosOmegaT), _mm_mul_ps(diffReal, sinOmegaT));
+		const __m128 negReal = _mm_sub_ps(zero, real);
+		const __m128 negImag = _mm_sub_ps(zero, imag);
+
+		const __m128 velocityScale = _mm_mul_ps(omega, timeScale4);
+		const __m128 negRateReal = _mm_mul_ps(velocityScale, _mm_add_ps(_mm_mul_ps(sumReal, sinOmegaT), _mm_mul_ps(sumImag, cosOmegaT)));
+		const __m128 rateImag = _mm_mul_ps(velocityScale, _mm_sub_ps(_mm_mul_ps(diffReal, cosOmegaT), _mm_mul_ps(diffImag, sinOmegaT)));
+
+		const __m128 dirX = _mm_load_ps(m_pWaveDirX + index);
+		const __m128 dirZ = _mm_load_ps(m_pWaveDirZ + index);
+		const __m128 waveNumberX = _mm_load_ps(m_pWaveNumberX + index);
+		const __m128 waveNumberZ = _mm_load_ps(m_pWaveNumberZ + index);
+
+		float* pDest = pSpectrum + stride*index;
+
+		SimdUtil::storePairs4(pDest + 2*FIELD_HEIGHT, stride, real, imag);
+		SimdUtil::storePairs4(pDest + 2*FIELD_DISPLACEMENT_X, stride, _mm_mul_ps(dirX, imag), _mm_mul_ps(dirX, negReal));
+		SimdUtil::storePairs4(pDest + 2*FIELD_DISPLACEMENT_Z, stride, _mm_mul_ps(dirZ, imag), _mm_mul_ps(dirZ, negReal));
+		SimdUtil::storePairs4(pDest + 2*FIELD_SLOPE_X, stride, _mm_mul_ps(waveNumberX, negImag), _mm_mul_ps(waveNumberX, real));
+		SimdUtil::storePairs4(pDest + 2*FIELD_SLOPE_Z, stride, _mm_mul_ps(waveNumberZ, negImag), _mm_mul_ps(waveNumberZ, real));
+		SimdUtil::storePairs4(pDest + 2*FIELD_VELOCITY_X, stride, _mm_mul_ps(dirX, rateImag), _mm_mul_ps(dirX, negRateReal));
+		SimdUtil::storePairs4(pDest + 2*FIELD_VELOCITY_Z, stride, _mm_mul_ps(dirZ, rateImag), _mm_mul_ps(dirZ, negRateReal));
+	}
+#endif
+
+	for(; index<end; index++)
+	{
+		const float omegaT = m_pOmega[index]*scaledTime;
+		const float cosOmegaT = cos(omegaT);
+		const float sinOmegaT = sin(omegaT);
+
+		const float real = m_pH0SumReal[index]*cosOmegaT - m_pH0SumImag[index]*sinOmegaT;
+		const float imag = m_pH0DiffImag[index]*cosOmegaT + m_pH0DiffReal[index]*sinOmegaT;
+
+		const float velocityScale = m_pOmega[index]*TIME_SCALE;
+		const float rateReal = -velocityScale*(m_pH0SumReal[index]*sinOmegaT + m_pH0SumImag[index]*cosOmegaT);
+		const float rateImag = velocityScale*(m_pH0DiffReal[index]*cosOmegaT - m_pH0DiffImag[index]*sinOmegaT);
+
+		float* pDest = pSpectrum + stride*index;
+
+		pDest[2*FIELD_HEIGHT] = real;
+		pDest[2*FIELD_HEIGHT+1] = imag;
+		pDest[2*FIELD_DISPLACEMENT_X] = m_pWaveDirX[index]*imag;
+		pDest[2*FIELD_DISPLACEMENT_X+1] = -m_pWaveDirX[index]*real;
+		pDest[2*FIELD_DISPLACEMENT_Z] = m_pWaveDirZ[index]*imag;
+		pDest[2*FIELD_DISPLACEMENT_Z+1] = -m_pWaveDirZ[index]*real;
+		pDest[2*FIELD_SLOPE_X] = -m_pWaveNumberX[index]*imag;
+		pDest[2*FIELD_SLOPE_X+1] = m_pWaveNumberX[index]*real;
+		pDest[2*FIELD_SLOPE_Z] = -m_pWaveNumberZ[index]*imag;
+		pDest[2*FIELD_SLOPE_Z+1] = m_pWaveNumberZ[index]*real;
+		pDest[2*FIELD_VELOCITY_X] = m_pWaveDirX[index]*rateImag;
+		pDest[2*FIELD_VELOCITY_X+1] = -m_pWaveDirX[index]*rateReal;
+		pDest[2*FIELD_VELOCITY_Z] = m_pWaveDirZ[index]*rateImag;
+		pDest[2*FIELD_VELOCITY_Z+1] = -m_pWaveDirZ[index]*rateReal;
+	}
+}
+
+/**
+ * Transforms the spectra at the given time with FFTW and with a naive inverse DFT over the full
+ * (Hermitian extended) spectra and compares all fields. Grids above 16 cells are only
+ * compared on a sparse lattice of 16x16 points, the naive DFT costs gridSize^2 per point and field
+ *
+ * @param  time  simulation time in seconds.
+ * @return largest absolute difference relative to the largest value of the same field.
+ */
+float FFTSimulation::computeTransformError(float time)
+{
+	const int halfSize = getHalfGridSize();
+	const int numValues = 2*NUM_FIELDS*m_gridSize*halfSize;
+
+	fillSpectrum(time);
+
+	// c2r transforms overwrite their input
+	const float* pSpectrum = m_pSpectrum;
+	std::vector<float> spectrum(pSpectrum, pSpectrum + numValues);
+
+	executeTransform();
+
+	std::vector<double> cosTable(m_gridSize), sinTable(m_gridSize);
+	for(int i=0; i<m_gridSize; i++) {
+		cosTable[i] = cos(2.0*GS_PI*i/m_gridSize);
+		sinTable[i] = sin(2.0*GS_PI*i/m_gridSize);
+	}
 
+	const int stride = std::max(m_gridSize/16, 1);
+	float maxRelativeError = 0.0f;
+
+	for(int field=0; field<NUM_FIELDS; field++) {
+
+		double maxError = 0.0;
+		double maxValue = 0.0;
+
+		for(int x=0; x<m_gridSize; x+=stride) {
+			for(int z=0; z<m_gridSize; z+=stride) {
+
+				double value = 0.0;
+
+				for(int i=0; i<m_gridSize; i++) {
+					for(int j=0; j<m_gridSize; j++) {
+
+						double real, imag;
+						if(j < halfSize) {
+							const int index = NUM_FIELDS*(i*halfSize + j) + field;
+							real = spectrum[2*index];
+							imag = spectrum[2*index+1];
+						} else {
+							const int indexNeg = NUM_FIELDS*(((m_gridSize - i) % m_gridSize)*halfSize + m_gridSize - j) + field;
+							real = spectrum[2*indexNeg];
+							imag = -spectrum[2*indexNeg+1];
+						}
+
+						const int angle = (i*x + j*z) % m_gridSize;
+						value += real*cosTable[angle] - imag*sinTable[angle];
+					}
+				}
+
+				maxError = std::max(maxError, fabs(value - m_pFields[NUM_FIELDS*(x*m_gridSize + z) + field]));
+				maxValue = std::max(maxValue, fabs(value));
+			}
 		}
 
-		fftwf_execute(m_FftPlan);
+		maxRelativeError = std::max(maxRelativeError, (float)(maxError/std::max(maxValue, 1.0e-6)));
+	}
+
+	return maxRelativeError;
+}
+
+/**
+ * Fills the displacement texture of the distant water
+ *
+ * @param  pDisplacements  receives x displacement (scaled by the choppiness), height and z displacement per cell.
+ */
+void FFTSimulation::fillDisplacements(float* pDisplacements)
+{
+	fillDisplacements(m_pFields, pDisplacements);
+}
 
+// displacement texture of a field array in the layout of getFields(), e.g. blended from two updates
+void FFTSimulation::fillDisplacements(const float* pFields, float* pDisplacements)
+{
+	const int numCells = m_gridSize*m_gridSize;
+
+	for(int index=0; index<numCells; index++) {
+		const float* pField = pFields + NUM_FIELDS*index;
+
+		pDisplacements[3*index] = m_choppiness*pField[FIELD_DISPLACEMENT_X];
+		pDisplacements[3*index+1] = pField[FIELD_HEIGHT];
+		pDisplacements[3*index+2] = m_choppiness*pField[FIELD_DISPLACEMENT_Z];
+	}
 }
 
+/**
+ * Fills the RGBA8 normal map (x, z, y in tangent space, height in alpha) from the spectral slope fields.
+ * The slopes are exact and periodic, so the map tiles without seams.
+ *
+ * @param  normals  gridSize*gridSize*4 bytes.
+ */
 void FFTSimulation::calculateAndFillNormals(unsigned char* normals)
 {
-	Vector3 n1, n2, N; // right and forward vectors for calculating normal
+	calculateAndFillNormals(m_pFields, normals);
+}
 
-	for(int i=0; i<GRIDSIZE; i++)
-		for(int j=0; j<GRIDSIZE; j++)
-		{
-			const int index = i*GRIDSIZE + j;
-
-			//m_pFftOut[index][0] += 40.0f;
-			//m_pFftOut[index][0] /= 20.0f;
-
-			if(i==0)
-				n1 = Vector3(CELL_DISTANCE, m_pFftOut[index][0]-m_pFftOut[index+GRIDSIZE][0], 0.0f );
-			else if(i == GRIDSIZE-1)
-				n1 = Vector3(CELL_DISTANCE, m_pFftOut[index-GRIDSIZE][0]-m_pFftOut[index][0], 0.0f );
-			else
-				n1 = Vector3(2.0f*CELL_DISTANCE, m_pFftOut[index-GRIDSIZE][0]-m_pFftOut[index+GRIDSIZE][0], 0.0f );
-
-			if(j==0)
-				n2 = Vector3(0.0f, m_pFftOut[index+1][0]-m_pFftOut[index][0], CELL_DISTANCE );
-			else if(j == GRIDSIZE-1)
-				n2 = Vector3(0.0f, m_pFftOut[index][0]-m_pFftOut[index-1][0], CELL_DISTANCE );
-			else 
-				n2 = Vector3(0.0f, m_pFftOut[index+1][0]-m_pFftOut[index-1][0], 2.0f*CELL_DISTANCE );
-
-			N.crossProduct(n2,n1);
-			N.normalize();
-
-			int offset = 4*index;
-
-			*(normals + offset) = ((N[0]+1)/2.0f)*255;
-			*(normals + offset+1) =((N[2]+1)/2.0f)*255; //Tangent Space 
-			*(normals + offset+2) =  ((N[1]+1)/2.0f)*255;
-			*(normals + offset+3) = m_pFftOut[index][0];
-		}
+// normal map of a field array in the layout of getFields(), e.g. blended from two updates
+void FFTSimulation::calculateAndFillNormals(const float* pFields, unsigned char* normals)
+{
+	#pragma omp parallel for num_threads(m_numThreads) if(m_numThreads > 1)
+	for(int i=0; i<m_gridSize; i++) {
+		fillNormalRow(pFields, normals, i);
+	}
+}
 
-	for(int i=0; i<GRIDSIZE; i++)
-		for(int j=0; j<GRIDSIZE; j++)
-		{
-			const int index = i*GRIDSIZE + j;
+void FFTSimulation::fillNormalRow(const float* pFields, unsigned char* normals, int row)
+{
+	// N = (slopeX*scale, 1, -slopeZ*scale)/length
+	const float slopeScale = NORMAL_SLOPE_SCALE;
+
+	const float* GS_RESTRICT pRowFields = pFields + NUM_FIELDS*row*m_gridSize;
+	unsigned char* GS_RESTRICT pNormals = normals + 4*row*m_gridSize;
+	int j = 0;
+
+#if defined(GS_SSE2)
+	const __m128 scale4 = _mm_set1_ps(slopeScale);
+	const __m128 negScale4 = _mm_set1_ps(-slopeScale);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 three = _mm_set1_ps(3.0f);
+	const __m128 byteScale = _mm_set1_ps(127.5f);
+
+	for(; j+4 <= m_gridSize; j += 4)
+	{
+		const float* p = pRowFields + NUM_FIELDS*j;
+
+		const __m128 x = _mm_mul_ps(_mm_setr_ps(p[FIELD_SLOPE_X], p[NUM_FIELDS + FIELD_SLOPE_X], p[2*NUM_FIELDS + FIELD_SLOPE_X], p[3*NUM_FIELDS + FIELD_SLOPE_X]), scale4);
+		const __m128 z = _mm_mul_ps(_mm_setr_ps(p[FIELD_SLOPE_Z], p[NUM_FIELDS + FIELD_SLOPE_Z], p[2*NUM_FIELDS + FIELD_SLOPE_Z], p[3*NUM_FIELDS + FIELD_SLOPE_Z]), negScale4);
+		const __m128 height = _mm_setr_ps(p[FIELD_HEIGHT], p[NUM_FIELDS + FIELD_HEIGHT], p[2*NUM_FIELDS + FIELD_HEIGHT], p[3*NUM_FIELDS + FIELD_HEIGHT]);
+
+		// 1/length with one Newton step on the estimate, the squared length is at least 1
+		const __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z)), one);
+		__m128 invLength = _mm_rsqrt_ps(lengthSquared);
+		invLength = _mm_mul_ps(_mm_mul_ps(half, invLength), _mm_sub_ps(three, _mm_mul_ps(_mm_mul_ps(lengthSquared, invLength), invLength)));
+
+		// (n+1)/2*255, truncated like the scalar path
+		const __m128 offset = _mm_mul_ps(invLength, byteScale);
+		const __m128i r = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, offset), byteScale));
+		const __m128i g = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(z, offset), byteScale));
+		const __m128i b = _mm_cvttps_epi32(_mm_add_ps(offset, byteScale));
+		const __m128i a = _mm_cvttps_epi32(height);
+
+		_mm_storeu_si128((__m128i*)(pNormals + 4*j), SimdUtil::packRGBA8x4(r, g, b, a));
+	}
+#endif
+
+	for(; j<m_gridSize; j++)
+	{
+		const float* p = pRowFields + NUM_FIELDS*j;
+
+		const float x = p[FIELD_SLOPE_X]*slopeScale;
+		const float z = -p[FIELD_SLOPE_Z]*slopeScale;
+		const float invLength = 1.0f/sqrt(x*x + z*z + 1.0f);
+
+		pNormals[4*j] = (unsigned char)((x*invLength + 1.0f)*127.5f);
+		pNormals[4*j+1] = (unsigned char)((z*invLength + 1.0f)*127.5f); //Tangent Space
+		pNormals[4*j+2] = (unsigned char)((invLength + 1.0f)*127.5f);
+		pNormals[4*j+3] = (unsigned char)std::min(std::max(p[FIELD_HEIGHT], 0.0f), 255.0f);
+	}
+}
+
+/**
+ * Periodic bilinear height, displacement, slope and orbital velocity at a batch of points, e.g. for the buoyancy
+ * of bodies outside the SWE grid or its inflow boundary. x runs along the rows of the fields, z along the columns.
+ *
+ * @param  pX, pZ  count positions in patch units, the patch repeats in both directions.
+ * @param  samples  output arrays.
+ * @param  accumulate  adds to the outputs instead of overwriting them, to sum up cascades.
+ */
+void FFTSimulation::sampleSurface(const float* pX, const float* pZ, unsigned int count, const SurfaceSamples& samples, bool accumulate)
+{
+	sampleFields(m_pFields, m_gridSize, m_patchSize, m_choppiness, pX, pZ, count, samples, accumulate);
+}
 
-			if(i==0)
-			{
-				const int indexOpposite = (GRIDSIZE-1)*GRIDSIZE + j;
+/**
+ * sampleSurface on any interleaved field array with NUM_FIELDS values per cell, e.g. a decoded animation cache frame
+ */
+void FFTSimulation::sampleFields(const float* pFields, unsigned short gridSize, float patchSize, float choppiness,
+	const float* pX, const float* pZ, unsigned int count, const SurfaceSamples& samples, bool accumulate)
+{
+	const float cellsPerUnit = gridSize/patchSize;
+	const float invGridSize = 1.0f/gridSize;
+
+	float* const pOutputs[NUM_FIELDS] = {samples.pHeights, samples.pDisplacementsX, samples.pDisplacementsZ, samples.pSlopesX, samples.pSlopesZ,
+		samples.pVelocitiesX, samples.pVelocitiesZ};
+	const float fieldScales[NUM_FIELDS] = {1.0f, choppiness, choppiness, 1.0f, 1.0f, choppiness, choppiness};
+
+	unsigned int i = 0;
+
+#if defined(GS_SSE2)
+	const __m128 scale4 = _mm_set1_ps(cellsPerUnit);
+	const __m128 gridSize4 = _mm_set1_ps(float(gridSize));
+	const __m128 invGridSize4 = _mm_set1_ps(invGridSize);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128i gridSizeInt4 = _mm_set1_epi32(gridSize);
+	const __m128i maxCell4 = _mm_set1_epi32(gridSize-1);
+
+	for(; i+4 <= count; i += 4)
+	{
+		// cell coordinates wrapped into [0, gridSize)
+		__m128 u = _mm_mul_ps(_mm_loadu_ps(pX + i), scale4);
+		__m128 v = _mm_mul_ps(_mm_loadu_ps(pZ + i), scale4);
+		u = _mm_sub_ps(u, _mm_mul_ps(SimdUtil::floor4(_mm_mul_ps(u, invGridSize4)), gridSize4));
+		v = _mm_sub_ps(v, _mm_mul_ps(SimdUtil::floor4(_mm_mul_ps(v, invGridSize4)), gridSize4));
+
+		__m128i row4 = _mm_cvttps_epi32(u);
+		__m128i column4 = _mm_cvttps_epi32(v);
+		const __m128 weightU = _mm_sub_ps(u, _mm_cvtepi32_ps(row4));
+		const __m128 weightV = _mm_sub_ps(v, _mm_cvtepi32_ps(column4));
+
+		// rounding of tiny negative positions can give gridSize itself
+		row4 = _mm_sub_epi32(row4, _mm_and_si128(_mm_cmpgt_epi32(row4, maxCell4), gridSizeInt4));
+		column4 = _mm_sub_epi32(column4, _mm_and_si128(_mm_cmpgt_epi32(column4, maxCell4), gridSizeInt4));
+
+		int rows[4], columns[4];
+		_mm_storeu_si128((__m128i*)rows, row4);
+		_mm_storeu_si128((__m128i*)columns, column4);
+
+		// the fields are interleaved per cell, gather the four corners of each point into one register per field
+		float corners[4][NUM_FIELDS][4];
+
+		for(int p=0; p<4; p++) {
+			const int row0 = rows[p]*gridSize;
+			const int row1 = ((rows[p] + 1 < gridSize) ? rows[p] + 1 : 0)*gridSize;
+			const int column0 = columns[p];
+			const int column1 = (column0 + 1 < gridSize) ? column0 + 1 : 0;
+
+			const float* pCorner00 = pFields + NUM_FIELDS*(row0 + column0);
+			const float* pCorner01 = pFields + NUM_FIELDS*(row0 + column1);
+			const float* pCorner10 = pFields + NUM_FIELDS*(row1 + column0);
+			const float* pCorner11 = pFields + NUM_FIELDS*(row1 + column1);
+
+			for(int field=0; field<NUM_FIELDS; field++) {
+				corners[0][field][p] = pCorner00[field];
+				corners[1][field][p] = pCorner01[field];
+				corners[2][field][p] = pCorner10[field];
+				corners[3][field][p] = pCorner11[field];
+			}
+		}
 
-				const int offset = 4*index;
-				const int offsetOpposite = 4*indexOpposite;
+		const __m128 weight00 = _mm_mul_ps(_mm_sub_ps(one, weightU), _mm_sub_ps(one, weightV));
+		const __m128 weight01 = _mm_mul_ps(_mm_sub_ps(one, weightU), weightV);
+		const __m128 weight10 = _mm_mul_ps(weightU, _mm_sub_ps(one, weightV));
+		const __m128 weight11 = _mm_mul_ps(weightU, weightV);
 
-				*(normals + offset) = *(normals + offset)*(2.0f/3.0f) + *(normals + offsetOpposite)*(1.0f/3.0f);
-				*(normals + offset+1) = *(normals + offset+1)*(2.0f/3.0f) + *(normals + offsetOpposite+1)*(1.0f/3.0f);
-				*(normals + offset+2) = *(normals + offset+2)*(2.0f/3.0f) + *(normals + offsetOpposite+2)*(1.0f/3.0f);
+		for(int field=0; field<NUM_FIELDS; field++) {
+			if(pOutputs[field] == NULL) {
+				continue;
+			}
+
+			__m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corners[0][field]), weight00), _mm_mul_ps(_mm_loadu_ps(corners[1][field]), weight01)),
+				_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(corners[2][field]), weight10), _mm_mul_ps(_mm_loadu_ps(corners[3][field]), weight11)));
+			value = _mm_mul_ps(value, _mm_set1_ps(fieldScales[field]));
 
-				*(normals + offsetOpposite) = *(normals + offset);
-				*(normals + offsetOpposite+1) = *(normals + offset+1);
-				*(normals + offsetOpposite+2) = *(normals + offset+2);
+			if(accumulate) {
+				value = _mm_add_ps(value, _mm_loadu_ps(pOutputs[field] + i));
 			}
 
-			if(j==0)
-			{
-				const int indexOpposite = i*GRIDSIZE + GRIDSIZE-1;
-				const int indexNeighbour1 = index + 1;
-				const int indexNeighbour2 = indexOpposite-1;
+			_mm_storeu_ps(pOutputs[field] + i, value);
+		}
+	}
+#endif
+
+	for(; i<count; i++)
+	{
+		float u = pX[i]*cellsPerUnit;
+		float v = pZ[i]*cellsPerUnit;
+		u -= floor(u*invGridSize)*gridSize;
+		v -= floor(v*invGridSize)*gridSize;
+
+		int row = (int)u;
+		int column = (int)v;
+		const float weightU = u - row;
+		const float weightV = v - column;
+
+		if(row >= gridSize) {
+			row -= gridSize;
+		}
+		if(column >= gridSize) {
+			column -= gridSize;
+		}
 
-				const int offset = 4*index;
-				const int offsetOpposite = 4*indexOpposite;
-				const int offsetNeighbour1 = 4*indexNeighbour1;
-				const int offsetNeighbour2 = 4*indexNeighbour2;
+		const int row0 = row*gridSize;
+		const int row1 = ((row + 1 < gridSize) ? row + 1 : 0)*gridSize;
+		const int column1 = (column + 1 < gridSize) ? column + 1 : 0;
 
-				*(normals + offset) = *(normals + offsetNeighbour1)*0.5f + *(normals + offsetNeighbour2)*0.5f;
-				*(normals + offset+1) = *(normals + offsetNeighbour1+1)*0.5f + *(normals + offsetNeighbour2+1)*0.5f;
-				*(normals + offset+2) = *(normals + offsetNeighbour1+2)*0.5f + *(normals + offsetNeighbour2+2)*0.5f;
+		const float* pCorner00 = pFields + NUM_FIELDS*(row0 + column);
+		const float* pCorner01 = pFields + NUM_FIELDS*(row0 + column1);
+		const float* pCorner10 = pFields + NUM_FIELDS*(row1 + column);
+		const float* pCorner11 = pFields + NUM_FIELDS*(row1 + column1);
 
-				*(normals + offsetOpposite) = *(normals + offset);
-				*(normals + offsetOpposite+1) = *(normals + offset+1);
-				*(normals + offsetOpposite+2) = *(normals + offset+2);
+		for(int field=0; field<NUM_FIELDS; field++) {
+			if(pOutputs[field] == NULL) {
+				continue;
 			}
+
+			const float value = ((1.0f - weightU)*((1.0f - weightV)*pCorner00[field] + weightV*pCorner01[field])
+				+ weightU*((1.0f - weightV)*pCorner10[field] + weightV*pCorner11[field]))*fieldScales[field];
+
+			pOutputs[field][i] = accumulate ? pOutputs[field][i] + value : value;
 		}
+	}
 }
@@ -7,23 +7,228 @@
  * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
  */
 
+#pragma once
+
 #include <stdlib.h>
+#if defined(GS_USE_FFTW)
 #include "fftw/fftw3.h"
+#endif
 #include "PreCompiled.h"
 #include "glut/glut.h"
 #include "base/math/Vector3.h"
+#include "base/math/RandomGenerator.h"
+#include "base/math/SimdUtil.h"
+#include "PhillipsSpectrum.h"
+#include "BuiltinFFT.h"
+#include "base/util/DebugUtil.h"
+#include <string>
+#include <vector>
 
 class FFTSimulation
 {
 public:
-	FFTSimulation();
+	FFTSimulation(unsigned short gridSize = GRIDSIZE, float patchSize = PATCH_SIZE);
 	~FFTSimulation();
 
 	static const unsigned short GRIDSIZE = 64;
+	static const float PATCH_SIZE; // side length of the periodic patch of a single simulation
+
+	static const float CHOPPINESS;
+	static const float NORMAL_SLOPE_SCALE; // the spectra give real slopes, larger values exaggerate the shading
+
+	// output fields, transformed together in one batch and stored interleaved per cell
+	enum Field
+	{
+		FIELD_HEIGHT,
+		FIELD_DISPLACEMENT_X, // horizontal choppy displacement before scaling with the choppiness
+		FIELD_DISPLACEMENT_Z,
+		FIELD_SLOPE_X,        // dh/dx
+		FIELD_SLOPE_Z,        // dh/dz
+		FIELD_VELOCITY_X,     // horizontal orbital velocity per second, d/dt of the displacement before the choppiness
+		FIELD_VELOCITY_Z,
+		NUM_FIELDS
+	};
+
+	enum FFTEngine
+	{
+		FFT_ENGINE_FFTW,    // FFTW plan, only with GS_USE_FFTW
+		FFT_ENGINE_BUILTIN  // BuiltinFFT, power of two sizes up to BuiltinFFT::MAX_GRIDSIZE
+	};
+
+	enum PlannerMode
+	{
+		PLANNER_ESTIMATE, // heuristic plan, no startup cost
+		PLANNER_MEASURE,  // timed plan, cached as FFTW wisdom
+		PLANNER_PATIENT   // wider timed search, cached as FFTW wisdom
+	};
+	static const float MAX_TRANSFORM_ERROR; // relative error of the FFT against the naive DFT accepted by BenchmarkDriver::testTransforms
 
 	void initFFTSimulation();
-	void update();
+	void setWind(float windSpeed, float directionX, float directionZ); // wind of the default Phillips spectrum, call before initFFTSimulation
+	void setWaveSpectrum(IWaveSpectrum* pWaveSpectrum); // NULL selects the default Phillips spectrum, call initFFTSimulation again to switch sea states
+	void setBand(float minWaveNumber, float maxWaveNumber); // call before initFFTSimulation
+	void setRepeatPeriod(float period); // call before initFFTSimulation, 0 keeps the exact dispersion
+
+	// seeds the spectrum, defaults to rand() so srand() still controls it
+	inline void setRandomSeed(unsigned int seed)
+	{
+		m_seed = seed;
+	}
+
+	inline unsigned int getRandomSeed()
+	{
+		return m_seed;
+	}
+
+	inline std::string getWaveSpectrumKey()
+	{
+		return m_pWaveSpectrum->getKey();
+	}
+
+	static unsigned int hashKey(const std::string& key);
+
+	// h0(k) tables of simulations initialised afterwards are loaded from and saved to h0Cache_*.dat
+	inline static void setH0CacheEnabled(bool enabled)
+	{
+		m_h0CacheEnabled = enabled;
+	}
+
+	static void setFFTEngine(FFTEngine engine);
+
+	// transform of simulations initialised afterwards, defaults to FFTW when it is compiled in
+	inline static FFTEngine getFFTEngine()
+	{
+		return m_fftEngine;
+	}
+
+	// planner effort of FFTW simulations initialised afterwards, FFTW wisdom is process wide as well
+	inline static void setPlannerMode(PlannerMode plannerMode)
+	{
+		m_plannerMode = plannerMode;
+	}
+
+	inline static PlannerMode getPlannerMode()
+	{
+		return m_plannerMode;
+	}
+
+	static void setNumThreads(int numThreads);
+
+	// threads of the FFTW plans created afterwards and of the spectrum and normal loops
+	inline static int getNumThreads()
+	{
+		return m_numThreads;
+	}
+
+	// outputs of sampleSurface, one value per point in each array, NULL skips an output
+	struct SurfaceSamples
+	{
+		float* pHeights;
+		float* pDisplacementsX; // scaled by the choppiness
+		float* pDisplacementsZ;
+		float* pSlopesX;
+		float* pSlopesZ;
+		float* pVelocitiesX; // scaled by the choppiness like the displacements
+		float* pVelocitiesZ;
+	};
+
+	void update(float time);
+	unsigned int getNumUpdateSteps();
+	void runUpdateSteps(float time, unsigned int begin, unsigned int end);
 	void calculateAndFillNormals(unsigned char* normals);
+	void calculateAndFillNormals(const float* pFields, unsigned char* normals);
+	void sampleSurface(const float* pX, const float* pZ, unsigned int count, const SurfaceSamples& samples, bool accumulate = false);
+	static void sampleFields(const float* pFields, unsigned short gridSize, float patchSize, float choppiness,
+		const float* pX, const float* pZ, unsigned int count, const SurfaceSamples& samples, bool accumulate);
+	float computeTransformError(float time);
+
+	inline unsigned short getGridSize()
+	{
+		return m_gridSize;
+	}
+
+	// number of complex coefficients in the last dimension of the Hermitian half spectrum
+	inline unsigned short getHalfGridSize()
+	{
+		return m_gridSize/2 + 1;
+	}
+
+	// all fields of a cell next to each other, NUM_FIELDS*getGridSize()*getGridSize() values in row major order
+	inline const float* getFields()
+	{
+		return m_pFields;
+	}
+
+	inline float getHeight(int index)
+	{
+		return m_pFields[NUM_FIELDS*index + FIELD_HEIGHT];
+	}
+
+	inline float getDisplacementX(int index)
+	{
+		return m_choppiness*m_pFields[NUM_FIELDS*index + FIELD_DISPLACEMENT_X];
+	}
+
+	inline float getDisplacementZ(int index)
+	{
+		return m_choppiness*m_pFields[NUM_FIELDS*index + FIELD_DISPLACEMENT_Z];
+	}
+
+	inline float getSlopeX(int index)
+	{
+		return m_pFields[NUM_FIELDS*index + FIELD_SLOPE_X];
+	}
+
+	inline float getSlopeZ(int index)
+	{
+		return m_pFields[NUM_FIELDS*index + FIELD_SLOPE_Z];
+	}
+
+	inline float getVelocityX(int index)
+	{
+		return m_choppiness*m_pFields[NUM_FIELDS*index + FIELD_VELOCITY_X];
+	}
+
+	inline float getVelocityZ(int index)
+	{
+		return m_choppiness*m_pFields[NUM_FIELDS*index + FIELD_VELOCITY_Z];
+	}
+
+	// scale of the horizontal displacement, 0 gives plain sine shaped waves
+	inline void setChoppiness(float choppiness)
+	{
+		m_choppiness = choppiness;
+	}
+
+	inline float getChoppiness()
+	{
+		return m_choppiness;
+	}
+
+	// side length of the periodic patch, displacements and slopes are in the same units
+	inline float getPatchSize()
+	{
+		return m_patchSize;
+	}
+
+	inline float getMinWaveNumber()
+	{
+		return m_minWaveNumber;
+	}
+
+	inline float getMaxWaveNumber()
+	{
+		return m_maxWaveNumber;
+	}
+
+	// seconds after which the animation repeats exactly, 0 if it never does
+	inline float getRepeatPeriod()
+	{
+		return m_repeatPeriod;
+	}
+
+	void fillDisplacements(float* pDisplacements);
+	void fillDisplacements(const float* pFields, float* pDisplacements);
 
 private:
 
@@ -32,24 +237,95 @@ private:
 		float x,y;
 	};
 
-	static const unsigned short L = 256;
-	static const float WINDSPEED, A, WAVELENGTH, GRAVITY, PI, CELL_DISTANCE;
+	static const float PI, TIME_SCALE;
+	static const unsigned int H0_CACHE_MAGIC;
+	static const unsigned int H0_CACHE_VERSION = 2;
+	static const int SPECTRUM_BLOCK_SIZE = 1024; // bins per parallel work item, multiple of 4 for the SIMD kernel
+	static PlannerMode m_plannerMode;
+	static FFTEngine m_fftEngine;
+	static int m_numThreads;
+	static bool m_fftwThreadsInitialized;
+	static bool m_h0CacheEnabled;
 
-	float m_h0Real[GRIDSIZE*GRIDSIZE], m_h0Complex[GRIDSIZE*GRIDSIZE];
-	Vec2 m_amplitudePos[GRIDSIZE*GRIDSIZE], m_amplitudeNeg[GRIDSIZE*GRIDSIZE];
-	Vec2 m_windDirection,m_waveDirection;
+	// h0 cache file: header, then gridSize*gridSize h0(k) in the order of the full spectrum
+	struct H0CacheHeader
+	{
+		unsigned int magic, version;
+		unsigned int gridSize;
+		unsigned int seed;
+		unsigned int keyHash;
+		float patchSize;
+		float minWaveNumber, maxWaveNumber;
+	};
+
+	unsigned short m_gridSize;
+	float m_patchSize;
+	float m_minWaveNumber, m_maxWaveNumber; // |k| band kept in the spectrum, cascades split the spectrum between them
+	float m_repeatPeriod;
 
-	fftwf_complex *m_pFftIn;
-	fftwf_complex *m_pFftOut;
+	// per bin of the half spectrum (gridSize*(gridSize/2+1) entries, 16 byte aligned): h0(k) + conj(h0(-k))
+	// and h0(k) - conj(h0(-k)) as separate real and imaginary arrays, and the dispersion omega(|k|) of the spectrum
+	float* m_pH0SumReal;
+	float* m_pH0SumImag;
+	float* m_pH0DiffReal;
+	float* m_pH0DiffImag;
+	float* m_pOmega;
+
+	// k/|k| for the displacement spectra and k for the slope spectra, 0 at k = 0 and in the Nyquist row and column
+	float* m_pWaveDirX;
+	float* m_pWaveDirZ;
+	float* m_pWaveNumberX;
+	float* m_pWaveNumberZ;
+	float m_choppiness;
+	PhillipsSpectrum m_defaultWaveSpectrum;
+	IWaveSpectrum* m_pWaveSpectrum;
+	unsigned int m_seed;
+	RandomGenerator m_random;
+
+	float *m_pSpectrum; // NUM_FIELDS interleaved half spectra, (real, imag) per value
+	float *m_pFields;
+	BuiltinFFT m_builtinFFT;
+#if defined(GS_USE_FFTW)
 	fftwf_plan m_FftPlan;
+	fftwf_plan m_FieldPlans[NUM_FIELDS]; // one field each, the steps of runUpdateSteps
+
+	fftwf_plan planTransform(unsigned int flags);
+	fftwf_plan planFieldTransform(int field, unsigned int flags);
+	std::string getWisdomFilename();
+#endif
 
-	Vec2 calculateH0(short mul);
+	void createPlan();
+	void executeTransform();
+
+	inline bool hasTransform()
+	{
+#if defined(GS_USE_FFTW)
+		return m_builtinFFT.isInitialized() || (m_FftPlan != NULL);
+#else
+		return m_builtinFFT.isInitialized();
+#endif
+	}
+	int getNumSpectrumBlocks();
+	void fillSpectrum(float time);
+	void fillSpectrum(float time, int beginBlock, int endBlock);
+	void fillSpectrumBlock(float scaledTime, int begin, int end);
+	void fillNormalRow(const float* pFields, unsigned char* normals, int row);
+	void generateH0(std::vector<Vec2>& h0);
+	bool loadH0(std::vector<Vec2>& h0);
+	void saveH0(const std::vector<Vec2>& h0);
+	std::string getH0Filename();
+	H0CacheHeader getH0CacheHeader();
 	Vec2 gaussian(float mean, float stdDeviation);
-	float calculatePhillipsSpectrum(short mul);
 
 	inline float getRandom(float min=0.0f, float max=1.0f)
 	{
-		return min+( (rand()/(RAND_MAX+1.0f)) *(max-min) );  
+		return m_random.getFloat(min, max);
+	}
+
+	// signed wave number of FFT index i, indices above gridSize/2 are the negative frequencies
+	inline int getWaveNumber(int i)
+	{
+		return (i <= m_gridSize/2) ? i : i - m_gridSize;
 	}
 	
 };
\ No newline at end of file
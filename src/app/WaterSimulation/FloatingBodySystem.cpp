@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "FloatingBodySystem.h"
+
+#include "base/util/DebugUtil.h"
+
+const float FloatingBodySystem::WATER_DENSITY = 1.0f/1000.0f;
+const float FloatingBodySystem::SUBSTEP = 0.01f;
+const float FloatingBodySystem::LINEAR_DRAG = 1.0f; // 1/s when fully submerged
+const float FloatingBodySystem::ANGULAR_DRAG = 2.0f; // 1/s when fully submerged
+const float FloatingBodySystem::SLEEP_SPEED = 0.05f;
+const float FloatingBodySystem::SLEEP_ANGULAR_SPEED = 0.05f;
+const float FloatingBodySystem::SLEEP_TIME = 1.0f;
+const float FloatingBodySystem::WAKE_HEIGHT = 0.02f;
+const int FloatingBodySystem::MAX_SUBSTEPS = 10;
+
+FloatingBodySystem::FloatingBodySystem(WaterSimulation& waterSimulation)
+{
+	m_pWaterSimulation = &waterSimulation;
+	m_numThreads = 1;
+	m_timeAccumulator = 0.0f;
+}
+
+FloatingBodySystem::~FloatingBodySystem()
+{
+	for(unsigned int i=0; i<m_shapes.size(); i++) {
+		delete m_shapes[i].pHull;
+		delete m_shapes[i].pMesh;
+	}
+}
+
+/**
+ * Adds a closed hull shape bodies can use
+ *
+ * @param  vertices  body space positions.
+ * @param  triangleIndices  three vertex indices per triangle, counter clockwise seen from outside.
+ * @return  the shape index for addBody().
+ */
+int FloatingBodySystem::addShape(const std::vector<Vector3>& vertices, const std::vector<int>& triangleIndices)
+{
+	Shape shape;
+	shape.pHull = new HullTriangleCache();
+	shape.pMesh = NULL;
+
+	float top = 0.0f;
+
+	for(unsigned int i=0; i+2<triangleIndices.size(); i+=3) {
+		shape.pHull->addTriangle(vertices[triangleIndices[i]], vertices[triangleIndices[i+1]], vertices[triangleIndices[i+2]]);
+
+		for(int v=0; v<3; v++) {
+			top = std::max(top, vertices[triangleIndices[i+v]][1]);
+		}
+	}
+
+	// volume of the whole hull is the submerged volume below water just above it
+	std::vector<float> waterHeights(shape.pHull->getPaddedSize(), top + 1.0f);
+	HullTriangleCache::Buoyancy buoyancy;
+	buoyancy.volume = 0.0f;
+
+	if(!waterHeights.empty()) {
+		shape.pHull->computeBuoyancy(&waterHeights[0], Vector3(0.0f, 1.0f, 0.0f), 0.0f, buoyancy, NULL);
+	}
+
+	shape.volume = buoyancy.volume;
+	GS_ASSERT_WITH_MSG(shape.volume > 0.0f, "floating body shape is not closed or turned inside out");
+
+	m_shapes.push_back(shape);
+
+	return (int)m_shapes.size() - 1;
+}
+
+/**
+ * Adds a box centred at the body origin
+ *
+ * @param  halfExtents  half the edge lengths.
+ * @param  subdivisions  quads per face edge, more triangles follow waves shorter than the box more closely.
+ */
+int FloatingBodySystem::addBoxShape(const Vector3& halfExtents, int subdivisions)
+{
+	subdivisions = std::max(subdivisions, 1);
+
+	std::vector<Vector3> vertices;
+	std::vector<int> triangleIndices;
+
+	for(int axis=0; axis<3; axis++) {
+		for(int side=-1; side<=1; side+=2) {
+
+			// u and v span the face so that u x v points along side*axis
+			const int uAxis = (axis + (side > 0 ? 1 : 2))%3;
+			const int vAxis = (axis + (side > 0 ? 2 : 1))%3;
+			const int firstVertex = (int)vertices.size();
+
+			for(int j=0; j<=subdivisions; j++) {
+				for(int i=0; i<=subdivisions; i++) {
+					Vector3 vertex;
+					vertex[axis] = side*halfExtents[axis];
+					vertex[uAxis] = (2.0f*i/subdivisions - 1.0f)*halfExtents[uAxis];
+					vertex[vAxis] = (2.0f*j/subdivisions - 1.0f)*halfExtents[vAxis];
+					vertices.push_back(vertex);
+				}
+			}
+
+			for(int j=0; j<subdivisions; j++) {
+				for(int i=0; i<subdivisions; i++) {
+					const int v00 = firstVertex + i + j*(subdivisions + 1);
+					const int v10 = v00 + 1;
+					const int v01 = v00 + subdivisions + 1;
+					const int v11 = v01 + 1;
+
+					triangleIndices.push_back(v00);
+					triangleIndices.push_back(v10);
+					triangleIndices.push_back(v11);
+					triangleIndices.push_back(v00);
+					triangleIndices.push_back(v11);
+					triangleIndices.push_back(v01);
+				}
+			}
+		}
+	}
+
+	return addShape(vertices, triangleIndices);
+}
+
+/**
+ * Adds a body at rest
+ *
+ * @param  shape  from addShape() or addBoxShape().
+ * @param  relativeDensity  density relative to the water, below 1 floats.
+ * @param  position  world position of the body origin.
+ * @return  the body index.
+ */
+int FloatingBodySystem::addBody(int shape, float relativeDensity, const Vector3& position, const Quaternion& orientation)
+{
+	GS_ASSERT((shape >= 0) && (shape < (int)m_shapes.size()));
+
+	Body body;
+	body.shape = shape;
+	body.firstTriangle = 0;
+	body.sleepTime = 0.0f;
+	body.referenceHeight = 0.0f;
+	body.asleep = false;
+
+	RigidBodyIntegrator::computeMassProperties(*m_shapes[shape].pHull, relativeDensity*WATER_DENSITY*m_shapes[shape].volume, body.massProperties);
+	RigidBodyIntegrator::initializeState(body.state, position, orientation);
+
+	m_bodies.push_back(body);
+
+	return (int)m_bodies.size() - 1;
+}
+
+void FloatingBodySystem::clearBodies()
+{
+	m_bodies.clear();
+	m_awakeBodies.clear();
+	m_timeAccumulator = 0.0f;
+}
+
+// advances all bodies by the simulation time step in fixed substeps
+void FloatingBodySystem::update()
+{
+	if(m_bodies.empty()) {
+		return;
+	}
+
+	wakeBodies();
+
+	// triangle ranges of the awake bodies, padded to whole SIMD groups
+	m_awakeBodies.clear();
+	int numTriangles = 0;
+
+	for(unsigned int i=0; i<m_bodies.size(); i++) {
+		if(!m_bodies[i].asleep) {
+			m_bodies[i].firstTriangle = numTriangles;
+			numTriangles += m_shapes[m_bodies[i].shape].pHull->getPaddedSize();
+			m_awakeBodies.push_back(i);
+		}
+	}
+
+	m_centroidsX.resize(numTriangles);
+	m_centroidsZ.resize(numTriangles);
+	m_waterHeights.resize(numTriangles);
+
+	m_timeAccumulator += m_pWaterSimulation->getTimeStep();
+
+	const int numSubsteps = std::min((int)(m_timeAccumulator/SUBSTEP + 0.001f), MAX_SUBSTEPS);
+	m_timeAccumulator = std::max(m_timeAccumulator - numSubsteps*SUBSTEP, 0.0f);
+
+	if(numTriangles == 0) {
+		return;
+	}
+
+	for(int i=0; i<numSubsteps; i++) {
+		step(SUBSTEP);
+	}
+}
+
+// one water sample per body at its centre of mass, sleeping bodies wake if the water there moved
+void FloatingBodySystem::wakeBodies()
+{
+	const int numBodies = (int)m_bodies.size();
+
+	m_bodyX.resize(numBodies);
+	m_bodyZ.resize(numBodies);
+	m_bodyWaterHeights.resize(numBodies);
+
+	for(int i=0; i<numBodies; i++) {
+		Vector3 centreOfMass;
+		m_bodies[i].state.transform.transformVector(m_bodies[i].massProperties.centreOfMass, centreOfMass);
+		m_bodyX[i] = centreOfMass[0];
+		m_bodyZ[i] = centreOfMass[2];
+	}
+
+	m_pWaterSimulation->getWaterHeights(&m_bodyX[0], &m_bodyZ[0], numBodies, &m_bodyWaterHeights[0]);
+
+	for(int i=0; i<numBodies; i++) {
+
+		Body& body = m_bodies[i];
+
+		if(body.asleep && (fabs(m_bodyWaterHeights[i] - body.referenceHeight) > WAKE_HEIGHT)) {
+			body.asleep = false;
+			body.sleepTime = 0.0f;
+		}
+
+		if(!body.asleep) {
+			body.referenceHeight = m_bodyWaterHeights[i];
+		}
+	}
+}
+
+void FloatingBodySystem::step(float dt)
+{
+	const int numAwakeBodies = (int)m_awakeBodies.size();
+	const int numBatches = (numAwakeBodies + BATCH_SIZE - 1)/BATCH_SIZE;
+
+	// centroids of all awake bodies, then their water heights in one batch (getWaterHeights is not thread safe)
+	#pragma omp parallel for num_threads(m_numThreads) schedule(dynamic) if((m_numThreads > 1) && (numBatches > 1))
+	for(int batch=0; batch<numBatches; batch++) {
+
+		const int end = std::min((batch + 1)*BATCH_SIZE, numAwakeBodies);
+
+		for(int i=batch*BATCH_SIZE; i<end; i++) {
+
+			const Body& body = m_bodies[m_awakeBodies[i]];
+
+			if(!body.asleep) {
+				m_shapes[body.shape].pHull->fillWorldCentroids(body.state.transform, &m_centroidsX[body.firstTriangle], &m_centroidsZ[body.firstTriangle]);
+			}
+		}
+	}
+
+	m_pWaterSimulation->getWaterHeights(&m_centroidsX[0], &m_centroidsZ[0], (unsigned int)m_centroidsX.size(), &m_waterHeights[0]);
+
+	#pragma omp parallel for num_threads(m_numThreads) schedule(dynamic) if((m_numThreads > 1) && (numBatches > 1))
+	for(int batch=0; batch<numBatches; batch++) {
+
+		const int end = std::min((batch + 1)*BATCH_SIZE, numAwakeBodies);
+
+		for(int i=batch*BATCH_SIZE; i<end; i++) {
+
+			Body& body = m_bodies[m_awakeBodies[i]];
+
+			if(!body.asleep) {
+				stepBody(body, dt);
+			}
+		}
+	}
+}
+
+void FloatingBodySystem::stepBody(Body& body, float dt)
+{
+	const Shape& shape = m_shapes[body.shape];
+	const float gravity = m_pWaterSimulation->GRAVITY;
+
+	HullTriangleCache::Buoyancy buoyancy;
+	shape.pHull->computeBuoyancy(&m_waterHeights[body.firstTriangle], RigidBodyIntegrator::getUp(body.state), body.state.translate[1], buoyancy, NULL);
+
+	RigidBodyIntegrator::applyBuoyancy(body.state, body.massProperties, buoyancy, -WATER_DENSITY*gravity, gravity, dt);
+
+	// drag grows with the submerged part
+	const float submerged = std::min(std::max(buoyancy.volume/shape.volume, 0.0f), 1.0f);
+	body.state.linearVelocity.scale(std::max(1.0f - dt*LINEAR_DRAG*submerged, 0.0f));
+	body.state.angularVelocity.scale(std::max(1.0f - dt*ANGULAR_DRAG*submerged, 0.0f));
+
+	RigidBodyIntegrator::integrate(body.state, body.massProperties, dt);
+
+	const bool slow = (body.state.linearVelocity.calcMagnitudeSquared() < SLEEP_SPEED*SLEEP_SPEED) &&
+		(body.state.angularVelocity.calcMagnitudeSquared() < SLEEP_ANGULAR_SPEED*SLEEP_ANGULAR_SPEED);
+
+	body.sleepTime = slow ? body.sleepTime + dt : 0.0f;
+
+	if(body.sleepTime >= SLEEP_TIME) {
+		body.asleep = true;
+		body.state.linearVelocity = body.state.angularVelocity = Vector3(0.0f, 0.0f, 0.0f);
+	}
+}
+
+void FloatingBodySystem::render()
+{
+	for(unsigned int s=0; s<m_shapes.size(); s++) {
+
+		m_instanceTransforms.clear();
+
+		for(unsigned int i=0; i<m_bodies.size(); i++) {
+			if(m_bodies[i].shape == (int)s) {
+				const float* pTransform = m_bodies[i].state.transform.rawConst();
+				m_instanceTransforms.insert(m_instanceTransforms.end(), pTransform, pTransform + 16);
+			}
+		}
+
+		if(m_instanceTransforms.empty()) {
+			continue;
+		}
+
+		if(m_shapes[s].pMesh == NULL) {
+			m_shapes[s].pMesh = new HullMesh();
+			m_shapes[s].pMesh->create(*m_shapes[s].pHull);
+		}
+
+		m_shapes[s].pMesh->renderInstances(&m_instanceTransforms[0], (int)m_instanceTransforms.size()/16);
+	}
+}
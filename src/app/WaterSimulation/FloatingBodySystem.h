@@ -0,0 +1,102 @@
+/** \class FloatingBodySystem
+ * Many small floating bodies (crates, buoys, debris) on the water, with the same buoyancy and dynamics as the
+ * boat. Hull shapes are shared, bodies live in one contiguous pool. Every substep transforms the triangle
+ * centroids of all awake bodies into one array in parallel batches, samples the water below them with one
+ * getWaterHeights call and then evaluates buoyancy, drag and integration in parallel batches again. Bodies
+ * that stay slow for SLEEP_TIME sleep until the water at their position moves by more than WAKE_HEIGHT.
+ * Rendering draws all bodies of a shape with one instanced call.
+ *
+ * @author  Rahul Mukhi
+ * @date 16/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "WaterSimulation.h"
+#include "HullTriangleCache.h"
+#include "RigidBodyIntegrator.h"
+#include "HullMesh.h"
+
+#include <vector>
+
+class FloatingBodySystem
+{
+public:
+	FloatingBodySystem(WaterSimulation& waterSimulation);
+	~FloatingBodySystem();
+
+	static const float WATER_DENSITY; // mass per cubic unit, as the boat
+	static const float SUBSTEP, LINEAR_DRAG, ANGULAR_DRAG;
+	static const float SLEEP_SPEED, SLEEP_ANGULAR_SPEED, SLEEP_TIME, WAKE_HEIGHT;
+	static const int MAX_SUBSTEPS;
+	static const int BATCH_SIZE = 16; // bodies per parallel work item
+
+	int addShape(const std::vector<Vector3>& vertices, const std::vector<int>& triangleIndices);
+	int addBoxShape(const Vector3& halfExtents, int subdivisions);
+	int addBody(int shape, float relativeDensity, const Vector3& position, const Quaternion& orientation);
+	void clearBodies();
+	void update();
+	void render();
+
+	inline void setNumThreads(int numThreads)
+	{
+		m_numThreads = std::max(numThreads, 1);
+	}
+
+	inline int getNumBodies()
+	{
+		return (int)m_bodies.size();
+	}
+
+	// awake bodies of the last update
+	inline int getNumAwakeBodies()
+	{
+		return (int)m_awakeBodies.size();
+	}
+
+	inline const Matrix4x4& getTransform(int body)
+	{
+		return m_bodies[body].state.transform;
+	}
+
+private:
+
+	struct Shape
+	{
+		HullTriangleCache* pHull;
+		HullMesh* pMesh; // uploaded at the first render
+		float volume;
+	};
+
+	struct Body
+	{
+		RigidBodyIntegrator::State state;
+		RigidBodyIntegrator::MassProperties massProperties;
+		int shape;
+		int firstTriangle; // into the per triangle arrays of the current substep, awake bodies only
+		float sleepTime;
+		float referenceHeight; // water height at the centre of mass while awake, compared against while asleep
+		bool asleep;
+	};
+
+	WaterSimulation* m_pWaterSimulation;
+	int m_numThreads;
+	float m_timeAccumulator;
+
+	std::vector<Shape> m_shapes;
+	std::vector<Body> m_bodies;
+	std::vector<int> m_awakeBodies;
+
+	// per triangle of all awake bodies and per body, reused every substep
+	std::vector<float> m_centroidsX, m_centroidsZ, m_waterHeights;
+	std::vector<float> m_bodyX, m_bodyZ, m_bodyWaterHeights;
+
+	// transforms of the bodies of one shape, reused every render
+	std::vector<float> m_instanceTransforms;
+
+	void wakeBodies();
+	void step(float dt);
+	void stepBody(Body& body, float dt);
+};
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "FrequencySpectrum.h"
+
+#include "base/Prerequisites.h"
+
+const float FrequencySpectrum::GRAVITY = 9.81f;
+
+FrequencySpectrum::FrequencySpectrum(float windSpeed, float depth) :
+	m_windSpeed(windSpeed),
+	m_windDirectionX(1.0f),
+	m_windDirectionZ(0.0f),
+	m_depth(depth)
+{
+}
+
+FrequencySpectrum::~FrequencySpectrum()
+{
+}
+
+void FrequencySpectrum::setWindDirection(float directionX, float directionZ)
+{
+	const float length = sqrt(directionX*directionX + directionZ*directionZ);
+
+	if(length > 0.0f) {
+		m_windDirectionX = directionX/length;
+		m_windDirectionZ = directionZ/length;
+	}
+}
+
+float FrequencySpectrum::getDensity(float waveNumberX, float waveNumberZ)
+{
+	const float waveNumber = sqrt(waveNumberX*waveNumberX + waveNumberZ*waveNumberZ);
+
+	if(waveNumber == 0.0f) {
+		return 0.0f;
+	}
+
+	const float cosine = (waveNumberX*m_windDirectionX + waveNumberZ*m_windDirectionZ)/waveNumber;
+
+	if(cosine <= 0.0f) {
+		return 0.0f;
+	}
+
+	const float omega = getOmega(waveNumber);
+
+	// group velocity domega/dk, g/(2*omega) in deep water
+	float groupVelocity = GRAVITY/(2.0f*omega);
+
+	if(m_depth > 0.0f) {
+		const float kh = waveNumber*m_depth;
+		const float tanhKh = tanh(kh);
+		groupVelocity = GRAVITY*(tanhKh + kh*(1.0f - tanhKh*tanhKh))/(2.0f*omega);
+	}
+
+	const float spreading = 2.0f/float(GS_PI)*cosine*cosine;
+
+	return getFrequencyDensity(omega)*groupVelocity/waveNumber*spreading;
+}
+
+float FrequencySpectrum::getOmega(float waveNumber)
+{
+	if(m_depth > 0.0f) {
+		return sqrt(GRAVITY*waveNumber*tanh(waveNumber*m_depth));
+	}
+
+	return sqrt(GRAVITY*waveNumber);
+}
+
+std::string FrequencySpectrum::getDirectionKey()
+{
+	std::ostringstream key;
+	key.precision(9);
+	key << m_windSpeed << "_" << m_windDirectionX << "_" << m_windDirectionZ << "_" << m_depth;
+
+	return key.str();
+}
@@ -0,0 +1,50 @@
+/** \class FrequencySpectrum
+ * Base of the spectra given as a frequency spectrum S(omega). The density over wave numbers is
+ * S(omega)*domega/dk/k times the directional spreading 2/PI*cos^2(theta) (waves with the wind only),
+ * the dispersion omega^2 = g*k*tanh(k*depth) includes finite depth.
+ *
+ * @author  Rahul Mukhi
+ * @date 12/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "IWaveSpectrum.h"
+
+class FrequencySpectrum : public IWaveSpectrum
+{
+public:
+	FrequencySpectrum(float windSpeed, float depth);
+	virtual ~FrequencySpectrum();
+
+	static const float GRAVITY;
+
+	void setWindDirection(float directionX, float directionZ);
+
+	virtual float getDensity(float waveNumberX, float waveNumberZ);
+	virtual float getOmega(float waveNumber);
+
+	inline float getWindSpeed()
+	{
+		return m_windSpeed;
+	}
+
+	// water depth in meters, 0 is deep water
+	inline float getDepth()
+	{
+		return m_depth;
+	}
+
+protected:
+
+	float m_windSpeed;
+	float m_windDirectionX, m_windDirectionZ;
+	float m_depth;
+
+	// variance of the surface height per angular frequency, in m^2*s
+	virtual float getFrequencyDensity(float omega) = 0;
+
+	std::string getDirectionKey();
+};
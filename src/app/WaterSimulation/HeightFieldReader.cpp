@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "HeightFieldReader.h"
+
+HeightFieldReader::HeightFieldReader()
+{
+	m_pHeader = NULL;
+	m_decodedFrame = 0xFFFFFFFF;
+}
+
+HeightFieldReader::~HeightFieldReader()
+{
+	close();
+}
+
+bool HeightFieldReader::open(const char* filename)
+{
+	close();
+
+	if(!m_file.open(filename, MappedFile::ACCESS_READ)) {
+		std::cout << "Could not open height field recording " << filename << std::endl;
+		return false;
+	}
+
+	m_pHeader = (const HeightFieldRecorder::FileHeader*)m_file.getData();
+
+	if((m_file.getSize() < sizeof(HeightFieldRecorder::FileHeader)) || (m_pHeader->magic != HeightFieldRecorder::MAGIC)
+		|| (m_pHeader->version != HeightFieldRecorder::VERSION) || (m_pHeader->numFields == 0) || (m_pHeader->numFields > HeightFieldRecorder::MAX_FIELDS)) {
+		std::cout << "Invalid height field recording " << filename << std::endl;
+		close();
+		return false;
+	}
+
+	const unsigned long long indexEnd = m_pHeader->indexOffset + (unsigned long long)m_pHeader->numFrames*sizeof(unsigned long long);
+
+	if((m_pHeader->indexOffset != 0) && (indexEnd <= m_file.getSize())) {
+
+		const unsigned long long* pIndex = (const unsigned long long*)(m_file.getData() + m_pHeader->indexOffset);
+		m_frameOffsets.assign(pIndex, pIndex + m_pHeader->numFrames);
+
+	} else if(!scanFrames()) {
+		close();
+		return false;
+	}
+
+	m_quantized.assign(m_pHeader->numFields*m_pHeader->numCellsX*m_pHeader->numCellsZ, 0);
+
+	return true;
+}
+
+void HeightFieldReader::close()
+{
+	m_file.close();
+	m_pHeader = NULL;
+	m_frameOffsets.clear();
+	m_decodedFrame = 0xFFFFFFFF;
+}
+
+bool HeightFieldReader::scanFrames()
+{
+	// recording was not closed: walk the chunks, a frame header with a wrong number ends the valid data
+	size_t offset = sizeof(HeightFieldRecorder::FileHeader);
+
+	while(offset + sizeof(HeightFieldRecorder::FrameHeader) <= m_file.getSize()) {
+
+		const HeightFieldRecorder::FrameHeader* pFrameHeader = (const HeightFieldRecorder::FrameHeader*)(m_file.getData() + offset);
+		const size_t end = offset + sizeof(HeightFieldRecorder::FrameHeader) + pFrameHeader->payloadSize;
+
+		if((pFrameHeader->frame != m_frameOffsets.size()) || (pFrameHeader->payloadSize == 0) || (end > m_file.getSize())) {
+			break;
+		}
+
+		m_frameOffsets.push_back(offset);
+		offset = end;
+	}
+
+	return !m_frameOffsets.empty();
+}
+
+void HeightFieldReader::getField(unsigned int frame, unsigned int field, const unsigned char*& pData, unsigned int& size)
+{
+	GS_ASSERT(m_pHeader != NULL);
+	GS_ASSERT(frame < m_frameOffsets.size());
+	GS_ASSERT(field < m_pHeader->numFields);
+
+	const unsigned char* pChunk = m_file.getData() + m_frameOffsets[frame] + sizeof(HeightFieldRecorder::FrameHeader);
+	const unsigned int* pFieldSizes = (const unsigned int*)pChunk;
+
+	pData = pChunk + m_pHeader->numFields*sizeof(unsigned int);
+
+	for(unsigned int i=0; i<field; i++) {
+		pData += HeightFieldRecorder::getPaddedSize(pFieldSizes[i]);
+	}
+
+	size = pFieldSizes[field];
+}
+
+bool HeightFieldReader::decodeQuantized(unsigned int frame)
+{
+	const unsigned int numCells = m_pHeader->numCellsX*m_pHeader->numCellsZ;
+	const unsigned int keyFrame = getFrameHeader(frame)->keyFrame;
+
+	// continue from the last decoded frame when stepping forward inside the same key frame interval
+	unsigned int start = keyFrame;
+
+	if((m_decodedFrame != 0xFFFFFFFF) && (m_decodedFrame >= keyFrame) && (m_decodedFrame <= frame)) {
+		start = m_decodedFrame + 1;
+	}
+
+	for(unsigned int f=start; f<=frame; f++) {
+		for(unsigned int field=0; field<m_pHeader->numFields; field++) {
+
+			const unsigned char* pData;
+			unsigned int size;
+			getField(f, field, pData, size);
+
+			short* pQuantized = &m_quantized[field*numCells];
+
+			if(f == keyFrame) {
+
+				if(size != numCells*sizeof(short)) {
+					return false;
+				}
+				memcpy(pQuantized, pData, size);
+
+			} else {
+
+				const unsigned char* pEnd = pData + size;
+
+				for(unsigned int i=0; i<numCells; i++) {
+
+					unsigned int zigzag = 0;
+					unsigned int shift = 0;
+
+					while((pData < pEnd) && (*pData & 0x80)) {
+						zigzag |= (unsigned int)(*pData & 0x7F) << shift;
+						shift += 7;
+						pData++;
+					}
+
+					if(pData >= pEnd) {
+						return false;
+					}
+
+					zigzag |= (unsigned int)(*pData) << shift;
+					pData++;
+
+					const int delta = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+					pQuantized[i] = (short)(pQuantized[i] + delta);
+				}
+			}
+		}
+
+		m_decodedFrame = f;
+	}
+
+	return true;
+}
+
+/**
+ * Decode one frame
+ *
+ * @param  frame  frame number.
+ * @param  pHeights  numCellsX*numCellsZ heights.
+ * @param  pXVelocities  x velocities or NULL (ignored if the recording has no velocities).
+ * @param  pZVelocities  z velocities or NULL.
+ * @return false if the frame does not exist or is corrupt.
+ */
+bool HeightFieldReader::readFrame(unsigned int frame, float* pHeights, float* pXVelocities, float* pZVelocities)
+{
+	if((m_pHeader == NULL) || (frame >= m_frameOffsets.size())) {
+		return false;
+	}
+
+	const unsigned int numCells = m_pHeader->numCellsX*m_pHeader->numCellsZ;
+	float* pFields[HeightFieldRecorder::MAX_FIELDS] = {pHeights, pXVelocities, pZVelocities};
+	const float offsets[HeightFieldRecorder::MAX_FIELDS] = {m_pHeader->heightOffset, .0f, .0f};
+	const float steps[HeightFieldRecorder::MAX_FIELDS] = {m_pHeader->heightStep, m_pHeader->velocityStep, m_pHeader->velocityStep};
+
+	if(m_pHeader->encoding == HeightFieldRecorder::ENCODING_RAW) {
+
+		for(unsigned int field=0; field<m_pHeader->numFields; field++) {
+
+			const unsigned char* pData;
+			unsigned int size;
+			getField(frame, field, pData, size);
+
+			if(size != numCells*sizeof(float)) {
+				return false;
+			}
+
+			if(pFields[field] != NULL) {
+				memcpy(pFields[field], pData, size);
+			}
+		}
+
+		return true;
+	}
+
+	if(m_pHeader->encoding == HeightFieldRecorder::ENCODING_QUANTIZED) {
+		m_decodedFrame = 0xFFFFFFFF; // every frame is a key frame
+	}
+
+	if(!decodeQuantized(frame)) {
+		m_decodedFrame = 0xFFFFFFFF;
+		return false;
+	}
+
+	for(unsigned int field=0; field<m_pHeader->numFields; field++) {
+
+		if(pFields[field] == NULL) {
+			continue;
+		}
+
+		const short* pQuantized = &m_quantized[field*numCells];
+
+		for(unsigned int i=0; i<numCells; i++) {
+			pFields[field][i] = HeightFieldRecorder::dequantize(pQuantized[i], offsets[field], steps[field]);
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,59 @@
+/** \class HeightFieldReader
+ * Random access to height field recordings written by HeightFieldRecorder, the file is memory mapped
+ * and frames are located through the index without parsing the ones before
+ *
+ * @author  Rahul Mukhi
+ * @date 23/05/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "HeightFieldRecorder.h"
+
+#include "base/io/MappedFile.h"
+#include "base/util/DebugUtil.h"
+
+#include <vector>
+
+class HeightFieldReader
+{
+public:
+	HeightFieldReader();
+	~HeightFieldReader();
+
+	bool open(const char* filename);
+	void close();
+
+	bool readFrame(unsigned int frame, float* pHeights, float* pXVelocities, float* pZVelocities);
+
+	inline unsigned int getNumFrames()
+	{
+		return (unsigned int)m_frameOffsets.size();
+	}
+
+	inline const HeightFieldRecorder::FileHeader* getFileHeader()
+	{
+		return m_pHeader;
+	}
+
+	inline const HeightFieldRecorder::FrameHeader* getFrameHeader(unsigned int frame)
+	{
+		GS_ASSERT(frame < m_frameOffsets.size());
+		return (const HeightFieldRecorder::FrameHeader*)(m_file.getData() + m_frameOffsets[frame]);
+	}
+
+private:
+
+	MappedFile m_file;
+	const HeightFieldRecorder::FileHeader* m_pHeader;
+	std::vector<unsigned long long> m_frameOffsets;
+
+	std::vector<short> m_quantized; // decoded state of m_decodedFrame (delta encoding)
+	unsigned int m_decodedFrame;
+
+	bool scanFrames();
+	bool decodeQuantized(unsigned int frame);
+	void getField(unsigned int frame, unsigned int field, const unsigned char*& pData, unsigned int& size);
+};
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "HeightFieldRecorder.h"
+
+#include "base/Prerequisites.h"
+
+const unsigned int HeightFieldRecorder::MAGIC = GS_MAKEFOURCC('W', 'S', 'H', 'F');
+const float HeightFieldRecorder::HEIGHT_STEP = 0.001f;
+const float HeightFieldRecorder::VELOCITY_STEP = 0.001f;
+
+HeightFieldRecorder::HeightFieldRecorder()
+{
+	m_writeOffset = 0;
+	m_lastKeyFrame = 0;
+	m_lastOriginX = m_lastOriginZ = .0f;
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+HeightFieldRecorder::~HeightFieldRecorder()
+{
+	close();
+}
+
+bool HeightFieldRecorder::open(const char* filename, int numCellsX, int numCellsZ, float cellEdge, float heightOffset, bool recordVelocities, Encoding encoding, unsigned int keyFrameInterval)
+{
+	close();
+
+	memset(&m_header, 0, sizeof(m_header));
+	m_header.magic = MAGIC;
+	m_header.version = VERSION;
+	m_header.numCellsX = numCellsX;
+	m_header.numCellsZ = numCellsZ;
+	m_header.numFields = recordVelocities ? 3 : 1;
+	m_header.encoding = encoding;
+	m_header.keyFrameInterval = std::max(1u, keyFrameInterval);
+	m_header.cellEdge = cellEdge;
+	m_header.heightOffset = heightOffset;
+	m_header.heightStep = HEIGHT_STEP;
+	m_header.velocityStep = VELOCITY_STEP;
+
+	// room for about a second of raw frames, grows by doubling
+	const size_t frameSize = sizeof(FrameHeader) + m_header.numFields*(4 + numCellsX*numCellsZ*sizeof(float));
+
+	if(!m_file.open(filename, MappedFile::ACCESS_READ_WRITE, sizeof(FileHeader) + 64*frameSize)) {
+		std::cout << "Could not create height field recording " << filename << std::endl;
+		return false;
+	}
+
+	memcpy(m_file.getData(), &m_header, sizeof(FileHeader));
+	m_writeOffset = sizeof(FileHeader);
+
+	m_frameOffsets.clear();
+	m_previousQuantized.assign(m_header.numFields*numCellsX*numCellsZ, 0);
+
+	std::cout << "Recording height field to " << filename << std::endl;
+
+	return true;
+}
+
+unsigned char* HeightFieldRecorder::reserve(size_t size)
+{
+	if(m_writeOffset + size > m_file.getSize()) {
+
+		size_t newSize = m_file.getSize()*2;
+
+		while(m_writeOffset + size > newSize) {
+			newSize *= 2;
+		}
+
+		if(!m_file.resize(newSize)) {
+			return NULL;
+		}
+	}
+
+	return m_file.getData() + m_writeOffset;
+}
+
+void HeightFieldRecorder::appendFrame(float time, float originX, float originZ, const float* pHeights, const float* pXVelocities, const float* pZVelocities)
+{
+	if(!m_file.isOpen()) {
+		return;
+	}
+
+	const unsigned int numCells = m_header.numCellsX*m_header.numCellsZ;
+	const unsigned int frame = (unsigned int)m_frameOffsets.size();
+
+	// worst case: raw floats, varints need at most 3 bytes for 16 bit deltas
+	const size_t maxPayload = m_header.numFields*(4 + getPaddedSize(numCells*4));
+	unsigned char* pChunk = reserve(sizeof(FrameHeader) + maxPayload);
+
+	if(pChunk == NULL) {
+		std::cout << "Height field recording failed, disk full?" << std::endl;
+		close();
+		return;
+	}
+
+	// a moved grid changes which world position a cell is, deltas would be meaningless
+	const bool keyFrame = (m_header.encoding != ENCODING_DELTA) || (frame - m_lastKeyFrame >= m_header.keyFrameInterval) || (frame == 0)
+		|| (originX != m_lastOriginX) || (originZ != m_lastOriginZ);
+
+	if(keyFrame) {
+		m_lastKeyFrame = frame;
+	}
+
+	m_lastOriginX = originX;
+	m_lastOriginZ = originZ;
+
+	const float* pFields[MAX_FIELDS] = {pHeights, pXVelocities, pZVelocities};
+	const float offsets[MAX_FIELDS] = {m_header.heightOffset, .0f, .0f};
+	const float steps[MAX_FIELDS] = {m_header.heightStep, m_header.velocityStep, m_header.velocityStep};
+
+	unsigned int* pFieldSizes = (unsigned int*)(pChunk + sizeof(FrameHeader));
+	unsigned char* pDest = pChunk + sizeof(FrameHeader) + m_header.numFields*sizeof(unsigned int);
+
+	for(unsigned int i=0; i<m_header.numFields; i++) {
+
+		const unsigned int fieldSize = writeField(pDest, pFields[i], offsets[i], steps[i], &m_previousQuantized[i*numCells], keyFrame);
+
+		pFieldSizes[i] = fieldSize;
+		pDest += getPaddedSize(fieldSize);
+	}
+
+	FrameHeader* pFrameHeader = (FrameHeader*)pChunk;
+	pFrameHeader->frame = frame;
+	pFrameHeader->keyFrame = m_lastKeyFrame;
+	pFrameHeader->time = time;
+	pFrameHeader->originX = originX;
+	pFrameHeader->originZ = originZ;
+	pFrameHeader->payloadSize = (unsigned int)(pDest - (pChunk + sizeof(FrameHeader)));
+	pFrameHeader->reserved[0] = pFrameHeader->reserved[1] = 0;
+
+	m_frameOffsets.push_back(m_writeOffset);
+	m_writeOffset += sizeof(FrameHeader) + pFrameHeader->payloadSize;
+}
+
+unsigned int HeightFieldRecorder::writeField(unsigned char* pDest, const float* pValues, float offset, float step, short* pPrevious, bool keyFrame)
+{
+	const unsigned int numCells = m_header.numCellsX*m_header.numCellsZ;
+
+	if(m_header.encoding == ENCODING_RAW) {
+		memcpy(pDest, pValues, numCells*sizeof(float));
+		return numCells*sizeof(float);
+	}
+
+	if(keyFrame) {
+
+		short* pQuantized = (short*)pDest;
+
+		for(unsigned int i=0; i<numCells; i++) {
+			pQuantized[i] = quantize(pValues[i], offset, step);
+		}
+
+		memcpy(pPrevious, pQuantized, numCells*sizeof(short));
+
+		return numCells*sizeof(short);
+	}
+
+	// unchanged cells cost one byte
+	unsigned char* pWrite = pDest;
+
+	for(unsigned int i=0; i<numCells; i++) {
+
+		const short quantized = quantize(pValues[i], offset, step);
+		const int delta = int(quantized) - int(pPrevious[i]);
+		unsigned int zigzag = (unsigned int)((delta << 1) ^ (delta >> 31));
+
+		while(zigzag >= 0x80) {
+			*pWrite++ = (unsigned char)(zigzag | 0x80);
+			zigzag >>= 7;
+		}
+		*pWrite++ = (unsigned char)zigzag;
+
+		pPrevious[i] = quantized;
+	}
+
+	return (unsigned int)(pWrite - pDest);
+}
+
+void HeightFieldRecorder::close()
+{
+	if(!m_file.isOpen()) {
+		return;
+	}
+
+	// index of frame offsets, 8 byte aligned
+	m_writeOffset = (m_writeOffset + 7) & ~(size_t)7;
+
+	const size_t indexSize = m_frameOffsets.size()*sizeof(unsigned long long);
+	unsigned char* pIndex = reserve(indexSize);
+
+	if(pIndex != NULL) {
+
+		if(indexSize > 0) {
+			memcpy(pIndex, &m_frameOffsets[0], indexSize);
+		}
+
+		m_header.numFrames = (unsigned int)m_frameOffsets.size();
+		m_header.indexOffset = m_writeOffset;
+		m_writeOffset += indexSize;
+
+		memcpy(m_file.getData(), &m_header, sizeof(FileHeader));
+		m_file.resize(m_writeOffset);
+
+		std::cout << "Height field recording: " << m_header.numFrames << " frames, " << m_writeOffset/1024 << " kB" << std::endl;
+	}
+
+	m_file.close();
+	m_frameOffsets.clear();
+}
@@ -0,0 +1,106 @@
+/** \class HeightFieldRecorder
+ * Streams the SWE height plane (optionally the velocities) of every step into a chunked, memory mapped
+ * time series file. Frames are raw floats, 16 bit quantized or quantized deltas against the previous frame,
+ * an index at the end of the file gives the offset of every frame (see HeightFieldReader).
+ *
+ * @author  Rahul Mukhi
+ * @date 23/05/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "base/io/MappedFile.h"
+
+#include <vector>
+
+class HeightFieldRecorder
+{
+public:
+	HeightFieldRecorder();
+	~HeightFieldRecorder();
+
+	enum Encoding
+	{
+		ENCODING_RAW, // 32 bit floats
+		ENCODING_QUANTIZED, // 16 bit fixed point, HEIGHT_STEP / VELOCITY_STEP resolution
+		ENCODING_DELTA // quantized key frames, zigzag varint deltas to the previous frame in between
+	};
+
+	// file layout: FileHeader, frames (FrameHeader, field sizes, fields padded to 4 bytes), index (64 bit frame offsets)
+	struct FileHeader
+	{
+		unsigned int magic, version;
+		unsigned int numCellsX, numCellsZ;
+		unsigned int numFields; // 1 heights only, 3 with x and z velocities
+		unsigned int encoding;
+		unsigned int keyFrameInterval;
+		unsigned int numFrames;
+		unsigned long long indexOffset; // 0 if the recording was not closed, frames can still be scanned
+		float cellEdge;
+		float heightOffset; // quantized heights are relative to this
+		float heightStep, velocityStep;
+		unsigned int reserved[2];
+	};
+
+	struct FrameHeader
+	{
+		unsigned int frame;
+		unsigned int keyFrame; // first frame needed to decode this one, equal to frame for key frames
+		float time;
+		float originX, originZ; // world position of cell 0, cells go towards -x and -z by cellEdge
+		unsigned int payloadSize; // bytes following this header
+		unsigned int reserved[2];
+	};
+
+	static const unsigned int MAGIC;
+	static const unsigned int VERSION = 1;
+	static const unsigned int MAX_FIELDS = 3;
+	static const float HEIGHT_STEP, VELOCITY_STEP;
+
+	bool open(const char* filename, int numCellsX, int numCellsZ, float cellEdge, float heightOffset, bool recordVelocities, Encoding encoding, unsigned int keyFrameInterval = 60);
+	void appendFrame(float time, float originX, float originZ, const float* pHeights, const float* pXVelocities, const float* pZVelocities);
+	void close();
+
+	inline bool isOpen()
+	{
+		return m_file.isOpen();
+	}
+
+	inline unsigned int getNumFrames()
+	{
+		return (unsigned int)m_frameOffsets.size();
+	}
+
+	static inline short quantize(float value, float offset, float step)
+	{
+		float q = (value - offset)/step;
+		q = (q < -32767.0f) ? -32767.0f : ((q > 32767.0f) ? 32767.0f : q);
+		return (short)((q >= 0.0f) ? (q + 0.5f) : (q - 0.5f));
+	}
+
+	static inline float dequantize(short value, float offset, float step)
+	{
+		return offset + float(value)*step;
+	}
+
+	static inline unsigned int getPaddedSize(unsigned int size)
+	{
+		return (size + 3) & ~3u;
+	}
+
+private:
+
+	MappedFile m_file;
+	size_t m_writeOffset;
+	FileHeader m_header;
+
+	std::vector<unsigned long long> m_frameOffsets;
+	std::vector<short> m_previousQuantized; // numFields*numCells of the previous frame for delta encoding
+	unsigned int m_lastKeyFrame;
+	float m_lastOriginX, m_lastOriginZ;
+
+	unsigned char* reserve(size_t size);
+	unsigned int writeField(unsigned char* pDest, const float* pValues, float offset, float step, short* pPrevious, bool keyFrame);
+};
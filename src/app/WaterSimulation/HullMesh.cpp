@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "HullMesh.h"
+
+#include <fstream>
+#include <iostream>
+
+HullMesh::HullMesh()
+{
+	m_vertexVBOId = m_indexVBOId = m_instanceVBOId = 0;
+	m_instanceVertShader = m_instanceShaderProgram = 0;
+	m_instancingChecked = m_instancingSupported = false;
+	m_instanceCapacity = 0;
+}
+
+HullMesh::~HullMesh()
+{
+	destroy();
+}
+
+/**
+ * Uploads the faces of an object, polygons as fans with the normal of their first corner, grouped by material
+ *
+ * @param  objReader  loaded object, vertices in body space.
+ */
+void HullMesh::create(ObjReader& objReader)
+{
+	std::vector<float> vertexData;
+	std::vector<GLuint> indices;
+	std::vector<std::string> materialNames;
+
+	for(unsigned int i=0; i<objReader.m_faces.size(); i++) {
+		if(std::find(materialNames.begin(), materialNames.end(), objReader.m_faces[i].materialName) == materialNames.end()) {
+			materialNames.push_back(objReader.m_faces[i].materialName);
+		}
+	}
+
+	m_ranges.clear();
+
+	for(unsigned int m=0; m<materialNames.size(); m++) {
+
+		Range range;
+		range.firstIndex = (unsigned int)indices.size();
+
+		for(unsigned int i=0; i<objReader.m_faces.size(); i++) {
+
+			const int* pVertexIndices = objReader.m_faces[i].vertex;
+			const int numVertices = objReader.m_faces[i].numVertices;
+
+			if((numVertices < 3) || (objReader.m_faces[i].materialName != materialNames[m])) {
+				continue;
+			}
+
+			Vector3 e1, e2, normal;
+			e1.sub(objReader.m_vertices[pVertexIndices[1]], objReader.m_vertices[pVertexIndices[0]]);
+			e2.sub(objReader.m_vertices[pVertexIndices[numVertices-1]], objReader.m_vertices[pVertexIndices[0]]);
+			normal.crossProduct(e1, e2);
+			if(normal.calcMagnitudeSquared() > 0.0f) {
+				normal.normalize();
+			}
+
+			const GLuint firstVertex = (GLuint)(vertexData.size()/VERTEX_SIZE);
+
+			for(int j=0; j<numVertices; j++) {
+				const Vector3& vertex = objReader.m_vertices[pVertexIndices[j]];
+				vertexData.push_back(vertex[0]);
+				vertexData.push_back(vertex[1]);
+				vertexData.push_back(vertex[2]);
+				vertexData.push_back(normal[0]);
+				vertexData.push_back(normal[1]);
+				vertexData.push_back(normal[2]);
+			}
+
+			for(int j=1; j<numVertices-1; j++) {
+				indices.push_back(firstVertex);
+				indices.push_back(firstVertex + j);
+				indices.push_back(firstVertex + j + 1);
+			}
+		}
+
+		range.numIndices = (unsigned int)indices.size() - range.firstIndex;
+
+		if(range.numIndices > 0) {
+			m_ranges.push_back(range);
+		}
+	}
+
+	upload(vertexData, indices);
+}
+
+/**
+ * Uploads the triangles of a hull as one material
+ *
+ * @param  hull  body space triangles.
+ */
+void HullMesh::create(HullTriangleCache& hull)
+{
+	const int numTriangles = hull.getNumTriangles();
+
+	std::vector<float> vertexData(numTriangles*3*VERTEX_SIZE);
+	std::vector<GLuint> indices(numTriangles*3);
+
+	for(int t=0; t<numTriangles; t++) {
+
+		Vector3 normal(hull.getStream(HullTriangleCache::STREAM_NORMAL_X)[t], hull.getStream(HullTriangleCache::STREAM_NORMAL_Y)[t], hull.getStream(HullTriangleCache::STREAM_NORMAL_Z)[t]);
+		if(normal.calcMagnitudeSquared() > 0.0f) {
+			normal.normalize();
+		}
+
+		for(int v=0; v<3; v++) {
+
+			float* pVertex = &vertexData[(3*t + v)*VERTEX_SIZE];
+			pVertex[0] = hull.getStream(HullTriangleCache::Stream(HullTriangleCache::STREAM_V0_X + 3*v))[t];
+			pVertex[1] = hull.getStream(HullTriangleCache::Stream(HullTriangleCache::STREAM_V0_Y + 3*v))[t];
+			pVertex[2] = hull.getStream(HullTriangleCache::Stream(HullTriangleCache::STREAM_V0_Z + 3*v))[t];
+			pVertex[3] = normal[0];
+			pVertex[4] = normal[1];
+			pVertex[5] = normal[2];
+
+			indices[3*t + v] = 3*t + v;
+		}
+	}
+
+	m_ranges.clear();
+
+	if(numTriangles > 0) {
+		Range range;
+		range.firstIndex = 0;
+		range.numIndices = numTriangles*3;
+		m_ranges.push_back(range);
+	}
+
+	upload(vertexData, indices);
+}
+
+void HullMesh::destroy()
+{
+	if(m_vertexVBOId != 0) {
+		glDeleteBuffers(1, &m_vertexVBOId);
+		glDeleteBuffers(1, &m_indexVBOId);
+		m_vertexVBOId = m_indexVBOId = 0;
+	}
+
+	if(m_instanceVBOId != 0) {
+		glDeleteBuffers(1, &m_instanceVBOId);
+		m_instanceVBOId = 0;
+		m_instanceCapacity = 0;
+	}
+
+	if(m_instanceShaderProgram != 0) {
+		glDetachShader(m_instanceShaderProgram, m_instanceVertShader);
+		glDeleteProgram(m_instanceShaderProgram);
+		m_instanceShaderProgram = 0;
+	}
+
+	if(m_instanceVertShader != 0) {
+		glDeleteShader(m_instanceVertShader);
+		m_instanceVertShader = 0;
+	}
+
+	m_instancingChecked = m_instancingSupported = false;
+}
+
+// one body with the current modelview matrix
+void HullMesh::render()
+{
+	if(!isCreated()) {
+		return;
+	}
+
+	bindArrays();
+	drawRanges();
+	unbindArrays();
+}
+
+/**
+ * Draws the mesh once per transform
+ *
+ * @param  pTransforms  numInstances column major body to world matrices, 16 floats each.
+ * @param  numInstances  number of bodies.
+ */
+void HullMesh::renderInstances(const float* pTransforms, int numInstances)
+{
+	if(!isCreated() || (numInstances <= 0)) {
+		return;
+	}
+
+	if(!initInstancing()) {
+
+		bindArrays();
+
+		for(int i=0; i<numInstances; i++) {
+			glPushMatrix();
+			glMultMatrixf(pTransforms + 16*i);
+			drawRanges();
+			glPopMatrix();
+		}
+
+		unbindArrays();
+		return;
+	}
+
+	// orphan the previous frame's transforms, the buffer only grows
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBOId);
+	m_instanceCapacity = std::max(m_instanceCapacity, (unsigned int)numInstances);
+	glBufferData(GL_ARRAY_BUFFER, m_instanceCapacity*16*sizeof(float), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, numInstances*16*sizeof(float), pTransforms);
+
+	for(GLuint c=0; c<4; c++) {
+		glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + c);
+		glVertexAttribPointer(INSTANCE_ATTRIBUTE + c, 4, GL_FLOAT, GL_FALSE, 16*sizeof(float), (void*)(4*c*sizeof(float)));
+		glVertexAttribDivisorARB(INSTANCE_ATTRIBUTE + c, 1);
+	}
+
+	glUseProgram(m_instanceShaderProgram);
+	bindArrays();
+
+	for(unsigned int r=0; r<m_ranges.size(); r++) {
+		glDrawElementsInstancedARB(GL_TRIANGLES, m_ranges[r].numIndices, GL_UNSIGNED_INT, (void*)(m_ranges[r].firstIndex*sizeof(GLuint)), numInstances);
+	}
+
+	unbindArrays();
+	glUseProgram(0);
+
+	for(GLuint c=0; c<4; c++) {
+		glVertexAttribDivisorARB(INSTANCE_ATTRIBUTE + c, 0);
+		glDisableVertexAttribArray(INSTANCE_ATTRIBUTE + c);
+	}
+}
+
+void HullMesh::upload(const std::vector<float>& vertexData, const std::vector<GLuint>& indices)
+{
+	if(m_vertexVBOId == 0) {
+		glGenBuffers(1, &m_vertexVBOId);
+		glGenBuffers(1, &m_indexVBOId);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexVBOId);
+	glBufferData(GL_ARRAY_BUFFER, vertexData.size()*sizeof(float), vertexData.empty() ? NULL : &vertexData[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBOId);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLuint), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void HullMesh::bindArrays()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexVBOId);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBOId);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+
+	glVertexPointer(3, GL_FLOAT, VERTEX_SIZE*sizeof(float), NULL);
+	glNormalPointer(GL_FLOAT, VERTEX_SIZE*sizeof(float), (void*)(3*sizeof(float)));
+}
+
+void HullMesh::unbindArrays()
+{
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void HullMesh::drawRanges()
+{
+	for(unsigned int r=0; r<m_ranges.size(); r++) {
+		glDrawElements(GL_TRIANGLES, m_ranges[r].numIndices, GL_UNSIGNED_INT, (void*)(m_ranges[r].firstIndex*sizeof(GLuint)));
+	}
+}
+
+// instanced arrays and the instance shader, checked once, false falls back to one draw per body
+bool HullMesh::initInstancing()
+{
+	if(m_instancingChecked) {
+		return m_instancingSupported;
+	}
+
+	m_instancingChecked = true;
+
+	if(!GLEW_ARB_draw_instanced || !GLEW_ARB_instanced_arrays) {
+		std::cout << "HullMesh: no instancing support, drawing bodies one by one" << std::endl;
+		return false;
+	}
+
+	std::ifstream shaderFile("RigidBodyInstanceVertexShader.glsl", std::ios::binary|std::ios::in);
+
+	if(!shaderFile.is_open()) {
+		std::cout << "HullMesh: RigidBodyInstanceVertexShader.glsl not found, drawing bodies one by one" << std::endl;
+		return false;
+	}
+
+	shaderFile.seekg(0, std::ios::end);
+	int size = (int)shaderFile.tellg();
+	shaderFile.seekg(0, std::ios::beg);
+
+	std::vector<char> source(size + 1);
+	shaderFile.read(&source[0], size);
+	source[size] = 0;
+	shaderFile.close();
+
+	const char* pSource = &source[0];
+	m_instanceVertShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(m_instanceVertShader, 1, &pSource, &size);
+	glCompileShader(m_instanceVertShader);
+
+	GLint compiled = 0;
+	glGetShaderiv(m_instanceVertShader, GL_COMPILE_STATUS, &compiled);
+
+	if(!compiled) {
+		char message[1024];
+		int logsize;
+		glGetShaderInfoLog(m_instanceVertShader, 1024, &logsize, message);
+		message[logsize] = 0;
+		std::cout << message << std::endl;
+		return false;
+	}
+
+	// vertex shader only, the fragments are coloured by the fixed function pipeline
+	m_instanceShaderProgram = glCreateProgram();
+	glAttachShader(m_instanceShaderProgram, m_instanceVertShader);
+	glBindAttribLocation(m_instanceShaderProgram, INSTANCE_ATTRIBUTE, "instanceColumn0");
+	glBindAttribLocation(m_instanceShaderProgram, INSTANCE_ATTRIBUTE + 1, "instanceColumn1");
+	glBindAttribLocation(m_instanceShaderProgram, INSTANCE_ATTRIBUTE + 2, "instanceColumn2");
+	glBindAttribLocation(m_instanceShaderProgram, INSTANCE_ATTRIBUTE + 3, "instanceColumn3");
+	glLinkProgram(m_instanceShaderProgram);
+
+	GLint linked = 0;
+	glGetProgramiv(m_instanceShaderProgram, GL_LINK_STATUS, &linked);
+
+	if(!linked) {
+		char message[1024];
+		int logsize;
+		glGetProgramInfoLog(m_instanceShaderProgram, 1024, &logsize, message);
+		message[logsize] = 0;
+		std::cout << message << std::endl;
+		return false;
+	}
+
+	glGenBuffers(1, &m_instanceVBOId);
+	m_instancingSupported = true;
+
+	return true;
+}
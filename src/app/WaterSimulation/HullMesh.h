@@ -0,0 +1,66 @@
+/** \class HullMesh
+ * Retained mode mesh of a rigid body: the faces are uploaded once into an interleaved vertex buffer (position and
+ * flat face normal) and an index buffer, sorted by material, so a body is drawn with one glDrawElements per
+ * material instead of immediate mode calls per face. Many bodies of the same mesh are drawn with one instanced
+ * call per material, their transforms streamed into an instance buffer and applied by RigidBodyInstanceVertexShader.glsl,
+ * which lights with light 0 like the fixed function pipeline. Without instancing support every body is drawn with
+ * its own glMultMatrixf and glDrawElements.
+ *
+ * @author  Rahul Mukhi
+ * @date 18/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "glew/glew.h"
+#include "ObjReader.h"
+#include "HullTriangleCache.h"
+
+#include "base/math/Matrix4x4.h"
+
+#include <vector>
+
+class HullMesh
+{
+public:
+	HullMesh();
+	~HullMesh();
+
+	static const int VERTEX_SIZE = 6; // floats per vertex, position and normal
+	static const GLuint INSTANCE_ATTRIBUTE = 12; // first of the four transform columns, clear of the aliased built-in attributes
+
+	void create(ObjReader& objReader);
+	void create(HullTriangleCache& hull);
+	void destroy();
+	void render();
+	void renderInstances(const float* pTransforms, int numInstances);
+
+	inline bool isCreated()
+	{
+		return m_vertexVBOId != 0;
+	}
+
+private:
+
+	// faces of one material, drawn with one call
+	struct Range
+	{
+		unsigned int firstIndex;
+		unsigned int numIndices;
+	};
+
+	GLuint m_vertexVBOId, m_indexVBOId, m_instanceVBOId;
+	GLuint m_instanceVertShader, m_instanceShaderProgram;
+	bool m_instancingChecked, m_instancingSupported;
+	unsigned int m_instanceCapacity; // transforms the instance buffer holds
+
+	std::vector<Range> m_ranges;
+
+	void upload(const std::vector<float>& vertexData, const std::vector<GLuint>& indices);
+	void bindArrays();
+	void unbindArrays();
+	void drawRanges();
+	bool initInstancing();
+};
@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "HullTriangleCache.h"
+
+#include <string.h>
+
+HullTriangleCache::HullTriangleCache()
+{
+	m_pData = NULL;
+	m_capacity = 0;
+	m_numTriangles = 0;
+}
+
+HullTriangleCache::~HullTriangleCache()
+{
+	SimdUtil::alignedFree(m_pData);
+}
+
+void HullTriangleCache::clear()
+{
+	if(m_pData != NULL) {
+		memset(m_pData, 0, sizeof(float)*NUM_STREAMS*m_capacity);
+	}
+	m_numTriangles = 0;
+}
+
+void HullTriangleCache::reserve(int capacity)
+{
+	// whole SIMD groups, the padding stays zero so it adds nothing
+	capacity = (capacity + 3) & ~3;
+
+	if(capacity <= m_capacity) {
+		return;
+	}
+
+	float* pData = (float*)SimdUtil::alignedMalloc(sizeof(float)*NUM_STREAMS*capacity);
+	memset(pData, 0, sizeof(float)*NUM_STREAMS*capacity);
+
+	for(int stream=0; stream<NUM_STREAMS; stream++) {
+		if(m_numTriangles > 0) {
+			memcpy(pData + stream*capacity, m_pData + stream*m_capacity, sizeof(float)*m_numTriangles);
+		}
+	}
+
+	SimdUtil::alignedFree(m_pData);
+	m_pData = pData;
+	m_capacity = capacity;
+}
+
+void HullTriangleCache::addTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2)
+{
+	if(m_numTriangles == m_capacity) {
+		reserve(std::max(2*m_capacity, 64));
+	}
+
+	Vector3 e1, e2, normal;
+	e1.sub(v1, v0);
+	e2.sub(v2, v0);
+	normal.crossProduct(e1, e2);
+	normal.scale(0.5f);
+
+	const float values[NUM_STREAMS] = {
+		v0[0], v0[1], v0[2],
+		v1[0], v1[1], v1[2],
+		v2[0], v2[1], v2[2],
+		(v0[0] + v1[0] + v2[0])/3.0f, (v0[1] + v1[1] + v2[1])/3.0f, (v0[2] + v1[2] + v2[2])/3.0f,
+		normal[0], normal[1], normal[2],
+		Vector3::dotProduct(normal, v0)
+	};
+
+	for(int stream=0; stream<NUM_STREAMS; stream++) {
+		m_pData[stream*m_capacity + m_numTriangles] = values[stream];
+	}
+
+	m_numTriangles++;
+}
+
+/**
+ * World x and z of the centroids
+ *
+ * @param  transform  body to world.
+ * @param  pX, pZ  getPaddedSize() values each.
+ */
+void HullTriangleCache::fillWorldCentroids(const Matrix4x4& transform, float* pX, float* pZ)
+{
+	const float* GS_RESTRICT pCentroidX = getStream(STREAM_CENTROID_X);
+	const float* GS_RESTRICT pCentroidY = getStream(STREAM_CENTROID_Y);
+	const float* GS_RESTRICT pCentroidZ = getStream(STREAM_CENTROID_Z);
+	const float* m = transform.rawConst();
+	const int count = getPaddedSize();
+
+	for(int i=0; i<count; i++) {
+		pX[i] = pCentroidX[i]*m[0] + pCentroidY[i]*m[4] + pCentroidZ[i]*m[8] + m[12];
+		pZ[i] = pCentroidX[i]*m[2] + pCentroidY[i]*m[6] + pCentroidZ[i]*m[10] + m[14];
+	}
+}
+
+/**
+ * Centre of mass and inertia tensor of the hull as a thin shell of uniform mass per area, which also works
+ * for hulls that are open at the deck. Uses the second moment of a triangle A/12*(a*a^T + b*b^T + c*c^T + s*s^T)
+ * with s = a + b + c.
+ *
+ * @param  mass  total mass.
+ * @param  centreOfMass  receives the centre of mass in body space.
+ * @param  inertia  receives the inertia tensor about the centre of mass in body axes, the 3x3 part.
+ */
+void HullTriangleCache::computeShellInertia(float mass, Vector3& centreOfMass, Matrix4x4& inertia)
+{
+	double area = 0.0;
+	double firstMoment[3] = {0.0, 0.0, 0.0};
+	double secondMoment[3][3] = {{0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}, {0.0, 0.0, 0.0}};
+
+	for(int i=0; i<m_numTriangles; i++) {
+
+		const Vector3 normal(getStream(STREAM_NORMAL_X)[i], getStream(STREAM_NORMAL_Y)[i], getStream(STREAM_NORMAL_Z)[i]);
+		const double triangleArea = normal.calcMagnitude();
+
+		double vertices[3][3], sum[3];
+		for(int c=0; c<3; c++) {
+			sum[c] = 0.0;
+			for(int v=0; v<3; v++) {
+				vertices[v][c] = getStream(Stream(STREAM_V0_X + 3*v + c))[i];
+				sum[c] += vertices[v][c];
+			}
+		}
+
+		area += triangleArea;
+
+		for(int r=0; r<3; r++) {
+			firstMoment[r] += triangleArea*sum[r]/3.0;
+
+			for(int c=0; c<3; c++) {
+				const double products = vertices[0][r]*vertices[0][c] + vertices[1][r]*vertices[1][c] + vertices[2][r]*vertices[2][c] + sum[r]*sum[c];
+				secondMoment[r][c] += triangleArea/12.0*products;
+			}
+		}
+	}
+
+	inertia.identity();
+	centreOfMass = Vector3(0.0f, 0.0f, 0.0f);
+
+	if(area <= 0.0) {
+		return;
+	}
+
+	const double massPerArea = mass/area;
+	double centre[3], covariance[3][3];
+
+	for(int r=0; r<3; r++) {
+		centre[r] = firstMoment[r]/area;
+		centreOfMass[r] = (float)centre[r];
+	}
+
+	// shifted to the centre of mass
+	for(int r=0; r<3; r++) {
+		for(int c=0; c<3; c++) {
+			covariance[r][c] = massPerArea*secondMoment[r][c] - mass*centre[r]*centre[c];
+		}
+	}
+
+	const double trace = covariance[0][0] + covariance[1][1] + covariance[2][2];
+
+	for(int r=0; r<3; r++) {
+		for(int c=0; c<3; c++) {
+			inertia[4*c + r] = (float)(((r == c) ? trace : 0.0) - covariance[r][c]);
+		}
+	}
+}
+
+/**
+ * Submerged volume, centre of buoyancy and hydrostatic force and torque below per triangle water heights in
+ * one pass. The volume is the sum of the cones from a point on the water plane of each triangle to its
+ * submerged part (the water plane closes the volume and adds nothing), force and torque integrate the depth,
+ * linear over each triangle, over its submerged part. The vertex depths decide
+ * which vertex is alone on its side of the water, the part of the triangle on the lone vertex' side is the
+ * triangle cut off at t_j = d_l/(d_l - d_j) along its two edges and covers t_j*t_k of the area.
+ *
+ * @param  pWaterHeights  getPaddedSize() world water heights, one per triangle.
+ * @param  up  world up direction in body space.
+ * @param  translationY  world height of the body origin, the triangles are in body space.
+ * @param  buoyancy  receives the results in body space.
+ * @param  pWaterlinePoints  receives the two points where every cut triangle crosses the water, in body space. May be NULL.
+ */
+void HullTriangleCache::computeBuoyancy(const float* pWaterHeights, const Vector3& up, float translationY, Buoyancy& buoyancy,
+	std::vector<Vector3>* pWaterlinePoints)
+{
+	float sums[NUM_SUMS];
+	for(int sum=0; sum<NUM_SUMS; sum++) {
+		sums[sum] = 0.0f;
+	}
+
+	int i = 0;
+
+#if defined(GS_SSE2)
+	const int numGroups = getPaddedSize()/4;
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 third = _mm_set1_ps(1.0f/3.0f);
+	const __m128 twelfth = _mm_set1_ps(1.0f/12.0f);
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	const __m128 threeQuarters = _mm_set1_ps(0.75f);
+	const __m128 translationY4 = _mm_set1_ps(translationY);
+	const __m128 upX = _mm_set1_ps(up[0]);
+	const __m128 upY = _mm_set1_ps(up[1]);
+	const __m128 upZ = _mm_set1_ps(up[2]);
+
+	__m128 sums4[NUM_SUMS];
+	for(int sum=0; sum<NUM_SUMS; sum++) {
+		sums4[sum] = zero;
+	}
+
+	for(int group=0; group<numGroups; group++, i+=4) {
+
+		// height of the water plane along up in body space
+		const __m128 waterLevel = _mm_sub_ps(_mm_loadu_ps(pWaterHeights + i), translationY4);
+
+		__m128 x[3], y[3], z[3], depth[3], below[3];
+		for(int v=0; v<3; v++) {
+			x[v] = _mm_load_ps(getStream(Stream(STREAM_V0_X + 3*v)) + i);
+			y[v] = _mm_load_ps(getStream(Stream(STREAM_V0_Y + 3*v)) + i);
+			z[v] = _mm_load_ps(getStream(Stream(STREAM_V0_Z + 3*v)) + i);
+			depth[v] = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(upX, x[v]), _mm_mul_ps(upY, y[v])), _mm_mul_ps(upZ, z[v])), waterLevel);
+			below[v] = _mm_cmplt_ps(depth[v], zero);
+		}
+
+		const __m128 allBelow = _mm_and_ps(below[0], _mm_and_ps(below[1], below[2]));
+		const __m128 cut = _mm_andnot_ps(allBelow, _mm_or_ps(below[0], _mm_or_ps(below[1], below[2])));
+
+		const __m128 differs01 = _mm_xor_ps(below[0], below[1]);
+		const __m128 differs02 = _mm_xor_ps(below[0], below[2]);
+		const __m128 differs12 = _mm_xor_ps(below[1], below[2]);
+		const __m128 lone[3] = {_mm_and_ps(differs01, differs02), _mm_and_ps(differs01, differs12), _mm_and_ps(differs02, differs12)};
+
+		__m128 loneDepth = zero, loneX = zero, loneY = zero, loneZ = zero;
+		for(int v=0; v<3; v++) {
+			loneDepth = _mm_or_ps(loneDepth, _mm_and_ps(lone[v], depth[v]));
+			loneX = _mm_or_ps(loneX, _mm_and_ps(lone[v], x[v]));
+			loneY = _mm_or_ps(loneY, _mm_and_ps(lone[v], y[v]));
+			loneZ = _mm_or_ps(loneZ, _mm_and_ps(lone[v], z[v]));
+		}
+
+		// crossing points along the edges from the lone vertex, the lone vertex itself for v == lone
+		__m128 crossX[3], crossY[3], crossZ[3];
+		__m128 fraction = one;
+		__m128 cutCentroidX = zero, cutCentroidY = zero, cutCentroidZ = zero;
+
+		for(int v=0; v<3; v++) {
+			const __m128 other = _mm_andnot_ps(lone[v], cut);
+			const __m128 t = _mm_and_ps(other, _mm_div_ps(loneDepth, SimdUtil::select4(other, _mm_sub_ps(loneDepth, depth[v]), one)));
+
+			crossX[v] = _mm_add_ps(loneX, _mm_mul_ps(_mm_sub_ps(x[v], loneX), t));
+			crossY[v] = _mm_add_ps(loneY, _mm_mul_ps(_mm_sub_ps(y[v], loneY), t));
+			crossZ[v] = _mm_add_ps(loneZ, _mm_mul_ps(_mm_sub_ps(z[v], loneZ), t));
+
+			fraction = _mm_mul_ps(fraction, SimdUtil::select4(other, t, one));
+			cutCentroidX = _mm_add_ps(cutCentroidX, crossX[v]);
+			cutCentroidY = _mm_add_ps(cutCentroidY, crossY[v]);
+			cutCentroidZ = _mm_add_ps(cutCentroidZ, crossZ[v]);
+		}
+
+		// area fraction and area weighted centroid of the cut off triangle, then of the submerged part
+		fraction = _mm_and_ps(cut, fraction);
+		const __m128 cutMomentX = _mm_mul_ps(_mm_mul_ps(cutCentroidX, third), fraction);
+		const __m128 cutMomentY = _mm_mul_ps(_mm_mul_ps(cutCentroidY, third), fraction);
+		const __m128 cutMomentZ = _mm_mul_ps(_mm_mul_ps(cutCentroidZ, third), fraction);
+
+		const __m128 centroidX = _mm_load_ps(getStream(STREAM_CENTROID_X) + i);
+		const __m128 centroidY = _mm_load_ps(getStream(STREAM_CENTROID_Y) + i);
+		const __m128 centroidZ = _mm_load_ps(getStream(STREAM_CENTROID_Z) + i);
+		const __m128 loneBelow = _mm_cmplt_ps(loneDepth, zero);
+
+		const __m128 submergedFraction = _mm_or_ps(_mm_and_ps(allBelow, one), _mm_and_ps(cut, SimdUtil::select4(loneBelow, fraction, _mm_sub_ps(one, fraction))));
+		const __m128 momentX = _mm_or_ps(_mm_and_ps(allBelow, centroidX), _mm_and_ps(cut, SimdUtil::select4(loneBelow, cutMomentX, _mm_sub_ps(centroidX, cutMomentX))));
+		const __m128 momentY = _mm_or_ps(_mm_and_ps(allBelow, centroidY), _mm_and_ps(cut, SimdUtil::select4(loneBelow, cutMomentY, _mm_sub_ps(centroidY, cutMomentY))));
+		const __m128 momentZ = _mm_or_ps(_mm_and_ps(allBelow, centroidZ), _mm_and_ps(cut, SimdUtil::select4(loneBelow, cutMomentZ, _mm_sub_ps(centroidZ, cutMomentZ))));
+
+		const __m128 normalX = _mm_load_ps(getStream(STREAM_NORMAL_X) + i);
+		const __m128 normalY = _mm_load_ps(getStream(STREAM_NORMAL_Y) + i);
+		const __m128 normalZ = _mm_load_ps(getStream(STREAM_NORMAL_Z) + i);
+		const __m128 normalUp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, upX), _mm_mul_ps(normalY, upY)), _mm_mul_ps(normalZ, upZ));
+
+		// cone over the whole triangle n.(v0 - apex)/3, its centroid is 3/4 of the way from the apex to the base centroid
+		const __m128 coneVolume = _mm_mul_ps(third, _mm_sub_ps(_mm_load_ps(getStream(STREAM_PLANE_OFFSET) + i), _mm_mul_ps(normalUp, waterLevel)));
+		const __m128 triangleVolume = _mm_mul_ps(submergedFraction, coneVolume);
+		const __m128 baseMomentScale = _mm_mul_ps(threeQuarters, coneVolume);
+		const __m128 apexMomentScale = _mm_mul_ps(_mm_mul_ps(quarter, triangleVolume), waterLevel);
+
+		sums4[SUM_VOLUME] = _mm_add_ps(sums4[SUM_VOLUME], triangleVolume);
+		sums4[SUM_MOMENT_X] = _mm_add_ps(sums4[SUM_MOMENT_X], _mm_add_ps(_mm_mul_ps(baseMomentScale, momentX), _mm_mul_ps(apexMomentScale, upX)));
+		sums4[SUM_MOMENT_Y] = _mm_add_ps(sums4[SUM_MOMENT_Y], _mm_add_ps(_mm_mul_ps(baseMomentScale, momentY), _mm_mul_ps(apexMomentScale, upY)));
+		sums4[SUM_MOMENT_Z] = _mm_add_ps(sums4[SUM_MOMENT_Z], _mm_add_ps(_mm_mul_ps(baseMomentScale, momentZ), _mm_mul_ps(apexMomentScale, upZ)));
+
+		// -depth*area of the submerged part (up.moment - level*fraction) along the normal
+		const __m128 pressure = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(upX, momentX), _mm_mul_ps(upY, momentY)), _mm_mul_ps(upZ, momentZ)), _mm_mul_ps(waterLevel, submergedFraction));
+
+		sums4[SUM_FORCE_X] = _mm_add_ps(sums4[SUM_FORCE_X], _mm_mul_ps(pressure, normalX));
+		sums4[SUM_FORCE_Y] = _mm_add_ps(sums4[SUM_FORCE_Y], _mm_mul_ps(pressure, normalY));
+		sums4[SUM_FORCE_Z] = _mm_add_ps(sums4[SUM_FORCE_Z], _mm_mul_ps(pressure, normalZ));
+
+		// depth weighted first moment, the linear depth over a triangle gives (sum(d)*sum(v) + sum(d*v))/12 per area,
+		// over the cut off triangle d_l*(2*l + q_j + q_k)/12 since the depth is zero at the crossings
+		const __m128 depthSum = _mm_add_ps(_mm_add_ps(depth[0], depth[1]), depth[2]);
+		const __m128 cutScale = _mm_mul_ps(_mm_mul_ps(fraction, loneDepth), twelfth);
+
+		const __m128 vertexSums[3] = {_mm_add_ps(_mm_add_ps(x[0], x[1]), x[2]), _mm_add_ps(_mm_add_ps(y[0], y[1]), y[2]), _mm_add_ps(_mm_add_ps(z[0], z[1]), z[2])};
+		const __m128 weightedSums[3] = {
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(depth[0], x[0]), _mm_mul_ps(depth[1], x[1])), _mm_mul_ps(depth[2], x[2])),
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(depth[0], y[0]), _mm_mul_ps(depth[1], y[1])), _mm_mul_ps(depth[2], y[2])),
+			_mm_add_ps(_mm_add_ps(_mm_mul_ps(depth[0], z[0]), _mm_mul_ps(depth[1], z[1])), _mm_mul_ps(depth[2], z[2]))};
+		const __m128 cutSums[3] = {_mm_add_ps(cutCentroidX, loneX), _mm_add_ps(cutCentroidY, loneY), _mm_add_ps(cutCentroidZ, loneZ)};
+
+		__m128 depthMoment[3];
+		for(int c=0; c<3; c++) {
+			const __m128 full = _mm_mul_ps(twelfth, _mm_add_ps(_mm_mul_ps(depthSum, vertexSums[c]), weightedSums[c]));
+			const __m128 cutOff = _mm_mul_ps(cutScale, cutSums[c]);
+			depthMoment[c] = _mm_or_ps(_mm_and_ps(allBelow, full), _mm_and_ps(cut, SimdUtil::select4(loneBelow, cutOff, _mm_sub_ps(full, cutOff))));
+		}
+
+		sums4[SUM_TORQUE_X] = _mm_add_ps(sums4[SUM_TORQUE_X], _mm_sub_ps(_mm_mul_ps(depthMoment[1], normalZ), _mm_mul_ps(depthMoment[2], normalY)));
+		sums4[SUM_TORQUE_Y] = _mm_add_ps(sums4[SUM_TORQUE_Y], _mm_sub_ps(_mm_mul_ps(depthMoment[2], normalX), _mm_mul_ps(depthMoment[0], normalZ)));
+		sums4[SUM_TORQUE_Z] = _mm_add_ps(sums4[SUM_TORQUE_Z], _mm_sub_ps(_mm_mul_ps(depthMoment[0], normalY), _mm_mul_ps(depthMoment[1], normalX)));
+
+		const int cutMask = _mm_movemask_ps(cut);
+
+		if((pWaterlinePoints != NULL) && (cutMask != 0)) {
+
+			float pointsX[3][4], pointsY[3][4], pointsZ[3][4];
+			int loneMasks[3];
+
+			for(int v=0; v<3; v++) {
+				_mm_storeu_ps(pointsX[v], crossX[v]);
+				_mm_storeu_ps(pointsY[v], crossY[v]);
+				_mm_storeu_ps(pointsZ[v], crossZ[v]);
+				loneMasks[v] = _mm_movemask_ps(lone[v]);
+			}
+
+			for(int lane=0; lane<4; lane++) {
+				for(int v=0; (v<3) && (cutMask & (1 << lane)); v++) {
+					if(!(loneMasks[v] & (1 << lane))) {
+						pWaterlinePoints->push_back(Vector3(pointsX[v][lane], pointsY[v][lane], pointsZ[v][lane]));
+					}
+				}
+			}
+		}
+	}
+
+	for(int sum=0; sum<NUM_SUMS; sum++) {
+		float lanes[4];
+		_mm_storeu_ps(lanes, sums4[sum]);
+		sums[sum] = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#endif
+
+	computeBuoyancyScalar(i, m_numTriangles, pWaterHeights, up, translationY, sums, pWaterlinePoints);
+
+	buoyancy.volume = sums[SUM_VOLUME];
+	buoyancy.pressureForce = Vector3(sums[SUM_FORCE_X], sums[SUM_FORCE_Y], sums[SUM_FORCE_Z]);
+	buoyancy.pressureTorque = Vector3(sums[SUM_TORQUE_X], sums[SUM_TORQUE_Y], sums[SUM_TORQUE_Z]);
+
+	if(buoyancy.volume != 0.0f) {
+		buoyancy.centreOfBuoyancy = Vector3(sums[SUM_MOMENT_X]/buoyancy.volume, sums[SUM_MOMENT_Y]/buoyancy.volume, sums[SUM_MOMENT_Z]/buoyancy.volume);
+	} else {
+		buoyancy.centreOfBuoyancy = Vector3(0.0f, 0.0f, 0.0f);
+	}
+}
+
+// the SSE2 kernel per triangle, for the remaining triangles and builds without SSE2
+void HullTriangleCache::computeBuoyancyScalar(int begin, int end, const float* pWaterHeights, const Vector3& up, float translationY, float* pSums,
+	std::vector<Vector3>* pWaterlinePoints)
+{
+	for(int i=begin; i<end; i++) {
+
+		const float waterLevel = pWaterHeights[i] - translationY;
+
+		Vector3 vertices[3];
+		float depth[3];
+		bool below[3];
+
+		for(int v=0; v<3; v++) {
+			vertices[v] = Vector3(getStream(Stream(STREAM_V0_X + 3*v))[i], getStream(Stream(STREAM_V0_Y + 3*v))[i], getStream(Stream(STREAM_V0_Z + 3*v))[i]);
+			depth[v] = Vector3::dotProduct(up, vertices[v]) - waterLevel;
+			below[v] = depth[v] < 0.0f;
+		}
+
+		const bool allBelow = below[0] && below[1] && below[2];
+		const bool cut = !allBelow && (below[0] || below[1] || below[2]);
+		const Vector3 centroid(getStream(STREAM_CENTROID_X)[i], getStream(STREAM_CENTROID_Y)[i], getStream(STREAM_CENTROID_Z)[i]);
+
+		float submergedFraction = allBelow ? 1.0f : 0.0f;
+		Vector3 moment = allBelow ? centroid : Vector3(0.0f, 0.0f, 0.0f);
+
+		Vector3 fullDepthMoment(0.0f, 0.0f, 0.0f);
+		for(int v=0; v<3; v++) {
+			Vector3 weighted = vertices[v];
+			weighted.scale(depth[v] + depth[0] + depth[1] + depth[2]);
+			fullDepthMoment.add(weighted);
+		}
+		fullDepthMoment.scale(1.0f/12.0f);
+
+		Vector3 depthMoment = allBelow ? fullDepthMoment : Vector3(0.0f, 0.0f, 0.0f);
+
+		if(cut) {
+			const int lone = (below[0] != below[1]) ? ((below[0] != below[2]) ? 0 : 1) : 2;
+			const Vector3& loneVertex = vertices[lone];
+
+			float fraction = 1.0f;
+			Vector3 cutCentroid = loneVertex;
+
+			for(int v=0; v<3; v++) {
+				if(v != lone) {
+					const float t = depth[lone]/(depth[lone] - depth[v]);
+
+					Vector3 crossing;
+					crossing.sub(vertices[v], loneVertex);
+					crossing.scale(t);
+					crossing.add(loneVertex);
+
+					fraction *= t;
+					cutCentroid.add(crossing);
+
+					if(pWaterlinePoints != NULL) {
+						pWaterlinePoints->push_back(crossing);
+					}
+				}
+			}
+
+			Vector3 cutMoment = cutCentroid;
+			cutMoment.scale(fraction/3.0f);
+
+			Vector3 cutDepthMoment = cutCentroid;
+			cutDepthMoment.add(loneVertex);
+			cutDepthMoment.scale(fraction*depth[lone]/12.0f);
+
+			if(below[lone]) {
+				submergedFraction = fraction;
+				moment = cutMoment;
+				depthMoment = cutDepthMoment;
+			} else {
+				submergedFraction = 1.0f - fraction;
+				moment.sub(centroid, cutMoment);
+				depthMoment.sub(fullDepthMoment, cutDepthMoment);
+			}
+		}
+
+		const Vector3 normal(getStream(STREAM_NORMAL_X)[i], getStream(STREAM_NORMAL_Y)[i], getStream(STREAM_NORMAL_Z)[i]);
+		const float coneVolume = (getStream(STREAM_PLANE_OFFSET)[i] - Vector3::dotProduct(normal, up)*waterLevel)/3.0f;
+		const float triangleVolume = submergedFraction*coneVolume;
+		const float pressure = Vector3::dotProduct(up, moment) - waterLevel*submergedFraction;
+
+		Vector3 torque;
+		torque.crossProduct(depthMoment, normal);
+
+		for(int c=0; c<3; c++) {
+			pSums[SUM_MOMENT_X + c] += 0.75f*coneVolume*moment[c] + 0.25f*triangleVolume*waterLevel*up[c];
+			pSums[SUM_FORCE_X + c] += pressure*normal[c];
+			pSums[SUM_TORQUE_X + c] += torque[c];
+		}
+		pSums[SUM_VOLUME] += triangleVolume;
+	}
+}
@@ -0,0 +1,97 @@
+/** \class HullTriangleCache
+ * Hull triangles of a floating body as a structure of arrays (vertex positions, centroid, area weighted normal
+ * and its plane offset per triangle), built once at load. The buoyancy kernel evaluates four triangles per
+ * SSE2 step without gathers or per case branches: the submerged part of a triangle is found from the vertex
+ * depths alone, since it lies in the triangle plane its area vector is the submerged area fraction times the
+ * triangle's area vector. The water planes may have any orientation in body space, so the body can pitch and roll.
+ *
+ * @author  Rahul Mukhi
+ * @date 14/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "base/math/Vector3.h"
+#include "base/math/Matrix4x4.h"
+#include "base/math/SimdUtil.h"
+
+#include <vector>
+
+class HullTriangleCache
+{
+public:
+	HullTriangleCache();
+	~HullTriangleCache();
+
+	enum Stream
+	{
+		STREAM_V0_X, STREAM_V0_Y, STREAM_V0_Z,
+		STREAM_V1_X, STREAM_V1_Y, STREAM_V1_Z,
+		STREAM_V2_X, STREAM_V2_Y, STREAM_V2_Z,
+		STREAM_CENTROID_X, STREAM_CENTROID_Y, STREAM_CENTROID_Z,
+		STREAM_NORMAL_X, STREAM_NORMAL_Y, STREAM_NORMAL_Z, // (v1-v0)x(v2-v0)/2, length is the area
+		STREAM_PLANE_OFFSET, // dot(normal, v0)
+		NUM_STREAMS
+	};
+
+	// body space results of computeBuoyancy
+	struct Buoyancy
+	{
+		float volume;
+		Vector3 centreOfBuoyancy; // the origin if nothing is submerged
+		Vector3 pressureForce;    // -sum of depth*area vector over the submerged surface, times water density and gravity the hydrostatic force
+		Vector3 pressureTorque;   // about the body origin, same scale
+	};
+
+	void clear();
+	void addTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2);
+
+	void fillWorldCentroids(const Matrix4x4& transform, float* pX, float* pZ);
+	void computeShellInertia(float mass, Vector3& centreOfMass, Matrix4x4& inertia);
+	void computeBuoyancy(const float* pWaterHeights, const Vector3& up, float translationY, Buoyancy& buoyancy,
+		std::vector<Vector3>* pWaterlinePoints);
+
+	inline int getNumTriangles()
+	{
+		return m_numTriangles;
+	}
+
+	// number of triangles rounded up to whole SIMD groups, per triangle arrays passed in need this size
+	inline int getPaddedSize()
+	{
+		return (m_numTriangles + 3) & ~3;
+	}
+
+	inline const float* getStream(Stream stream)
+	{
+		return m_pData + stream*m_capacity;
+	}
+
+private:
+
+	enum Sum
+	{
+		SUM_VOLUME,
+		SUM_MOMENT_X, SUM_MOMENT_Y, SUM_MOMENT_Z,
+		SUM_FORCE_X, SUM_FORCE_Y, SUM_FORCE_Z,
+		SUM_TORQUE_X, SUM_TORQUE_Y, SUM_TORQUE_Z,
+		NUM_SUMS
+	};
+
+	// NUM_STREAMS arrays of m_capacity floats, 16 byte aligned, padding triangles are zero
+	float* m_pData;
+	int m_capacity;
+	int m_numTriangles;
+
+	void reserve(int capacity);
+
+	inline float* getStreamWritable(Stream stream)
+	{
+		return m_pData + stream*m_capacity;
+	}
+
+	void computeBuoyancyScalar(int begin, int end, const float* pWaterHeights, const Vector3& up, float translationY, float* pSums,
+		std::vector<Vector3>* pWaterlinePoints);
+};
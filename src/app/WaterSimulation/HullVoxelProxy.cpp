@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "HullVoxelProxy.h"
+
+#include "base/util/DebugUtil.h"
+
+HullVoxelProxy::HullVoxelProxy()
+{
+	m_voxelSize = 0.0f;
+	m_volume = 0.0;
+}
+
+HullVoxelProxy::~HullVoxelProxy()
+{
+}
+
+/**
+ * Voxelises the hull, replaces the samples of an earlier build
+ *
+ * @param  hull  body space triangles.
+ * @param  voxelSize  edge length of the voxels in body units.
+ */
+void HullVoxelProxy::build(HullTriangleCache& hull, float voxelSize)
+{
+	GS_ASSERT(voxelSize > 0.0f);
+
+	m_voxelSize = voxelSize;
+	m_volume = 0.0;
+	m_x.clear();
+	m_y.clear();
+	m_z.clear();
+	m_volumes.clear();
+
+	const int numTriangles = hull.getNumTriangles();
+
+	if(numTriangles == 0) {
+		return;
+	}
+
+	const float* pVertexX[3] = {hull.getStream(HullTriangleCache::STREAM_V0_X), hull.getStream(HullTriangleCache::STREAM_V1_X), hull.getStream(HullTriangleCache::STREAM_V2_X)};
+	const float* pVertexY[3] = {hull.getStream(HullTriangleCache::STREAM_V0_Y), hull.getStream(HullTriangleCache::STREAM_V1_Y), hull.getStream(HullTriangleCache::STREAM_V2_Y)};
+	const float* pVertexZ[3] = {hull.getStream(HullTriangleCache::STREAM_V0_Z), hull.getStream(HullTriangleCache::STREAM_V1_Z), hull.getStream(HullTriangleCache::STREAM_V2_Z)};
+
+	Vector3 minimum(pVertexX[0][0], pVertexY[0][0], pVertexZ[0][0]);
+	Vector3 maximum = minimum;
+
+	for(int i=0; i<numTriangles; i++) {
+		for(int v=0; v<3; v++) {
+			minimum[0] = std::min(minimum[0], pVertexX[v][i]);
+			minimum[1] = std::min(minimum[1], pVertexY[v][i]);
+			minimum[2] = std::min(minimum[2], pVertexZ[v][i]);
+			maximum[0] = std::max(maximum[0], pVertexX[v][i]);
+			maximum[1] = std::max(maximum[1], pVertexY[v][i]);
+			maximum[2] = std::max(maximum[2], pVertexZ[v][i]);
+		}
+	}
+
+	// columns centred on the bounding box
+	const int numColumnsX = std::max(1, (int)ceil((maximum[0] - minimum[0])/voxelSize));
+	const int numColumnsZ = std::max(1, (int)ceil((maximum[2] - minimum[2])/voxelSize));
+	const float startX = 0.5f*(minimum[0] + maximum[0]) - 0.5f*voxelSize*(numColumnsX - 1);
+	const float startZ = 0.5f*(minimum[2] + maximum[2]) - 0.5f*voxelSize*(numColumnsZ - 1);
+
+	// heights where the vertical ray through each column centre crosses the hull
+	std::vector< std::vector<float> > crossings(numColumnsX*numColumnsZ);
+
+	for(int i=0; i<numTriangles; i++) {
+
+		const float x0 = pVertexX[0][i], z0 = pVertexZ[0][i];
+		const float x1 = pVertexX[1][i], z1 = pVertexZ[1][i];
+		const float x2 = pVertexX[2][i], z2 = pVertexZ[2][i];
+
+		// twice the signed area of the projection, vertical triangles are not crossed
+		const float area = (x1 - x0)*(z2 - z0) - (x2 - x0)*(z1 - z0);
+
+		if(fabs(area) < 1.0e-12f) {
+			continue;
+		}
+
+		const int firstColumnX = std::max(0, (int)ceil((std::min(x0, std::min(x1, x2)) - startX)/voxelSize));
+		const int lastColumnX = std::min(numColumnsX - 1, (int)floor((std::max(x0, std::max(x1, x2)) - startX)/voxelSize));
+		const int firstColumnZ = std::max(0, (int)ceil((std::min(z0, std::min(z1, z2)) - startZ)/voxelSize));
+		const int lastColumnZ = std::min(numColumnsZ - 1, (int)floor((std::max(z0, std::max(z1, z2)) - startZ)/voxelSize));
+
+		for(int columnZ=firstColumnZ; columnZ<=lastColumnZ; columnZ++) {
+			for(int columnX=firstColumnX; columnX<=lastColumnX; columnX++) {
+
+				const float x = startX + columnX*voxelSize;
+				const float z = startZ + columnZ*voxelSize;
+
+				// barycentric coordinates of the column in the projected triangle
+				const float b1 = ((x - x0)*(z2 - z0) - (x2 - x0)*(z - z0))/area;
+				const float b2 = ((x1 - x0)*(z - z0) - (x - x0)*(z1 - z0))/area;
+				const float b0 = 1.0f - b1 - b2;
+
+				if((b0 >= 0.0f) && (b1 >= 0.0f) && (b2 >= 0.0f)) {
+					crossings[columnX + columnZ*numColumnsX].push_back(b0*pVertexY[0][i] + b1*pVertexY[1][i] + b2*pVertexY[2][i]);
+				}
+			}
+		}
+	}
+
+	for(int columnZ=0; columnZ<numColumnsZ; columnZ++) {
+		for(int columnX=0; columnX<numColumnsX; columnX++) {
+
+			std::vector<float>& columnCrossings = crossings[columnX + columnZ*numColumnsX];
+
+			if(!columnCrossings.empty()) {
+				addColumn(startX + columnX*voxelSize, startZ + columnZ*voxelSize, columnCrossings, minimum[1], maximum[1]);
+			}
+		}
+	}
+}
+
+// one sample per voxel of the column that overlaps the inside intervals, at the centre of the overlap
+void HullVoxelProxy::addColumn(float x, float z, std::vector<float>& crossings, float bottom, float top)
+{
+	std::sort(crossings.begin(), crossings.end());
+
+	if(crossings.size()%2 != 0) {
+		crossings.push_back(top);
+	}
+
+	const float voxelArea = m_voxelSize*m_voxelSize;
+	const int numVoxels = std::max(1, (int)ceil((top - bottom)/m_voxelSize));
+
+	for(int voxel=0; voxel<numVoxels; voxel++) {
+
+		const float voxelBottom = bottom + voxel*m_voxelSize;
+		const float voxelTop = voxelBottom + m_voxelSize;
+
+		float length = 0.0f;
+		float moment = 0.0f;
+
+		for(unsigned int i=0; i+1<crossings.size(); i+=2) {
+
+			const float low = std::max(crossings[i], voxelBottom);
+			const float high = std::min(crossings[i+1], voxelTop);
+
+			if(high > low) {
+				length += high - low;
+				moment += 0.5f*(high*high - low*low);
+			}
+		}
+
+		if(length > 0.0f) {
+			m_x.push_back(x);
+			m_y.push_back(moment/length);
+			m_z.push_back(z);
+			m_volumes.push_back(voxelArea*length);
+			m_volume += voxelArea*length;
+		}
+	}
+}
+
+/**
+ * World x and z of the samples
+ *
+ * @param  transform  body to world.
+ * @param  pX, pZ  getNumSamples() values each.
+ */
+void HullVoxelProxy::fillWorldPositions(const Matrix4x4& transform, float* pX, float* pZ)
+{
+	const float* m = transform.rawConst();
+	const int count = getNumSamples();
+
+	for(int i=0; i<count; i++) {
+		pX[i] = m_x[i]*m[0] + m_y[i]*m[4] + m_z[i]*m[8] + m[12];
+		pZ[i] = m_x[i]*m[2] + m_y[i]*m[6] + m_z[i]*m[10] + m[14];
+	}
+}
+
+/**
+ * Submerged volume and centre of buoyancy of the samples, the force acts along up at the centre of buoyancy.
+ * Same parameters and results as HullTriangleCache::computeBuoyancy, with one water height per sample.
+ *
+ * @param  pWaterlinePoints  receives the samples that are partly submerged, moved onto the water plane. May be NULL.
+ */
+void HullVoxelProxy::computeBuoyancy(const float* pWaterHeights, const Vector3& up, float translationY, HullTriangleCache::Buoyancy& buoyancy,
+	std::vector<Vector3>* pWaterlinePoints)
+{
+	const int count = getNumSamples();
+	const float invVoxelSize = 1.0f/m_voxelSize;
+
+	// double sums, fine voxelisations have millions of samples
+	double volume = 0.0;
+	double momentX = 0.0, momentY = 0.0, momentZ = 0.0;
+
+	for(int i=0; i<count; i++) {
+
+		const float depth = up[0]*m_x[i] + up[1]*m_y[i] + up[2]*m_z[i] - (pWaterHeights[i] - translationY);
+		const float submerged = std::min(std::max(0.5f - depth*invVoxelSize, 0.0f), 1.0f);
+		const float sampleVolume = submerged*m_volumes[i];
+
+		volume += sampleVolume;
+		momentX += sampleVolume*m_x[i];
+		momentY += sampleVolume*m_y[i];
+		momentZ += sampleVolume*m_z[i];
+
+		if((pWaterlinePoints != NULL) && (submerged > 0.0f) && (submerged < 1.0f)) {
+			pWaterlinePoints->push_back(Vector3(m_x[i] - depth*up[0], m_y[i] - depth*up[1], m_z[i] - depth*up[2]));
+		}
+	}
+
+	const Vector3 moment((float)momentX, (float)momentY, (float)momentZ);
+
+	buoyancy.volume = (float)volume;
+	buoyancy.pressureForce = up;
+	buoyancy.pressureForce.scale(buoyancy.volume);
+	buoyancy.pressureTorque.crossProduct(moment, up);
+
+	if(volume != 0.0) {
+		buoyancy.centreOfBuoyancy = Vector3((float)(momentX/volume), (float)(momentY/volume), (float)(momentZ/volume));
+	} else {
+		buoyancy.centreOfBuoyancy = Vector3(0.0f, 0.0f, 0.0f);
+	}
+}
@@ -0,0 +1,61 @@
+/** \class HullVoxelProxy
+ * Cheaper stand-in for the per triangle buoyancy of HullTriangleCache on detailed hulls: the hull is voxelised
+ * once at load into sample points with a volume each, so a step costs one water height and a few multiplies per
+ * sample instead of per triangle. Every sample is a slab of voxelSize along the water normal that is submerged
+ * linearly with its depth, the voxel size trades accuracy against the number of samples.
+ *
+ * Columns are cut by vertical rays through the hull, an odd number of crossings is closed at the top of the
+ * hull, which fills hulls that are open at the deck up to their rim.
+ *
+ * @author  Rahul Mukhi
+ * @date 17/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "HullTriangleCache.h"
+
+#include "base/math/Vector3.h"
+#include "base/math/Matrix4x4.h"
+
+#include <vector>
+
+class HullVoxelProxy
+{
+public:
+	HullVoxelProxy();
+	~HullVoxelProxy();
+
+	void build(HullTriangleCache& hull, float voxelSize);
+	void fillWorldPositions(const Matrix4x4& transform, float* pX, float* pZ);
+	void computeBuoyancy(const float* pWaterHeights, const Vector3& up, float translationY, HullTriangleCache::Buoyancy& buoyancy,
+		std::vector<Vector3>* pWaterlinePoints);
+
+	inline int getNumSamples()
+	{
+		return (int)m_volumes.size();
+	}
+
+	inline float getVoxelSize()
+	{
+		return m_voxelSize;
+	}
+
+	// volume of all samples, the hull volume up to the voxelisation error
+	inline float getVolume()
+	{
+		return (float)m_volume;
+	}
+
+private:
+
+	float m_voxelSize;
+	double m_volume; // summed in double, a float saturates over the many small samples of fine voxel sizes
+
+	// body space sample positions and volumes
+	std::vector<float> m_x, m_y, m_z, m_volumes;
+
+	void addColumn(float x, float z, std::vector<float>& crossings, float bottom, float top);
+};
@@ -0,0 +1,28 @@
+/** \class IWaveSpectrum
+ * Wave spectrum interface, gives the directional variance density and the dispersion the FFT ocean
+ * draws its initial amplitudes h0(k) and phase speeds from
+ *
+ * @author  Rahul Mukhi
+ * @date 12/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include <string>
+
+class IWaveSpectrum
+{
+public:
+	virtual ~IWaveSpectrum() {};
+
+	// variance of the surface height per unit area of wave number space at k = (kx, kz), in m^4
+	virtual float getDensity(float waveNumberX, float waveNumberZ) = 0;
+
+	// angular frequency of a wave with wave number |k|
+	virtual float getOmega(float waveNumber) = 0;
+
+	// name and parameters, two spectra with the same key give the same h0(k) for the same seed
+	virtual std::string getKey() = 0;
+};
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "InputTrace.h"
+
+#include "base/Prerequisites.h"
+
+const unsigned int InputTrace::MAGIC = GS_MAKEFOURCC('W', 'S', 'I', 'T');
+
+InputTrace::InputTrace()
+{
+	m_seed = 0;
+	m_numTicks = 0;
+}
+
+InputTrace::~InputTrace()
+{
+}
+
+void InputTrace::clear(unsigned int seed)
+{
+	m_events.clear();
+	m_seed = seed;
+	m_numTicks = 0;
+}
+
+void InputTrace::addEvent(const Event& event)
+{
+	m_events.push_back(event);
+
+	if(event.tick >= m_numTicks) {
+		m_numTicks = event.tick + 1;
+	}
+}
+
+bool InputTrace::save(const char* filename)
+{
+	// header: magic, version, seed, ticks, events
+	// events: tick delta (varint), type (byte), payload (varint keys, zigzag varint mouse, raw float drops)
+	std::vector<unsigned char> buffer;
+	buffer.reserve(20 + m_events.size()*4);
+
+	writeUInt(buffer, MAGIC);
+	writeUInt(buffer, VERSION);
+	writeUInt(buffer, m_seed);
+	writeUInt(buffer, m_numTicks);
+	writeUInt(buffer, (unsigned int)m_events.size());
+
+	unsigned int lastTick = 0;
+
+	for(unsigned int i=0; i<m_events.size(); i++) {
+
+		const Event& event = m_events[i];
+
+		writeVarInt(buffer, event.tick - lastTick);
+		lastTick = event.tick;
+
+		buffer.push_back((unsigned char)event.type);
+
+		switch(event.type) {
+
+			case EVENT_NORMAL_KEY_DOWN:
+			case EVENT_NORMAL_KEY_UP:
+			case EVENT_SPECIAL_KEY_DOWN:
+			case EVENT_SPECIAL_KEY_UP:
+				writeVarInt(buffer, (unsigned int)event.x);
+				break;
+
+			case EVENT_MOUSE_MOVE:
+				writeVarInt(buffer, encodeSigned(event.x));
+				writeVarInt(buffer, encodeSigned(event.y));
+				break;
+
+			case EVENT_DROP: {
+				unsigned int posX, posZ;
+				memcpy(&posX, &event.posX, sizeof(unsigned int));
+				memcpy(&posZ, &event.posZ, sizeof(unsigned int));
+				writeUInt(buffer, posX);
+				writeUInt(buffer, posZ);
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+
+	FILE* pFile = fopen(filename, "wb");
+
+	if(pFile == NULL) {
+		std::cout << "Could not write input trace " << filename << std::endl;
+		return false;
+	}
+
+	const size_t written = fwrite(&buffer[0], 1, buffer.size(), pFile);
+	fclose(pFile);
+
+	return written == buffer.size();
+}
+
+bool InputTrace::load(const char* filename)
+{
+	clear(0);
+
+	FILE* pFile = fopen(filename, "rb");
+
+	if(pFile == NULL) {
+		std::cout << "Could not open input trace " << filename << std::endl;
+		return false;
+	}
+
+	std::vector<unsigned char> buffer;
+	unsigned char block[4096];
+	size_t numRead;
+
+	while((numRead = fread(block, 1, sizeof(block), pFile)) > 0) {
+		buffer.insert(buffer.end(), block, block + numRead);
+	}
+
+	fclose(pFile);
+
+	if(buffer.empty()) {
+		return false;
+	}
+
+	const unsigned char* pData = &buffer[0];
+	const unsigned char* pEnd = pData + buffer.size();
+
+	unsigned int magic, version, numTicks, numEvents;
+
+	if(!readUInt(pData, pEnd, magic) || (magic != MAGIC) || !readUInt(pData, pEnd, version) || (version != VERSION)) {
+		std::cout << "Invalid input trace " << filename << std::endl;
+		return false;
+	}
+
+	if(!readUInt(pData, pEnd, m_seed) || !readUInt(pData, pEnd, numTicks) || !readUInt(pData, pEnd, numEvents)) {
+		std::cout << "Truncated input trace " << filename << std::endl;
+		return false;
+	}
+
+	m_events.reserve(numEvents);
+
+	unsigned int tick = 0;
+
+	for(unsigned int i=0; i<numEvents; i++) {
+
+		Event event;
+		unsigned int tickDelta, value;
+
+		if(!readVarInt(pData, pEnd, tickDelta) || (pData >= pEnd) || (*pData >= NUM_EVENT_TYPES)) {
+			std::cout << "Truncated input trace " << filename << std::endl;
+			return false;
+		}
+
+		tick += tickDelta;
+
+		event.tick = tick;
+		event.type = (EventType)*pData;
+		event.x = event.y = 0;
+		event.posX = event.posZ = .0f;
+		pData++;
+
+		bool valid = true;
+
+		switch(event.type) {
+
+			case EVENT_NORMAL_KEY_DOWN:
+			case EVENT_NORMAL_KEY_UP:
+			case EVENT_SPECIAL_KEY_DOWN:
+			case EVENT_SPECIAL_KEY_UP:
+				valid = readVarInt(pData, pEnd, value);
+				event.x = (int)value;
+				break;
+
+			case EVENT_MOUSE_MOVE:
+				valid = readVarInt(pData, pEnd, value);
+				event.x = decodeSigned(value);
+				valid = valid && readVarInt(pData, pEnd, value);
+				event.y = decodeSigned(value);
+				break;
+
+			case EVENT_DROP:
+				valid = readUInt(pData, pEnd, value);
+				memcpy(&event.posX, &value, sizeof(float));
+				valid = valid && readUInt(pData, pEnd, value);
+				memcpy(&event.posZ, &value, sizeof(float));
+				break;
+
+			default:
+				break;
+		}
+
+		if(!valid) {
+			std::cout << "Truncated input trace " << filename << std::endl;
+			return false;
+		}
+
+		m_events.push_back(event);
+	}
+
+	m_numTicks = numTicks;
+
+	return true;
+}
+
+void InputTrace::writeVarInt(std::vector<unsigned char>& buffer, unsigned int value)
+{
+	while(value >= 0x80) {
+		buffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+
+	buffer.push_back((unsigned char)value);
+}
+
+void InputTrace::writeUInt(std::vector<unsigned char>& buffer, unsigned int value)
+{
+	// little endian independent of the platform
+	buffer.push_back((unsigned char)(value & 0xFF));
+	buffer.push_back((unsigned char)((value >> 8) & 0xFF));
+	buffer.push_back((unsigned char)((value >> 16) & 0xFF));
+	buffer.push_back((unsigned char)((value >> 24) & 0xFF));
+}
+
+bool InputTrace::readVarInt(const unsigned char*& pData, const unsigned char* pEnd, unsigned int& value)
+{
+	value = 0;
+
+	for(unsigned int shift=0; shift<35; shift+=7) {
+
+		if(pData >= pEnd) {
+			return false;
+		}
+
+		const unsigned char byte = *pData;
+		pData++;
+
+		value |= (unsigned int)(byte & 0x7F) << shift;
+
+		if((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool InputTrace::readUInt(const unsigned char*& pData, const unsigned char* pEnd, unsigned int& value)
+{
+	if(pEnd - pData < 4) {
+		return false;
+	}
+
+	value = (unsigned int)pData[0] | ((unsigned int)pData[1] << 8) | ((unsigned int)pData[2] << 16) | ((unsigned int)pData[3] << 24);
+	pData += 4;
+
+	return true;
+}
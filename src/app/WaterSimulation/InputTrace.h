@@ -0,0 +1,93 @@
+/** \class InputTrace
+ * Timestamped input events of a session in a compact binary trace, used for deterministic replays
+ *
+ * @author  Rahul Mukhi
+ * @date 21/05/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include <vector>
+
+class InputTrace
+{
+public:
+	InputTrace();
+	~InputTrace();
+
+	enum EventType
+	{
+		EVENT_NORMAL_KEY_DOWN,
+		EVENT_NORMAL_KEY_UP,
+		EVENT_SPECIAL_KEY_DOWN,
+		EVENT_SPECIAL_KEY_UP,
+		EVENT_MOUSE_MOVE,
+		EVENT_DROP,
+		NUM_EVENT_TYPES
+	};
+
+	struct Event
+	{
+		unsigned int tick; // simulation tick the event is applied before
+		EventType type;
+		int x, y; // key in x, mouse position in x and y
+		float posX, posZ; // world position of drops
+	};
+
+	static const unsigned int MAGIC;
+	static const unsigned int VERSION = 1;
+
+	void clear(unsigned int seed);
+	void addEvent(const Event& event);
+
+	bool save(const char* filename);
+	bool load(const char* filename);
+
+	inline unsigned int getSeed()
+	{
+		return m_seed;
+	}
+
+	inline unsigned int getNumTicks()
+	{
+		return m_numTicks;
+	}
+
+	inline void setNumTicks(unsigned int numTicks)
+	{
+		m_numTicks = numTicks;
+	}
+
+	inline unsigned int getNumEvents()
+	{
+		return (unsigned int)m_events.size();
+	}
+
+	inline const Event& getEvent(unsigned int i)
+	{
+		return m_events[i];
+	}
+
+private:
+
+	std::vector<Event> m_events;
+	unsigned int m_seed, m_numTicks;
+
+	static void writeVarInt(std::vector<unsigned char>& buffer, unsigned int value);
+	static void writeUInt(std::vector<unsigned char>& buffer, unsigned int value);
+	static bool readVarInt(const unsigned char*& pData, const unsigned char* pEnd, unsigned int& value);
+	static bool readUInt(const unsigned char*& pData, const unsigned char* pEnd, unsigned int& value);
+
+	// zigzag mapping so small negative mouse coordinates stay short
+	static inline unsigned int encodeSigned(int value)
+	{
+		return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+	}
+
+	static inline int decodeSigned(unsigned int value)
+	{
+		return (int)(value >> 1) ^ -(int)(value & 1);
+	}
+};
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "JonswapSpectrum.h"
+
+const float JonswapSpectrum::FETCH = 100000.0f;
+const float JonswapSpectrum::GAMMA = 3.3f;
+
+JonswapSpectrum::JonswapSpectrum(float windSpeed, float fetch, float gamma) :
+	FrequencySpectrum(windSpeed, 0.0f),
+	m_fetch(fetch),
+	m_gamma(gamma)
+{
+}
+
+JonswapSpectrum::JonswapSpectrum(float windSpeed, float fetch, float gamma, float depth) :
+	FrequencySpectrum(windSpeed, depth),
+	m_fetch(fetch),
+	m_gamma(gamma)
+{
+}
+
+JonswapSpectrum::~JonswapSpectrum()
+{
+}
+
+float JonswapSpectrum::getFrequencyDensity(float omega)
+{
+	const float alpha = 0.076f*pow(m_windSpeed*m_windSpeed/(m_fetch*GRAVITY), 0.22f);
+	const float peakOmega = 22.0f*pow(GRAVITY*GRAVITY/(m_windSpeed*m_fetch), 1.0f/3.0f);
+	const float sigma = (omega <= peakOmega) ? 0.07f : 0.09f;
+	const float ratio = peakOmega/omega;
+	const float peakDistance = (omega - peakOmega)/(sigma*peakOmega);
+
+	const float peakEnhancement = pow(m_gamma, exp(-0.5f*peakDistance*peakDistance));
+
+	return alpha*GRAVITY*GRAVITY/pow(omega, 5.0f)*exp(-1.25f*ratio*ratio*ratio*ratio)*peakEnhancement;
+}
+
+std::string JonswapSpectrum::getParameterKey()
+{
+	std::ostringstream key;
+	key.precision(9);
+	key << getDirectionKey() << "_" << m_fetch << "_" << m_gamma;
+
+	return key.str();
+}
+
+std::string JonswapSpectrum::getKey()
+{
+	return "jonswap_" + getParameterKey();
+}
@@ -0,0 +1,37 @@
+/** \class JonswapSpectrum
+ * JONSWAP spectrum of a fetch limited deep water sea: Pierson-Moskowitz shape with the peak enhanced by
+ * gamma^r, r = exp(-(omega-omegaPeak)^2/(2*sigma^2*omegaPeak^2)). alpha and omegaPeak follow from the
+ * wind speed U 10 m above the surface and the fetch F (Hasselmann et al. 1973).
+ *
+ * @author  Rahul Mukhi
+ * @date 12/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "FrequencySpectrum.h"
+
+class JonswapSpectrum : public FrequencySpectrum
+{
+public:
+	JonswapSpectrum(float windSpeed, float fetch = FETCH, float gamma = GAMMA);
+	virtual ~JonswapSpectrum();
+
+	static const float FETCH; // meters
+	static const float GAMMA; // peak enhancement
+
+	virtual std::string getKey();
+
+protected:
+
+	float m_fetch;
+	float m_gamma;
+
+	// for TMASpectrum, which only adds the depth
+	JonswapSpectrum(float windSpeed, float fetch, float gamma, float depth);
+
+	virtual float getFrequencyDensity(float omega);
+	std::string getParameterKey();
+};
@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "OceanAnimationCache.h"
+#include "HeightFieldRecorder.h"
+
+#include "base/Prerequisites.h"
+#include "base/io/MappedFile.h"
+
+const unsigned int OceanAnimationCache::MAGIC = GS_MAKEFOURCC('W', 'S', 'O', 'C');
+
+OceanAnimationCache::OceanAnimationCache()
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+OceanAnimationCache::~OceanAnimationCache()
+{
+}
+
+void OceanAnimationCache::clear()
+{
+	memset(&m_header, 0, sizeof(m_header));
+	m_normals.clear();
+	m_displacements.clear();
+}
+
+void OceanAnimationCache::initHeader(FFTSimulation* pSimulation, unsigned int numFrames)
+{
+	memset(&m_header, 0, sizeof(m_header));
+	m_header.magic = MAGIC;
+	m_header.version = VERSION;
+	m_header.gridSize = pSimulation->getGridSize();
+	m_header.numFrames = numFrames;
+	m_header.period = pSimulation->getRepeatPeriod();
+	m_header.patchSize = pSimulation->getPatchSize();
+	m_header.minWaveNumber = pSimulation->getMinWaveNumber();
+	m_header.maxWaveNumber = pSimulation->getMaxWaveNumber();
+	m_header.spectrumKeyHash = FFTSimulation::hashKey(pSimulation->getWaveSpectrumKey());
+	m_header.seed = pSimulation->getRandomSeed();
+}
+
+/**
+ * Samples one repeat period of the simulation at numFrames evenly spaced times. The simulation
+ * must be initialised with a repeat period, it is left at the time of the last frame.
+ *
+ * @param  pSimulation  initialised simulation with getRepeatPeriod() > 0.
+ * @param  numFrames  frames per period.
+ * @return false if the simulation does not loop.
+ */
+bool OceanAnimationCache::build(FFTSimulation* pSimulation, unsigned int numFrames)
+{
+	clear();
+
+	if((pSimulation->getRepeatPeriod() <= 0.0f) || (numFrames == 0)) {
+		std::cout << "Ocean animation cache needs a repeat period and at least one frame" << std::endl;
+		return false;
+	}
+
+	const unsigned int numCells = pSimulation->getGridSize()*pSimulation->getGridSize();
+	const float period = pSimulation->getRepeatPeriod();
+
+	if(numFrames < period*MIN_FRAMES_PER_SECOND) {
+		std::cout << "Ocean animation cache: " << numFrames << " frames over " << period << " s interpolate fast waves poorly, use at least "
+			<< (unsigned int)ceil(period*MIN_FRAMES_PER_SECOND) << std::endl;
+	}
+
+	m_normals.resize(numFrames*numCells*4);
+	std::vector<float> displacements(numFrames*numCells*3);
+
+	// stored without choppiness, playback applies the current one
+	const float choppiness = pSimulation->getChoppiness();
+	pSimulation->setChoppiness(1.0f);
+
+	float maxDisplacement = 0.0f;
+
+	for(unsigned int frame=0; frame<numFrames; frame++) {
+
+		pSimulation->update(frame*period/numFrames);
+		pSimulation->calculateAndFillNormals(&m_normals[frame*numCells*4]);
+		pSimulation->fillDisplacements(&displacements[frame*numCells*3]);
+
+		for(unsigned int i=frame*numCells*3; i<(frame+1)*numCells*3; i++) {
+			maxDisplacement = std::max(maxDisplacement, fabs(displacements[i]));
+		}
+	}
+
+	pSimulation->setChoppiness(choppiness);
+
+	initHeader(pSimulation, numFrames);
+	m_header.displacementStep = std::max(maxDisplacement, 1.0e-6f)/32767.0f;
+
+	m_displacements.resize(displacements.size());
+
+	for(size_t i=0; i<displacements.size(); i++) {
+		m_displacements[i] = HeightFieldRecorder::quantize(displacements[i], 0.0f, m_header.displacementStep);
+	}
+
+	std::cout << "Built ocean animation cache: " << numFrames << " frames of " << pSimulation->getGridSize() << "x" << pSimulation->getGridSize()
+		<< ", " << getMemorySize()/(1024*1024) << " MB" << std::endl;
+
+	return true;
+}
+
+/**
+ * Loads frames saved for a simulation with the same grid size, patch, band, wave spectrum, seed and repeat period
+ *
+ * @param  filename  file written by save().
+ * @param  pSimulation  simulation the frames replace, only its settings are compared.
+ * @param  numFrames  expected frames per period.
+ * @return false if the file is missing or was made for other settings.
+ */
+bool OceanAnimationCache::load(const char* filename, FFTSimulation* pSimulation, unsigned int numFrames)
+{
+	clear();
+
+	MappedFile file;
+
+	if(!file.open(filename, MappedFile::ACCESS_READ) || (file.getSize() < sizeof(FileHeader))) {
+		return false;
+	}
+
+	initHeader(pSimulation, numFrames);
+	const FileHeader expected = m_header;
+
+	const FileHeader* pHeader = (const FileHeader*)file.getData();
+	const unsigned int numCells = pHeader->gridSize*pHeader->gridSize;
+	const size_t normalsSize = size_t(pHeader->numFrames)*numCells*4;
+	const size_t displacementsSize = size_t(pHeader->numFrames)*numCells*3*sizeof(short);
+
+	if((pHeader->magic != expected.magic) || (pHeader->version != expected.version) || (pHeader->gridSize != expected.gridSize)
+		|| (pHeader->numFrames != expected.numFrames) || (pHeader->period != expected.period) || (pHeader->patchSize != expected.patchSize)
+		|| (pHeader->minWaveNumber != expected.minWaveNumber) || (pHeader->maxWaveNumber != expected.maxWaveNumber)
+		|| (pHeader->spectrumKeyHash != expected.spectrumKeyHash) || (pHeader->seed != expected.seed)
+		|| (file.getSize() != sizeof(FileHeader) + normalsSize + displacementsSize)) {
+
+		std::cout << "Ignoring ocean animation cache " << filename << ", made for other settings" << std::endl;
+		clear();
+		return false;
+	}
+
+	m_header = *pHeader;
+
+	const unsigned char* pData = file.getData() + sizeof(FileHeader);
+
+	m_normals.assign(pData, pData + normalsSize);
+	m_displacements.resize(numFrames*numCells*3);
+	memcpy(&m_displacements[0], pData + normalsSize, displacementsSize);
+
+	std::cout << "Loaded ocean animation cache " << filename << std::endl;
+
+	return true;
+}
+
+bool OceanAnimationCache::save(const char* filename)
+{
+	if(!isValid()) {
+		return false;
+	}
+
+	const size_t normalsSize = m_normals.size();
+	const size_t displacementsSize = m_displacements.size()*sizeof(short);
+
+	MappedFile file;
+
+	if(!file.open(filename, MappedFile::ACCESS_READ_WRITE, sizeof(FileHeader) + normalsSize + displacementsSize)) {
+		std::cout << "Could not write ocean animation cache " << filename << std::endl;
+		return false;
+	}
+
+	unsigned char* pData = file.getData();
+
+	memcpy(pData, &m_header, sizeof(FileHeader));
+	memcpy(pData + sizeof(FileHeader), &m_normals[0], normalsSize);
+	memcpy(pData + sizeof(FileHeader) + normalsSize, &m_displacements[0], displacementsSize);
+
+	file.close();
+
+	return true;
+}
+
+void OceanAnimationCache::getFrames(float time, unsigned int& frame0, unsigned int& frame1, float& weight)
+{
+	float loopTime = fmod(time, m_header.period);
+	if(loopTime < 0.0f) {
+		loopTime += m_header.period;
+	}
+
+	const float position = loopTime/m_header.period*m_header.numFrames;
+
+	frame0 = std::min((unsigned int)position, m_header.numFrames-1);
+	frame1 = (frame0 + 1) % m_header.numFrames;
+	weight = std::min(std::max(position - frame0, 0.0f), 1.0f);
+}
+
+/**
+ * Normal map at the given time, interpolated between the two nearest frames
+ *
+ * @param  time  seconds, wraps around the period.
+ * @param  pNormals  gridSize*gridSize*4 bytes, same layout as FFTSimulation::calculateAndFillNormals.
+ */
+void OceanAnimationCache::fillNormals(float time, unsigned char* pNormals)
+{
+	unsigned int frame0, frame1;
+	float weight;
+	getFrames(time, frame0, frame1, weight);
+
+	const unsigned int frameSize = m_header.gridSize*m_header.gridSize*4;
+	const unsigned char* GS_RESTRICT pFrame0 = &m_normals[frame0*frameSize];
+	const unsigned char* GS_RESTRICT pFrame1 = &m_normals[frame1*frameSize];
+
+	// 8 bit fixed point weights, (a*(256-w) + b*w) >> 8 fits in 16 bits
+	const unsigned short weight1 = (unsigned short)(weight*256.0f + 0.5f);
+	const unsigned short weight0 = 256 - weight1;
+	unsigned int i = 0;
+
+#if defined(GS_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weight0x8 = _mm_set1_epi16((short)weight0);
+	const __m128i weight1x8 = _mm_set1_epi16((short)weight1);
+
+	for(; i+16 <= frameSize; i += 16)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i*)(pFrame0 + i));
+		const __m128i b = _mm_loadu_si128((const __m128i*)(pFrame1 + i));
+
+		const __m128i low = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), weight0x8), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), weight1x8)), 8);
+		const __m128i high = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), weight0x8), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), weight1x8)), 8);
+
+		_mm_storeu_si128((__m128i*)(pNormals + i), _mm_packus_epi16(low, high));
+	}
+#endif
+
+	for(; i<frameSize; i++) {
+		pNormals[i] = (unsigned char)((pFrame0[i]*weight0 + pFrame1[i]*weight1) >> 8);
+	}
+}
+
+/**
+ * Displacement map at the given time, interpolated between the two nearest frames
+ *
+ * @param  time  seconds, wraps around the period.
+ * @param  choppiness  scale of the horizontal displacement.
+ * @param  pDisplacements  gridSize*gridSize*3 floats, same layout as FFTSimulation::fillDisplacements.
+ */
+void OceanAnimationCache::fillDisplacements(float time, float choppiness, float* pDisplacements)
+{
+	unsigned int frame0, frame1;
+	float weight;
+	getFrames(time, frame0, frame1, weight);
+
+	const unsigned int numCells = m_header.gridSize*m_header.gridSize;
+	const short* GS_RESTRICT pFrame0 = &m_displacements[frame0*numCells*3];
+	const short* GS_RESTRICT pFrame1 = &m_displacements[frame1*numCells*3];
+
+	const float step0 = (1.0f - weight)*m_header.displacementStep;
+	const float step1 = weight*m_header.displacementStep;
+
+	for(unsigned int i=0; i<numCells; i++) {
+		pDisplacements[3*i] = choppiness*(pFrame0[3*i]*step0 + pFrame1[3*i]*step1);
+		pDisplacements[3*i+1] = pFrame0[3*i+1]*step0 + pFrame1[3*i+1]*step1;
+		pDisplacements[3*i+2] = choppiness*(pFrame0[3*i+2]*step0 + pFrame1[3*i+2]*step1);
+	}
+}
+
+/**
+ * Field array of FFTSimulation::getFields() at the given time, for sampling a cached cascade. Heights and
+ * displacements are interpolated like fillDisplacements, the slopes are recovered from the 8 bit normal maps
+ * and the velocities are the rate of the interpolated displacements between the two frames.
+ *
+ * @param  time  seconds, wraps around the period.
+ * @param  pFields  FFTSimulation::NUM_FIELDS*gridSize*gridSize floats, displacements without choppiness.
+ */
+void OceanAnimationCache::fillFields(float time, float* pFields)
+{
+	unsigned int frame0, frame1;
+	float weight;
+	getFrames(time, frame0, frame1, weight);
+
+	const unsigned int numCells = m_header.gridSize*m_header.gridSize;
+	const short* GS_RESTRICT pDisplacements0 = &m_displacements[frame0*numCells*3];
+	const short* GS_RESTRICT pDisplacements1 = &m_displacements[frame1*numCells*3];
+	const unsigned char* GS_RESTRICT pNormals0 = &m_normals[frame0*numCells*4];
+	const unsigned char* GS_RESTRICT pNormals1 = &m_normals[frame1*numCells*4];
+
+	const float step0 = (1.0f - weight)*m_header.displacementStep;
+	const float step1 = weight*m_header.displacementStep;
+	const float byteScale0 = (1.0f - weight)/127.5f;
+	const float byteScale1 = weight/127.5f;
+	const float rateScale = m_header.displacementStep*m_header.numFrames/m_header.period;
+
+	for(unsigned int i=0; i<numCells; i++) {
+		float* pField = pFields + FFTSimulation::NUM_FIELDS*i;
+
+		pField[FFTSimulation::FIELD_DISPLACEMENT_X] = pDisplacements0[3*i]*step0 + pDisplacements1[3*i]*step1;
+		pField[FFTSimulation::FIELD_HEIGHT] = pDisplacements0[3*i+1]*step0 + pDisplacements1[3*i+1]*step1;
+		pField[FFTSimulation::FIELD_DISPLACEMENT_Z] = pDisplacements0[3*i+2]*step0 + pDisplacements1[3*i+2]*step1;
+		pField[FFTSimulation::FIELD_VELOCITY_X] = (pDisplacements1[3*i] - pDisplacements0[3*i])*rateScale;
+		pField[FFTSimulation::FIELD_VELOCITY_Z] = (pDisplacements1[3*i+2] - pDisplacements0[3*i+2])*rateScale;
+
+		// normal (slopeX, 1, -slopeZ)*scale/length, see FFTSimulation::calculateAndFillNormals
+		const float normalX = pNormals0[4*i]*byteScale0 + pNormals1[4*i]*byteScale1 - 1.0f;
+		const float normalZ = pNormals0[4*i+1]*byteScale0 + pNormals1[4*i+1]*byteScale1 - 1.0f;
+		const float normalY = std::max(pNormals0[4*i+2]*byteScale0 + pNormals1[4*i+2]*byteScale1 - 1.0f, 0.1f);
+
+		pField[FFTSimulation::FIELD_SLOPE_X] = normalX/(normalY*FFTSimulation::NORMAL_SLOPE_SCALE);
+		pField[FFTSimulation::FIELD_SLOPE_Z] = -normalZ/(normalY*FFTSimulation::NORMAL_SLOPE_SCALE);
+	}
+}
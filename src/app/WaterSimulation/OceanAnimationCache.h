@@ -0,0 +1,83 @@
+/** \class OceanAnimationCache
+ * Precomputed loop of a FFTSimulation with a repeat period: numFrames normal maps (RGBA8) and displacement
+ * maps (16 bit quantized x, height, z) over one period, played back with linear interpolation between
+ * frames. The per frame cost is then an interpolated copy instead of spectrum, FFT and normals.
+ * The frames can be stored in a file and loaded on the next start.
+ *
+ * @author  Rahul Mukhi
+ * @date 11/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "FFTSimulation.h"
+
+#include <vector>
+
+class OceanAnimationCache
+{
+public:
+	OceanAnimationCache();
+	~OceanAnimationCache();
+
+	// file layout: FileHeader, normal maps of all frames, displacement maps of all frames
+	struct FileHeader
+	{
+		unsigned int magic, version;
+		unsigned int gridSize;
+		unsigned int numFrames;
+		float period;
+		float patchSize;
+		float minWaveNumber, maxWaveNumber;
+		float displacementStep; // quantization step of the displacements
+		unsigned int spectrumKeyHash; // FFTSimulation::hashKey of the wave spectrum key
+		unsigned int seed; // FFTSimulation::getRandomSeed, other seeds give other waves of the same spectrum
+		unsigned int reserved;
+	};
+
+	static const unsigned int MAGIC;
+	static const unsigned int VERSION = 3;
+	static const unsigned int MIN_FRAMES_PER_SECOND = 30; // fastest waves turn about 0.6 rad per frame, fewer frames visibly blur them
+
+	bool build(FFTSimulation* pSimulation, unsigned int numFrames);
+	bool load(const char* filename, FFTSimulation* pSimulation, unsigned int numFrames);
+	bool save(const char* filename);
+
+	void fillNormals(float time, unsigned char* pNormals);
+	void fillDisplacements(float time, float choppiness, float* pDisplacements);
+	void fillFields(float time, float* pFields);
+
+	inline bool isValid()
+	{
+		return m_header.numFrames > 0;
+	}
+
+	inline unsigned int getNumFrames()
+	{
+		return m_header.numFrames;
+	}
+
+	inline float getPeriod()
+	{
+		return m_header.period;
+	}
+
+	// bytes of all frames in memory
+	inline size_t getMemorySize()
+	{
+		return m_normals.size() + m_displacements.size()*sizeof(short);
+	}
+
+private:
+
+	FileHeader m_header;
+
+	std::vector<unsigned char> m_normals; // 4*gridSize^2 bytes per frame
+	std::vector<short> m_displacements; // 3*gridSize^2 values per frame
+
+	void clear();
+	void initHeader(FFTSimulation* pSimulation, unsigned int numFrames);
+	void getFrames(float time, unsigned int& frame0, unsigned int& frame1, float& weight);
+};
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "PhillipsSpectrum.h"
+
+const float PhillipsSpectrum::AMPLITUDE = 0.0081f;
+const float PhillipsSpectrum::WIND_SPEED = 10.0f;
+const float PhillipsSpectrum::SUPPRESSION_LENGTH = 0.1f;
+const float PhillipsSpectrum::GRAVITY = 9.81f;
+
+PhillipsSpectrum::PhillipsSpectrum(float amplitude, float windSpeed, float suppressionLength) :
+	m_amplitude(amplitude),
+	m_windSpeed(windSpeed),
+	m_windDirectionX(1.0f),
+	m_windDirectionZ(0.0f),
+	m_suppressionLength(suppressionLength)
+{
+}
+
+PhillipsSpectrum::~PhillipsSpectrum()
+{
+}
+
+void PhillipsSpectrum::setWind(float windSpeed, float directionX, float directionZ)
+{
+	const float length = sqrt(directionX*directionX + directionZ*directionZ);
+
+	m_windSpeed = windSpeed;
+
+	if(length > 0.0f) {
+		m_windDirectionX = directionX/length;
+		m_windDirectionZ = directionZ/length;
+	}
+}
+
+float PhillipsSpectrum::getDensity(float waveNumberX, float waveNumberZ)
+{
+	const float waveNumberSquared = waveNumberX*waveNumberX + waveNumberZ*waveNumberZ;
+
+	if(waveNumberSquared == 0.0f) {
+		return 0.0f;
+	}
+
+	const float largestWave = m_windSpeed*m_windSpeed/GRAVITY;
+	const float cosine = (waveNumberX*m_windDirectionX + waveNumberZ*m_windDirectionZ)/sqrt(waveNumberSquared);
+
+	float density = m_amplitude*exp(-1.0f/(waveNumberSquared*largestWave*largestWave));
+	density /= waveNumberSquared*waveNumberSquared;
+	density *= cosine*cosine;
+	density *= exp(-waveNumberSquared*m_suppressionLength*m_suppressionLength);
+
+	return density;
+}
+
+float PhillipsSpectrum::getOmega(float waveNumber)
+{
+	return sqrt(GRAVITY*waveNumber);
+}
+
+std::string PhillipsSpectrum::getKey()
+{
+	std::ostringstream key;
+	key.precision(9);
+	key << "phillips_" << m_amplitude << "_" << m_windSpeed << "_" << m_windDirectionX << "_" << m_windDirectionZ << "_" << m_suppressionLength;
+
+	return key.str();
+}
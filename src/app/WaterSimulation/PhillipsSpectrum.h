@@ -0,0 +1,35 @@
+/** \class PhillipsSpectrum
+ * Phillips spectrum A*exp(-1/(k*L)^2)/k^4*cos^2(theta)*exp(-k^2*l^2) of a wind driven deep water sea,
+ * L = V^2/g is the largest wave the wind speed V builds and l suppresses waves shorter than it
+ *
+ * @author  Rahul Mukhi
+ * @date 12/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "IWaveSpectrum.h"
+
+class PhillipsSpectrum : public IWaveSpectrum
+{
+public:
+	PhillipsSpectrum(float amplitude = AMPLITUDE, float windSpeed = WIND_SPEED, float suppressionLength = SUPPRESSION_LENGTH);
+	virtual ~PhillipsSpectrum();
+
+	static const float AMPLITUDE, WIND_SPEED, SUPPRESSION_LENGTH, GRAVITY;
+
+	void setWind(float windSpeed, float directionX, float directionZ);
+
+	virtual float getDensity(float waveNumberX, float waveNumberZ);
+	virtual float getOmega(float waveNumber);
+	virtual std::string getKey();
+
+private:
+
+	float m_amplitude;
+	float m_windSpeed;
+	float m_windDirectionX, m_windDirectionZ;
+	float m_suppressionLength;
+};
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "PiersonMoskowitzSpectrum.h"
+
+const float PiersonMoskowitzSpectrum::ALPHA = 0.0081f;
+
+PiersonMoskowitzSpectrum::PiersonMoskowitzSpectrum(float windSpeed) :
+	FrequencySpectrum(windSpeed, 0.0f)
+{
+}
+
+PiersonMoskowitzSpectrum::~PiersonMoskowitzSpectrum()
+{
+}
+
+float PiersonMoskowitzSpectrum::getFrequencyDensity(float omega)
+{
+	const float peakOmega = 0.855f*GRAVITY/m_windSpeed;
+	const float ratio = peakOmega/omega;
+
+	return ALPHA*GRAVITY*GRAVITY/pow(omega, 5.0f)*exp(-1.25f*ratio*ratio*ratio*ratio);
+}
+
+std::string PiersonMoskowitzSpectrum::getKey()
+{
+	return "piersonMoskowitz_" + getDirectionKey();
+}
@@ -0,0 +1,28 @@
+/** \class PiersonMoskowitzSpectrum
+ * Pierson-Moskowitz spectrum of a fully developed deep water sea, alpha*g^2/omega^5*exp(-5/4*(omegaPeak/omega)^4)
+ * with omegaPeak = 0.855*g/U for the wind speed U 19.5 m above the surface
+ *
+ * @author  Rahul Mukhi
+ * @date 12/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "FrequencySpectrum.h"
+
+class PiersonMoskowitzSpectrum : public FrequencySpectrum
+{
+public:
+	PiersonMoskowitzSpectrum(float windSpeed);
+	virtual ~PiersonMoskowitzSpectrum();
+
+	static const float ALPHA; // Phillips constant
+
+	virtual std::string getKey();
+
+protected:
+
+	virtual float getFrequencyDensity(float omega);
+};
@@ -35,6 +35,7 @@ void PortScene::initialize()
 	m_portScene.objectLoader(filename);
 
 	calculateHeightForLowLevelGrid();
+	buildCollisionTree();
 
 	unsigned char *textureBuffer;
 	FILE *textureFile;
@@ -74,6 +75,18 @@ void PortScene::initialize()
 	createVBO();
 }
 
+// the group vertex data is triangulated in world space, 8 floats per vertex with the position first
+void PortScene::buildCollisionTree()
+{
+	m_collisionTree.clear();
+
+	for(unsigned int k=0; k<m_portScene.m_groups.size(); k++) {
+		m_collisionTree.addTriangles(m_portScene.m_groups[k].vertexData, (int)m_portScene.m_groups[k].faces.size(), 8);
+	}
+
+	m_collisionTree.build();
+}
+
 void PortScene::calculateHeightForLowLevelGrid() 
 {
 	float GridLength;
@@ -295,7 +308,7 @@ void PortScene::calculateMaxGroundHeight(float GridLength)
 
 }
 
-float PortScene::getGroundHeight(float x, float z) {
+float PortScene::getGroundHeight(float x, float z) const {
 
 	float groundHeight = -100.0f;
 
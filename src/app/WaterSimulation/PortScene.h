@@ -7,7 +7,10 @@
  * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
  */
 
+#pragma once
+
 #include "ObjReader.h"
+#include "TriangleBVH.h"
 #include "glew/glew.h"
 #include "glut/glut.h"
 #include "base/2d/PNGUtil.h"
@@ -25,7 +28,13 @@ public:
 	~PortScene();
 
 	void renderPort();
-	float getGroundHeight(float x, float z);
+	float getGroundHeight(float x, float z) const; // read only, safe to call from several simulations in parallel
+
+	// world triangles of all groups for the collision queries of the boat, read only like getGroundHeight
+	inline const TriangleBVH& getCollisionTree() const
+	{
+		return m_collisionTree;
+	}
 
 private:
 	void initialize();
@@ -40,7 +49,10 @@ private:
 	float m_cellEdge, m_uniformGridCellEdge, m_Xmax, m_Zmax;
 	uniformGrid *m_uniformGrid;
 
+	TriangleBVH m_collisionTree;
+
 	void createVBO();
+	void buildCollisionTree();
 	void calculateHeightForLowLevelGrid();
 	void partitionTriangleInUniformGrid(float &GridLength);
 	void calculateMaxGroundHeight(float GridLength);
@@ -9,6 +9,19 @@ const float RigidBody::LINEAR_CONSTANT = 2.0f;
 const float RigidBody::SCALE = 0.05f;
 const float RigidBody::WATER_DENSITY = 1.0f;
 const float RigidBody::PI_BY_180 = 3.14159265f/180.0f;
+const float RigidBody::SUBSTEP = 0.01f;
+const float RigidBody::LINEAR_DRAG = 4.0f; // 1/s, horizontal velocity towards the driven one
+const float RigidBody::HEAVE_DAMPING = 1.7f; // 1/s
+const float RigidBody::ANGULAR_DRAG = 4.0f; // 1/s, yaw rate towards the steered one
+const float RigidBody::ROLL_DAMPING = 1.0f; // 1/s, roll and pitch rate
+const int RigidBody::MAX_SUBSTEPS = 10;
+const float RigidBody::CONTACT_SKIN = 0.01f; // distance the hull stops in front of the port
+const float RigidBody::RESTITUTION = 0.2f;
+const int RigidBody::MAX_CONTACT_ITERATIONS = 4;
+const float RigidBody::DEFAULT_VOXEL_FRACTION = 0.25f;
+const float RigidBody::COLLINEAR_TOLERANCE = 1.0e-5f;
+RigidBody::BuoyancyModel RigidBody::m_buoyancyModel = RigidBody::BUOYANCY_EXACT;
+float RigidBody::m_voxelSize = 0.0f;
 
 RigidBody::RigidBody(WaterSimulation& waterSimulation, Camera& camera)
 {
@@ -23,390 +36,413 @@ RigidBody::~RigidBody()
 
 void RigidBody::initialize()
 {
-	std::string filename ("Data/boatHull01.obj");
-	m_rigidBody.objectLoader(filename);
+	loadHull(m_rigidBody, m_hullTriangles);
+
+	m_changeRotAngle = 0.0f;
+	m_speed = 0.0f;
+	m_timeAccumulator = 0.0f;
 
-	float minY, maxY;
+	const Vector3 translate(0.0f, m_pWaterSimulation->TOTAL_HEIGHT - 2.0f, 0.0f);
+	RigidBodyIntegrator::initializeState(m_state, translate, Quaternion(180.0f*PI_BY_180, Vector3(0.0f, 1.0f, 0.0f)));
 
-	m_rigidBody.m_vertices[0].v[0]*= SCALE;
-	m_rigidBody.m_vertices[0].v[1]*= SCALE;
-	m_rigidBody.m_vertices[0].v[2]*= SCALE;
+	m_centreOfBuoyancy = Vector3(0.0f, 0.0f, 0.0f);
 
-	minY = maxY = m_rigidBody.m_vertices[0].v[1];
+	m_hullMinimum = m_rigidBody.m_vertices.empty() ? Vector3(0.0f, 0.0f, 0.0f) : m_rigidBody.m_vertices[0];
+	m_hullMaximum = m_hullMinimum;
 
 	for(int i=1; i<m_rigidBody.m_vertices.size(); i++) {
+		for(int axis=0; axis<3; axis++) {
+			m_hullMinimum[axis] = std::min(m_hullMinimum[axis], m_rigidBody.m_vertices[i].v[axis]);
+			m_hullMaximum[axis] = std::max(m_hullMaximum[axis], m_rigidBody.m_vertices[i].v[axis]);
+		}
+	}
 
-		m_rigidBody.m_vertices[i].v[0]*= SCALE;
-		m_rigidBody.m_vertices[i].v[1]*= SCALE;
-		m_rigidBody.m_vertices[i].v[2]*= SCALE;
+	if(m_buoyancyModel == BUOYANCY_VOXELS) {
+		Vector3 extent;
+		extent.sub(m_hullMaximum, m_hullMinimum);
+		m_hullVoxels.build(m_hullTriangles, getVoxelSize(extent, m_voxelSize));
+	}
 
-		minY = std::min(minY, m_rigidBody.m_vertices[i].v[1]);
-		maxY = std::max(maxY, m_rigidBody.m_vertices[i].v[1]);
+	m_hullTree.clear();
 
+	for(int i=0; i<m_rigidBody.m_faces.size(); i++) {
+		for(int j=1; j<m_rigidBody.m_faces[i].numVertices-1; j++) {
+			m_hullTree.addTriangle(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j]],
+				m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j+1]]);
+		}
 	}
-	
-	m_bottom = minY;
-	m_top = maxY;
 
-	m_changeRotAngle = 0.0f;
-	m_rotationAngle = 180.0f;
-
-	m_translate[0] = m_translate[2] = 0.0f;
-	m_translate[1] = m_pWaterSimulation->TOTAL_HEIGHT - 2.0f;
-	m_speed = m_yVelocity = 0.0f;
-
-	// create triangular mesh for object if not triangulated
-	for (int i = 0; i < m_rigidBody.m_faces.size(); i++) {
-		if(m_rigidBody.m_faces[i].numVertices>3) {
-			for(int j=1; j<m_rigidBody.m_faces[i].numVertices-1; j++) 
-			{
-				triangle tri;
-				tri.v0Index = m_rigidBody.m_faces[i].vertex[0];
-				tri.v1Index = m_rigidBody.m_faces[i].vertex[j];
-				tri.v2Index = m_rigidBody.m_faces[i].vertex[j+1];
-				m_triangles.push_back(tri);
-			}
+	m_hullTree.build();
 
-		} else {
+	RigidBodyIntegrator::computeMassProperties(m_hullTriangles, MASS, m_massProperties);
+}
 
-			triangle tri;
-			tri.v0Index = m_rigidBody.m_faces[i].vertex[0];
-			tri.v1Index = m_rigidBody.m_faces[i].vertex[1];
-			tri.v2Index = m_rigidBody.m_faces[i].vertex[2];
+/**
+ * Loads the boat hull, scales it to simulation units and triangulates its faces as fans
+ *
+ * @param  objReader  receives the scaled vertices and the faces for rendering.
+ * @param  hull  receives the triangles in body space.
+ * @return  false if the hull has no triangles.
+ */
+bool RigidBody::loadHull(ObjReader& objReader, HullTriangleCache& hull)
+{
+	std::string filename ("Data/boatHull01.obj");
+	objReader.objectLoader(filename);
 
-			m_triangles.push_back(tri);
+	for(int i=0; i<objReader.m_vertices.size(); i++) {
+
+		objReader.m_vertices[i].v[0]*= SCALE;
+		objReader.m_vertices[i].v[1]*= SCALE;
+		objReader.m_vertices[i].v[2]*= SCALE;
+	}
+
+	hull.clear();
+
+	for(int i=0; i<objReader.m_faces.size(); i++) {
+		for(int j=1; j<objReader.m_faces[i].numVertices-1; j++) {
+			hull.addTriangle(objReader.m_vertices[objReader.m_faces[i].vertex[0]], objReader.m_vertices[objReader.m_faces[i].vertex[j]], objReader.m_vertices[objReader.m_faces[i].vertex[j+1]]);
 		}
 	}
 
-	m_triangles.size();
+	return hull.getNumTriangles() > 0;
 }
 
-void RigidBody::rigidBodyInteraction()
+/**
+ * Selects the buoyancy of bodies initialised afterwards
+ *
+ * @param  model  hull triangles or voxel samples.
+ * @param  voxelSize  voxel edge length in simulation units used by BUOYANCY_VOXELS, 0 derives it from the hull.
+ */
+void RigidBody::setBuoyancyModel(BuoyancyModel model, float voxelSize)
 {
-	setPosition();
-	calculateBuoyantForce();
-	calculateConvexHull();
-	passConvexHulltoSimulation();
+	m_buoyancyModel = model;
+	m_voxelSize = std::max(voxelSize, 0.0f);
 }
 
-void RigidBody::setPosition()
+/**
+ * Voxel size for a hull, DEFAULT_VOXEL_FRACTION of its smallest extent unless one is given. The size is doubled
+ * until the box of the hull holds at most MAX_VOXEL_SAMPLES voxels, every sample costs a water height per substep.
+ *
+ * @param  extent  size of the hull's body space box.
+ * @param  voxelSize  requested edge length, 0 for the default.
+ * @return  edge length to build the HullVoxelProxy with.
+ */
+float RigidBody::getVoxelSize(const Vector3& extent, float voxelSize)
 {
-	m_rotationAngle += m_changeRotAngle;
-	m_translate[0] -= m_speed*sin(m_rotationAngle*PI_BY_180);
-	m_translate[2] -= m_speed*cos(m_rotationAngle*PI_BY_180);
+	const float smallestExtent = std::max(std::min(extent[0], std::min(extent[1], extent[2])), 1.0e-3f);
+
+	if(voxelSize <= 0.0f) {
+		voxelSize = DEFAULT_VOXEL_FRACTION*smallestExtent;
+	}
 
-	m_translate[0] += 0.05f*m_pWaterSimulation->m_xVelocity;
-	m_translate[2] += 0.05f*m_pWaterSimulation->m_zVelocity;
+	while((extent[0]/voxelSize + 1.0f)*(extent[1]/voxelSize + 1.0f)*(extent[2]/voxelSize + 1.0f) > MAX_VOXEL_SAMPLES) {
+		voxelSize *= 2.0f;
+	}
 
-	m_pCamera->moveCameraWithBoat(m_translate);
+	return voxelSize;
 }
 
-void RigidBody::calculateBuoyantForce()
+void RigidBody::rigidBodyInteraction()
 {
-	float hDiff;
+	// fixed substeps keep the stiff buoyancy spring stable for any simulation time step
+	m_timeAccumulator += m_pWaterSimulation->getTimeStep();
 
-	float gravity = m_pWaterSimulation->GRAVITY;
-	const float waterHeight = m_pWaterSimulation->TOTAL_HEIGHT;
-	float dt = m_pWaterSimulation->TIME_STEP;
+	const int numSubsteps = std::min((int)(m_timeAccumulator/SUBSTEP + 0.001f), MAX_SUBSTEPS);
+	m_timeAccumulator = std::max(m_timeAccumulator - numSubsteps*SUBSTEP, 0.0f);
 
-	float volumeSubmerged = calculateVolumeSubmerged();
+	for(int i=0; i<numSubsteps; i++) {
+		step(SUBSTEP, i == numSubsteps - 1);
+	}
 
-	if(waterHeight > m_top)
-		hDiff = m_top - m_bottom;
-	else if (waterHeight<m_bottom)
-		hDiff = 0.0f;
-	else
-		hDiff = waterHeight - m_bottom;
+	if(numSubsteps > 0) {
+		calculateConvexHull();
+		passConvexHulltoSimulation();
+	}
 
-	float force = MASS*gravity - WATER_DENSITY*volumeSubmerged*gravity/1000.0f;
+	m_pCamera->moveCameraWithBoat(m_state.translate);
+}
 
-	m_yVelocity += force*dt/MASS;
-	m_yVelocity *= 0.95f; // damping
-	m_translate.v[1] += dt*m_yVelocity;
+/**
+ * Semi-implicit Euler step of the rigid body: velocities from the forces first, then position and orientation
+ * from the new velocities
+ *
+ * @param  dt  step size.
+ * @param  collectWaterline  keep the points where the hull crosses the water for the convex hull.
+ */
+void RigidBody::step(float dt, bool collectWaterline)
+{
+	const float timeStep = m_pWaterSimulation->getTimeStep();
 
-	m_bottom += dt*m_yVelocity;
-	m_top += dt*m_yVelocity;
+	HullTriangleCache::Buoyancy buoyancy;
+	calculateBuoyancy(buoyancy, collectWaterline);
 
-	//std::cout<<m_translate.v[1] <<std::endl;
-}
+	const float gravity = m_pWaterSimulation->GRAVITY;
+	RigidBodyIntegrator::applyBuoyancy(m_state, m_massProperties, buoyancy, -WATER_DENSITY*gravity/1000.0f, gravity, dt);
 
-float RigidBody::calculateVolumeSubmerged()
-{ 
-	float volume = 0.0f;
-	float d0, d1, d2;
-
-	const float waterHeight = m_pWaterSimulation->TOTAL_HEIGHT;
-	 
-	// points on boat intersecting water surface
-	m_waterPlaneIntersection.clear();
-
-	for (int i = 0; i < m_triangles.size(); i++) {
-
-		// depth of each vertex of triangle
-		float d0 = m_rigidBody.m_vertices[m_triangles[i].v0Index].v[1] + m_translate[1] - waterHeight;
-		float d1 = m_rigidBody.m_vertices[m_triangles[i].v1Index].v[1] + m_translate[1] - waterHeight;
-		float d2 = m_rigidBody.m_vertices[m_triangles[i].v2Index].v[1] + m_translate[1] - waterHeight;
-			
-		if((d0<0.0f) && (d1<0.0f) && (d2<0.0f)) { // if all three vertices inside water calculate volume of tatrahedron
-			float x = (m_rigidBody.m_vertices[m_triangles[i].v0Index].v[0] + m_rigidBody.m_vertices[m_triangles[i].v1Index].v[0] + m_rigidBody.m_vertices[m_triangles[i].v2Index].v[0])/3.0f;
-			float z = (m_rigidBody.m_vertices[m_triangles[i].v0Index].v[2] + m_rigidBody.m_vertices[m_triangles[i].v1Index].v[2] + m_rigidBody.m_vertices[m_triangles[i].v2Index].v[2])/3.0f;
-			volume += tetrahedronVolume(m_rigidBody.m_vertices[m_triangles[i].v0Index], m_rigidBody.m_vertices[m_triangles[i].v1Index], m_rigidBody.m_vertices[m_triangles[i].v2Index], m_pWaterSimulation->getWaterHeight(x,z));
-		}
-		else if((d0>0.0f) && (d1>0.0f) && (d2>0.0f)) { // clip triangle and calculate tetrahedron volume for clipped triangle
-		} else {
-			float x = (m_rigidBody.m_vertices[m_triangles[i].v0Index].v[0] + m_rigidBody.m_vertices[m_triangles[i].v1Index].v[0] + m_rigidBody.m_vertices[m_triangles[i].v2Index].v[0])/3.0f;
-			float z = (m_rigidBody.m_vertices[m_triangles[i].v0Index].v[2] + m_rigidBody.m_vertices[m_triangles[i].v1Index].v[2] + m_rigidBody.m_vertices[m_triangles[i].v2Index].v[2])/3.0f;
-			volume += clipTriangle(m_rigidBody.m_vertices[m_triangles[i].v0Index], m_rigidBody.m_vertices[m_triangles[i].v1Index], m_rigidBody.m_vertices[m_triangles[i].v2Index], d0,d1,d2, m_pWaterSimulation->getWaterHeight(x,z));
-		}
+	// propeller and rudder: the keys give the distance and yaw per simulation time step, the water drags the hull along
+	Vector3 heading(m_state.transform[8], 0.0f, m_state.transform[10]);
+	if(heading.calcMagnitudeSquared() > 0.0f) {
+		heading.normalize();
 	}
 
-	return volume;
+	const float targetVelocityX = (-m_speed*heading[0] + 0.05f*m_pWaterSimulation->m_xVelocity)/timeStep;
+	const float targetVelocityZ = (-m_speed*heading[2] + 0.05f*m_pWaterSimulation->m_zVelocity)/timeStep;
+	const float targetYawRate = m_changeRotAngle*PI_BY_180/timeStep;
+
+	m_state.linearVelocity[0] += dt*LINEAR_DRAG*(targetVelocityX - m_state.linearVelocity[0]);
+	m_state.linearVelocity[1] -= dt*HEAVE_DAMPING*m_state.linearVelocity[1];
+	m_state.linearVelocity[2] += dt*LINEAR_DRAG*(targetVelocityZ - m_state.linearVelocity[2]);
+
+	m_state.angularVelocity[0] -= dt*ROLL_DAMPING*m_state.angularVelocity[0];
+	m_state.angularVelocity[1] += dt*ANGULAR_DRAG*(targetYawRate - m_state.angularVelocity[1]);
+	m_state.angularVelocity[2] -= dt*ROLL_DAMPING*m_state.angularVelocity[2];
+
+	const RigidBodyIntegrator::State previous = m_state;
+	RigidBodyIntegrator::integrate(m_state, m_massProperties, dt);
+
+	collidePort(previous);
 }
 
-float RigidBody::tetrahedronVolume(const Vector3& v0, const Vector3& v1, const Vector3& v2, float waterHeight)
+/**
+ * Sweeps the hull vertices from the transform before the step to the current one through the port, and the port
+ * vertices inside the swept hull box through the hull in body space, which catches posts and thin edges between
+ * the hull vertices. The first crossing of either pushes the body out along the triangle normal to CONTACT_SKIN in
+ * front of it, so it keeps sliding along the port, and the contact impulse turns the velocity away from it. The
+ * pushed transform is swept again for corners, if it still crosses after MAX_CONTACT_ITERATIONS the body stays
+ * where it was before the step.
+ *
+ * @param  previous  state before the step, not crossing the port.
+ */
+void RigidBody::collidePort(const RigidBodyIntegrator::State& previous)
 {
-	Vector3 a, b, r;
-	float tetrahedronVolume;
-	a.sub(v0, v1);
-	b.sub(v2, v1);
-	r.sub(Vector3(0.0f, waterHeight - m_translate[1], 0.0f), v1);
-
-	Vector3 cross;
-	cross.crossProduct(b,a);
-	tetrahedronVolume = (1.0f/6.0f)*Vector3::dotProduct(cross, r);
-	return -tetrahedronVolume;
-}
+	const PortScene* pPortScene = m_pWaterSimulation->getPortScene();
+	const int numPoints = (int)m_rigidBody.m_vertices.size();
+
+	if((pPortScene == NULL) || (numPoints == 0)) {
+		return;
+	}
 
-float RigidBody::clipTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const float& d0, const float& d1, const float& d2, float waterHeight)
-{ 
-	float volume = .0f;
-	Vector3 clipped1, clipped2, v;
+	// broad phase, the corners of the hull box at both transforms
+	Vector3 minimum, maximum;
 
-	if((d0<0.0f) && (d1>0.0f) && (d2>0.0f)) {
+	for(int corner=0; corner<8; corner++) {
 
-		clipped1.add(v0, v.sub(v2, v0).scale(d0/(d0-d2))); // clipped points
-		clipped2.add(v0, v.sub(v1, v0).scale(d0/(d0-d1)));
-		m_waterPlaneIntersection.push_back(clipped1);
-		m_waterPlaneIntersection.push_back(clipped2);
-		volume += tetrahedronVolume(v0, clipped1, clipped2, waterHeight);
+		const Vector3 bodyCorner((corner & 1) ? m_hullMaximum[0] : m_hullMinimum[0], (corner & 2) ? m_hullMaximum[1] : m_hullMinimum[1],
+			(corner & 4) ? m_hullMaximum[2] : m_hullMinimum[2]);
 
-	} else if((d0>0.0f) && (d1<0.0f) && (d2>0.0f)) {
+		Vector3 start, end;
+		previous.transform.transformVector(bodyCorner, start);
+		m_state.transform.transformVector(bodyCorner, end);
 
-		clipped1.add(v1, v.sub(v2, v1).scale(d1/(d1-d2)));
-		clipped2.add(v1, v.sub(v0, v1).scale(d1/(d1-d0)));
-		m_waterPlaneIntersection.push_back(clipped1);
-		m_waterPlaneIntersection.push_back(clipped2);
-		volume += tetrahedronVolume(v1, clipped1, clipped2, waterHeight);
+		if(corner == 0) {
+			minimum = start;
+			maximum = start;
+		}
 
-	} else if((d0>0.0f) && (d1>0.0f) && (d2<0.0f)) {
+		for(int axis=0; axis<3; axis++) {
+			minimum[axis] = std::min(minimum[axis], std::min(start[axis], end[axis]));
+			maximum[axis] = std::max(maximum[axis], std::max(start[axis], end[axis]));
+		}
+	}
 
-		clipped1.add(v2, v.sub(v1, v2).scale(d2/(d2-d1)));
-		clipped2.add(v2, v.sub(v0, v2).scale(d2/(d2-d0)));
-		m_waterPlaneIntersection.push_back(clipped1);
-		m_waterPlaneIntersection.push_back(clipped2);
-		volume += tetrahedronVolume(v2, clipped1, clipped2, waterHeight);
+	const TriangleBVH& portTree = pPortScene->getCollisionTree();
 
-	} else if((d0<0.0f) && (d1<0.0f) && (d2>0.0f)) {
+	if(!portTree.overlapsBox(minimum, maximum)) {
+		return;
+	}
 
-		clipped1.add(v0, v.sub(v2, v0).scale(d0/(d0-d2)));
-		clipped2.add(v1, v.sub(v2, v1).scale(d1/(d1-d2)));
-		m_waterPlaneIntersection.push_back(clipped1);
-		m_waterPlaneIntersection.push_back(clipped2);
-		volume += tetrahedronVolume(v0, clipped1, clipped2, waterHeight);
-		volume += tetrahedronVolume(v0, v1, clipped2, waterHeight);
+	m_collisionStart.resize(numPoints);
+	m_collisionEnd.resize(numPoints);
 
-	} else if((d0<0.0f) && (d1>0.0f) && (d2<0.0f)) {
+	for(int i=0; i<numPoints; i++) {
+		previous.transform.transformVector(m_rigidBody.m_vertices[i], m_collisionStart[i]);
+	}
 
-		clipped1.add(v0, v.sub(v1, v0).scale(d0/(d0-d1)));
-		clipped2.add(v2, v.sub(v1, v2).scale(d2/(d2-d1)));
-		m_waterPlaneIntersection.push_back(clipped1);
-		m_waterPlaneIntersection.push_back(clipped2);
-		volume += tetrahedronVolume(v0, clipped1, clipped2, waterHeight);
-		volume += tetrahedronVolume(v0, v2, clipped2, waterHeight);
+	// port vertices the hull may reach, swept against the hull in body space where the port moves instead
+	portTree.collectVertices(minimum, maximum, m_portVertices);
 
-	} else if((d0>0.0f) && (d1<0.0f) && (d2<0.0f)){
+	const int numPortPoints = (int)m_portVertices.size();
+	m_portStart.resize(numPortPoints);
+	m_portEnd.resize(numPortPoints);
 
-		clipped1.add(v1, v.sub(v0, v1).scale(d1/(d1-d0)));
-		clipped2.add(v2, v.sub(v0, v2).scale(d2/(d2-d0)));
-		m_waterPlaneIntersection.push_back(clipped1);
-		m_waterPlaneIntersection.push_back(clipped2);
-		volume += tetrahedronVolume(v1, clipped1, clipped2, waterHeight);
-		volume += tetrahedronVolume(v1, v2, clipped2, waterHeight);
+	Matrix4x4 inverse;
+	inverse.invert3x4(previous.transform);
 
-	} else {
+	for(int i=0; i<numPortPoints; i++) {
+		inverse.transformVector(m_portVertices[i], m_portStart[i]);
 	}
 
-	return volume;
-}
+	for(int iteration=0; iteration<=MAX_CONTACT_ITERATIONS; iteration++) {
 
-void RigidBody::calculateConvexHull() // using Graham Scan
-{
-	Vector3 P0;
-	int index = 0;
+		for(int i=0; i<numPoints; i++) {
+			m_state.transform.transformVector(m_rigidBody.m_vertices[i], m_collisionEnd[i]);
+		}
+
+		inverse.invert3x4(m_state.transform);
+
+		for(int i=0; i<numPortPoints; i++) {
+			inverse.transformVector(m_portVertices[i], m_portEnd[i]);
+		}
 
-	if(m_waterPlaneIntersection.size() > 0) {
+		TriangleBVH::Hit hit, portHit;
+		const bool hullVertexHit = portTree.sweepPoints(&m_collisionStart[0], &m_collisionEnd[0], numPoints, hit);
+		const bool portVertexHit = (numPortPoints > 0) && m_hullTree.sweepPoints(&m_portStart[0], &m_portEnd[0], numPortPoints, portHit);
 
-		P0 = m_waterPlaneIntersection[0];
+		if(!hullVertexHit && !portVertexHit) {
+			return;
+		}
+
+		if(iteration == MAX_CONTACT_ITERATIONS) {
+			break;
+		}
 
-		for(int i=1; i<m_waterPlaneIntersection.size(); i++) { // locate point P0 with max x and z coordinates
-	
-			if(m_waterPlaneIntersection[i].v[2] > P0.v[2]) {
+		// the crossing point ends this far behind the triangle plane
+		Vector3 direction, point, normal;
+		float depth;
 
-				P0 = m_waterPlaneIntersection[i];
-				index = i;
-			}
+		if(hullVertexHit && (!portVertexHit || (hit.fraction <= portHit.fraction))) {
 
-			if(m_waterPlaneIntersection[i].v[2] == P0.v[2]) {
-				if(m_waterPlaneIntersection[i].v[0] > P0.v[0]) {
+			direction.sub(m_collisionEnd[hit.pointIndex], m_collisionStart[hit.pointIndex]);
+			depth = -(1.0f - hit.fraction)*direction.dotProduct(hit.normal);
+			point = hit.point;
+			normal = hit.normal;
 
-					P0 = m_waterPlaneIntersection[i];
-					index = i;
-				}
-			}
+		} else {
+
+			// the hull triangle normal faces the port vertex, the hull is pushed the other way
+			direction.sub(m_portEnd[portHit.pointIndex], m_portStart[portHit.pointIndex]);
+			depth = -(1.0f - portHit.fraction)*direction.dotProduct(portHit.normal);
+			m_state.transform.transformVector(portHit.point, point);
+			m_state.transform.rotateVector(portHit.normal, normal);
+			normal.negate();
 		}
 
-		std::vector<convexHull> sortedPointsInitial;
+		m_state.translate.madd(normal, depth + CONTACT_SKIN);
+		m_state.transform.setTranslation(m_state.translate);
 
-		for(int i=0; i<m_waterPlaneIntersection.size(); i++) { // sort points from right to left
-			
-			if(i != index) {
+		RigidBodyIntegrator::applyContact(m_state, m_massProperties, point, normal, RESTITUTION);
+	}
 
-				convexHull cH;
-				cH.point = m_waterPlaneIntersection[i];
+	m_state.translate = previous.translate;
+	m_state.orientation = previous.orientation;
+	m_state.transform = previous.transform;
+}
 
-				float d = (m_waterPlaneIntersection[i].v[0] - P0.v[0])*(m_waterPlaneIntersection[i].v[0] - P0.v[0]) + (m_waterPlaneIntersection[i].v[2] - P0.v[2])*(m_waterPlaneIntersection[i].v[2] - P0.v[2]);
+// buoyancy below the water at the centre of each triangle or voxel sample, outside the SWE grid
+// it comes from the FFT waves in one batch
+void RigidBody::calculateBuoyancy(HullTriangleCache::Buoyancy& buoyancy, bool collectWaterline)
+{
+	const bool voxels = (m_buoyancyModel == BUOYANCY_VOXELS);
+	const int numSamples = voxels ? m_hullVoxels.getNumSamples() : m_hullTriangles.getNumTriangles();
+	const int paddedSize = voxels ? numSamples : m_hullTriangles.getPaddedSize();
+	m_triangleCentresX.resize(paddedSize);
+	m_triangleCentresZ.resize(paddedSize);
+	m_waterHeights.resize(paddedSize);
+
+	if(collectWaterline) {
+		m_waterPlaneIntersection.clear();
+	}
 
-				if(d!=0) {
-					cH.cos = (m_waterPlaneIntersection[i].v[0] - P0.v[0])/sqrt(d);
-					cH.distancefromP0 = d;
-					sortedPointsInitial.push_back(cH);
-				}
-			}
+	if (numSamples == 0) {
+		buoyancy.volume = 0.0f;
+		buoyancy.centreOfBuoyancy = buoyancy.pressureForce = buoyancy.pressureTorque = Vector3(0.0f, 0.0f, 0.0f);
+		return;
+	}
+
+	std::vector<Vector3>* pWaterlinePoints = collectWaterline ? &m_waterPlaneIntersection : NULL;
+
+	if(voxels) {
+		m_hullVoxels.fillWorldPositions(m_state.transform, &m_triangleCentresX[0], &m_triangleCentresZ[0]);
+	} else {
+		m_hullTriangles.fillWorldCentroids(m_state.transform, &m_triangleCentresX[0], &m_triangleCentresZ[0]);
+	}
+
+	m_pWaterSimulation->getWaterHeights(&m_triangleCentresX[0], &m_triangleCentresZ[0], numSamples, &m_waterHeights[0]);
+
+	if(voxels) {
+		m_hullVoxels.computeBuoyancy(&m_waterHeights[0], RigidBodyIntegrator::getUp(m_state), m_state.translate[1], buoyancy, pWaterlinePoints);
+	} else {
+		m_hullTriangles.computeBuoyancy(&m_waterHeights[0], RigidBodyIntegrator::getUp(m_state), m_state.translate[1], buoyancy, pWaterlinePoints);
+	}
+
+	m_centreOfBuoyancy = buoyancy.centreOfBuoyancy;
+
+	// points on boat intersecting water surface, to world space
+	if(collectWaterline) {
+		for(int i=0; i<m_waterPlaneIntersection.size(); i++) {
+			Vector3 point;
+			m_state.transform.transformVector(m_waterPlaneIntersection[i], point);
+			m_waterPlaneIntersection[i] = point;
 		}
+	}
+}
+
+void RigidBody::calculateConvexHull()
+{
+	computeConvexHull(m_waterPlaneIntersection, m_convexHull);
+}
+
+/**
+ * Convex hull in x and z with Andrew's monotone chain: the points are sorted by x and z, then the lower and the
+ * upper chain are built in one pass each, dropping every point that does not turn clockwise. Duplicate and
+ * collinear points, also collinear up to rounding, are removed, the hull is clockwise as seen with x to the right
+ * and z up. Both vectors keep their capacity, so repeated calls do not allocate once they have grown to the
+ * largest input.
+ *
+ * @param  points  input, sorted in place.
+ * @param  hull  receives the hull vertices, empty if the points span no area.
+ */
+void RigidBody::computeConvexHull(std::vector<Vector3>& points, std::vector<Vector3>& hull)
+{
+	const int numPoints = (int)points.size();
+	hull.clear();
 
-		std::sort(sortedPointsInitial.begin(), sortedPointsInitial.end(), sortAngle);
+	if(numPoints < 3) {
+		return;
+	}
 
-		std::vector<Vector3> sortedPoints;
-		std::vector<convexHull>::iterator it, temp;
+	std::sort(points.begin(), points.end(), xzComparison());
 
-		temp = sortedPointsInitial.begin();
+	// at most numPoints + 1 entries, the first point closes the upper chain
+	hull.resize(numPoints + 1);
+	int size = 0;
 
-		// remove duplicate points or chose farthest point if angle is same 
-		for(it=sortedPointsInitial.begin()+1; it<sortedPointsInitial.end(); it++) {
-			if(temp->cos == it->cos) {
-				if(it->distancefromP0 > temp->distancefromP0) {
-					temp = it;
-				} 
-			} else {
-				temp->cos = it->cos;
-				sortedPoints.push_back(it->point);
-			}
+	for(int i=0; i<numPoints; i++) { // lower chain
+		while((size >= 2) && !isClockwiseTurn(hull[size-2], hull[size-1], points[i])) {
+			size--;
 		}
+		hull[size++] = points[i];
+	}
 
-		m_convexHull.clear();
-		m_convexHull.push_back(P0);
-		m_convexHull.push_back(sortedPoints[0]);
-
-		std::vector<Vector3>::iterator sP_Iterator, cH_Iterator;
-		int offset = 0;
-		cH_Iterator = m_convexHull.begin()+offset;
-
-		for(sP_Iterator=sortedPoints.begin()+1; sP_Iterator<sortedPoints.end(); sP_Iterator++) {
-			if(isLeft(*cH_Iterator, *(cH_Iterator+1), *sP_Iterator) < 0.0f) { // check if the point lies to the left
-				m_convexHull.push_back(*sP_Iterator);
-				offset++;
-				cH_Iterator = m_convexHull.begin()+offset;
-			} else {
-				m_convexHull.pop_back();
-				m_convexHull.push_back(*sP_Iterator);
-			}
+	const int lowerSize = size + 1;
+
+	for(int i=numPoints-2; i>=0; i--) { // upper chain
+		while((size >= lowerSize) && !isClockwiseTurn(hull[size-2], hull[size-1], points[i])) {
+			size--;
 		}
+		hull[size++] = points[i];
 	}
 
+	// the last point is the first one again
+	hull.resize(std::max(size - 1, 0));
+
+	if(hull.size() < 3) {
+		hull.clear();
+	}
 }
 
 void RigidBody::renderObject()
 {
-	glPushMatrix();
-	glTranslatef(m_translate[0], m_translate[1], m_translate[2]);
-	glRotatef(m_rotationAngle, 0.0f, 1.0f, 0.0f);
-
-	for (int i = 0; i < m_rigidBody.m_faces.size(); i++) {
-		if( m_rigidBody.m_faces[i].numVertices == 3) {
-			/*if (m_rigidBody.m_faces[i].numVertices == 3) {
-				glBegin(GL_TRIANGLES);
-				glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[0]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[0]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[0]].v[2]);
-                glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[2]);
-                glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[1]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[1]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[1]].v[2]);
-                glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[2]);
-                glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[2]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[2]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[2]].v[2]);
-                glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[2]);
-				glEnd();
-			} else {*/
-				Vector3 e1, e2, normal;
-				e1.sub(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]]);
-				e2.sub(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]]);
-				normal.crossProduct(e1,e2);
-				normal.normalize();
-				glBegin(GL_TRIANGLES);
-				glNormal3f(normal[0], normal[1], normal[2]);
-				glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[2]);
-				glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[2]);
-				glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[2]);
-				glEnd();
-			//}
-		} else if(m_rigidBody.m_faces[i].numVertices== 4) {
-			/*if (m_rigidBody.m_faces[i].numVertices== 4) {
-				glBegin(GL_QUADS);
-				glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[0]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[0]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[0]].v[2]);
-                glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[2]);
-                glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[1]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[1]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[1]].v[2]);
-                glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[2]);
-                glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[2]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[2]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[2]].v[2]);
-                glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[2]);
-				glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[3]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[3]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[3]].v[2]);
-                glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[3]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[3]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[3]].v[2]);
-				glEnd();
-			} else {*/
-				Vector3 e1, e2, normal;
-				e1.sub(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]]);
-				e2.sub(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[3]], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]]);
-				normal.crossProduct(e1,e2);
-				normal.normalize();
-				glBegin(GL_QUADS);
-				glNormal3f(normal[0], normal[1], normal[2]);
-				glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]].v[2]);
-				glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]].v[2]);
-				glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[2]].v[2]);
-				glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[3]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[3]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[3]].v[2]);
-				glEnd();
-			//}
-		} else {
-			/*if (m_rigidBody.m_faces[i].normal.size() == m_rigidBody.m_faces[i].vertex.size()) {
-				glBegin(GL_POLYGON);
-				for(int j=0; j<m_rigidBody.m_faces[i].n; j++)
-				{
-					glNormal3f(m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[j]].v[0], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[j]].v[1], m_rigidBody.m_normals[m_rigidBody.m_faces[i].normal[j]].v[2]);
-					glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j]].v[2]);
-				}
-				glEnd();
-			} else {*/
-				Vector3 e1, e2, normal;
-				e1.sub(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[1]], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]]);
-				e2.sub(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[m_rigidBody.m_faces[i].numVertices-1]], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[0]]);
-				normal.crossProduct(e1,e2);
-				normal.normalize();
-				glBegin(GL_POLYGON);
-				glNormal3f(normal[0], normal[1], normal[2]);
-				for(int j=0; j<m_rigidBody.m_faces[i].numVertices; j++)
-					glVertex3f(m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j]].v[0], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j]].v[1], m_rigidBody.m_vertices[m_rigidBody.m_faces[i].vertex[j]].v[2]);
-				glEnd();
-			//}*/
-		}
+	if(!m_mesh.isCreated()) {
+		m_mesh.create(m_rigidBody);
 	}
 
-	glPopMatrix();
+	glPushMatrix();
+	glMultMatrixf(m_state.transform.rawConst());
+
+	m_mesh.render();
 
+	glPopMatrix();
 }
 
 void RigidBody::pressNormalKey(unsigned char& key)
@@ -435,17 +471,7 @@ void RigidBody::releaseNormalKey(unsigned char& key)
 
 void RigidBody::passConvexHulltoSimulation()
 {
-	std::vector<Vector3>::iterator it;
-	int i=0;
-
-	for(it = m_convexHull.begin(); it<m_convexHull.end(); it++) {
-
-		m_pWaterSimulation->m_convexHull[i] = transform(*it);
-		i++;
-
-	}
-
-	m_pWaterSimulation->m_convexHullSize = i;
+	m_pWaterSimulation->m_convexHull.assign(m_convexHull.begin(), m_convexHull.end());
 	m_pWaterSimulation->m_boatSpeed = m_speed;
-	m_pWaterSimulation->m_rotation = m_changeRotAngle;
+	m_pWaterSimulation->m_rotation = m_state.angularVelocity[1]*m_pWaterSimulation->getTimeStep()/PI_BY_180;
 }
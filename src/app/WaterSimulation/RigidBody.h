@@ -1,5 +1,12 @@
 /** \class RigidBody
- * Defines rigid body to interacting with shallow water
+ * Defines rigid body to interacting with shallow water. The body moves in all six degrees of freedom: hydrostatic
+ * pressure on the submerged hull gives force and torque, orientation is a quaternion and the inertia tensor comes
+ * from the hull as a thin shell. The dynamics run at a fixed SUBSTEP independent of the simulation time step.
+ * The buoyancy comes from the hull triangles or, with BUOYANCY_VOXELS, from a voxelised proxy of the hull.
+ * The hull is drawn from a HullMesh uploaded at the first render. After every substep the hull vertices are swept
+ * through the port's TriangleBVH and the port vertices near the hull through a TriangleBVH of the hull, so the boat
+ * stops at quays and at thin posts between its vertices. Port edges crossing hull edges between vertices are not
+ * detected.
  *
  * @author  Rahul Mukhi
  * @date 04/05/12
@@ -7,11 +14,17 @@
  * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
  */
 
+#pragma once
+
 #include "ObjReader.h"
 #include "WaterSimulation.h"
 #include "glut/glut.h"
 #include "iostream"
 #include "Camera.h"
+#include "HullTriangleCache.h"
+#include "HullVoxelProxy.h"
+#include "HullMesh.h"
+#include "RigidBodyIntegrator.h"
 #include <stdlib.h>
 #include <queue>
 
@@ -21,65 +34,91 @@ public:
 	RigidBody(WaterSimulation& waterSimulation, Camera& camera);
 	~RigidBody();
 
-	struct triangle
-	{
-		int v0Index;
-		int v1Index;
-		int v2Index;
-	};
-
-	struct convexHull
+	enum BuoyancyModel
 	{
-		Vector3 point;
-		float cos, distancefromP0;
+		BUOYANCY_EXACT,  // submerged part of every hull triangle
+		BUOYANCY_VOXELS  // voxel samples of HullVoxelProxy
 	};
 
-	struct angleComparison 
+	// lexicographic order in x and z for the monotone chain
+	struct xzComparison 
 	{
-		bool operator()(const convexHull& c1, const convexHull& c2)
+		bool operator()(const Vector3& p1, const Vector3& p2) const
 		{
-			return (c1.cos > c2.cos);
+			return (p1.v[0] < p2.v[0]) || ((p1.v[0] == p2.v[0]) && (p1.v[2] < p2.v[2]));
 		}
-	}sortAngle;
+	};
 
 	void initialize();
 	void renderObject();
 	void rigidBodyInteraction();
-	void setPosition();
-	void calculateBuoyantForce();
 	void calculateConvexHull();
 	void pressNormalKey(unsigned char& key);
 	void releaseNormalKey(unsigned char& key);
 
+	static const float DEFAULT_VOXEL_FRACTION; // default voxel size relative to the smallest extent of the hull
+	static const int MAX_VOXEL_SAMPLES = 4096; // voxels in the hull's box, larger voxel sizes are coarsened to it
+	static const float COLLINEAR_TOLERANCE; // sine of the smallest turn kept in the convex hull
+
+	static bool loadHull(ObjReader& objReader, HullTriangleCache& hull);
+	static void computeConvexHull(std::vector<Vector3>& points, std::vector<Vector3>& hull);
+	static void setBuoyancyModel(BuoyancyModel model, float voxelSize);
+	static float getVoxelSize(const Vector3& extent, float voxelSize);
+
+	inline static BuoyancyModel getBuoyancyModel()
+	{
+		return m_buoyancyModel;
+	}
+
 private: 
 
 	static const float MASS, LINEAR_CONSTANT, SCALE, WATER_DENSITY, PI_BY_180;
-	float m_bottom, m_top;
-	float m_yVelocity, m_speed;
-	float m_changeRotAngle, m_rotationAngle;
-	Vector3 m_translate;
-
-	float calculateVolumeSubmerged();
-	float tetrahedronVolume(const Vector3& v0, const Vector3& v1, const Vector3& v2, float waterHeight);
-	float clipTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const float& d0, const float& d1, const float& d2, float waterHeight);
+	static const float SUBSTEP, LINEAR_DRAG, HEAVE_DAMPING, ANGULAR_DRAG, ROLL_DAMPING;
+	static const float CONTACT_SKIN, RESTITUTION;
+	static const int MAX_SUBSTEPS, MAX_CONTACT_ITERATIONS;
+
+	static BuoyancyModel m_buoyancyModel;
+	static float m_voxelSize;
+
+	float m_speed, m_changeRotAngle; // per simulation time step, from the keys
+	float m_timeAccumulator; // simulated time not yet covered by substeps
+
+	RigidBodyIntegrator::State m_state;
+	RigidBodyIntegrator::MassProperties m_massProperties;
+
+	void step(float dt, bool collectWaterline);
+	void calculateBuoyancy(HullTriangleCache::Buoyancy& buoyancy, bool collectWaterline);
+	void collidePort(const RigidBodyIntegrator::State& previous);
 	void passConvexHulltoSimulation();
 
-	inline float isLeft(const Vector3& P0, const Vector3& P1, const Vector3& P2)
+	inline static float isLeft(const Vector3& P0, const Vector3& P1, const Vector3& P2)
 	{
 		return ((P1.v[0] - P0.v[0])*(P2.v[2] - P0.v[2]) - (P2.v[0] - P0.v[0])*(P1.v[2] - P0.v[2]));
 	}
 
-	inline Vector3 transform(const Vector3& v)
+	// P0, P1, P2 turn clockwise by more than COLLINEAR_TOLERANCE, which also rejects duplicates
+	inline static bool isClockwiseTurn(const Vector3& P0, const Vector3& P1, const Vector3& P2)
 	{
-		float angle = m_rotationAngle*PI_BY_180;
-		return Vector3(v[0]*cos(-angle) - v[2]*sin(-angle) + m_translate[0], v[1] + m_translate[1], v[0]*sin(-angle) + v[2]*cos(-angle) + m_translate[2]);
+		const float cross = isLeft(P0, P1, P2);
+		const float ax = P1.v[0] - P0.v[0], az = P1.v[2] - P0.v[2];
+		const float bx = P2.v[0] - P0.v[0], bz = P2.v[2] - P0.v[2];
+
+		return (cross < 0.0f) && (cross*cross > COLLINEAR_TOLERANCE*COLLINEAR_TOLERANCE*(ax*ax + az*az)*(bx*bx + bz*bz));
 	}
 
-	std::vector<triangle> m_triangles;
-	std::vector<Vector3> m_waterPlaneIntersection;
+	std::vector<Vector3> m_waterPlaneIntersection; // world space, reordered by calculateConvexHull
 	std::vector<Vector3> m_convexHull;
+	std::vector<float> m_triangleCentresX, m_triangleCentresZ, m_waterHeights; // per triangle or voxel sample, reused every step
+	std::vector<Vector3> m_collisionStart, m_collisionEnd; // world hull vertices before and after a step, reused every step
+	std::vector<Vector3> m_portVertices, m_portStart, m_portEnd; // port vertices in the broad phase box, world and body space before and after a step
+	Vector3 m_hullMinimum, m_hullMaximum; // body space box of the hull vertices, broad phase of the port collision
+	TriangleBVH m_hullTree; // body space hull triangles for sweeping the port vertices
+	HullTriangleCache m_hullTriangles;
+	HullVoxelProxy m_hullVoxels; // built only for BUOYANCY_VOXELS
+	Vector3 m_centreOfBuoyancy; // body space, of the last calculateBuoyancy
 
 	ObjReader m_rigidBody;
+	HullMesh m_mesh;
 	Camera *m_pCamera;
 
 	WaterSimulation *m_pWaterSimulation;
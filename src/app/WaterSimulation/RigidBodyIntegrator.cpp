@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "RigidBodyIntegrator.h"
+
+void RigidBodyIntegrator::initializeState(State& state, const Vector3& translate, const Quaternion& orientation)
+{
+	state.translate = translate;
+	state.orientation = orientation;
+	state.linearVelocity = state.angularVelocity = Vector3(0.0f, 0.0f, 0.0f);
+
+	state.transform.identity();
+	state.transform.setRotation(state.orientation);
+	state.transform.setTranslation(state.translate);
+}
+
+/**
+ * Mass properties of a hull as a thin shell, see HullTriangleCache::computeShellInertia
+ *
+ * @param  hull  body space triangles.
+ * @param  mass  total mass.
+ * @param  massProperties  receives mass, centre of mass and inertia.
+ */
+void RigidBodyIntegrator::computeMassProperties(HullTriangleCache& hull, float mass, MassProperties& massProperties)
+{
+	massProperties.mass = mass;
+	hull.computeShellInertia(mass, massProperties.centreOfMass, massProperties.inertia);
+
+	if(!massProperties.inverseInertia.invert3x4(massProperties.inertia)) {
+		massProperties.inverseInertia.identity();
+	}
+}
+
+/**
+ * Changes the velocities by gravity, the hydrostatic force and torque and the gyroscopic torque over dt
+ *
+ * @param  buoyancy  of the current transform, in body space.
+ * @param  pressureScale  water density times gravity, scales the pressure force and torque.
+ * @param  gravity  acceleration along y, negative.
+ */
+void RigidBodyIntegrator::applyBuoyancy(State& state, const MassProperties& massProperties, const HullTriangleCache::Buoyancy& buoyancy,
+	float pressureScale, float gravity, float dt)
+{
+	// hydrostatic force and its torque about the centre of mass, body space
+	Vector3 force = buoyancy.pressureForce;
+	Vector3 torque = buoyancy.pressureTorque;
+	force.scale(pressureScale);
+	torque.scale(pressureScale);
+
+	Vector3 leverTorque;
+	leverTorque.crossProduct(massProperties.centreOfMass, force);
+	torque.sub(leverTorque);
+
+	// gyroscopic torque -w x Iw
+	Vector3 bodyAngularVelocity, angularMomentum, gyroscopicTorque;
+	Matrix4x4 inverseRotation;
+	inverseRotation.invert3x4(state.transform);
+	inverseRotation.rotateVector(state.angularVelocity, bodyAngularVelocity);
+	massProperties.inertia.rotateVector(bodyAngularVelocity, angularMomentum);
+	gyroscopicTorque.crossProduct(bodyAngularVelocity, angularMomentum);
+	torque.sub(gyroscopicTorque);
+
+	Vector3 worldForce, angularAcceleration, worldAngularAcceleration;
+	state.transform.rotateVector(force, worldForce);
+	massProperties.inverseInertia.rotateVector(torque, angularAcceleration);
+	state.transform.rotateVector(angularAcceleration, worldAngularAcceleration);
+
+	state.linearVelocity[0] += dt*worldForce[0]/massProperties.mass;
+	state.linearVelocity[1] += dt*(worldForce[1]/massProperties.mass + gravity);
+	state.linearVelocity[2] += dt*worldForce[2]/massProperties.mass;
+
+	for(int i=0; i<3; i++) {
+		state.angularVelocity[i] += dt*worldAngularAcceleration[i];
+	}
+}
+
+// moves the centre of mass and rotates about it, q' = q + dt/2*(w, 0)*q
+void RigidBodyIntegrator::integrate(State& state, const MassProperties& massProperties, float dt)
+{
+	Vector3 centreOfMass;
+	state.transform.transformVector(massProperties.centreOfMass, centreOfMass);
+
+	for(int i=0; i<3; i++) {
+		centreOfMass[i] += dt*state.linearVelocity[i];
+	}
+
+	Quaternion spin(state.angularVelocity[0], state.angularVelocity[1], state.angularVelocity[2], 0.0f);
+	spin.mult(state.orientation);
+	spin.mult(0.5f*dt);
+	state.orientation.add(spin);
+	state.orientation.normalise();
+
+	state.transform.setRotation(state.orientation);
+
+	Vector3 rotatedCentreOfMass;
+	state.transform.rotateVector(massProperties.centreOfMass, rotatedCentreOfMass);
+	state.translate.sub(centreOfMass, rotatedCentreOfMass);
+	state.transform.setTranslation(state.translate);
+}
+
+/**
+ * Frictionless impulse at a contact with static geometry, removes the velocity of the contact point into the
+ * geometry and bounces back the given part of it
+ *
+ * @param  point  world position of the contact.
+ * @param  normal  unit world normal, pointing away from the geometry.
+ * @param  restitution  0 stops the contact point, 1 reflects its normal velocity.
+ */
+void RigidBodyIntegrator::applyContact(State& state, const MassProperties& massProperties, const Vector3& point, const Vector3& normal, float restitution)
+{
+	Vector3 centreOfMass, arm;
+	state.transform.transformVector(massProperties.centreOfMass, centreOfMass);
+	arm.sub(point, centreOfMass);
+
+	Vector3 pointVelocity;
+	pointVelocity.crossProduct(state.angularVelocity, arm);
+	pointVelocity.add(state.linearVelocity);
+
+	const float normalVelocity = pointVelocity.dotProduct(normal);
+
+	if(normalVelocity >= 0.0f) {
+		return;
+	}
+
+	// world inverse inertia applied to arm x normal, through the body axes
+	Vector3 angularImpulse, bodyAngularImpulse, bodyAngularChange, angularChange;
+	Matrix4x4 inverseRotation;
+	angularImpulse.crossProduct(arm, normal);
+	inverseRotation.invert3x4(state.transform);
+	inverseRotation.rotateVector(angularImpulse, bodyAngularImpulse);
+	massProperties.inverseInertia.rotateVector(bodyAngularImpulse, bodyAngularChange);
+	state.transform.rotateVector(bodyAngularChange, angularChange);
+
+	Vector3 armChange;
+	armChange.crossProduct(angularChange, arm);
+
+	const float impulse = -(1.0f + restitution)*normalVelocity/(1.0f/massProperties.mass + armChange.dotProduct(normal));
+
+	state.linearVelocity.madd(normal, impulse/massProperties.mass);
+	state.angularVelocity.madd(angularChange, impulse);
+}
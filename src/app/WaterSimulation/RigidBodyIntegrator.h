@@ -0,0 +1,53 @@
+/** \class RigidBodyIntegrator
+ * Rigid body dynamics shared by the boat and the floating bodies: hydrostatic force and torque from
+ * HullTriangleCache::computeBuoyancy, gravity and the gyroscopic torque go into the velocities, then the
+ * centre of mass moves and the quaternion orientation turns about it (semi-implicit Euler). Velocities
+ * are in world space and about the centre of mass, the inertia tensor in body axes. Contacts with static
+ * geometry get a frictionless impulse.
+ *
+ * @author  Rahul Mukhi
+ * @date 16/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "HullTriangleCache.h"
+
+#include "base/math/Vector3.h"
+#include "base/math/Quaternion.h"
+#include "base/math/Matrix4x4.h"
+
+class RigidBodyIntegrator
+{
+public:
+
+	struct State
+	{
+		Vector3 translate; // world position of the body origin
+		Quaternion orientation;
+		Vector3 linearVelocity, angularVelocity;
+		Matrix4x4 transform; // body to world
+	};
+
+	struct MassProperties
+	{
+		float mass;
+		Vector3 centreOfMass; // body space
+		Matrix4x4 inertia, inverseInertia; // body axes, about the centre of mass
+	};
+
+	static void initializeState(State& state, const Vector3& translate, const Quaternion& orientation);
+	static void computeMassProperties(HullTriangleCache& hull, float mass, MassProperties& massProperties);
+	static void applyBuoyancy(State& state, const MassProperties& massProperties, const HullTriangleCache::Buoyancy& buoyancy,
+		float pressureScale, float gravity, float dt);
+	static void integrate(State& state, const MassProperties& massProperties, float dt);
+	static void applyContact(State& state, const MassProperties& massProperties, const Vector3& point, const Vector3& normal, float restitution);
+
+	// world up direction in body space, the transposed rotation applied to the y axis
+	inline static Vector3 getUp(const State& state)
+	{
+		return Vector3(state.transform[1], state.transform[5], state.transform[9]);
+	}
+};
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "TMASpectrum.h"
+
+#include "base/util/DebugUtil.h"
+
+TMASpectrum::TMASpectrum(float windSpeed, float depth, float fetch, float gamma) :
+	JonswapSpectrum(windSpeed, fetch, gamma, depth)
+{
+	GS_ASSERT(depth > 0.0f);
+}
+
+TMASpectrum::~TMASpectrum()
+{
+}
+
+float TMASpectrum::getFrequencyDensity(float omega)
+{
+	// Kitaigorodskii approximation of the depth function
+	const float omegaDepth = omega*sqrt(m_depth/GRAVITY);
+	float depthFactor = 1.0f;
+
+	if(omegaDepth <= 1.0f) {
+		depthFactor = 0.5f*omegaDepth*omegaDepth;
+	} else if(omegaDepth < 2.0f) {
+		depthFactor = 1.0f - 0.5f*(2.0f - omegaDepth)*(2.0f - omegaDepth);
+	}
+
+	return JonswapSpectrum::getFrequencyDensity(omega)*depthFactor;
+}
+
+std::string TMASpectrum::getKey()
+{
+	return "tma_" + getParameterKey();
+}
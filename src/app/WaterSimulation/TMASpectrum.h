@@ -0,0 +1,26 @@
+/** \class TMASpectrum
+ * TMA spectrum for shallow water: JONSWAP times the Kitaigorodskii depth function, which damps the
+ * low frequencies that the depth cuts off, with the finite depth dispersion
+ *
+ * @author  Rahul Mukhi
+ * @date 12/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "JonswapSpectrum.h"
+
+class TMASpectrum : public JonswapSpectrum
+{
+public:
+	TMASpectrum(float windSpeed, float depth, float fetch = FETCH, float gamma = GAMMA);
+	virtual ~TMASpectrum();
+
+	virtual std::string getKey();
+
+protected:
+
+	virtual float getFrequencyDensity(float omega);
+};
@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+#include "TriangleBVH.h"
+
+#include "base/util/DebugUtil.h"
+
+#include <float.h>
+
+const float TriangleBVH::MIN_DETERMINANT = 1.0e-12f;
+
+TriangleBVH::TriangleBVH()
+{
+	m_pLeafData = NULL;
+	m_numLeaves = 0;
+}
+
+TriangleBVH::~TriangleBVH()
+{
+	SimdUtil::alignedFree(m_pLeafData);
+}
+
+void TriangleBVH::clear()
+{
+	m_vertices.clear();
+	m_nodes.clear();
+	m_leafTriangles.clear();
+	m_numLeaves = 0;
+
+	SimdUtil::alignedFree(m_pLeafData);
+	m_pLeafData = NULL;
+}
+
+void TriangleBVH::addTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2)
+{
+	m_vertices.push_back(v0);
+	m_vertices.push_back(v1);
+	m_vertices.push_back(v2);
+}
+
+/**
+ * Adds triangles from interleaved vertex data, three consecutive vertices per triangle
+ *
+ * @param  pVertexData  position first in every vertex.
+ * @param  vertexStride  floats from one vertex to the next.
+ */
+void TriangleBVH::addTriangles(const float* pVertexData, int numTriangles, int vertexStride)
+{
+	m_vertices.reserve(m_vertices.size() + 3*numTriangles);
+
+	for(int i=0; i<3*numTriangles; i++) {
+		m_vertices.push_back(Vector3(pVertexData + i*vertexStride));
+	}
+}
+
+void TriangleBVH::getTriangle(int index, Vector3& v0, Vector3& v1, Vector3& v2) const
+{
+	v0 = m_vertices[3*index];
+	v1 = m_vertices[3*index + 1];
+	v2 = m_vertices[3*index + 2];
+}
+
+// box around all triangles of the last build, false if it has none
+bool TriangleBVH::getBounds(Vector3& minimum, Vector3& maximum) const
+{
+	if(m_nodes.empty()) {
+		return false;
+	}
+
+	minimum.set(m_nodes[0].minimum);
+	maximum.set(m_nodes[0].maximum);
+	return true;
+}
+
+/**
+ * Builds the hierarchy over the triangles added so far, replaces an earlier build
+ */
+void TriangleBVH::build()
+{
+	m_nodes.clear();
+	m_leafTriangles.clear();
+	m_numLeaves = 0;
+
+	SimdUtil::alignedFree(m_pLeafData);
+	m_pLeafData = NULL;
+
+	const int numTriangles = getNumTriangles();
+
+	if(numTriangles == 0) {
+		return;
+	}
+
+	std::vector<Vector3> centroids(numTriangles);
+	std::vector<int> order(numTriangles);
+
+	for(int i=0; i<numTriangles; i++) {
+		centroids[i].add(m_vertices[3*i], m_vertices[3*i + 1]);
+		centroids[i].add(m_vertices[3*i + 2]);
+		centroids[i].scale(1.0f/3.0f);
+		order[i] = i;
+	}
+
+	m_nodes.reserve(numTriangles); // median splits leave at least two triangles per leaf
+	m_nodes.resize(1);
+	buildNode(0, order, centroids, 0, numTriangles);
+
+	// leaf triangles as first vertex and edges, padding stays zero
+	const int leafFloats = NUM_STREAMS*LEAF_SIZE;
+	m_pLeafData = (float*)SimdUtil::alignedMalloc(sizeof(float)*leafFloats*m_numLeaves);
+	memset(m_pLeafData, 0, sizeof(float)*leafFloats*m_numLeaves);
+
+	for(int leaf=0; leaf<m_numLeaves; leaf++) {
+
+		float* pData = m_pLeafData + leaf*leafFloats;
+
+		for(int i=0; i<LEAF_SIZE; i++) {
+
+			const int triangle = m_leafTriangles[leaf*LEAF_SIZE + i];
+
+			if(triangle < 0) {
+				continue;
+			}
+
+			const Vector3& v0 = m_vertices[3*triangle];
+			const Vector3& v1 = m_vertices[3*triangle + 1];
+			const Vector3& v2 = m_vertices[3*triangle + 2];
+
+			for(int axis=0; axis<3; axis++) {
+				pData[(STREAM_V0_X + axis)*LEAF_SIZE + i] = v0.v[axis];
+				pData[(STREAM_EDGE1_X + axis)*LEAF_SIZE + i] = v1.v[axis] - v0.v[axis];
+				pData[(STREAM_EDGE2_X + axis)*LEAF_SIZE + i] = v2.v[axis] - v0.v[axis];
+			}
+		}
+	}
+}
+
+// bounds of the triangles order[begin..end), leaf or median split of the centroids along their longest axis
+void TriangleBVH::buildNode(int nodeIndex, std::vector<int>& order, const std::vector<Vector3>& centroids, int begin, int end)
+{
+	Vector3 minimum = m_vertices[3*order[begin]];
+	Vector3 maximum = minimum;
+	Vector3 centroidMinimum = centroids[order[begin]];
+	Vector3 centroidMaximum = centroidMinimum;
+
+	for(int i=begin; i<end; i++) {
+
+		for(int v=0; v<3; v++) {
+			for(int axis=0; axis<3; axis++) {
+				minimum[axis] = std::min(minimum[axis], m_vertices[3*order[i] + v].v[axis]);
+				maximum[axis] = std::max(maximum[axis], m_vertices[3*order[i] + v].v[axis]);
+			}
+		}
+
+		for(int axis=0; axis<3; axis++) {
+			centroidMinimum[axis] = std::min(centroidMinimum[axis], centroids[order[i]].v[axis]);
+			centroidMaximum[axis] = std::max(centroidMaximum[axis], centroids[order[i]].v[axis]);
+		}
+	}
+
+	for(int axis=0; axis<3; axis++) {
+		m_nodes[nodeIndex].minimum[axis] = minimum[axis];
+		m_nodes[nodeIndex].maximum[axis] = maximum[axis];
+	}
+
+	if(end - begin <= LEAF_SIZE) {
+
+		m_nodes[nodeIndex].firstChild = -1;
+		m_nodes[nodeIndex].leaf = m_numLeaves++;
+
+		for(int i=0; i<LEAF_SIZE; i++) {
+			m_leafTriangles.push_back((begin + i < end) ? order[begin + i] : -1);
+		}
+		return;
+	}
+
+	centroidComparison comparison;
+	comparison.pCentroids = &centroids;
+	comparison.axis = 0;
+
+	for(int axis=1; axis<3; axis++) {
+		if(centroidMaximum[axis] - centroidMinimum[axis] > centroidMaximum[comparison.axis] - centroidMinimum[comparison.axis]) {
+			comparison.axis = axis;
+		}
+	}
+
+	const int middle = (begin + end)/2;
+	std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, comparison);
+
+	const int firstChild = (int)m_nodes.size();
+	m_nodes.resize(firstChild + 2);
+	m_nodes[nodeIndex].firstChild = firstChild;
+	m_nodes[nodeIndex].leaf = -1;
+
+	buildNode(firstChild, order, centroids, begin, middle);
+	buildNode(firstChild + 1, order, centroids, middle, end);
+}
+
+/**
+ * Earliest crossing of the triangles by points moving along straight segments, e.g. the hull vertices of a body
+ * from its transform before a step to the one after it
+ *
+ * @param  pStart, pEnd  numPoints segment ends each.
+ * @param  hit  receives the crossing, only valid if true is returned.
+ * @return  true if a segment crosses a triangle.
+ */
+bool TriangleBVH::sweepPoints(const Vector3* pStart, const Vector3* pEnd, int numPoints, Hit& hit) const
+{
+	hit.fraction = FLT_MAX;
+	hit.pointIndex = -1;
+
+	if(m_nodes.empty() || (numPoints <= 0)) {
+		return false;
+	}
+
+	// broad phase, the box around all segments
+	float minimum[3], maximum[3];
+
+	for(int axis=0; axis<3; axis++) {
+		minimum[axis] = std::min(pStart[0].v[axis], pEnd[0].v[axis]);
+		maximum[axis] = std::max(pStart[0].v[axis], pEnd[0].v[axis]);
+	}
+
+	for(int i=1; i<numPoints; i++) {
+		for(int axis=0; axis<3; axis++) {
+			minimum[axis] = std::min(minimum[axis], std::min(pStart[i].v[axis], pEnd[i].v[axis]));
+			maximum[axis] = std::max(maximum[axis], std::max(pStart[i].v[axis], pEnd[i].v[axis]));
+		}
+	}
+
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while(stackSize > 0) {
+
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		if(!overlaps(node, minimum, maximum)) {
+			continue;
+		}
+
+		if(node.leaf < 0) {
+			GS_ASSERT(stackSize + 2 <= MAX_DEPTH);
+			stack[stackSize++] = node.firstChild + 1;
+			stack[stackSize++] = node.firstChild;
+			continue;
+		}
+
+		for(int i=0; i<numPoints; i++) {
+
+			float segmentMinimum[3], segmentMaximum[3];
+
+			for(int axis=0; axis<3; axis++) {
+				segmentMinimum[axis] = std::min(pStart[i].v[axis], pEnd[i].v[axis]);
+				segmentMaximum[axis] = std::max(pStart[i].v[axis], pEnd[i].v[axis]);
+			}
+
+			if(overlaps(node, segmentMinimum, segmentMaximum)) {
+				sweepLeaf(node.leaf, pStart[i], pEnd[i], i, hit);
+			}
+		}
+	}
+
+	return hit.pointIndex >= 0;
+}
+
+/**
+ * Broad phase for a moving body, true if the box touches the box of a leaf. Much cheaper than sweepPoints
+ * when the body is away from the triangles.
+ */
+bool TriangleBVH::overlapsBox(const Vector3& minimum, const Vector3& maximum) const
+{
+	if(m_nodes.empty()) {
+		return false;
+	}
+
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while(stackSize > 0) {
+
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		if(!overlaps(node, minimum.v, maximum.v)) {
+			continue;
+		}
+
+		if(node.leaf >= 0) {
+			return true;
+		}
+
+		GS_ASSERT(stackSize + 2 <= MAX_DEPTH);
+		stack[stackSize++] = node.firstChild + 1;
+		stack[stackSize++] = node.firstChild;
+	}
+
+	return false;
+}
+
+/**
+ * Triangle vertices inside a box, e.g. to sweep them against a moving body in its own space. A vertex shared by
+ * several triangles is added once per triangle.
+ *
+ * @param  minimum, maximum  corners of the box.
+ * @param  vertices  cleared, then receives the vertices, keeps its capacity.
+ */
+void TriangleBVH::collectVertices(const Vector3& minimum, const Vector3& maximum, std::vector<Vector3>& vertices) const
+{
+	vertices.clear();
+
+	if(m_nodes.empty()) {
+		return;
+	}
+
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while(stackSize > 0) {
+
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		if(!overlaps(node, minimum.v, maximum.v)) {
+			continue;
+		}
+
+		if(node.leaf < 0) {
+			GS_ASSERT(stackSize + 2 <= MAX_DEPTH);
+			stack[stackSize++] = node.firstChild + 1;
+			stack[stackSize++] = node.firstChild;
+			continue;
+		}
+
+		for(int i=0; i<LEAF_SIZE; i++) {
+
+			const int triangle = m_leafTriangles[node.leaf*LEAF_SIZE + i];
+			if(triangle < 0) {
+				continue;
+			}
+
+			for(int k=0; k<3; k++) {
+				const Vector3& vertex = m_vertices[3*triangle + k];
+
+				if((vertex.v[0] >= minimum.v[0]) && (vertex.v[0] <= maximum.v[0]) && (vertex.v[1] >= minimum.v[1]) && (vertex.v[1] <= maximum.v[1])
+					&& (vertex.v[2] >= minimum.v[2]) && (vertex.v[2] <= maximum.v[2])) {
+					vertices.push_back(vertex);
+				}
+			}
+		}
+	}
+}
+
+// Moller-Trumbore for the segment against the four triangles of the leaf, keeps the hit if it is earlier
+void TriangleBVH::sweepLeaf(int leaf, const Vector3& start, const Vector3& end, int pointIndex, Hit& hit) const
+{
+	const float* pData = m_pLeafData + leaf*NUM_STREAMS*LEAF_SIZE;
+	const float directionX = end.v[0] - start.v[0];
+	const float directionY = end.v[1] - start.v[1];
+	const float directionZ = end.v[2] - start.v[2];
+
+	float fractions[LEAF_SIZE];
+
+#if defined(GS_SSE2)
+
+	const __m128 dx = _mm_set1_ps(directionX);
+	const __m128 dy = _mm_set1_ps(directionY);
+	const __m128 dz = _mm_set1_ps(directionZ);
+
+	const __m128 e1x = _mm_load_ps(pData + STREAM_EDGE1_X*LEAF_SIZE);
+	const __m128 e1y = _mm_load_ps(pData + STREAM_EDGE1_Y*LEAF_SIZE);
+	const __m128 e1z = _mm_load_ps(pData + STREAM_EDGE1_Z*LEAF_SIZE);
+	const __m128 e2x = _mm_load_ps(pData + STREAM_EDGE2_X*LEAF_SIZE);
+	const __m128 e2y = _mm_load_ps(pData + STREAM_EDGE2_Y*LEAF_SIZE);
+	const __m128 e2z = _mm_load_ps(pData + STREAM_EDGE2_Z*LEAF_SIZE);
+
+	// p = d x e2
+	const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+	const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	const __m128 absDeterminant = _mm_andnot_ps(_mm_castsi128_ps(_mm_set1_epi32(0x80000000)), determinant);
+	const __m128 invDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+	// s = start - v0
+	const __m128 sx = _mm_sub_ps(_mm_set1_ps(start.v[0]), _mm_load_ps(pData + STREAM_V0_X*LEAF_SIZE));
+	const __m128 sy = _mm_sub_ps(_mm_set1_ps(start.v[1]), _mm_load_ps(pData + STREAM_V0_Y*LEAF_SIZE));
+	const __m128 sz = _mm_sub_ps(_mm_set1_ps(start.v[2]), _mm_load_ps(pData + STREAM_V0_Z*LEAF_SIZE));
+
+	const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDeterminant);
+
+	// q = s x e1
+	const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+	const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDeterminant);
+	const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDeterminant);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	// comparisons with the NaNs of padding triangles are false
+	__m128 mask = _mm_cmpgt_ps(absDeterminant, _mm_set1_ps(MIN_DETERMINANT));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+	mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+	mask = _mm_and_ps(mask, _mm_cmple_ps(t, one));
+
+	_mm_storeu_ps(fractions, _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, _mm_set1_ps(FLT_MAX))));
+
+#else
+
+	for(int i=0; i<LEAF_SIZE; i++) {
+
+		const float e1x = pData[STREAM_EDGE1_X*LEAF_SIZE + i], e1y = pData[STREAM_EDGE1_Y*LEAF_SIZE + i], e1z = pData[STREAM_EDGE1_Z*LEAF_SIZE + i];
+		const float e2x = pData[STREAM_EDGE2_X*LEAF_SIZE + i], e2y = pData[STREAM_EDGE2_Y*LEAF_SIZE + i], e2z = pData[STREAM_EDGE2_Z*LEAF_SIZE + i];
+
+		const float px = directionY*e2z - directionZ*e2y;
+		const float py = directionZ*e2x - directionX*e2z;
+		const float pz = directionX*e2y - directionY*e2x;
+		const float determinant = e1x*px + e1y*py + e1z*pz;
+
+		fractions[i] = FLT_MAX;
+
+		if(fabs(determinant) <= MIN_DETERMINANT) {
+			continue;
+		}
+
+		const float invDeterminant = 1.0f/determinant;
+		const float sx = start.v[0] - pData[STREAM_V0_X*LEAF_SIZE + i];
+		const float sy = start.v[1] - pData[STREAM_V0_Y*LEAF_SIZE + i];
+		const float sz = start.v[2] - pData[STREAM_V0_Z*LEAF_SIZE + i];
+		const float u = (sx*px + sy*py + sz*pz)*invDeterminant;
+
+		const float qx = sy*e1z - sz*e1y;
+		const float qy = sz*e1x - sx*e1z;
+		const float qz = sx*e1y - sy*e1x;
+		const float v = (directionX*qx + directionY*qy + directionZ*qz)*invDeterminant;
+		const float t = (e2x*qx + e2y*qy + e2z*qz)*invDeterminant;
+
+		if((u >= 0.0f) && (v >= 0.0f) && (u + v <= 1.0f) && (t >= 0.0f) && (t <= 1.0f)) {
+			fractions[i] = t;
+		}
+	}
+
+#endif
+
+	for(int i=0; i<LEAF_SIZE; i++) {
+
+		if(fractions[i] >= hit.fraction) {
+			continue;
+		}
+
+		const Vector3 direction(directionX, directionY, directionZ);
+		const Vector3 edge1(pData[STREAM_EDGE1_X*LEAF_SIZE + i], pData[STREAM_EDGE1_Y*LEAF_SIZE + i], pData[STREAM_EDGE1_Z*LEAF_SIZE + i]);
+		const Vector3 edge2(pData[STREAM_EDGE2_X*LEAF_SIZE + i], pData[STREAM_EDGE2_Y*LEAF_SIZE + i], pData[STREAM_EDGE2_Z*LEAF_SIZE + i]);
+
+		hit.fraction = fractions[i];
+		hit.pointIndex = pointIndex;
+		hit.triangleIndex = m_leafTriangles[leaf*LEAF_SIZE + i];
+		hit.point = start;
+		hit.point.madd(direction, fractions[i]);
+		hit.normal.crossProduct(edge1, edge2);
+		hit.normal.normalize();
+
+		if(hit.normal.dotProduct(direction) > 0.0f) {
+			hit.normal.negate();
+		}
+	}
+}
@@ -0,0 +1,108 @@
+/** \class TriangleBVH
+ * Static bounding volume hierarchy over world triangles, built once at load for the collision queries of moving
+ * bodies against the port. Nodes split at the median of the triangle centroids along the longest axis until at
+ * most LEAF_SIZE triangles are left, the leaf triangles are stored as a structure of arrays (first vertex and two
+ * edges) so one SSE2 Moller-Trumbore test covers the whole leaf. A query sweeps points along segments, the box
+ * around all segments rejects whole subtrees and each segment is only tested against leaves its own box touches.
+ * Triangles are two sided.
+ *
+ * @author  Rahul Mukhi
+ * @date 19/06/12
+ *
+ * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "base/math/Vector3.h"
+#include "base/math/SimdUtil.h"
+
+#include <vector>
+
+class TriangleBVH
+{
+public:
+	TriangleBVH();
+	~TriangleBVH();
+
+	static const int LEAF_SIZE = 4; // triangles per leaf, one SIMD group
+	static const int MAX_DEPTH = 64; // traversal stack, median splits stay far below it
+	static const float MIN_DETERMINANT; // segments closer to parallel with a triangle do not cross it
+
+	// earliest crossing of sweepPoints
+	struct Hit
+	{
+		float fraction; // along the segments, 0 at the start points and 1 at the end points
+		int pointIndex; // segment that crosses first
+		int triangleIndex; // in the order the triangles were added
+		Vector3 point; // where the segment crosses the triangle
+		Vector3 normal; // unit triangle normal, facing the start of the segment
+	};
+
+	void clear();
+	void addTriangle(const Vector3& v0, const Vector3& v1, const Vector3& v2);
+	void addTriangles(const float* pVertexData, int numTriangles, int vertexStride);
+	void build();
+	bool sweepPoints(const Vector3* pStart, const Vector3* pEnd, int numPoints, Hit& hit) const;
+	bool overlapsBox(const Vector3& minimum, const Vector3& maximum) const;
+	void collectVertices(const Vector3& minimum, const Vector3& maximum, std::vector<Vector3>& vertices) const;
+	void getTriangle(int index, Vector3& v0, Vector3& v1, Vector3& v2) const;
+	bool getBounds(Vector3& minimum, Vector3& maximum) const;
+
+	inline int getNumTriangles() const
+	{
+		return (int)m_vertices.size()/3;
+	}
+
+	inline int getNumNodes() const
+	{
+		return (int)m_nodes.size();
+	}
+
+	// orders triangle indices by their centroid along one axis for the median split
+	struct centroidComparison
+	{
+		const std::vector<Vector3>* pCentroids;
+		int axis;
+
+		bool operator()(int t1, int t2) const
+		{
+			return (*pCentroids)[t1].v[axis] < (*pCentroids)[t2].v[axis];
+		}
+	};
+
+private:
+
+	enum Stream
+	{
+		STREAM_V0_X, STREAM_V0_Y, STREAM_V0_Z,
+		STREAM_EDGE1_X, STREAM_EDGE1_Y, STREAM_EDGE1_Z, // v1-v0
+		STREAM_EDGE2_X, STREAM_EDGE2_Y, STREAM_EDGE2_Z, // v2-v0
+		NUM_STREAMS
+	};
+
+	struct Node
+	{
+		float minimum[3], maximum[3];
+		int firstChild; // the second child follows it, -1 for leaves
+		int leaf; // index of the leaf's triangle group, -1 for inner nodes
+	};
+
+	std::vector<Vector3> m_vertices; // three per triangle, as added
+	std::vector<Node> m_nodes; // root first
+
+	// NUM_STREAMS*LEAF_SIZE floats per leaf, 16 byte aligned, padding triangles have zero edges and are never crossed
+	float* m_pLeafData;
+	std::vector<int> m_leafTriangles; // LEAF_SIZE triangle indices per leaf, -1 for padding
+	int m_numLeaves;
+
+	void buildNode(int nodeIndex, std::vector<int>& order, const std::vector<Vector3>& centroids, int begin, int end);
+	void sweepLeaf(int leaf, const Vector3& start, const Vector3& end, int pointIndex, Hit& hit) const;
+
+	inline static bool overlaps(const Node& node, const float* pMinimum, const float* pMaximum)
+	{
+		return (node.minimum[0] <= pMaximum[0]) && (node.maximum[0] >= pMinimum[0])
+			&& (node.minimum[1] <= pMaximum[1]) && (node.maximum[1] >= pMinimum[1])
+			&& (node.minimum[2] <= pMaximum[2]) && (node.maximum[2] >= pMinimum[2]);
+	}
+};
@@ -5,8 +5,14 @@
 #include "PreCompiled.h"
 #include "WaterScene.h"
 
+#include "base/util/TimeUtil.h"
+
 using namespace std;
 
+const float WaterScene::FRAME_TIME = 1.0f/60.0f;
+
+int WaterScene::m_numFloatingBodies = 0;
+
 WaterScene::WaterScene()
 {
 	m_frame = m_time = m_timebase = 0;
@@ -17,17 +23,26 @@ WaterScene::WaterScene()
 	m_pPortScene = new PortScene();
 	m_pWaterShape = new WaterShape(m_pPortScene);
 	m_pBoat = new RigidBody(m_pWaterShape->m_waterSimulation, m_camera);
+	m_pFloatingBodies = new FloatingBodySystem(m_pWaterShape->m_waterSimulation);
 
 	m_renderPort = true;
 
+	m_inputMode = INPUT_LIVE;
+	m_tick = m_nextReplayEvent = 0;
+	m_updateTime = m_renderTime = m_replayStartTime = .0;
+
 	initWaterScene();
+	addFloatingBodies();
 }
 
 WaterScene::~WaterScene()
 {
+	stopHeightFieldRecording();
+
 	delete m_pPortScene;
 	delete m_pWaterShape;
 	delete m_pBoat;
+	delete m_pFloatingBodies;
 }
 
 void WaterScene::initWaterScene()
@@ -53,25 +68,55 @@ void WaterScene::initLight()
 
 }
 
+void WaterScene::addFloatingBodies()
+{
+	if(m_numFloatingBodies <= 0) {
+		return;
+	}
+
+	const int crate = m_pFloatingBodies->addBoxShape(Vector3(0.5f, 0.4f, 0.5f), 2);
+	const int plank = m_pFloatingBodies->addBoxShape(Vector3(1.0f, 0.1f, 0.25f), 2);
+
+	// rand() is seeded for recording and replay
+	for(int i=0; i<m_numFloatingBodies; i++) {
+
+		const float angle = 6.2831853f*rand()/float(RAND_MAX);
+		const float radius = 15.0f + 50.0f*rand()/float(RAND_MAX);
+		const Vector3 position(radius*cos(angle), WaterSimulation::TOTAL_HEIGHT + 1.0f, radius*sin(angle));
+		const float density = 0.3f + 0.5f*rand()/float(RAND_MAX);
+
+		m_pFloatingBodies->addBody((i%2 == 0) ? crate : plank, density, position, Quaternion(angle, Vector3(0.0f, 1.0f, 0.0f)));
+	}
+}
+
 void WaterScene::update()
 {
-	m_camera.moveCamera();
+	if(m_inputMode == INPUT_REPLAY) {
+		dispatchReplayEvents();
+	}
 
-	unsigned int time1 = glutGet(GLUT_ELAPSED_TIME);
+	const double time1 = TimeUtil::getTime();
 
-	m_pWaterShape->update(m_camera.getCameraView());
+	m_camera.moveCamera();
+
+	m_pWaterShape->update(m_camera.getCameraView(), getSimulationTime());
 	m_pBoat->rigidBodyInteraction();
+	m_pFloatingBodies->update();
+
+	m_updateTime += TimeUtil::getTime() - time1;
 
-	unsigned int time2 = glutGet(GLUT_ELAPSED_TIME);
+	if(m_heightFieldRecorder.isOpen()) {
+		recordHeightField();
+	}
 
-	//std::cout<<time2 - time1<<std::endl;
+	m_tick++;
 
 }
 
 
 void WaterScene::renderScene()
 {
-	unsigned int time1 = glutGet(GLUT_ELAPSED_TIME);
+	const double time1 = TimeUtil::getTime();
 
 	// Preparing the buffer so it sends data to GPU while doing other operations
 	m_pWaterShape->updateSWEGrid();
@@ -88,6 +133,7 @@ void WaterScene::renderScene()
 	glEnable(GL_LIGHT0);
 
 	m_pBoat->renderObject();
+	m_pFloatingBodies->render();
 
 	glDisable(GL_LIGHT0);
 	glDisable(GL_LIGHTING);
@@ -110,9 +156,7 @@ void WaterScene::renderScene()
 
 	glutSwapBuffers();
 
-	unsigned int time2 = glutGet(GLUT_ELAPSED_TIME);
-
-	//std::cout<<time2 - time1<<std::endl;
+	m_renderTime += TimeUtil::getTime() - time1;
 }
 
 void WaterScene::createReflectionTexture()
@@ -195,39 +239,27 @@ void WaterScene::createReflectionTexture()
 
 void WaterScene::pressKey(int key)
 {
-	m_camera.keyPressed(key);
+	recordEvent(InputTrace::EVENT_SPECIAL_KEY_DOWN, key, 0, .0f, .0f);
 }
 
 void WaterScene::releaseKey(int key)
 {
-	m_camera.keyReleased(key);
+	recordEvent(InputTrace::EVENT_SPECIAL_KEY_UP, key, 0, .0f, .0f);
 }
 
 void WaterScene::pressNormalKey(unsigned char key)
 {
-	m_pBoat->pressNormalKey(key);
-	m_pWaterShape->pressNormalKey(key);
-
-	if(key == 'r') {
-
-		if(m_renderPort) {
-			m_renderPort= false;
-		} else {
-			m_renderPort = true;
-		}
-
-	}
-
+	recordEvent(InputTrace::EVENT_NORMAL_KEY_DOWN, key, 0, .0f, .0f);
 }
 
 void WaterScene::releaseNormalKey(unsigned char key)
 {
-	m_pBoat->releaseNormalKey(key);
+	recordEvent(InputTrace::EVENT_NORMAL_KEY_UP, key, 0, .0f, .0f);
 }
 
 void WaterScene::mouseMoved(int x, int y)
 {
-	m_camera.mouseMoved(x,y);
+	recordEvent(InputTrace::EVENT_MOUSE_MOVE, x, y, .0f, .0f);
 }
 
 void WaterScene::mouseButton(int button, int state, int x, int y)
@@ -250,11 +282,180 @@ void WaterScene::mouseButton(int button, int state, int x, int y)
 			glReadPixels( x, y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &z );
 			gluUnProject( (float)x, (float)y, z, modelview, projection, viewport, &objPosX, &objPosY, &objPosZ);
 
-			m_pWaterShape->addDrop(objPosX,objPosZ);
+			// the world position is traced, the depth read back is not reproducible headless
+			recordEvent(InputTrace::EVENT_DROP, 0, 0, (float)objPosX, (float)objPosZ);
 		}
 	}
 }
 
+void WaterScene::recordEvent(InputTrace::EventType type, int x, int y, float posX, float posZ)
+{
+	if(m_inputMode == INPUT_REPLAY) {
+		return;
+	}
+
+	if(m_inputMode == INPUT_RECORD) {
+
+		InputTrace::Event event;
+		event.tick = m_tick;
+		event.type = type;
+		event.x = x;
+		event.y = y;
+		event.posX = posX;
+		event.posZ = posZ;
+
+		m_inputTrace.addEvent(event);
+	}
+
+	applyEvent(type, x, y, posX, posZ);
+}
+
+void WaterScene::dispatchReplayEvents()
+{
+	while((m_nextReplayEvent < m_inputTrace.getNumEvents()) && (m_inputTrace.getEvent(m_nextReplayEvent).tick <= m_tick)) {
+
+		const InputTrace::Event& event = m_inputTrace.getEvent(m_nextReplayEvent);
+		applyEvent(event.type, event.x, event.y, event.posX, event.posZ);
+
+		m_nextReplayEvent++;
+	}
+}
+
+void WaterScene::applyEvent(InputTrace::EventType type, int x, int y, float posX, float posZ)
+{
+	unsigned char key = (unsigned char)x;
+
+	switch(type) {
+
+		case InputTrace::EVENT_NORMAL_KEY_DOWN:
+
+			m_pBoat->pressNormalKey(key);
+			m_pWaterShape->pressNormalKey(key);
+
+			if(key == 'r') {
+
+				if(m_renderPort) {
+					m_renderPort= false;
+				} else {
+					m_renderPort = true;
+				}
+
+			}
+			break;
+
+		case InputTrace::EVENT_NORMAL_KEY_UP:
+			m_pBoat->releaseNormalKey(key);
+			break;
+
+		case InputTrace::EVENT_SPECIAL_KEY_DOWN:
+			m_camera.keyPressed(x);
+			break;
+
+		case InputTrace::EVENT_SPECIAL_KEY_UP:
+			m_camera.keyReleased(x);
+			break;
+
+		case InputTrace::EVENT_MOUSE_MOVE:
+			m_camera.mouseMoved(x,y);
+			break;
+
+		case InputTrace::EVENT_DROP:
+			m_pWaterShape->addDrop(posX,posZ);
+			break;
+
+		default:
+			break;
+	}
+}
+
+void WaterScene::startRecording(const char* filename, unsigned int seed)
+{
+	m_inputMode = INPUT_RECORD;
+	m_traceFilename = filename;
+	m_inputTrace.clear(seed);
+	m_tick = 0;
+
+	std::cout << "Recording input trace " << filename << " (seed " << seed << ")" << std::endl;
+}
+
+void WaterScene::stopRecording()
+{
+	if(m_inputMode != INPUT_RECORD) {
+		return;
+	}
+
+	m_inputTrace.setNumTicks(m_tick);
+
+	if(m_inputTrace.save(m_traceFilename.c_str())) {
+		std::cout << "Saved input trace " << m_traceFilename << ": " << m_tick << " ticks, " << m_inputTrace.getNumEvents() << " events" << std::endl;
+	}
+
+	m_inputMode = INPUT_LIVE;
+}
+
+/**
+ * Replays a trace loaded with InputTrace::load. The scene has to be created after srand(inputTrace.getSeed())
+ * so the FFT spectrum and new SWE cells match the recording.
+ */
+void WaterScene::startReplay(const InputTrace& inputTrace)
+{
+	m_inputMode = INPUT_REPLAY;
+	m_inputTrace = inputTrace;
+	m_tick = 0;
+	m_nextReplayEvent = 0;
+	m_updateTime = m_renderTime = .0;
+	m_replayStartTime = TimeUtil::getTime();
+}
+
+bool WaterScene::isReplayFinished()
+{
+	return (m_inputMode == INPUT_REPLAY) && (m_tick >= m_inputTrace.getNumTicks());
+}
+
+void WaterScene::printReplayReport()
+{
+	const double totalTime = TimeUtil::getTime() - m_replayStartTime;
+	const double numTicks = std::max(1u, m_tick);
+
+	std::cout << "Replay: " << m_tick << " ticks, " << m_inputTrace.getNumEvents() << " events in " << totalTime << " s" << std::endl;
+	std::cout << "  update " << 1000.0*m_updateTime/numTicks << " ms/tick, render " << 1000.0*m_renderTime/numTicks << " ms/tick, "
+		<< numTicks/totalTime << " ticks/s" << std::endl;
+}
+
+void WaterScene::startHeightFieldRecording(const char* filename, HeightFieldRecorder::Encoding encoding, bool recordVelocities)
+{
+	m_recordHeights.resize(WaterSimulation::NUM_GRIDS);
+	m_recordXVelocities.resize(recordVelocities ? WaterSimulation::NUM_GRIDS : 0);
+	m_recordZVelocities.resize(recordVelocities ? WaterSimulation::NUM_GRIDS : 0);
+
+	m_heightFieldRecorder.open(filename, WaterSimulation::NUM_CELLS, WaterSimulation::NUM_CELLS, WaterSimulation::CELL_EDGE, WaterSimulation::TOTAL_HEIGHT, recordVelocities, encoding);
+}
+
+void WaterScene::stopHeightFieldRecording()
+{
+	m_heightFieldRecorder.close();
+}
+
+void WaterScene::recordHeightField()
+{
+	WaterSimulation& waterSimulation = m_pWaterShape->m_waterSimulation;
+
+	float* pXVelocities = m_recordXVelocities.empty() ? NULL : &m_recordXVelocities[0];
+	float* pZVelocities = m_recordZVelocities.empty() ? NULL : &m_recordZVelocities[0];
+
+	waterSimulation.fillHeightField(&m_recordHeights[0], pXVelocities, pZVelocities);
+	m_heightFieldRecorder.appendFrame(getSimulationTime(), waterSimulation.getOriginX(), waterSimulation.getOriginZ(), &m_recordHeights[0], pXVelocities, pZVelocities);
+}
+
+float WaterScene::getSimulationTime()
+{
+	if(m_inputMode == INPUT_LIVE) {
+		return glutGet(GLUT_ELAPSED_TIME)/1000.0f;
+	}
+
+	// fixed ticks so recording and replay see the same FFT animation
+	return float(m_tick)*FRAME_TIME;
+}
 
 void WaterScene::displayFPS()
 {
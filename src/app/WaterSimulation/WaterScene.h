@@ -15,6 +15,9 @@
 #include "Camera.h"
 #include "SkyBox.h"
 #include "RigidBody.h"
+#include "FloatingBodySystem.h"
+#include "InputTrace.h"
+#include "HeightFieldRecorder.h"
 
 #include "base/math/Plane.h"
 #include "base/math/Vector3.h"
@@ -30,6 +33,21 @@ public:
 	WaterScene();
 	~WaterScene();
 
+	enum InputMode
+	{
+		INPUT_LIVE,
+		INPUT_RECORD, // live input, events are written to a trace
+		INPUT_REPLAY // live input is ignored, events come from a trace
+	};
+
+	static const float FRAME_TIME; // simulated seconds per tick while recording or replaying
+
+	// crates and planks dropped around the boat by scenes created afterwards
+	inline static void setNumFloatingBodies(int numBodies)
+	{
+		m_numFloatingBodies = numBodies;
+	}
+
 	int m_windowWidth, m_windowHeight;
 
 	void initWaterScene();
@@ -44,8 +62,26 @@ public:
 	void pressNormalKey(unsigned char key);
 	void releaseNormalKey(unsigned char key);
 
+	void startRecording(const char* filename, unsigned int seed);
+	void stopRecording();
+	void startReplay(const InputTrace& inputTrace);
+	bool isReplayFinished();
+	void printReplayReport();
+
+	void startHeightFieldRecording(const char* filename, HeightFieldRecorder::Encoding encoding, bool recordVelocities);
+	void stopHeightFieldRecording();
+
 private:
 
+	InputMode m_inputMode;
+	InputTrace m_inputTrace;
+	std::string m_traceFilename;
+	unsigned int m_tick, m_nextReplayEvent;
+	double m_updateTime, m_renderTime, m_replayStartTime;
+
+	HeightFieldRecorder m_heightFieldRecorder;
+	std::vector<float> m_recordHeights, m_recordXVelocities, m_recordZVelocities;
+
 	int m_frame, m_time, m_timebase;
 	char m_fps[50];
 	
@@ -53,7 +89,10 @@ private:
 	PortScene* m_pPortScene;
 	WaterShape* m_pWaterShape;
 	RigidBody* m_pBoat;
+	FloatingBodySystem* m_pFloatingBodies;
 	Camera m_camera;
+
+	static int m_numFloatingBodies;
 	
 	bool m_renderPort;
 
@@ -62,6 +101,13 @@ private:
 	unsigned char* m_pTexBuffer;
 
 	void initLight();
+	void addFloatingBodies();
+
+	float getSimulationTime();
+	void recordEvent(InputTrace::EventType type, int x, int y, float posX, float posZ);
+	void dispatchReplayEvents();
+	void recordHeightField();
+	void applyEvent(InputTrace::EventType type, int x, int y, float posX, float posZ);
 	void createReflectionTexture();
 
 	void renderBitmapString(void *pFont, char *pString);
@@ -4,18 +4,33 @@
 
 #include "WaterShape.h"
 
+#include "base/util/MeshUtil.h"
+#include "base/util/TimeUtil.h"
+
 using namespace std;
 
 
-WaterShape::WaterShape(PortScene* portScene): m_waterSimulation(portScene)
+const float WaterShape::SEA_STATE_WIND_SPEED = 8.0f;
+const float WaterShape::SHALLOW_WATER_DEPTH = 5.0f;
+
+WaterShape::WaterShape(PortScene* portScene): m_waterSimulation(portScene),
+	m_piersonMoskowitzSpectrum(SEA_STATE_WIND_SPEED),
+	m_jonswapSpectrum(SEA_STATE_WIND_SPEED),
+	m_tmaSpectrum(SEA_STATE_WIND_SPEED, SHALLOW_WATER_DEPTH)
 {
-	initWaterShape();
+	m_seaState = SEA_STATE_PHILLIPS;
 	m_line = false;
+	m_skipGroundQuads = true;
+	initWaterShape();
+
+	// boats outside the SWE grid float on the FFT waves
+	m_waterSimulation.setOpenSea(&m_fftOcean);
 }
 
 WaterShape::~WaterShape()
 {
 	delete[] m_fftNormals;
+	delete[] m_fftDisplacements;
 	deleteVBO();
 	deleteShaders();
 	deleteFrameBufferObject();
@@ -25,35 +40,44 @@ void WaterShape::initWaterShape()
 {
 	initializeGrid();
 	initShaders();
+	initFFTSimulation();
 	initNormalMap();
 	initFrameBufferObject();
-	initFFTSimulation();
 
 	createVBO();
 
-	m_fftNormals = new unsigned char[m_fftSimulation.GRIDSIZE * m_fftSimulation.GRIDSIZE * 4];
+	// all cascades have the same grid size and are uploaded one after the other
+	const int fftGridSize = m_fftOcean.getCascade(0)->getGridSize();
+
+	m_fftNormals = new unsigned char[fftGridSize * fftGridSize * 4];
+	m_fftDisplacements = new float[fftGridSize * fftGridSize * 3];
 }
 
 void WaterShape::createVBO()
 {
-	std::vector<GLuint> indexVectSWE;
-	std::vector<GLuint> indexVectFFT;
-	indexVectSWE.clear();
-	indexVectFFT.clear();
+	std::vector<GLushort> indexVectFFT;
 
-	m_waterSimulation.fillIndicesSWE(indexVectSWE);
 	m_waterSimulation.fillIndicesFFT(indexVectFFT);
 
-	m_numIndicesSWE = indexVectSWE.size();
 	m_numIndicesFFT = indexVectFFT.size();
 
+	// strips with primitive restart need GL 3.1, otherwise fall back to a triangle list
+	m_useStripsSWE = (GLEW_VERSION_3_1 != 0);
+
+	if(m_waterSimulation.NUM_GRIDS < 0xFFFF) {
+		m_indexTypeSWE = GL_UNSIGNED_SHORT;
+		m_restartIndexSWE = 0xFFFF;
+	} else {
+		m_indexTypeSWE = GL_UNSIGNED_INT;
+		m_restartIndexSWE = 0xFFFFFFFF;
+	}
+
 	glGenBuffers(1, &m_vertexVBOIdSWE);
 	glBindBuffer(GL_ARRAY_BUFFER, m_vertexVBOIdSWE);
 	glBufferData(GL_ARRAY_BUFFER, m_waterSimulation.NUM_GRIDS*6*sizeof(float), NULL, GL_STREAM_DRAW);
 
 	glGenBuffers(1, &m_indexVBOIdSWE);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBOIdSWE);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_numIndicesSWE*sizeof(GLuint), &indexVectSWE[0], GL_STATIC_DRAW);
+	updateIndicesSWE();
 
 	glGenBuffers(1, &m_vertexVBOIdFFT);
 	glBindBuffer(GL_ARRAY_BUFFER, m_vertexVBOIdFFT);
@@ -65,10 +89,61 @@ void WaterShape::createVBO()
 
 	glGenBuffers(1, &m_indexVBOIdFFT);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBOIdFFT);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_numIndicesFFT*sizeof(GLuint), &indexVectFFT[0], GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_numIndicesFFT*sizeof(GLushort), &indexVectFFT[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	reportIndexCacheEfficiency();
 	
 }
 
+void WaterShape::updateIndicesSWE()
+{
+	if(m_indexTypeSWE == GL_UNSIGNED_SHORT) {
+		uploadIndicesSWE<GLushort>();
+	} else {
+		uploadIndicesSWE<GLuint>();
+	}
+
+	m_waterSimulation.resetCellStatesChanged();
+}
+
+template <class IndexType> void WaterShape::uploadIndicesSWE()
+{
+	std::vector<IndexType> indexVect;
+
+	if(m_useStripsSWE) {
+		m_waterSimulation.fillIndicesSWEStrips(indexVect, (IndexType)m_restartIndexSWE, m_skipGroundQuads);
+	} else {
+		m_waterSimulation.fillIndicesSWE(indexVect, m_skipGroundQuads);
+	}
+
+	m_numIndicesSWE = indexVect.size();
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexVBOIdSWE);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_numIndicesSWE*sizeof(IndexType), m_numIndicesSWE > 0 ? &indexVect[0] : NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void WaterShape::reportIndexCacheEfficiency()
+{
+	// compare the plain 32 bit triangle list against the buffers actually uploaded
+	std::vector<GLuint> listSWE, listFFT;
+	std::vector<GLushort> stripsSWE;
+
+	m_waterSimulation.fillIndicesSWE(listSWE, false);
+	m_waterSimulation.fillIndicesSWEStrips(stripsSWE, (GLushort)0xFFFF, m_skipGroundQuads);
+	m_waterSimulation.fillIndicesFFT(listFFT);
+
+	const float acmrListSWE = MeshUtil::computeACMR(&listSWE[0], listSWE.size(), MeshUtil::PRIMITIVE_TRIANGLES, 0xFFFFFFFF);
+	const float acmrStripsSWE = MeshUtil::computeACMR(&stripsSWE[0], stripsSWE.size(), MeshUtil::PRIMITIVE_TRIANGLE_STRIP, 0xFFFF);
+	const float acmrFFT = MeshUtil::computeACMR(&listFFT[0], listFFT.size(), MeshUtil::PRIMITIVE_TRIANGLES, 0xFFFFFFFF);
+
+	std::cout << "SWE indices: list " << listSWE.size() << " x 32 bit, ACMR " << acmrListSWE
+		<< " -> strips " << stripsSWE.size() << " x 16 bit, ACMR " << acmrStripsSWE
+		<< (m_useStripsSWE ? "" : " (primitive restart unsupported, using list)") << std::endl;
+	std::cout << "FFT indices: " << listFFT.size() << " x 16 bit, ACMR " << acmrFFT << std::endl;
+}
+
 void WaterShape::deleteVBO()
 {
 	glDeleteBuffers(1, &m_vertexVBOIdSWE);
@@ -264,27 +339,68 @@ void WaterShape::initNormalMap()
 	fclose(m_pNormalMap);
 	free(m_pBufferNormalMap);*/
 
-	glGenTextures(1, &m_normalMapTexture);
-	glBindTexture(GL_TEXTURE_2D, m_normalMapTexture);
+	// one normal map (unit 0, 3, 5, 7) and one choppy displacement map (unit 2, 4, 6, 8) per cascade, the
+	// reflection stays on unit 1. The SWE shader blends into the first cascade at its borders.
+	glUseProgram(m_fftShaderProgram);
 
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);  
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	float cascadeScale[FFTOcean::MAX_CASCADES], cascadeWeight[FFTOcean::MAX_CASCADES];
 
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );  
-	glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT ); 
+	for(int i=0; i<FFTOcean::MAX_CASCADES; i++) {
 
-	//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, m_imageDescNormalMap.m_width, m_imageDescNormalMap.m_height, 0, GL_RGB, GL_UNSIGNED_BYTE, m_imageDescNormalMap.m_pBuffer);
+		m_normalMapTextures[i] = 0;
+		m_displacementTextures[i] = 0;
+		cascadeScale[i] = 1.0f;
+		cascadeWeight[i] = 0.0f;
+
+		std::ostringstream suffix;
+		if(i > 0) {
+			suffix << i;
+		}
+
+		glUniform1i(glGetUniformLocation(m_fftShaderProgram, ("normalMap_texture" + suffix.str()).c_str()), getNormalMapUnit(i));
+		glUniform1i(glGetUniformLocation(m_fftShaderProgram, ("displacement_texture" + suffix.str()).c_str()), getDisplacementUnit(i));
+
+		if(i >= m_fftOcean.getNumCascades()) {
+			continue;
+		}
+
+		cascadeScale[i] = m_fftOcean.getCascadeScale(i);
+		cascadeWeight[i] = 1.0f;
+
+		glGenTextures(1, &m_normalMapTextures[i]);
+		glBindTexture(GL_TEXTURE_2D, m_normalMapTextures[i]);
+
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);  
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );  
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT ); 
+
+		// choppy displacement (x, height, z) of the cascade, tiled like its normal map
+		glGenTextures(1, &m_displacementTextures[i]);
+		glBindTexture(GL_TEXTURE_2D, m_displacementTextures[i]);
+
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);  
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );  
+		glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT ); 
+	}
+
+	glUniform4fv(glGetUniformLocation(m_fftShaderProgram, "cascade_scale"), 1, cascadeScale);
+	glUniform4fv(glGetUniformLocation(m_fftShaderProgram, "cascade_weight"), 1, cascadeWeight);
+
+	// displacements are in patch units, the shader needs them in texture coordinates of a PATCH_SIZE patch
+	int displacementScale_location = glGetUniformLocation(m_fftShaderProgram, "displacement_scale");
+	glUniform1f(displacementScale_location, 1.0f/FFTSimulation::PATCH_SIZE);
 
-	int normal_location = glGetUniformLocation(m_fftShaderProgram, "normalMap_texture");
-	glUseProgram(m_fftShaderProgram);
-	glUniform1i(normal_location, 0);
 	glUseProgram(0);
 
-	normal_location = glGetUniformLocation(m_sweShaderProgram, "normalMap_texture");
+	int normal_location = glGetUniformLocation(m_sweShaderProgram, "normalMap_texture");
 	glUseProgram(m_sweShaderProgram);
 	glUniform1i(normal_location, 0);
+	glUniform1f(glGetUniformLocation(m_sweShaderProgram, "normalMap_scale"), cascadeScale[0]);
 	glUseProgram(0);
-
 }
 
 void WaterShape::initFrameBufferObject()
@@ -323,7 +439,7 @@ void WaterShape::initFrameBufferObject()
 
 void WaterShape::initFFTSimulation()
 {
-	m_fftSimulation.initFFTSimulation();
+	m_fftOcean.initialize(NUM_FFT_CASCADES);
 }
 
 void WaterShape::deleteShaders()
@@ -345,10 +461,11 @@ void WaterShape::deleteShaders()
 	glDeleteProgram(m_sweShaderProgram);
 }
 
-void WaterShape::update(const Vector3& cameraView)
+void WaterShape::update(const Vector3& cameraView, float time)
 {
+	// the SWE border flows in from the open sea at the same time
+	m_fftOcean.update(time);
 	m_waterSimulation.update(cameraView);
-	m_fftSimulation.update();
 }
 
 void WaterShape::addDrop(int x, int y)
@@ -377,6 +494,15 @@ void WaterShape::renderWater(const Vector3& cameraPos)
 
 void WaterShape::updateSWEGrid()
 {
+	// Ground quads follow the moving grid
+	if(m_waterSimulation.getCellStatesChanged()) {
+		if(m_skipGroundQuads) {
+			updateIndicesSWE();
+		} else {
+			m_waterSimulation.resetCellStatesChanged();
+		}
+	}
+
 	glEnableClientState(GL_VERTEX_ARRAY);
 	glEnableClientState(GL_NORMAL_ARRAY);
 
@@ -416,26 +542,36 @@ void WaterShape::renderSWEGrid(const Vector3& cameraPos)
 						6*sizeof(float),
 						(void*)(3*sizeof(float)));
 
+	const GLenum mode = m_useStripsSWE ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+
+	if(m_useStripsSWE) {
+		glEnable(GL_PRIMITIVE_RESTART);
+		glPrimitiveRestartIndex(m_restartIndexSWE);
+	}
+
 	if(m_line) {
 
 		glPolygonMode( GL_FRONT_AND_BACK, GL_LINE );
 
 
-		glDrawElements(	GL_TRIANGLES, //mode
+		glDrawElements(	mode, //mode
 							m_numIndicesSWE,  //count, ie. how many indices
-							GL_UNSIGNED_INT, //type of the index array
+							m_indexTypeSWE, //type of the index array
 							NULL);
 
 		glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
 
 	} else {
 
-		glDrawElements(	GL_TRIANGLES, //mode
+		glDrawElements(	mode, //mode
 						m_numIndicesSWE,  //count, ie. how many indices
-						GL_UNSIGNED_INT, //type of the index array
+						m_indexTypeSWE, //type of the index array
 						NULL);
 	}
 
+	if(m_useStripsSWE) {
+		glDisable(GL_PRIMITIVE_RESTART);
+	}
 
 	glUseProgram(0);
 }
@@ -456,14 +592,26 @@ void WaterShape::renderFFTGrid(const Vector3& cameraPos)
 	int cameraPosLocationFFT = glGetUniformLocation(m_fftShaderProgram, "cameraPos");
 	glUniform3fv(cameraPosLocationFFT, 1, &cameraPos[0]);
 
-	m_fftSimulation.calculateAndFillNormals(m_fftNormals);
+	const int numCascades = m_fftOcean.getNumCascades();
 
-	glBindTexture(GL_TEXTURE_2D, m_normalMapTexture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_fftSimulation.GRIDSIZE, m_fftSimulation.GRIDSIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_fftNormals);
+	for(int i=0; i<numCascades; i++) {
 
-	glActiveTexture(GL_TEXTURE0);
-	glEnable(GL_TEXTURE_2D);  
-	glBindTexture(GL_TEXTURE_2D, m_normalMapTexture); 
+		FFTSimulation* pCascade = m_fftOcean.getCascade(i);
+
+		m_fftOcean.fillNormals(i, m_fftNormals);
+
+		glActiveTexture(GL_TEXTURE0 + getNormalMapUnit(i));
+		glEnable(GL_TEXTURE_2D);  
+		glBindTexture(GL_TEXTURE_2D, m_normalMapTextures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pCascade->getGridSize(), pCascade->getGridSize(), 0, GL_RGBA, GL_UNSIGNED_BYTE, m_fftNormals);
+
+		m_fftOcean.fillDisplacements(i, m_fftDisplacements);
+
+		glActiveTexture(GL_TEXTURE0 + getDisplacementUnit(i));
+		glEnable(GL_TEXTURE_2D);  
+		glBindTexture(GL_TEXTURE_2D, m_displacementTextures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, pCascade->getGridSize(), pCascade->getGridSize(), 0, GL_RGB, GL_FLOAT, m_fftDisplacements);
+	}
 
 	glActiveTexture(GL_TEXTURE1);
 	glEnable(GL_TEXTURE_2D);  
@@ -476,12 +624,20 @@ void WaterShape::renderFFTGrid(const Vector3& cameraPos)
 
 	glDrawElements(	GL_TRIANGLES, //mode
 						m_numIndicesFFT,  //count, ie. how many indices
-						GL_UNSIGNED_INT, //type of the index array
+						GL_UNSIGNED_SHORT, //type of the index array
 						NULL);
 
+	// the first normal map stays bound to unit 0 for the SWE shader
+	for(int i=numCascades-1; i>=0; i--) {
+		glActiveTexture(GL_TEXTURE0 + getDisplacementUnit(i));
+		glDisable(GL_TEXTURE_2D);  
+		glActiveTexture(GL_TEXTURE0 + getNormalMapUnit(i));
+		glDisable(GL_TEXTURE_2D);  
+	}
+
+	glActiveTexture(GL_TEXTURE1);
 	glDisable(GL_TEXTURE_2D);  
 	glActiveTexture(GL_TEXTURE0);
-	glDisable(GL_TEXTURE_2D);  
 
 	glUseProgram(0);
 }
@@ -522,6 +678,57 @@ void WaterShape::pressNormalKey(unsigned char key)
 			m_line = true;
 		}
 
+	} else if(key == 'g') {
+
+		m_skipGroundQuads = !m_skipGroundQuads;
+		updateIndicesSWE();
+
+	} else if(key == 'i') {
+
+		if(m_waterSimulation.getSolverType() == WaterSimulation::EXPLICIT_SOLVER) {
+			m_waterSimulation.setSolverType(WaterSimulation::SEMI_IMPLICIT_SOLVER);
+			std::cout << "SWE solver: semi-implicit, dt " << m_waterSimulation.getTimeStep() << std::endl;
+		} else {
+			m_waterSimulation.setSolverType(WaterSimulation::EXPLICIT_SOLVER);
+			std::cout << "SWE solver: explicit, dt " << m_waterSimulation.getTimeStep() << std::endl;
+		}
+
+	} else if(key == 't') {
+
+		// cycle the simulated time per frame through 1x, 2x, 4x and 8x TIME_STEP
+		float timeStep = 2.0f*m_waterSimulation.getTimeStep();
+
+		if(timeStep > 8.5f*WaterSimulation::TIME_STEP) {
+			timeStep = WaterSimulation::TIME_STEP;
+		}
+
+		m_waterSimulation.setTimeStep(timeStep);
+		std::cout << "SWE dt " << timeStep << std::endl;
+
+	} else if(key == 'c') {
+
+		// cycle the distant water through flat crests, default and exaggerated choppiness
+		float choppiness = m_fftOcean.getChoppiness() + FFTSimulation::CHOPPINESS;
+
+		if(choppiness > 2.5f*FFTSimulation::CHOPPINESS) {
+			choppiness = 0.0f;
+		}
+
+		m_fftOcean.setChoppiness(choppiness);
+		std::cout << "FFT choppiness " << choppiness << std::endl;
+
+	} else if(key == 'v') {
+
+		// switch the sea state, regenerates h0 (a file load with -h0Cache)
+		m_seaState = (m_seaState + 1) % NUM_SEA_STATES;
+
+		IWaveSpectrum* pWaveSpectra[NUM_SEA_STATES] = {NULL, &m_piersonMoskowitzSpectrum, &m_jonswapSpectrum, &m_tmaSpectrum};
+		const char* seaStateNames[NUM_SEA_STATES] = {"Phillips", "Pierson-Moskowitz", "JONSWAP", "TMA"};
+
+		const double startTime = TimeUtil::getTime();
+		m_fftOcean.setWaveSpectrum(pWaveSpectra[m_seaState]);
+
+		std::cout << "FFT sea state " << seaStateNames[m_seaState] << " in " << (TimeUtil::getTime() - startTime)*1000.0 << " ms" << std::endl;
 	}
 }
 
@@ -7,8 +7,13 @@
  * Copyright (C) GIANTS Software GmbH, Confidential, All Rights Reserved.
  */
 
+#pragma once
+
 #include "WaterSimulation.h"
-#include "FFTSimulation.h"
+#include "FFTOcean.h"
+#include "PiersonMoskowitzSpectrum.h"
+#include "JonswapSpectrum.h"
+#include "TMASpectrum.h"
 #include "base/2d/PNGUtil.h"
 
 class WaterShape
@@ -25,13 +30,17 @@ public:
 
 	void initWaterShape();
 	
-	void update(const Vector3& cameraView);
+	void update(const Vector3& cameraView, float time);
 	void updateSWEGrid();
 	void renderWater(const Vector3& cameraPos);
 	void addDrop(int x, int y);
 	void passModelViewProjectionToGLSL();
 	void pressNormalKey(unsigned char key);
 
+	static const int NUM_FFT_CASCADES = 3;
+	static const float SEA_STATE_WIND_SPEED; // m/s of the switchable spectra
+	static const float SHALLOW_WATER_DEPTH; // m of the TMA spectrum
+
 	inline float getTotalHeight()
 	{
 		return m_waterSimulation.TOTAL_HEIGHT;
@@ -53,6 +62,7 @@ private:
 	std::vector <GLushort> m_indexPort;
 
 	bool m_line;
+	bool m_useStripsSWE, m_skipGroundQuads;
 
 	FILE *m_pNormalMap;
 	unsigned char *m_pBufferNormalMap;
@@ -60,15 +70,33 @@ private:
 	ImageDesc m_imageDescNormalMap;
 	
 	PlaneDef m_inclinedPlane;
-	FFTSimulation m_fftSimulation;
+	FFTOcean m_fftOcean;
+
+	// sea states cycled with 'v', the first one is the default Phillips spectrum
+	enum SeaState
+	{
+		SEA_STATE_PHILLIPS,
+		SEA_STATE_PIERSON_MOSKOWITZ,
+		SEA_STATE_JONSWAP,
+		SEA_STATE_TMA,
+		NUM_SEA_STATES
+	};
+
+	PiersonMoskowitzSpectrum m_piersonMoskowitzSpectrum;
+	JonswapSpectrum m_jonswapSpectrum;
+	TMASpectrum m_tmaSpectrum;
+	int m_seaState;
 	
 	unsigned int m_numIndicesSWE, m_numIndicesFFT;
+	GLenum m_indexTypeSWE;
+	GLuint m_restartIndexSWE;
 	GLuint m_vertexVBOIdSWE, m_indexVBOIdSWE, m_vertexVBOIdFFT, m_indexVBOIdFFT;
 	GLuint m_fftFragShader, m_fftVertShader, m_fftShaderProgram;
 	GLuint m_sweVertShader, m_sweFragShader, m_sweShaderProgram;
-	GLuint m_normalMapTexture;
+	GLuint m_normalMapTextures[FFTOcean::MAX_CASCADES], m_displacementTextures[FFTOcean::MAX_CASCADES];
 
 	unsigned char* m_fftNormals;
+	float* m_fftDisplacements;
 
 	void createVBO();
 	void deleteVBO();
@@ -86,8 +114,22 @@ private:
 
 	
 	void fillIndices();
+	void updateIndicesSWE();
+	void reportIndexCacheEfficiency();
+	template <class IndexType> void uploadIndicesSWE();
 	void renderNonSWEquads();
 	void renderSWEGrid(const Vector3& cameraPos);
 	void renderFFTGrid(const Vector3& cameraPos);
 
+	// texture units of the cascade maps, unit 1 is the reflection
+	inline int getNormalMapUnit(int cascade)
+	{
+		return (cascade == 0) ? 0 : 2*cascade + 1;
+	}
+
+	inline int getDisplacementUnit(int cascade)
+	{
+		return 2*cascade + 2;
+	}
+
 };
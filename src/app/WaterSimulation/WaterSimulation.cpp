@@ -2,7 +2,9 @@
  * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
  */
 
+#include "PreCompiled.h"
 #include "WaterSimulation.h"
+#include "FFTOcean.h"
 
 const float WaterSimulation::FLAT = 2.0f;
 const float WaterSimulation::TOTAL_HEIGHT = 6.0f;
@@ -15,18 +17,42 @@ const float WaterSimulation::UNDER_WATER = TOTAL_HEIGHT;
 const float WaterSimulation::BOUNDARY_THRESHOLD = TOTAL_HEIGHT;
 const float WaterSimulation::GRIDSTART_X = CELL_EDGE*NUM_CELLS/2.0f;
 const float WaterSimulation::GRIDSTART_Z = GRIDSTART_X;
+const float WaterSimulation::MAX_EXPLICIT_TIME_STEP = TIME_STEP;
+const float WaterSimulation::SOLVER_TOLERANCE = 1.0e-5f;
 
 WaterSimulation::WaterSimulation(PortScene* portScene)
 {
 	m_xTranslate = m_zTranslate = 0.0f;
 	m_xVelocity = m_zVelocity = .0f;
 	m_newNumObjectCellIndices = 0;
+	m_boatSpeed = m_rotation = .0f;
+	m_cellStatesChanged = true;
 	m_pPortScene = portScene;
+	m_pOpenSea = NULL;
+
+	m_solverType = EXPLICIT_SOLVER;
+	m_timeStep = TIME_STEP;
+	m_solverIterations = 0;
+	m_numSolverCells = 0;
+
+	m_random.setSeed((unsigned int)rand());
 }
 
 WaterSimulation::~WaterSimulation()
 {
 	delete[] m_pGrids;
+
+	delete[] m_pSolverHeight;
+	delete[] m_pSolverRhs;
+	delete[] m_pSolverResidual;
+	delete[] m_pSolverPrecond;
+	delete[] m_pSolverDirection;
+	delete[] m_pSolverProduct;
+	delete[] m_pSolverDiagonal;
+	delete[] m_pSolverDepthX;
+	delete[] m_pSolverDepthZ;
+	delete[] m_pSolverGroundHeight;
+	delete[] m_pSolverCells;
 }
 
 void WaterSimulation::initializeGrid()
@@ -34,6 +60,18 @@ void WaterSimulation::initializeGrid()
 
 	m_pGrids = new GridCell[NUM_GRIDS];
 
+	m_pSolverHeight = new float[NUM_GRIDS];
+	m_pSolverRhs = new float[NUM_GRIDS];
+	m_pSolverResidual = new float[NUM_GRIDS];
+	m_pSolverPrecond = new float[NUM_GRIDS];
+	m_pSolverDirection = new float[NUM_GRIDS];
+	m_pSolverProduct = new float[NUM_GRIDS];
+	m_pSolverDiagonal = new float[NUM_GRIDS];
+	m_pSolverDepthX = new float[NUM_GRIDS];
+	m_pSolverDepthZ = new float[NUM_GRIDS];
+	m_pSolverGroundHeight = new float[NUM_GRIDS];
+	m_pSolverCells = new int[NUM_GRIDS];
+
 	for (int zc = 0; zc < NUM_CELLS; zc++) {
 		for (int xc = 0; xc < NUM_CELLS; xc++) {
 
@@ -68,20 +106,54 @@ void WaterSimulation::update(const Vector3& cameraView)
 {
 	moveSWEGrid(cameraView);
 
+	if(m_pOpenSea != NULL) {
+		sampleInflow();
+	}
+
 	resetGrid();
+
+	if(m_solverType == SEMI_IMPLICIT_SOLVER) {
+
+		semiImplicitStep(m_timeStep);
+
+	} else {
+
+		// explicit gravity waves are only stable below the CFL limit
+		const int numSubSteps = std::max(1, (int)ceil(m_timeStep/MAX_EXPLICIT_TIME_STEP - 0.001f));
+		const float subStep = m_timeStep/float(numSubSteps);
+
+		for(int i=0; i<numSubSteps; i++) {
+			explicitStep(subStep);
+		}
+	}
 	
-	advectHeight(); //waterheight
-	advectVelocityX(); //xVelocity
-	advectVelocityZ(); //zVelocity
+	bodyInteraction();
 	
-	updateHeight();
-	updateVelocities();
+}
+
+void WaterSimulation::explicitStep(float timeStep)
+{
+	advectHeight(timeStep); //waterheight
+	advectVelocityX(timeStep); //xVelocity
+	advectVelocityZ(timeStep); //zVelocity
+	
+	updateHeight(timeStep);
+	updateVelocities(timeStep);
+
+	reflectBoundaries();
+	absorbingBoundaries();
+}
+
+void WaterSimulation::semiImplicitStep(float timeStep)
+{
+	advectHeight(timeStep); //waterheight
+	advectVelocityX(timeStep); //xVelocity
+	advectVelocityZ(timeStep); //zVelocity
+
+	solveHeightImplicit(timeStep); // heights and velocities
 
 	reflectBoundaries();
 	absorbingBoundaries();
-	
-	bodyInteraction();
-	
 }
 
 void WaterSimulation::moveSWEGrid(const Vector3& cameraView)
@@ -180,6 +252,10 @@ void WaterSimulation::moveSWEGrid(const Vector3& cameraView)
 		}
 	}
 
+	if((dir[0] > CELL_EDGE) || (dir[0] < -CELL_EDGE) || (dir[2] > CELL_EDGE) || (dir[2] < -CELL_EDGE)) {
+		m_cellStatesChanged = true;
+	}
+
 	boundaryCheck();  // after creating new cells
 
 }
@@ -320,7 +396,7 @@ void WaterSimulation::resetGrid()
 	}
 }
 
-void WaterSimulation::advectHeight()
+void WaterSimulation::advectHeight(float timeStep)
 {
 	float x1, x2, y1, y2;
 	int X, Z;
@@ -338,8 +414,8 @@ void WaterSimulation::advectHeight()
 				v += (m_pGrids[index].zVelocity + m_pGrids[index+NUM_CELLS].zVelocity) *0.5f;
 
 				// backtrace position
-				float srcpi = (float)i - u * TIME_STEP * INV_DIST;
-				float srcpj = (float)j - v * TIME_STEP * INV_DIST;
+				float srcpi = (float)i - u * timeStep * INV_DIST;
+				float srcpj = (float)j - v * timeStep * INV_DIST;
 
 				// clamp range of accesses
 				if(srcpi<0.) srcpi = .0f;
@@ -379,7 +455,7 @@ void WaterSimulation::advectHeight()
 	}
 }
 
-void WaterSimulation::advectVelocityX()
+void WaterSimulation::advectVelocityX(float timeStep)
 {
 
 	for(int j=1; j< NUM_CELLS-1; j++) {
@@ -395,8 +471,8 @@ void WaterSimulation::advectVelocityX()
 					
 
 				// backtrace position
-				float srcpi = (float)i - u * TIME_STEP * INV_DIST;
-				float srcpj = (float)j - v * TIME_STEP * INV_DIST;
+				float srcpi = (float)i - u * timeStep * INV_DIST;
+				float srcpj = (float)j - v * timeStep * INV_DIST;
 
 				// clamp range of accesses
 				if(srcpi<0.) srcpi = .0f;
@@ -430,7 +506,7 @@ void WaterSimulation::advectVelocityX()
 	}
 }
 
-void WaterSimulation::advectVelocityZ()
+void WaterSimulation::advectVelocityZ(float timeStep)
 {
 	
 	for(int j=1; j< NUM_CELLS-1; j++) {
@@ -447,8 +523,8 @@ void WaterSimulation::advectVelocityZ()
 					
 
 				// backtrace position
-				float srcpi = (float)i - u * TIME_STEP * INV_DIST;
-				float srcpj = (float)j - v * TIME_STEP * INV_DIST;
+				float srcpi = (float)i - u * timeStep * INV_DIST;
+				float srcpj = (float)j - v * timeStep * INV_DIST;
 
 				// clamp range of accesses
 				if(srcpi<0.) srcpi = .0f;
@@ -482,7 +558,7 @@ void WaterSimulation::advectVelocityZ()
 	}
 }
 
-void WaterSimulation::updateHeight() 
+void WaterSimulation::updateHeight(float timeStep)
 {
 	// update heights as per shallow water equation
 	for (int j=1;j<NUM_CELLS-1;j++) {
@@ -496,7 +572,7 @@ void WaterSimulation::updateHeight()
 						(m_pGrids[index+1].xVelocity  - m_pGrids[index].xVelocity) +
 						(m_pGrids[index+NUM_CELLS].zVelocity - m_pGrids[index].zVelocity) );
 
-					m_pGrids[index].waterHeight += dh * TIME_STEP;
+					m_pGrids[index].waterHeight += dh * timeStep;
 
 					const float x = GRIDSTART_X + m_xTranslate - CELL_EDGE*float(i);
 					const float z = GRIDSTART_Z + m_zTranslate - CELL_EDGE*float(j);
@@ -521,7 +597,7 @@ void WaterSimulation::updateHeight()
 
 }
 
-void WaterSimulation::updateVelocities()
+void WaterSimulation::updateVelocities(float timeStep)
 { 
 	// accelerate velocities as per SWE
 	for (int j=1; j< NUM_CELLS-1 ;j++) {
@@ -531,19 +607,222 @@ void WaterSimulation::updateVelocities()
 
 			if((m_pGrids[index].state == Water) || (m_pGrids[index].state == NearBoundary)) {
 
-				m_pGrids[index].xVelocity += GRAVITY * TIME_STEP * INV_DIST * (m_pGrids[index].y - m_pGrids[index-1].y); 
-				m_pGrids[index].zVelocity += GRAVITY * TIME_STEP * INV_DIST * (m_pGrids[index].y - m_pGrids[index-NUM_CELLS].y); 
+				m_pGrids[index].xVelocity += GRAVITY * timeStep * INV_DIST * (m_pGrids[index].y - m_pGrids[index-1].y); 
+				m_pGrids[index].zVelocity += GRAVITY * timeStep * INV_DIST * (m_pGrids[index].y - m_pGrids[index-NUM_CELLS].y); 
 			}
 		} 
 	}
 
 }
 
+void WaterSimulation::solveHeightImplicit(float timeStep)
+{
+	// Linearized SWE with the gravity term taken at the new time level:
+	//   u' = u + GRAVITY*dt/dx*(y_i - y_i-1),   h' = h - 0.5*dt/dx*sum(D_f*u'_f)
+	// Inserting u' into h' gives the Helmholtz system y_i + sum(a_f*(y_i - y_j)) = y* - 0.5*dt/dx*sum(D_f*u_f)
+	// with a_f = 0.5*g*dt^2/dx^2*D_f. Faces use the averaged depth D_f so the matrix is symmetric positive definite
+	// and is solved matrix free with Jacobi preconditioned conjugate gradients. Faces to Ground and Boundary cells are
+	// closed, the wet SWE border is kept at TOTAL_HEIGHT.
+
+	const float depthScale = 0.5f; // same scale as in updateHeight
+	const float alphaScale = -depthScale*GRAVITY*timeStep*timeStep*INV_DIST*INV_DIST;
+	const float fluxScale = depthScale*timeStep*INV_DIST;
+
+	memset(m_pSolverHeight, 0, NUM_GRIDS*sizeof(float));
+	memset(m_pSolverResidual, 0, NUM_GRIDS*sizeof(float));
+	memset(m_pSolverPrecond, 0, NUM_GRIDS*sizeof(float));
+	memset(m_pSolverDirection, 0, NUM_GRIDS*sizeof(float));
+	memset(m_pSolverProduct, 0, NUM_GRIDS*sizeof(float));
+
+	// open faces and their depths
+	for (int j=0; j<NUM_CELLS; j++) {
+		for (int i=0; i<NUM_CELLS; i++) {
+
+			const int index = i + j*NUM_CELLS;
+
+			m_pSolverDepthX[index] = .0f;
+			m_pSolverDepthZ[index] = .0f;
+
+			if(isWet(index)) {
+
+				if((i > 0) && isWet(index-1)) {
+					m_pSolverDepthX[index] = std::max(.0f, 0.5f*(m_pGrids[index].waterHeight + m_pGrids[index-1].waterHeight));
+				}
+
+				if((j > 0) && isWet(index-NUM_CELLS)) {
+					m_pSolverDepthZ[index] = std::max(.0f, 0.5f*(m_pGrids[index].waterHeight + m_pGrids[index-NUM_CELLS].waterHeight));
+				}
+			}
+		}
+	}
+
+	// unknowns are the wet interior cells
+	m_numSolverCells = 0;
+
+	for (int j=1; j<NUM_CELLS-1; j++) {
+		for (int i=1; i<NUM_CELLS-1; i++) {
+
+			const int index = i + j*NUM_CELLS;
+
+			if(isWet(index)) {
+				m_pSolverCells[m_numSolverCells] = index;
+				m_numSolverCells++;
+			}
+		}
+	}
+
+	// right hand side, diagonal and initial guess y*
+	for (int k=0; k<m_numSolverCells; k++) {
+
+		const int index = m_pSolverCells[k];
+		const int i = index%NUM_CELLS;
+		const int j = index/NUM_CELLS;
+
+		const float x = GRIDSTART_X + m_xTranslate - CELL_EDGE*float(i);
+		const float z = GRIDSTART_Z + m_zTranslate - CELL_EDGE*float(j);
+
+		m_pSolverGroundHeight[index] = getGroundHeight(x,z);
+
+		const float dLeft = m_pSolverDepthX[index];
+		const float dRight = m_pSolverDepthX[index+1];
+		const float dBottom = m_pSolverDepthZ[index];
+		const float dTop = m_pSolverDepthZ[index+NUM_CELLS];
+
+		const float divergence = dRight*m_pGrids[index+1].xVelocity - dLeft*m_pGrids[index].xVelocity
+			+ dTop*m_pGrids[index+NUM_CELLS].zVelocity - dBottom*m_pGrids[index].zVelocity;
+
+		const float yStar = m_pSolverGroundHeight[index] + m_pGrids[index].waterHeight;
+
+		m_pSolverRhs[index] = yStar - fluxScale*divergence;
+		m_pSolverDiagonal[index] = 1.0f + alphaScale*(dLeft + dRight + dBottom + dTop);
+		m_pSolverHeight[index] = yStar;
+
+		// open faces to the wet border are Dirichlet
+		if(i == 1) m_pSolverRhs[index] += alphaScale*dLeft*TOTAL_HEIGHT;
+		if(i == NUM_CELLS-2) m_pSolverRhs[index] += alphaScale*dRight*TOTAL_HEIGHT;
+		if(j == 1) m_pSolverRhs[index] += alphaScale*dBottom*TOTAL_HEIGHT;
+		if(j == NUM_CELLS-2) m_pSolverRhs[index] += alphaScale*dTop*TOTAL_HEIGHT;
+	}
+
+	// preconditioned conjugate gradients
+	applyHelmholtzOperator(m_pSolverHeight, m_pSolverProduct, alphaScale);
+
+	float rz = .0f;
+	float rr = .0f;
+
+	for (int k=0; k<m_numSolverCells; k++) {
+
+		const int index = m_pSolverCells[k];
+
+		m_pSolverResidual[index] = m_pSolverRhs[index] - m_pSolverProduct[index];
+		m_pSolverPrecond[index] = m_pSolverResidual[index]/m_pSolverDiagonal[index];
+		m_pSolverDirection[index] = m_pSolverPrecond[index];
+
+		rz += m_pSolverResidual[index]*m_pSolverPrecond[index];
+		rr += m_pSolverResidual[index]*m_pSolverResidual[index];
+	}
+
+	const float maxResidual = SOLVER_TOLERANCE*SOLVER_TOLERANCE*float(m_numSolverCells);
+
+	m_solverIterations = 0;
+
+	while((m_solverIterations < MAX_SOLVER_ITERATIONS) && (rr > maxResidual)) {
+
+		applyHelmholtzOperator(m_pSolverDirection, m_pSolverProduct, alphaScale);
+
+		float pAp = .0f;
+
+		for (int k=0; k<m_numSolverCells; k++) {
+			const int index = m_pSolverCells[k];
+			pAp += m_pSolverDirection[index]*m_pSolverProduct[index];
+		}
+
+		if(pAp <= .0f) {
+			break;
+		}
+
+		const float alpha = rz/pAp;
+		float rzNew = .0f;
+		rr = .0f;
+
+		for (int k=0; k<m_numSolverCells; k++) {
+
+			const int index = m_pSolverCells[k];
+
+			m_pSolverHeight[index] += alpha*m_pSolverDirection[index];
+			m_pSolverResidual[index] -= alpha*m_pSolverProduct[index];
+			m_pSolverPrecond[index] = m_pSolverResidual[index]/m_pSolverDiagonal[index];
+
+			rzNew += m_pSolverResidual[index]*m_pSolverPrecond[index];
+			rr += m_pSolverResidual[index]*m_pSolverResidual[index];
+		}
+
+		const float beta = rzNew/rz;
+		rz = rzNew;
+
+		for (int k=0; k<m_numSolverCells; k++) {
+			const int index = m_pSolverCells[k];
+			m_pSolverDirection[index] = m_pSolverPrecond[index] + beta*m_pSolverDirection[index];
+		}
+
+		m_solverIterations++;
+	}
+
+	// heights of the unknowns, the border is fixed
+	for (int k=0; k<m_numSolverCells; k++) {
+
+		const int index = m_pSolverCells[k];
+
+		m_pGrids[index].y = m_pSolverHeight[index];
+		m_pGrids[index].waterHeight = m_pSolverHeight[index] - m_pSolverGroundHeight[index];
+	}
+
+	for (int j=0;j<NUM_CELLS;j++) {
+		for (int i=0;i<NUM_CELLS;i++) {
+			if(((i==0)||(i==NUM_CELLS-1)||(j==0)||(j==NUM_CELLS-1))) {
+				m_pGrids[i + j*NUM_CELLS].y = TOTAL_HEIGHT;
+				m_pSolverHeight[i + j*NUM_CELLS] = TOTAL_HEIGHT;
+			}
+		}
+	}
+
+	// accelerate velocities on the open faces with the new heights
+	for (int j=0; j<NUM_CELLS; j++) {
+		for (int i=0; i<NUM_CELLS; i++) {
+
+			const int index = i + j*NUM_CELLS;
+
+			if(m_pSolverDepthX[index] > .0f) {
+				m_pGrids[index].xVelocity += GRAVITY * timeStep * INV_DIST * (m_pSolverHeight[index] - m_pSolverHeight[index-1]);
+			}
+
+			if(m_pSolverDepthZ[index] > .0f) {
+				m_pGrids[index].zVelocity += GRAVITY * timeStep * INV_DIST * (m_pSolverHeight[index] - m_pSolverHeight[index-NUM_CELLS]);
+			}
+		}
+	}
+}
+
+void WaterSimulation::applyHelmholtzOperator(const float* pIn, float* pOut, float alphaScale)
+{
+	// pIn is zero outside the unknowns, so closed faces and the Dirichlet border drop out of the off diagonal terms
+	for (int k=0; k<m_numSolverCells; k++) {
+
+		const int index = m_pSolverCells[k];
+
+		const float offDiagonal = m_pSolverDepthX[index]*pIn[index-1] + m_pSolverDepthX[index+1]*pIn[index+1]
+			+ m_pSolverDepthZ[index]*pIn[index-NUM_CELLS] + m_pSolverDepthZ[index+NUM_CELLS]*pIn[index+NUM_CELLS];
+
+		pOut[index] = m_pSolverDiagonal[index]*pIn[index] - alphaScale*offDiagonal;
+	}
+}
+
 void WaterSimulation::absorbingBoundaries()
 {
 
 	const float HeightFFT = TOTAL_HEIGHT - FLAT;
 	const float inv_gridLength = 1.0f/(NUM_CELLS*CELL_EDGE);
+	int inflowIndex = 0;
 
 	for(int j=0; j<NUM_CELLS; j++) {
 		for(int i=0; i<NUM_CELLS; i++)  {
@@ -552,7 +831,7 @@ void WaterSimulation::absorbingBoundaries()
 
 			//if(m_pGrids[index].state != Ground ) {
 			
-				if((i<=NUM_BORDER_DAMPING_CELLS) || (j<=NUM_BORDER_DAMPING_CELLS) || (i>=(NUM_CELLS-NUM_BORDER_DAMPING_CELLS)) || (j>=(NUM_CELLS-NUM_BORDER_DAMPING_CELLS))) {
+				if(isDampingCell(i, j)) {
 
 					float x = GRIDSTART_X - CELL_EDGE*float(i);
 					float z = GRIDSTART_Z - CELL_EDGE*float(j);
@@ -576,10 +855,32 @@ void WaterSimulation::absorbingBoundaries()
 						factor = dz;
 					}
 
-					// damp height and velocities near SWE border by factor
-					m_pGrids[index].y -= (m_pGrids[index].y - TOTAL_HEIGHT)*factor;
-					m_pGrids[index].xVelocity -= factor*(m_pGrids[index].xVelocity);
-					m_pGrids[index].zVelocity -= factor*(m_pGrids[index].zVelocity);
+					if(m_pOpenSea != NULL) {
+
+						// inflow: relax towards the open sea surface and its orbital velocity, the outer ring takes it exactly
+						if((i==0) || (j==0) || (i==NUM_CELLS-1) || (j==NUM_CELLS-1)) {
+							factor = 1.0f;
+						}
+
+						const float dy = (TOTAL_HEIGHT + m_inflowHeights[inflowIndex] - m_pGrids[index].y)*factor;
+						m_pGrids[index].y += dy;
+
+						if(isWet(index)) {
+							m_pGrids[index].waterHeight += dy;
+						}
+
+						// SWE velocities point towards increasing i and j, which is -x and -z
+						m_pGrids[index].xVelocity -= factor*(m_pGrids[index].xVelocity + m_inflowVelocitiesX[inflowIndex]);
+						m_pGrids[index].zVelocity -= factor*(m_pGrids[index].zVelocity + m_inflowVelocitiesZ[inflowIndex]);
+						inflowIndex++;
+
+					} else {
+
+						// damp height and velocities near SWE border by factor
+						m_pGrids[index].y -= (m_pGrids[index].y - TOTAL_HEIGHT)*factor;
+						m_pGrids[index].xVelocity -= factor*(m_pGrids[index].xVelocity);
+						m_pGrids[index].zVelocity -= factor*(m_pGrids[index].zVelocity);
+					}
 				
 				//}
 			}
@@ -797,92 +1098,28 @@ void WaterSimulation::fillFFTVertexBuffer(float* pVertices)
 
 }
 
-void WaterSimulation::fillIndicesSWE(std::vector<GLuint>& indexVect)
+/**
+ * Copy the surface heights and face velocities of all cells (NUM_GRIDS each), row major from getOriginX/Z
+ *
+ * @param  pHeights  surface heights.
+ * @param  pXVelocities  x velocities or NULL.
+ * @param  pZVelocities  z velocities or NULL.
+ */
+void WaterSimulation::fillHeightField(float* pHeights, float* pXVelocities, float* pZVelocities)
 {
-
-	for (int zc = 0; zc < NUM_CELLS ; zc++) {
-		for (int xc = 0; xc < NUM_CELLS ; xc++) {
-			const int index = xc + zc*NUM_CELLS ;
-
-			//create two triangles:
-			if ((xc < NUM_CELLS-1) && (zc < NUM_CELLS-1)) {
-			
-				indexVect.push_back(index);
-				indexVect.push_back(index+1);
-				indexVect.push_back(index+1+NUM_CELLS);
-
-				indexVect.push_back(index);
-				indexVect.push_back(index+1+NUM_CELLS);
-				indexVect.push_back(index+NUM_CELLS);
-
-			}	
-		}
+	for (int i=0; i<NUM_GRIDS; i++) {
+		pHeights[i] = m_pGrids[i].y;
 	}
 
-
-}
-
-void WaterSimulation::fillIndicesFFT(std::vector<GLuint>& indexVect)
-{
-	const int indexCorners = 4*NUM_CELLS;
-
-	for(int xc=0; xc<NUM_CELLS; xc++) {
-		int zc = 0;
-		const int index = xc;
-
-		if(xc<NUM_CELLS-1) {
-			indexVect.push_back(index);
-			indexVect.push_back(index+1);
-			indexVect.push_back(indexCorners);
-		} else {
-			indexVect.push_back(index);
-			indexVect.push_back(indexCorners);
-			indexVect.push_back(indexCorners+1);
+	if(pXVelocities != NULL) {
+		for (int i=0; i<NUM_GRIDS; i++) {
+			pXVelocities[i] = m_pGrids[i].xVelocity;
 		}
 	}
 
-	for(int zc=0; zc<NUM_CELLS; zc++) {
-		int xc = NUM_CELLS-1;
-		const int index = NUM_CELLS+zc;
-
-		if(zc<NUM_CELLS-1) {
-			indexVect.push_back(index);
-			indexVect.push_back(index+1);
-			indexVect.push_back(indexCorners+1);
-		} else {
-			indexVect.push_back(index);
-			indexVect.push_back(indexCorners+1);
-			indexVect.push_back(indexCorners+2);
-		}
-	}
-
-	for(int xc=NUM_CELLS-1; xc>=0; xc--) {
-		int zc = NUM_CELLS-1;
-		const int index = 2*NUM_CELLS + xc;
-
-		if(xc>0) {
-			indexVect.push_back(index);
-			indexVect.push_back(index-1);
-			indexVect.push_back(indexCorners+2);
-		} else {
-			indexVect.push_back(index);
-			indexVect.push_back(indexCorners+2);
-			indexVect.push_back(indexCorners+3);
-		}
-	}
-
-	for(int zc=NUM_CELLS-1; zc>=0; zc--) {
-		int xc = NUM_CELLS-1;
-		const int index = 3*NUM_CELLS + zc;
-
-		if(zc>0) {
-			indexVect.push_back(index);
-			indexVect.push_back(index-1);
-			indexVect.push_back(indexCorners+3);
-		} else {
-			indexVect.push_back(index);
-			indexVect.push_back(indexCorners+3);
-			indexVect.push_back(indexCorners);
+	if(pZVelocities != NULL) {
+		for (int i=0; i<NUM_GRIDS; i++) {
+			pZVelocities[i] = m_pGrids[i].zVelocity;
 		}
 	}
 }
@@ -900,78 +1137,147 @@ void WaterSimulation::addDrop(float objPosX, float objPosZ)
 	}
 }
 
+/**
+ * Samples height and orbital velocity of the open sea at the cells of the border damping band in one batch,
+ * absorbingBoundaries blends the SWE water into it so both join without a seam
+ */
+void WaterSimulation::sampleInflow()
+{
+	m_inflowX.clear();
+	m_inflowZ.clear();
+
+	for(int j=0; j<NUM_CELLS; j++) {
+		for(int i=0; i<NUM_CELLS; i++) {
+			if(isDampingCell(i, j)) {
+				m_inflowX.push_back(GRIDSTART_X + m_xTranslate - CELL_EDGE*float(i));
+				m_inflowZ.push_back(GRIDSTART_Z + m_zTranslate - CELL_EDGE*float(j));
+			}
+		}
+	}
+
+	m_inflowHeights.resize(m_inflowX.size());
+	m_inflowVelocitiesX.resize(m_inflowX.size());
+	m_inflowVelocitiesZ.resize(m_inflowX.size());
+
+	FFTSimulation::SurfaceSamples samples;
+	memset(&samples, 0, sizeof(samples));
+	samples.pHeights = &m_inflowHeights[0];
+	samples.pVelocitiesX = &m_inflowVelocitiesX[0];
+	samples.pVelocitiesZ = &m_inflowVelocitiesZ[0];
+
+	m_pOpenSea->sampleSurface(&m_inflowX[0], &m_inflowZ[0], (unsigned int)m_inflowX.size(), samples);
+}
+
+/**
+ * Water surface at a point. On the grid the heights of the four surrounding cells are interpolated bilinearly,
+ * cells without a surface (ground, cells covered by an object) are left out. Under an object the nearest cells
+ * beside it along the row and the column are interpolated instead. Outside the grid the open sea is sampled.
+ *
+ * @param  x, z  world position.
+ * @return  height of the surface, TOTAL_HEIGHT on dry ground.
+ */
 float WaterSimulation::getWaterHeight( float x,  float z)
 {
-	float height;
+	if(!isInsideGrid(x, z)) {
+		float height;
+		getWaterHeights(&x, &z, 1, &height);
+		return height;
+	}
 
-	// average height
-	int i = (GRIDSTART_X - x + m_xTranslate)/CELL_EDGE;
-	int j = (GRIDSTART_Z - z + m_zTranslate)/CELL_EDGE;
+	// cell coordinates grow towards -x and -z, the last row and column interpolate towards the one before
+	const float cellX = (GRIDSTART_X - x + m_xTranslate)/CELL_EDGE;
+	const float cellZ = (GRIDSTART_Z - z + m_zTranslate)/CELL_EDGE;
+	const int i = std::min(std::max((int)floor(cellX), 0), NUM_CELLS-2);
+	const int j = std::min(std::max((int)floor(cellZ), 0), NUM_CELLS-2);
+	const float s = std::min(std::max(cellX - i, 0.0f), 1.0f);
+	const float t = std::min(std::max(cellZ - j, 0.0f), 1.0f);
 
-	if((i>=0) && (i<NUM_CELLS) && (j>=0) && (j<NUM_CELLS)) {
+	const int indices[4] = { i + j*NUM_CELLS, i+1 + j*NUM_CELLS, i + (j+1)*NUM_CELLS, i+1 + (j+1)*NUM_CELLS };
+	const float weights[4] = { (1.0f-s)*(1.0f-t), s*(1.0f-t), (1.0f-s)*t, s*t };
 
-		int imax, imin; 
-		imax = imin = i;
+	float heightSum = 0.0f;
+	float weightSum = 0.0f;
 
-		while(m_pGrids[imin + j*NUM_CELLS].state == Object) {
-			imin--;
-			if(imin < 0) {
-				imin++;
-				break;
-			}
+	for(int k=0; k<4; k++) {
+		if(hasSurface(indices[k])) {
+			heightSum += weights[k]*m_pGrids[indices[k]].y;
+			weightSum += weights[k];
 		}
+	}
 
-		while(m_pGrids[imax + j*NUM_CELLS].state == Object) {
-			imax++;
-			if(imax > NUM_CELLS-1) {
-				imax--;
-				break;
-			}
-		}
+	if(weightSum > 0.0f) {
+		return heightSum/weightSum;
+	}
 
-		int jmax, jmin;
-		jmax = jmin = j;
+	// under an object: walk out of it along the row and the column of the nearest cell
+	const int ci = std::min((int)(cellX + 0.5f), NUM_CELLS-1);
+	const int cj = std::min((int)(cellZ + 0.5f), NUM_CELLS-1);
 
-		while(m_pGrids[i + jmin*NUM_CELLS].state == Object) {
-			jmin--;
-			if(jmin < 0) {
-				jmin++;
-				break;
-			}
-		}
+	if(m_pGrids[ci + cj*NUM_CELLS].state != Object) {
+		return TOTAL_HEIGHT;
+	}
 
-		while(m_pGrids[i + jmax*NUM_CELLS].state == Object) {
-			jmax++;
-			if(jmax > NUM_CELLS-1) {
-				jmax--;
-				break;
-			}
-		}
+	int imin = ci, imax = ci, jmin = cj, jmax = cj;
 
-		const float h_imin = m_pGrids[imin + j*NUM_CELLS].y;
-		const float h_imax = m_pGrids[imax + j*NUM_CELLS].y;
-		const float h_jmin = m_pGrids[i + jmin*NUM_CELLS].y;
-		const float h_jmax = m_pGrids[i + jmax*NUM_CELLS].y;
+	while((imin > 0) && (m_pGrids[imin + cj*NUM_CELLS].state == Object)) {
+		imin--;
+	}
+	while((imax < NUM_CELLS-1) && (m_pGrids[imax + cj*NUM_CELLS].state == Object)) {
+		imax++;
+	}
+	while((jmin > 0) && (m_pGrids[ci + jmin*NUM_CELLS].state == Object)) {
+		jmin--;
+	}
+	while((jmax < NUM_CELLS-1) && (m_pGrids[ci + jmax*NUM_CELLS].state == Object)) {
+		jmax++;
+	}
 
-		const float x_imin = GRIDSTART_X - CELL_EDGE*float(imin);
-		const float x_imax = GRIDSTART_X - CELL_EDGE*float(imax);
-		const float z_jmin = GRIDSTART_Z - CELL_EDGE*float(jmin);
-		const float z_jmax = GRIDSTART_Z - CELL_EDGE*float(jmax);
+	const float rowHeight = interpolateCells(imin + cj*NUM_CELLS, imax + cj*NUM_CELLS, (cellX - imin)/float(imax - imin));
+	const float columnHeight = interpolateCells(ci + jmin*NUM_CELLS, ci + jmax*NUM_CELLS, (cellZ - jmin)/float(jmax - jmin));
 
-	
-		if((x_imin - x_imax == 0) && (z_jmax - z_jmin == 0)) {
-			height = TOTAL_HEIGHT;
+	return 0.5f*(rowHeight + columnHeight);
+}
+
+/**
+ * Water heights at a batch of points. Points on the grid use getWaterHeight, points outside are sampled from
+ * the open sea together, which is much cheaper than one query per point.
+ *
+ * @param  pX, pZ  count world positions.
+ * @param  pHeights  receives count heights.
+ */
+void WaterSimulation::getWaterHeights(const float* pX, const float* pZ, unsigned int count, float* pHeights)
+{
+	m_openSeaX.clear();
+	m_openSeaZ.clear();
+	m_openSeaIndices.clear();
+
+	for(unsigned int i=0; i<count; i++) {
+		if(isInsideGrid(pX[i], pZ[i])) {
+			pHeights[i] = getWaterHeight(pX[i], pZ[i]);
+		} else if(m_pOpenSea == NULL) {
+			pHeights[i] = TOTAL_HEIGHT;
 		} else {
-			height = (h_imin*(x-x_imax) + h_imax*(x_imin-x) + h_jmin*(z_jmax - z) + h_jmax*(z - z_jmin))/ ((x_imin - x_imax) + (z_jmax - z_jmin));
+			m_openSeaX.push_back(pX[i]);
+			m_openSeaZ.push_back(pZ[i]);
+			m_openSeaIndices.push_back(i);
 		}
+	}
 
-	} else {
-		height = TOTAL_HEIGHT;
+	if(m_openSeaIndices.empty()) {
+		return;
 	}
 
-	height = TOTAL_HEIGHT;
+	m_openSeaHeights.resize(m_openSeaIndices.size());
 
-	return height;
+	FFTSimulation::SurfaceSamples samples;
+	memset(&samples, 0, sizeof(samples));
+	samples.pHeights = &m_openSeaHeights[0];
+
+	m_pOpenSea->sampleSurface(&m_openSeaX[0], &m_openSeaZ[0], (unsigned int)m_openSeaIndices.size(), samples);
+
+	for(size_t i=0; i<m_openSeaIndices.size(); i++) {
+		pHeights[m_openSeaIndices[i]] = TOTAL_HEIGHT + m_openSeaHeights[i];
+	}
 }
 
 
@@ -990,7 +1296,7 @@ void WaterSimulation::bodyInteraction()
 {
 	int convexMinX, convexMaxX, convexMinZ, convexMaxZ;
 
-	if(m_convexHullSize > 0) {
+	if(!m_convexHull.empty()) {
 		findObjectCellsOnGrid(convexMinX, convexMaxX, convexMinZ, convexMaxZ);
 		findObjectBoundaryOnGrid(convexMinX, convexMaxX, convexMinZ, convexMaxZ);
 	}
@@ -999,9 +1305,23 @@ void WaterSimulation::bodyInteraction()
 
 void WaterSimulation::findObjectCellsOnGrid(int &minX, int &maxX, int &minZ, int &maxZ)
 {
-	float ffx[25], ffz[25], FDX[25], FDZ[25]; 
+	const int hullSize = (int)m_convexHull.size();
 
-	for(int i=0; i<m_convexHullSize; i++) {
+	m_hullCellsX.resize(hullSize);
+	m_hullCellsZ.resize(hullSize);
+	m_hullEdgesX.resize(hullSize);
+	m_hullEdgesZ.resize(hullSize);
+	m_hullRowOffsets.resize(hullSize);
+	m_hullCellOffsets.resize(hullSize);
+
+	float* ffx = &m_hullCellsX[0];
+	float* ffz = &m_hullCellsZ[0];
+	float* FDX = &m_hullEdgesX[0];
+	float* FDZ = &m_hullEdgesZ[0];
+	float* CZ = &m_hullRowOffsets[0];
+	float* CX = &m_hullCellOffsets[0];
+
+	for(int i=0; i<hullSize; i++) {
 
 		ffx[i] = (GRIDSTART_X - m_convexHull[i].v[0] + m_xTranslate)/CELL_EDGE;
 		ffz[i] = (GRIDSTART_Z - m_convexHull[i].v[2] + m_zTranslate)/CELL_EDGE;;
@@ -1024,18 +1344,16 @@ void WaterSimulation::findObjectCellsOnGrid(int &minX, int &maxX, int &minZ, int
 			maxZ = ffz[i];
 		}
 
-		if(i == m_convexHullSize-1) {
+		if(i == hullSize-1) {
 			FDX[i] = ffx[i] - ffx[0];
 			FDZ[i] = ffz[i] - ffz[0];
 		}
 	}
 
-	float  C[25], CZ[25], CX[25];
-
-	for(int i=0; i<m_convexHullSize; i++) {
+	for(int i=0; i<hullSize; i++) {
 		
-		C[i] = FDZ[i]*ffx[i] - FDX[i]*ffz[i]; 
-		CZ[i] = C[i] + FDX[i]*minZ - FDZ[i]*minX;
+		const float C = FDZ[i]*ffx[i] - FDX[i]*ffz[i]; 
+		CZ[i] = C + FDX[i]*minZ - FDZ[i]*minX;
 		CX[i] = CZ[i];
 
 	}
@@ -1047,7 +1365,7 @@ void WaterSimulation::findObjectCellsOnGrid(int &minX, int &maxX, int &minZ, int
 
 	for(int z=minZ; z<=maxZ; z++) {
 
-		for(int i=0; i<m_convexHullSize; i++) {
+		for(int i=0; i<hullSize; i++) {
 				CX[i] = CZ[i];
 		}
 
@@ -1055,7 +1373,7 @@ void WaterSimulation::findObjectCellsOnGrid(int &minX, int &maxX, int &minZ, int
 
 			bool Passed = 1;
 
-			for(int i=0; i<m_convexHullSize; i++) {
+			for(int i=0; i<hullSize; i++) {
 			
 				if(!(CX[i]>-0.5f)) {
 					Passed = 0;
@@ -1087,12 +1405,12 @@ void WaterSimulation::findObjectCellsOnGrid(int &minX, int &maxX, int &minZ, int
 
 			}
 
-			for(int i=0; i<m_convexHullSize; i++) {
+			for(int i=0; i<hullSize; i++) {
 				CX[i] -= FDZ[i];
 			}
 		}
 
-		for(int i=0; i<m_convexHullSize; i++) {
+		for(int i=0; i<hullSize; i++) {
 				CZ[i] += FDX[i];
 		}
 	}
@@ -15,10 +15,14 @@
 #include "PortScene.h"
 
 #include "base/math/Vector3.h"
+#include "base/math/RandomGenerator.h"
 #include <fstream>
+#include <vector>
 
 #pragma once
 
+class FFTOcean;
+
 class WaterSimulation
 {
 
@@ -29,20 +33,32 @@ public:
 	static const int NUM_CELLS = 120;
 	static const int NUM_GRIDS = NUM_CELLS*NUM_CELLS;
 	static const int NUM_BORDER_DAMPING_CELLS = NUM_CELLS/20;
+	static const int STRIP_BAND_WIDTH = 6; // quads per strip row, keeps the previous row inside a 16 entry FIFO vertex cache
 	static const float TOTAL_HEIGHT;
 	static const float FLAT, CELL_EDGE, INV_DIST, TIME_STEP, GRAVITY, DISPLACED_HEIGHT, UNDER_WATER, BOUNDARY_THRESHOLD, GRIDSTART_X, GRIDSTART_Z;
+	static const float MAX_EXPLICIT_TIME_STEP; // gravity wave CFL limit of the explicit solver, larger steps are substepped
+	static const float SOLVER_TOLERANCE; // rms height residual in meters at which the implicit solve stops
+	static const int MAX_SOLVER_ITERATIONS = 50;
+
+	enum SolverType
+	{
+		EXPLICIT_SOLVER,
+		SEMI_IMPLICIT_SOLVER
+	};
 
 	void initializeGrid();
 	void update(const Vector3& cameraView);
 	void addDrop(float objPosX, float objPosZ);
-	void fillIndicesSWE(std::vector<GLuint>& indexVect);
-	void fillIndicesFFT(std::vector<GLuint>& indexVect);
+	template <class IndexType> void fillIndicesSWE(std::vector<IndexType>& indexVect, bool skipGround);
+	template <class IndexType> void fillIndicesSWEStrips(std::vector<IndexType>& indexVect, IndexType restartIndex, bool skipGround);
+	template <class IndexType> void fillIndicesFFT(std::vector<IndexType>& indexVect);
 	void fillVertexBufferandUpdateNormals(float* pVertices);
 	void fillFFTVertexBuffer(float* pVertices);
+	void fillHeightField(float* pHeights, float* pXVelocities, float* pZVelocities);
 	float getWaterHeight(float x, float z);
+	void getWaterHeights(const float* pX, const float* pZ, unsigned int count, float* pHeights);
 
-	Vector3 m_convexHull[25];
-	short m_convexHullSize;
+	std::vector<Vector3> m_convexHull; // boat's waterline polygon, clockwise in x and z, empty if the boat is out of the water
 	float m_xVelocity, m_zVelocity;
 	float m_boatSpeed, m_rotation;
 	
@@ -56,6 +72,17 @@ public:
 		return GRIDSTART_Z;
 	}
 
+	// world position of cell 0, cells go towards -x and -z by CELL_EDGE
+	inline float getOriginX()
+	{
+		return GRIDSTART_X + m_xTranslate;
+	}
+
+	inline float getOriginZ()
+	{
+		return GRIDSTART_Z + m_zTranslate;
+	}
+
 	inline float getTranslationX()
 	{
 		return m_xTranslate;
@@ -66,6 +93,71 @@ public:
 		return m_zTranslate;
 	}
 
+	inline SolverType getSolverType()
+	{
+		return m_solverType;
+	}
+
+	inline void setSolverType(SolverType solverType)
+	{
+		m_solverType = solverType;
+	}
+
+	// simulated time per update() call, the explicit solver splits it into substeps of at most MAX_EXPLICIT_TIME_STEP
+	inline float getTimeStep()
+	{
+		return m_timeStep;
+	}
+
+	inline void setTimeStep(float timeStep)
+	{
+		m_timeStep = timeStep;
+	}
+
+	// seeds the noise of newly created cells, defaults to rand() so srand() still controls it
+	inline void setRandomSeed(unsigned int seed)
+	{
+		m_random.setSeed(seed);
+	}
+
+	// PCG iterations of the last semi-implicit step
+	inline int getSolverIterations()
+	{
+		return m_solverIterations;
+	}
+
+	// true if cells were created by moving the grid since the last reset (Ground cells may have changed)
+	inline bool getCellStatesChanged()
+	{
+		return m_cellStatesChanged;
+	}
+
+	inline void resetCellStatesChanged()
+	{
+		m_cellStatesChanged = false;
+	}
+
+	// port the grid was created in, its ground and collision geometry share the world coordinates of the bodies
+	inline const PortScene* getPortScene()
+	{
+		return m_pPortScene;
+	}
+
+	// distant water whose waves are added to TOTAL_HEIGHT outside the grid and flow in through the
+	// border damping band, NULL keeps both flat. Not owned, update it before this simulation.
+	inline void setOpenSea(FFTOcean* pOpenSea)
+	{
+		m_pOpenSea = pOpenSea;
+	}
+
+	inline bool isInsideGrid(float x, float z)
+	{
+		const int i = (int)floor((GRIDSTART_X - x + m_xTranslate)/CELL_EDGE);
+		const int j = (int)floor((GRIDSTART_Z - z + m_zTranslate)/CELL_EDGE);
+
+		return (i>=0) && (i<NUM_CELLS) && (j>=0) && (j<NUM_CELLS);
+	}
+
 private:
 
 	enum State
@@ -88,18 +180,55 @@ private:
 	GridCell* m_pGrids;
 
 	PortScene* m_pPortScene;
+	FFTOcean* m_pOpenSea;
+
+	// points of getWaterHeights outside the grid, sampled from the open sea in one batch
+	std::vector<float> m_openSeaX, m_openSeaZ, m_openSeaHeights;
+	std::vector<unsigned int> m_openSeaIndices;
+
+	// convex hull in cell units and its edge equations for the object cells, reused every update
+	std::vector<float> m_hullCellsX, m_hullCellsZ, m_hullEdgesX, m_hullEdgesZ, m_hullRowOffsets, m_hullCellOffsets;
+
+	// open sea surface at the cells of the border damping band in row order, sampled once per update
+	std::vector<float> m_inflowX, m_inflowZ, m_inflowHeights, m_inflowVelocitiesX, m_inflowVelocitiesZ;
 
 	float m_xTranslate, m_zTranslate;
+	bool m_cellStatesChanged;
+
+	RandomGenerator m_random;
+
+	SolverType m_solverType;
+	float m_timeStep;
+	int m_solverIterations;
+
+	// scratch arrays of the semi-implicit solver (NUM_GRIDS entries each), only unknown cells are non zero in the PCG vectors
+	float* m_pSolverHeight;
+	float* m_pSolverRhs;
+	float* m_pSolverResidual;
+	float* m_pSolverPrecond;
+	float* m_pSolverDirection;
+	float* m_pSolverProduct;
+	float* m_pSolverDiagonal;
+	float* m_pSolverDepthX; // water depth on the face between index-1 and index, 0 if the face is closed
+	float* m_pSolverDepthZ; // water depth on the face between index-NUM_CELLS and index
+	float* m_pSolverGroundHeight;
+	int* m_pSolverCells;
+	int m_numSolverCells;
 	int m_newObjectCellIndices[2000], m_newNumObjectCellIndices;
 
 	void moveSWEGrid(const Vector3& cameraView);
-	void advectHeight();
-	void advectVelocityX();
-	void advectVelocityZ();
-	void updateHeight();
-	void updateVelocities();
+	void explicitStep(float timeStep);
+	void semiImplicitStep(float timeStep);
+	void advectHeight(float timeStep);
+	void advectVelocityX(float timeStep);
+	void advectVelocityZ(float timeStep);
+	void updateHeight(float timeStep);
+	void updateVelocities(float timeStep);
+	void solveHeightImplicit(float timeStep);
+	void applyHelmholtzOperator(const float* pIn, float* pOut, float alphaScale);
 	void updateNormals();
 	void absorbingBoundaries();
+	void sampleInflow();
 	void reflectBoundaries();
 	void freeSurface();
 	void createNewCell( int i,  int j);
@@ -113,10 +242,46 @@ private:
 
 	inline float getRandom(float min=0., float max=1.)
 	{
-		return min+( (rand()/(RAND_MAX+1.0)) *(max-min) );  
+		return m_random.getFloat(min, max);
 	}
 
 
+	inline bool isWet(int index)
+	{
+		return (m_pGrids[index].state == Water) || (m_pGrids[index].state == NearBoundary);
+	}
+
+	// cells whose y is a water surface, ground cells render below the terrain and object cells are covered
+	inline bool hasSurface(int index)
+	{
+		return (m_pGrids[index].state != Ground) && (m_pGrids[index].state != Object);
+	}
+
+	// linear between the surfaces of two cells, an end without a surface takes the other one
+	inline float interpolateCells(int index0, int index1, float weight)
+	{
+		const bool surface0 = hasSurface(index0);
+		const bool surface1 = hasSurface(index1);
+
+		if(surface0 && surface1) {
+			return m_pGrids[index0].y + (m_pGrids[index1].y - m_pGrids[index0].y)*weight;
+		}
+
+		return surface0 ? m_pGrids[index0].y : (surface1 ? m_pGrids[index1].y : TOTAL_HEIGHT);
+	}
+
+	inline bool isDampingCell(int i, int j)
+	{
+		return (i<=NUM_BORDER_DAMPING_CELLS) || (j<=NUM_BORDER_DAMPING_CELLS) || (i>=(NUM_CELLS-NUM_BORDER_DAMPING_CELLS)) || (j>=(NUM_CELLS-NUM_BORDER_DAMPING_CELLS));
+	}
+
+	inline bool isGroundQuad(int xc, int zc)
+	{
+		const int index = xc + zc*NUM_CELLS;
+
+		return (m_pGrids[index].state == Ground) && (m_pGrids[index+1].state == Ground) && (m_pGrids[index+NUM_CELLS].state == Ground) && (m_pGrids[index+1+NUM_CELLS].state == Ground);
+	}
+
 	inline float interpolate( float x, float z,  float x1,  float x2,  float y1,  float y2) {
 		
 		const int X = (int)x;
@@ -129,4 +294,134 @@ private:
 		return  s0*(t0* x1 + t1*x2 )+ s1*(t0*y1  + t1*y2 );
 	}
 				
-};
\ No newline at end of file
+};
+
+template <class IndexType> void WaterSimulation::fillIndicesSWE(std::vector<IndexType>& indexVect, bool skipGround)
+{
+
+	for (int zc = 0; zc < NUM_CELLS ; zc++) {
+		for (int xc = 0; xc < NUM_CELLS ; xc++) {
+			const int index = xc + zc*NUM_CELLS ;
+
+			//create two triangles:
+			if ((xc < NUM_CELLS-1) && (zc < NUM_CELLS-1)) {
+
+				if(skipGround && isGroundQuad(xc, zc)) {
+					continue;
+				}
+			
+				indexVect.push_back(index);
+				indexVect.push_back(index+1);
+				indexVect.push_back(index+1+NUM_CELLS);
+
+				indexVect.push_back(index);
+				indexVect.push_back(index+1+NUM_CELLS);
+				indexVect.push_back(index+NUM_CELLS);
+
+			}	
+		}
+	}
+
+}
+
+template <class IndexType> void WaterSimulation::fillIndicesSWEStrips(std::vector<IndexType>& indexVect, IndexType restartIndex, bool skipGround)
+{
+	// one strip per row inside vertical bands of STRIP_BAND_WIDTH quads, so the shared row is still in the vertex cache.
+	// Same winding as fillIndicesSWE, strips are split with restartIndex around skipped quads.
+	for (int xStart = 0; xStart < NUM_CELLS-1; xStart += STRIP_BAND_WIDTH) {
+
+		const int xEnd = std::min(xStart + STRIP_BAND_WIDTH, NUM_CELLS-1);
+
+		for (int zc = 0; zc < NUM_CELLS-1; zc++) {
+
+			bool stripOpen = false;
+
+			for (int xc = xStart; xc < xEnd; xc++) {
+
+				const int index = xc + zc*NUM_CELLS;
+
+				if(skipGround && isGroundQuad(xc, zc)) {
+					if(stripOpen) {
+						indexVect.push_back(restartIndex);
+						stripOpen = false;
+					}
+					continue;
+				}
+
+				if(!stripOpen) {
+					indexVect.push_back(index+NUM_CELLS);
+					indexVect.push_back(index);
+					stripOpen = true;
+				}
+
+				indexVect.push_back(index+1+NUM_CELLS);
+				indexVect.push_back(index+1);
+			}
+
+			if(stripOpen) {
+				indexVect.push_back(restartIndex);
+			}
+		}
+	}
+}
+
+template <class IndexType> void WaterSimulation::fillIndicesFFT(std::vector<IndexType>& indexVect)
+{
+	const int indexCorners = 4*NUM_CELLS;
+
+	for(int xc=0; xc<NUM_CELLS; xc++) {
+		const int index = xc;
+
+		if(xc<NUM_CELLS-1) {
+			indexVect.push_back(index);
+			indexVect.push_back(index+1);
+			indexVect.push_back(indexCorners);
+		} else {
+			indexVect.push_back(index);
+			indexVect.push_back(indexCorners);
+			indexVect.push_back(indexCorners+1);
+		}
+	}
+
+	for(int zc=0; zc<NUM_CELLS; zc++) {
+		const int index = NUM_CELLS+zc;
+
+		if(zc<NUM_CELLS-1) {
+			indexVect.push_back(index);
+			indexVect.push_back(index+1);
+			indexVect.push_back(indexCorners+1);
+		} else {
+			indexVect.push_back(index);
+			indexVect.push_back(indexCorners+1);
+			indexVect.push_back(indexCorners+2);
+		}
+	}
+
+	for(int xc=NUM_CELLS-1; xc>=0; xc--) {
+		const int index = 2*NUM_CELLS + xc;
+
+		if(xc>0) {
+			indexVect.push_back(index);
+			indexVect.push_back(index-1);
+			indexVect.push_back(indexCorners+2);
+		} else {
+			indexVect.push_back(index);
+			indexVect.push_back(indexCorners+2);
+			indexVect.push_back(indexCorners+3);
+		}
+	}
+
+	for(int zc=NUM_CELLS-1; zc>=0; zc--) {
+		const int index = 3*NUM_CELLS + zc;
+
+		if(zc>0) {
+			indexVect.push_back(index);
+			indexVect.push_back(index-1);
+			indexVect.push_back(indexCorners+3);
+		} else {
+			indexVect.push_back(index);
+			indexVect.push_back(indexCorners+3);
+			indexVect.push_back(indexCorners);
+		}
+	}
+}
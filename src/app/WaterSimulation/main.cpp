@@ -1,12 +1,24 @@
 #include "WaterScene.h"
+#include "EnsembleDriver.h"
+#include "BenchmarkDriver.h"
 #include "glew/glew.h"
 #include "glut/glut.h"
 
+#include <string.h>
+#include <time.h>
+
 WaterScene* water;
 
 void display()
 {
 	water->update();
+
+	if(water->isReplayFinished()) {
+		water->printReplayReport();
+		water->stopHeightFieldRecording();
+		exit(0);
+	}
+
 	water->renderScene();
 }
 
@@ -41,9 +53,11 @@ void reshape(int width, int height)
 
 void pressNormalKeys(unsigned char key, int x, int y)
 {
-	if (key == 27)
+	if (key == 27) {
+		water->stopRecording();
+		water->stopHeightFieldRecording();
 		exit(0);
-	else
+	} else
 		water->pressNormalKey(key);
 }
 
@@ -91,6 +105,198 @@ int main(int argc, char**argv)
 {
 	// init GLUT and create window
 	glutInit(&argc, argv);
+
+	// -record <file>: write input to a trace, -replay <file> [-headless]: play a trace back and report timings
+	// -ensemble <K> [-ticks <N>]: run K independent simulations without rendering and report throughput
+	// -recordHeights <file> [-heightEncoding raw|quantized|delta] [-recordVelocities]: stream the SWE surface to a file
+	// -fftPlanner estimate|measure|patient: FFTW planner effort, measured plans are cached in fftwWisdom_*.dat
+	// -fftThreads <N>: threads of the FFT ocean update (0 = all processors)
+	// -fftEngine fftw|builtin: FFT of the ocean, the builtin engine needs no FFTW (default without GS_USE_FFTW)
+	// -h0Cache: load the initial FFT amplitudes from h0Cache_*.dat, generate and save them if missing
+	// -benchmark <frames> [-fftThreads <N>]: time the FFT ocean update from 128 to 1024 cells with up to N threads, then FFTW against the builtin engine
+	// -oceanCache <frames> [-oceanPeriod <seconds>] [-oceanCacheFile <prefix>]: loop the FFT ocean and play it back from precomputed frames (30 per second of period)
+	// -oceanUpdateDivider <k>: compute the FFT ocean every k-th frame, spread over k frames, and blend the frames in between
+	// -floatingBodies <N>: drop N crates and planks around the boat
+	// -bodyBenchmark <N> [-ticks <T>] [-fftThreads <N>]: time the update of N floating bodies with up to N threads
+	// -wakeTest <ticks>: let a crate fall asleep in calm SWE water within the given ticks and check that a drop under it wakes it
+	// -buoyancy exact|voxel [-voxelSize <s>]: boat buoyancy from the hull triangles or from voxels of size s (default: 1/4 of the smallest hull extent)
+	// -buoyancyBenchmark <poses>: compare the voxel buoyancy of the boat hull against the exact one, needs no window
+	// -hullTest <repeats>: check and time the waterline convex hull on degenerate and collinear inputs, needs no window
+	// -collisionTest <queries>: check and time swept point queries against the port's collision tree
+	// -fftTest <times> [-fftThreads <N>]: check the FFT engines against a naive DFT at the given number of times, needs no window
+	// -spectrumTest <seeds>: check the height variance of the FFT ocean against the integral of its wave spectrum, needs no window
+	// -heightFieldTest <frames>: record a test surface in every encoding and read it back in random order, needs no window
+	const char* recordFilename = NULL;
+	const char* replayFilename = NULL;
+	bool headless = false;
+	int numEnsembleInstances = 0;
+	unsigned int numEnsembleTicks = 600;
+	int numFftThreads = 1;
+	unsigned int numBenchmarkFrames = 0;
+	const char* heightFieldFilename = NULL;
+	HeightFieldRecorder::Encoding heightFieldEncoding = HeightFieldRecorder::ENCODING_DELTA;
+	bool recordVelocities = false;
+	unsigned int numOceanCacheFrames = 0;
+	float oceanRepeatPeriod = FFTOcean::DEFAULT_REPEAT_PERIOD;
+	const char* oceanCacheFilePrefix = NULL;
+	unsigned int oceanUpdateDivider = 1;
+	int numFloatingBodies = 0;
+	int numBenchmarkBodies = 0;
+	unsigned int numWakeTestTicks = 0;
+	RigidBody::BuoyancyModel buoyancyModel = RigidBody::BUOYANCY_EXACT;
+	float voxelSize = 0.0f; // derived from the hull
+	unsigned int numBuoyancyPoses = 0;
+	unsigned int numHullRepeats = 0;
+	unsigned int numCollisionQueries = 0;
+	unsigned int numHeightFieldTestFrames = 0;
+	unsigned int numFftTestTimes = 0;
+	unsigned int numSpectrumTestSeeds = 0;
+
+	for(int i=1; i<argc; i++) {
+		if((strcmp(argv[i], "-record") == 0) && (i+1 < argc)) {
+			recordFilename = argv[++i];
+		} else if((strcmp(argv[i], "-replay") == 0) && (i+1 < argc)) {
+			replayFilename = argv[++i];
+		} else if(strcmp(argv[i], "-headless") == 0) {
+			headless = true;
+		} else if((strcmp(argv[i], "-ensemble") == 0) && (i+1 < argc)) {
+			numEnsembleInstances = atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-ticks") == 0) && (i+1 < argc)) {
+			numEnsembleTicks = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-recordHeights") == 0) && (i+1 < argc)) {
+			heightFieldFilename = argv[++i];
+		} else if((strcmp(argv[i], "-heightEncoding") == 0) && (i+1 < argc)) {
+			i++;
+			if(strcmp(argv[i], "raw") == 0) {
+				heightFieldEncoding = HeightFieldRecorder::ENCODING_RAW;
+			} else if(strcmp(argv[i], "quantized") == 0) {
+				heightFieldEncoding = HeightFieldRecorder::ENCODING_QUANTIZED;
+			} else {
+				heightFieldEncoding = HeightFieldRecorder::ENCODING_DELTA;
+			}
+		} else if(strcmp(argv[i], "-recordVelocities") == 0) {
+			recordVelocities = true;
+		} else if((strcmp(argv[i], "-fftThreads") == 0) && (i+1 < argc)) {
+			numFftThreads = atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-benchmark") == 0) && (i+1 < argc)) {
+			numBenchmarkFrames = (unsigned int)atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-h0Cache") == 0) {
+			FFTSimulation::setH0CacheEnabled(true);
+		} else if((strcmp(argv[i], "-oceanCache") == 0) && (i+1 < argc)) {
+			numOceanCacheFrames = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-oceanPeriod") == 0) && (i+1 < argc)) {
+			oceanRepeatPeriod = (float)atof(argv[++i]);
+		} else if((strcmp(argv[i], "-oceanCacheFile") == 0) && (i+1 < argc)) {
+			oceanCacheFilePrefix = argv[++i];
+		} else if((strcmp(argv[i], "-oceanUpdateDivider") == 0) && (i+1 < argc)) {
+			oceanUpdateDivider = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-floatingBodies") == 0) && (i+1 < argc)) {
+			numFloatingBodies = atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-bodyBenchmark") == 0) && (i+1 < argc)) {
+			numBenchmarkBodies = atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-wakeTest") == 0) && (i+1 < argc)) {
+			numWakeTestTicks = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-buoyancy") == 0) && (i+1 < argc)) {
+			i++;
+			buoyancyModel = (strcmp(argv[i], "voxel") == 0) ? RigidBody::BUOYANCY_VOXELS : RigidBody::BUOYANCY_EXACT;
+		} else if((strcmp(argv[i], "-voxelSize") == 0) && (i+1 < argc)) {
+			voxelSize = (float)atof(argv[++i]);
+		} else if((strcmp(argv[i], "-buoyancyBenchmark") == 0) && (i+1 < argc)) {
+			numBuoyancyPoses = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-hullTest") == 0) && (i+1 < argc)) {
+			numHullRepeats = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-collisionTest") == 0) && (i+1 < argc)) {
+			numCollisionQueries = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-heightFieldTest") == 0) && (i+1 < argc)) {
+			numHeightFieldTestFrames = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-fftTest") == 0) && (i+1 < argc)) {
+			numFftTestTimes = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-spectrumTest") == 0) && (i+1 < argc)) {
+			numSpectrumTestSeeds = (unsigned int)atoi(argv[++i]);
+		} else if((strcmp(argv[i], "-fftPlanner") == 0) && (i+1 < argc)) {
+			i++;
+			if(strcmp(argv[i], "measure") == 0) {
+				FFTSimulation::setPlannerMode(FFTSimulation::PLANNER_MEASURE);
+			} else if(strcmp(argv[i], "patient") == 0) {
+				FFTSimulation::setPlannerMode(FFTSimulation::PLANNER_PATIENT);
+			} else {
+				FFTSimulation::setPlannerMode(FFTSimulation::PLANNER_ESTIMATE);
+			}
+		} else if((strcmp(argv[i], "-fftEngine") == 0) && (i+1 < argc)) {
+			i++;
+			if(strcmp(argv[i], "builtin") == 0) {
+				FFTSimulation::setFFTEngine(FFTSimulation::FFT_ENGINE_BUILTIN);
+			} else {
+				FFTSimulation::setFFTEngine(FFTSimulation::FFT_ENGINE_FFTW);
+			}
+		}
+	}
+
+	if(numBenchmarkFrames > 0) {
+
+		// FFT only, needs no window
+		BenchmarkDriver benchmark;
+		benchmark.run(numBenchmarkFrames, numFftThreads);
+		benchmark.compareEngines(numBenchmarkFrames, numFftThreads);
+
+		return 0;
+	}
+
+	if(numBuoyancyPoses > 0) {
+
+		// hull only, needs no window
+		BenchmarkDriver benchmark;
+		benchmark.compareBuoyancyModels(numBuoyancyPoses);
+
+		return 0;
+	}
+
+	if(numHullRepeats > 0) {
+
+		BenchmarkDriver benchmark;
+		return benchmark.testConvexHull(numHullRepeats) ? 0 : 1;
+	}
+
+	if(numHeightFieldTestFrames > 0) {
+
+		BenchmarkDriver benchmark;
+		return benchmark.testHeightFieldRecording("heightFieldTest.whf", numHeightFieldTestFrames) ? 0 : 1;
+	}
+
+	if(numFftTestTimes > 0) {
+
+		BenchmarkDriver benchmark;
+		return benchmark.testTransforms(numFftTestTimes, numFftThreads) ? 0 : 1;
+	}
+
+	if(numSpectrumTestSeeds > 0) {
+
+		BenchmarkDriver benchmark;
+		return benchmark.testSpectrumVariance(numSpectrumTestSeeds) ? 0 : 1;
+	}
+
+	RigidBody::setBuoyancyModel(buoyancyModel, voxelSize);
+
+	FFTSimulation::setNumThreads(numFftThreads);
+	FFTOcean::setAnimationCache(numOceanCacheFrames, oceanRepeatPeriod, oceanCacheFilePrefix);
+	FFTOcean::setUpdateDivider(oceanUpdateDivider);
+	WaterScene::setNumFloatingBodies(numFloatingBodies);
+
+	InputTrace inputTrace;
+	unsigned int seed = (unsigned int)time(NULL);
+
+	if(replayFilename != NULL) {
+		if(!inputTrace.load(replayFilename)) {
+			return 1;
+		}
+		seed = inputTrace.getSeed();
+	}
+
+	// FFT spectrum and new SWE cells use rand(), a trace replays only with the seed it was recorded with
+	if((recordFilename != NULL) || (replayFilename != NULL)) {
+		srand(seed);
+	}
+
 	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
 	glutInitWindowSize(1360,768);
 	glutCreateWindow("Water Simulation");
@@ -113,8 +319,97 @@ int main(int argc, char**argv)
 
 	InitGL();
 
+	if(numEnsembleInstances > 0) {
+
+		// the port still needs the GL context for its buffers, but it is loaded only once for all instances
+		glutHideWindow();
+
+		PortScene* pPortScene = new PortScene();
+		EnsembleDriver* pEnsemble = new EnsembleDriver(pPortScene);
+
+		pEnsemble->initialize(numEnsembleInstances, seed);
+		pEnsemble->run(numEnsembleTicks);
+
+		delete pEnsemble;
+		delete pPortScene;
+
+		return 0;
+	}
+
+	if(numBenchmarkBodies > 0) {
+
+		// the SWE grid needs the port, which needs the GL context
+		glutHideWindow();
+
+		PortScene* pPortScene = new PortScene();
+
+		BenchmarkDriver benchmark;
+		benchmark.runFloatingBodies(pPortScene, numBenchmarkBodies, numEnsembleTicks, numFftThreads);
+
+		delete pPortScene;
+
+		return 0;
+	}
+
+	if(numWakeTestTicks > 0) {
+
+		// the SWE grid needs the port, which needs the GL context
+		glutHideWindow();
+
+		PortScene* pPortScene = new PortScene();
+
+		BenchmarkDriver benchmark;
+		const bool passed = benchmark.testBodyWaking(pPortScene, numWakeTestTicks);
+
+		delete pPortScene;
+
+		return passed ? 0 : 1;
+	}
+
+	if(numCollisionQueries > 0) {
+
+		// the port loads its textures and buffers into the GL context
+		glutHideWindow();
+
+		PortScene* pPortScene = new PortScene();
+
+		BenchmarkDriver benchmark;
+		const bool passed = benchmark.testCollisionTree(pPortScene->getCollisionTree(), numCollisionQueries);
+
+		delete pPortScene;
+
+		return passed ? 0 : 1;
+	}
+
 	water = new WaterScene();
 
+	if(heightFieldFilename != NULL) {
+		water->startHeightFieldRecording(heightFieldFilename, heightFieldEncoding, recordVelocities);
+	}
+
+	if(replayFilename != NULL) {
+
+		water->startReplay(inputTrace);
+
+		if(headless) {
+
+			// simulation only, the window just provides the GL context for the buffers
+			glutHideWindow();
+
+			while(!water->isReplayFinished()) {
+				water->update();
+			}
+
+			water->printReplayReport();
+			delete water;
+
+			return 0;
+		}
+
+	} else if(recordFilename != NULL) {
+		water->startRecording(recordFilename, seed);
+	}
+
 	// enter GLUT event processing cycle
 	glutMainLoop();
 
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+
+#include "MappedFile.h"
+
+#if !defined(_WIN32)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+#endif
+
+MappedFile::MappedFile()
+{
+    m_mode = ACCESS_READ;
+    m_pData = NULL;
+    m_size = 0;
+
+#if defined(_WIN32)
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = NULL;
+#else
+    m_file = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+/**
+ * Open and map a file
+ *
+ * @param  filename  file to open.
+ * @param  mode  read only, or read/write which creates or truncates the file.
+ * @param  size  initial size of a read/write file in bytes (must not be 0), ignored for read only files.
+ * @return true on success.
+ */
+bool MappedFile::open(const char* filename, AccessMode mode, size_t size)
+{
+    close();
+
+    m_mode = mode;
+
+#if defined(_WIN32)
+    if (mode == ACCESS_READ) {
+        m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    } else {
+        m_file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    if (mode == ACCESS_READ) {
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(m_file, &fileSize);
+        size = (size_t)fileSize.QuadPart;
+    }
+#else
+    if (mode == ACCESS_READ) {
+        m_file = ::open(filename, O_RDONLY);
+    } else {
+        m_file = ::open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+
+    if (m_file < 0) {
+        return false;
+    }
+
+    if (mode == ACCESS_READ) {
+        struct stat fileStat;
+        fstat(m_file, &fileStat);
+        size = (size_t)fileStat.st_size;
+    }
+#endif
+
+    if (size == 0) {
+        close();
+        return false;
+    }
+
+    if (mode == ACCESS_READ) {
+        m_size = size;
+        if (!map()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    if (!resize(size)) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Change the size of a read/write file and map it again, the data pointer changes
+ *
+ * @param  size  new size in bytes (must not be 0).
+ * @return true on success.
+ */
+bool MappedFile::resize(size_t size)
+{
+    if ((m_mode != ACCESS_READ_WRITE) || (size == 0)) {
+        return false;
+    }
+
+    unmap();
+
+#if defined(_WIN32)
+    if (m_file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    fileSize.QuadPart = (LONGLONG)size;
+
+    if (!SetFilePointerEx(m_file, fileSize, NULL, FILE_BEGIN) || !SetEndOfFile(m_file)) {
+        return false;
+    }
+#else
+    if ((m_file < 0) || (ftruncate(m_file, (off_t)size) != 0)) {
+        return false;
+    }
+#endif
+
+    m_size = size;
+
+    return map();
+}
+
+void MappedFile::close()
+{
+    unmap();
+
+#if defined(_WIN32)
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_file >= 0) {
+        ::close(m_file);
+        m_file = -1;
+    }
+#endif
+
+    m_size = 0;
+}
+
+bool MappedFile::map()
+{
+#if defined(_WIN32)
+    const unsigned long long size = m_size;
+    const DWORD protect = (m_mode == ACCESS_READ) ? PAGE_READONLY : PAGE_READWRITE;
+    const DWORD access = (m_mode == ACCESS_READ) ? FILE_MAP_READ : FILE_MAP_WRITE;
+
+    m_mapping = CreateFileMappingA(m_file, NULL, protect, (DWORD)(size >> 32), (DWORD)(size & 0xFFFFFFFF), NULL);
+
+    if (m_mapping == NULL) {
+        return false;
+    }
+
+    m_pData = (unsigned char*)MapViewOfFile(m_mapping, access, 0, 0, m_size);
+#else
+    const int protect = (m_mode == ACCESS_READ) ? PROT_READ : (PROT_READ | PROT_WRITE);
+
+    void* pData = mmap(NULL, m_size, protect, MAP_SHARED, m_file, 0);
+    m_pData = (pData == MAP_FAILED) ? NULL : (unsigned char*)pData;
+#endif
+
+    return m_pData != NULL;
+}
+
+void MappedFile::unmap()
+{
+#if defined(_WIN32)
+    if (m_pData != NULL) {
+        UnmapViewOfFile(m_pData);
+    }
+
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+#else
+    if (m_pData != NULL) {
+        munmap(m_pData, m_size);
+    }
+#endif
+
+    m_pData = NULL;
+}
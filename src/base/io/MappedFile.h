@@ -0,0 +1,55 @@
+/** \class MappedFile
+ * File mapped into memory, read only or read/write with explicit resizing
+ *
+ * @author  Rahul Mukhi
+ * @date  23/05/12
+ *
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+class MappedFile
+{
+public:
+
+    enum AccessMode
+    {
+        ACCESS_READ,
+        ACCESS_READ_WRITE // creates or truncates the file
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char* filename, AccessMode mode, size_t size = 0);
+    bool resize(size_t size);
+    void close();
+
+    bool isOpen() const { return m_pData != NULL; };
+    unsigned char* getData() const { return m_pData; };
+    size_t getSize() const { return m_size; };
+
+private:
+
+    AccessMode m_mode;
+    unsigned char* m_pData;
+    size_t m_size;
+
+#if defined(_WIN32)
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_file;
+#endif
+
+    bool map();
+    void unmap();
+
+    // not copyable, the mapping is owned
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
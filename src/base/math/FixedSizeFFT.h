@@ -0,0 +1,287 @@
+/** \class FixedSizeFFT
+ * Inverse complex FFT of a power of two size known at compile time, for LANES independent sequences at once.
+ * Element k of all lanes is one Lanes value, so the SSE2 path computes four transforms with the instructions
+ * of one and needs no shuffles. Stockham autosort radix-4 stages (one radix-2 stage first for odd powers of two)
+ * avoid the bit reversal pass; the twiddle factors are precomputed by fillTwiddles.
+ *
+ * @author  Rahul Mukhi
+ * @date  13/06/12
+ *
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include "base/math/SimdUtil.h"
+
+#include <math.h>
+
+template <unsigned int N> class FixedSizeFFT
+{
+public:
+
+    static const unsigned int SIZE = N;
+    static const unsigned int LANES = 4;
+    static const unsigned int NUM_TWIDDLES = 3*N; // upper bound of the twiddles of all stages
+
+#if defined(GS_SSE2)
+    typedef __m128 Lanes;
+#else
+    struct Lanes
+    {
+        float v[LANES];
+    };
+#endif
+
+    /**
+     * Twiddle factors exp(+2*pi*i*p/n) of all stages in the order inverse() uses them
+     *
+     * @param  pReal, pImag  NUM_TWIDDLES floats each.
+     */
+    static void fillTwiddles(float* pReal, float* pImag)
+    {
+        unsigned int count = 0;
+        unsigned int n = N;
+
+        if (!isPowerOfFour(N)) {
+            for (unsigned int p=0; p<n/2; p++) {
+                const double angle = 2.0*3.14159265358979323846*p/n;
+                pReal[count] = (float)cos(angle);
+                pImag[count] = (float)sin(angle);
+                count++;
+            }
+            n /= 2;
+        }
+
+        for (; n>=4; n/=4) {
+            for (unsigned int p=0; p<n/4; p++) {
+                for (unsigned int power=1; power<=3; power++) {
+                    const double angle = 2.0*3.14159265358979323846*p*power/n;
+                    pReal[count] = (float)cos(angle);
+                    pImag[count] = (float)sin(angle);
+                    count++;
+                }
+            }
+        }
+    }
+
+    /**
+     * In place inverse transform x[j] = sum_k X[k]*exp(+2*pi*i*j*k/N), not normalized (like FFTW's backward transform)
+     *
+     * @param  pTwiddleReal, pTwiddleImag  tables of fillTwiddles.
+     * @param  pReal, pImag  N values each, element k of all lanes in one Lanes value.
+     * @param  pTempReal, pTempImag  N values each of scratch space.
+     */
+    static void inverse(const float* GS_RESTRICT pTwiddleReal, const float* GS_RESTRICT pTwiddleImag,
+        Lanes* pReal, Lanes* pImag, Lanes* pTempReal, Lanes* pTempImag)
+    {
+        Lanes* pSourceReal = pReal;
+        Lanes* pSourceImag = pImag;
+        Lanes* pDestReal = pTempReal;
+        Lanes* pDestImag = pTempImag;
+
+        unsigned int n = N;
+        unsigned int stride = 1;
+
+        if (!isPowerOfFour(N)) {
+            radix2Stage(n, stride, pTwiddleReal, pTwiddleImag, pSourceReal, pSourceImag, pDestReal, pDestImag);
+            pTwiddleReal += n/2;
+            pTwiddleImag += n/2;
+            n /= 2;
+            stride *= 2;
+            swap(pSourceReal, pDestReal);
+            swap(pSourceImag, pDestImag);
+        }
+
+        for (; n>=4; n/=4, stride*=4) {
+            radix4Stage(n, stride, pTwiddleReal, pTwiddleImag, pSourceReal, pSourceImag, pDestReal, pDestImag);
+            pTwiddleReal += 3*(n/4);
+            pTwiddleImag += 3*(n/4);
+            swap(pSourceReal, pDestReal);
+            swap(pSourceImag, pDestImag);
+        }
+
+        // the result ends up in the scratch buffers after an odd number of stages
+        if (pSourceReal != pReal) {
+            for (unsigned int k=0; k<N; k++) {
+                pReal[k] = pSourceReal[k];
+                pImag[k] = pSourceImag[k];
+            }
+        }
+    }
+
+    /**
+     * Transposes four Lanes values, afterwards value l holds lane l of the four inputs
+     */
+    static GS_FORCEINLINE void transpose(Lanes& a, Lanes& b, Lanes& c, Lanes& d)
+    {
+#if defined(GS_SSE2)
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+#else
+        Lanes* rows[4] = {&a, &b, &c, &d};
+        for (unsigned int i=0; i<LANES; i++) {
+            for (unsigned int j=i+1; j<LANES; j++) {
+                const float temp = rows[i]->v[j];
+                rows[i]->v[j] = rows[j]->v[i];
+                rows[j]->v[i] = temp;
+            }
+        }
+#endif
+    }
+
+    static GS_FORCEINLINE Lanes set(float a, float b, float c, float d)
+    {
+#if defined(GS_SSE2)
+        return _mm_setr_ps(a, b, c, d);
+#else
+        Lanes result = {{a, b, c, d}};
+        return result;
+#endif
+    }
+
+    static GS_FORCEINLINE void store(float* pDest, Lanes value)
+    {
+#if defined(GS_SSE2)
+        _mm_storeu_ps(pDest, value);
+#else
+        for (unsigned int l=0; l<LANES; l++) {
+            pDest[l] = value.v[l];
+        }
+#endif
+    }
+
+    static GS_FORCEINLINE Lanes add(Lanes a, Lanes b)
+    {
+#if defined(GS_SSE2)
+        return _mm_add_ps(a, b);
+#else
+        Lanes result;
+        for (unsigned int l=0; l<LANES; l++) {
+            result.v[l] = a.v[l] + b.v[l];
+        }
+        return result;
+#endif
+    }
+
+    static GS_FORCEINLINE Lanes sub(Lanes a, Lanes b)
+    {
+#if defined(GS_SSE2)
+        return _mm_sub_ps(a, b);
+#else
+        Lanes result;
+        for (unsigned int l=0; l<LANES; l++) {
+            result.v[l] = a.v[l] - b.v[l];
+        }
+        return result;
+#endif
+    }
+
+private:
+
+    static bool isPowerOfFour(unsigned int n)
+    {
+        while (n >= 4) {
+            n /= 4;
+        }
+        return n == 1;
+    }
+
+    static GS_FORCEINLINE void swap(Lanes*& a, Lanes*& b)
+    {
+        Lanes* temp = a;
+        a = b;
+        b = temp;
+    }
+
+    static GS_FORCEINLINE Lanes broadcast(float value)
+    {
+#if defined(GS_SSE2)
+        return _mm_set1_ps(value);
+#else
+        Lanes result = {{value, value, value, value}};
+        return result;
+#endif
+    }
+
+    // a*w for complex a and a twiddle broadcast to all lanes
+    static GS_FORCEINLINE void multiply(Lanes real, Lanes imag, Lanes wReal, Lanes wImag, Lanes& outReal, Lanes& outImag)
+    {
+#if defined(GS_SSE2)
+        outReal = _mm_sub_ps(_mm_mul_ps(real, wReal), _mm_mul_ps(imag, wImag));
+        outImag = _mm_add_ps(_mm_mul_ps(real, wImag), _mm_mul_ps(imag, wReal));
+#else
+        for (unsigned int l=0; l<LANES; l++) {
+            outReal.v[l] = real.v[l]*wReal.v[l] - imag.v[l]*wImag.v[l];
+            outImag.v[l] = real.v[l]*wImag.v[l] + imag.v[l]*wReal.v[l];
+        }
+#endif
+    }
+
+    // Stockham step of length n: y[q + stride*(2p+r)] from x[q + stride*(p + r*n/2)]
+    static void radix2Stage(unsigned int n, unsigned int stride, const float* GS_RESTRICT pTwiddleReal, const float* GS_RESTRICT pTwiddleImag,
+        const Lanes* GS_RESTRICT pSourceReal, const Lanes* GS_RESTRICT pSourceImag, Lanes* GS_RESTRICT pDestReal, Lanes* GS_RESTRICT pDestImag)
+    {
+        const unsigned int m = n/2;
+
+        for (unsigned int p=0; p<m; p++) {
+
+            const Lanes wReal = broadcast(pTwiddleReal[p]);
+            const Lanes wImag = broadcast(pTwiddleImag[p]);
+
+            for (unsigned int q=0; q<stride; q++) {
+
+                const unsigned int a = q + stride*p;
+                const unsigned int b = a + stride*m;
+                const unsigned int dest = q + stride*2*p;
+
+                pDestReal[dest] = add(pSourceReal[a], pSourceReal[b]);
+                pDestImag[dest] = add(pSourceImag[a], pSourceImag[b]);
+                multiply(sub(pSourceReal[a], pSourceReal[b]), sub(pSourceImag[a], pSourceImag[b]), wReal, wImag, pDestReal[dest + stride], pDestImag[dest + stride]);
+            }
+        }
+    }
+
+    // Stockham step of length n: y[q + stride*(4p+r)] from x[q + stride*(p + r*n/4)]
+    static void radix4Stage(unsigned int n, unsigned int stride, const float* GS_RESTRICT pTwiddleReal, const float* GS_RESTRICT pTwiddleImag,
+        const Lanes* GS_RESTRICT pSourceReal, const Lanes* GS_RESTRICT pSourceImag, Lanes* GS_RESTRICT pDestReal, Lanes* GS_RESTRICT pDestImag)
+    {
+        const unsigned int m = n/4;
+
+        for (unsigned int p=0; p<m; p++) {
+
+            const Lanes w1Real = broadcast(pTwiddleReal[3*p]);
+            const Lanes w1Imag = broadcast(pTwiddleImag[3*p]);
+            const Lanes w2Real = broadcast(pTwiddleReal[3*p+1]);
+            const Lanes w2Imag = broadcast(pTwiddleImag[3*p+1]);
+            const Lanes w3Real = broadcast(pTwiddleReal[3*p+2]);
+            const Lanes w3Imag = broadcast(pTwiddleImag[3*p+2]);
+
+            for (unsigned int q=0; q<stride; q++) {
+
+                const unsigned int a = q + stride*p;
+                const unsigned int b = a + stride*m;
+                const unsigned int c = b + stride*m;
+                const unsigned int d = c + stride*m;
+                const unsigned int dest = q + stride*4*p;
+
+                const Lanes apcReal = add(pSourceReal[a], pSourceReal[c]);
+                const Lanes apcImag = add(pSourceImag[a], pSourceImag[c]);
+                const Lanes amcReal = sub(pSourceReal[a], pSourceReal[c]);
+                const Lanes amcImag = sub(pSourceImag[a], pSourceImag[c]);
+                const Lanes bpdReal = add(pSourceReal[b], pSourceReal[d]);
+                const Lanes bpdImag = add(pSourceImag[b], pSourceImag[d]);
+
+                // i*(b-d)
+                const Lanes jbmdReal = sub(pSourceImag[d], pSourceImag[b]);
+                const Lanes jbmdImag = sub(pSourceReal[b], pSourceReal[d]);
+
+                pDestReal[dest] = add(apcReal, bpdReal);
+                pDestImag[dest] = add(apcImag, bpdImag);
+                multiply(add(amcReal, jbmdReal), add(amcImag, jbmdImag), w1Real, w1Imag, pDestReal[dest + stride], pDestImag[dest + stride]);
+                multiply(sub(apcReal, bpdReal), sub(apcImag, bpdImag), w2Real, w2Imag, pDestReal[dest + 2*stride], pDestImag[dest + 2*stride]);
+                multiply(sub(amcReal, jbmdReal), sub(amcImag, jbmdImag), w3Real, w3Imag, pDestReal[dest + 3*stride], pDestImag[dest + 3*stride]);
+            }
+        }
+    }
+};
@@ -0,0 +1,45 @@
+/** \class RandomGenerator
+ * Small linear congruential generator with its own state, so independent simulations can run on
+ * separate threads with reproducible sequences (rand() shares one global state)
+ *
+ * @author  Rahul Mukhi
+ * @date  22/05/12
+ *
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+class RandomGenerator
+{
+public:
+    RandomGenerator() { setSeed(1); };
+    RandomGenerator(unsigned int seed) { setSeed(seed); };
+
+    inline void setSeed(unsigned int seed)
+    {
+        m_state = seed;
+    }
+
+    inline unsigned int getSeed() const
+    {
+        return m_state;
+    }
+
+    // 24 random bits
+    inline unsigned int getNext()
+    {
+        m_state = m_state*1664525u + 1013904223u;
+        return m_state >> 8;
+    }
+
+    // uniform in [min, max)
+    inline float getFloat(float min=0.0f, float max=1.0f)
+    {
+        return min + (float(getNext())*(1.0f/16777216.0f))*(max-min);
+    }
+
+private:
+    unsigned int m_state;
+};
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+
+#include "SimdUtil.h"
+
+#include <stdlib.h>
+#if defined(_MSC_VER)
+    #include <malloc.h>
+#endif
+
+/**
+ * Sine and cosine of an array of angles
+ *
+ * @param  pAngles  angles in radians.
+ * @param  pSin  receives the sines, may alias pAngles.
+ * @param  pCos  receives the cosines.
+ * @param  count  number of angles, the arrays need no alignment.
+ */
+void SimdUtil::sinCos(const float* pAngles, float* pSin, float* pCos, unsigned int count)
+{
+    unsigned int i = 0;
+
+#if defined(GS_SSE2)
+    for (; i+4 <= count; i += 4) {
+        __m128 s, c;
+        sinCos4(_mm_loadu_ps(pAngles + i), &s, &c);
+        _mm_storeu_ps(pSin + i, s);
+        _mm_storeu_ps(pCos + i, c);
+    }
+#endif
+
+    for (; i<count; i++) {
+        const float angle = pAngles[i];
+        pSin[i] = sinf(angle);
+        pCos[i] = cosf(angle);
+    }
+}
+
+void* SimdUtil::alignedMalloc(size_t size)
+{
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, 16);
+#else
+    void* pMemory = NULL;
+    if (posix_memalign(&pMemory, 16, size) != 0) {
+        return NULL;
+    }
+    return pMemory;
+#endif
+}
+
+void SimdUtil::alignedFree(void* pMemory)
+{
+#if defined(_MSC_VER)
+    _aligned_free(pMemory);
+#else
+    free(pMemory);
+#endif
+}
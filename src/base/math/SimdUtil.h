@@ -0,0 +1,130 @@
+/** \class SimdUtil
+ * SSE2 helpers for batch math, every function has a scalar fallback when GS_SSE2 is not defined
+ *
+ * @author  Rahul Mukhi
+ * @date  05/06/12
+ *
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+// x64 always has SSE2, on x86 it needs /arch:SSE2 (default since VC11), define GS_NO_SIMD to test the scalar paths
+#if !defined(GS_NO_SIMD) && (defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__))
+    #define GS_SSE2
+    #include <emmintrin.h>
+#endif
+
+class SimdUtil
+{
+public:
+
+    static void sinCos(const float* pAngles, float* pSin, float* pCos, unsigned int count);
+
+    // 16 byte aligned memory for the SSE2 loads and stores, free with alignedFree
+    static void* alignedMalloc(size_t size);
+    static void alignedFree(void* pMemory);
+
+#if defined(GS_SSE2)
+
+    /**
+     * Sine and cosine of four angles with the Cephes single precision polynomials. The angles are wrapped
+     * to [-pi, pi) first, so the error stays about 2^-23 plus the float spacing of the angle itself for
+     * any |angle| < 2^33 (e.g. omega*t of a long running simulation), larger angles give undefined results.
+     */
+    static GS_FORCEINLINE void sinCos4(__m128 angles, __m128* pSin, __m128* pCos)
+    {
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+
+        // angle - turns*2*pi in two parts (Cody-Waite), the high part has few bits so turns*high is exact
+        const __m128 turns = floor4(_mm_add_ps(_mm_mul_ps(angles, _mm_set1_ps(0.15915494309189535f)), _mm_set1_ps(0.5f)));
+        __m128 wrapped = _mm_sub_ps(angles, _mm_mul_ps(turns, _mm_set1_ps(6.28125f)));
+        wrapped = _mm_sub_ps(wrapped, _mm_mul_ps(turns, _mm_set1_ps(1.9353071795864769e-3f)));
+
+        __m128 signSin = _mm_and_ps(wrapped, signMask);
+        __m128 x = _mm_andnot_ps(signMask, wrapped);
+
+        // octant, rounded up to even so x is reduced to [-pi/4, pi/4]
+        __m128i octant = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+        octant = _mm_and_si128(_mm_add_epi32(octant, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+        const __m128 y = _mm_cvtepi32_ps(octant);
+
+        signSin = _mm_xor_ps(signSin, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(octant, _mm_set1_epi32(4)), 29)));
+        const __m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(_mm_andnot_si128(_mm_sub_epi32(octant, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+        const __m128 sinPolyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(octant, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+        // x - y*pi/4 in three parts (Cody-Waite)
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-0.78515625f)));
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-2.4187564849853515625e-4f)));
+        x = _mm_add_ps(x, _mm_mul_ps(y, _mm_set1_ps(-3.77489497744594108e-8f)));
+
+        const __m128 z = _mm_mul_ps(x, x);
+
+        __m128 cosPoly = _mm_set1_ps(2.443315711809948e-5f);
+        cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(-1.388731625493765e-3f));
+        cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, z), _mm_set1_ps(4.166664568298827e-2f));
+        cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, z), z);
+        cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+        __m128 sinPoly = _mm_set1_ps(-1.9515295891e-4f);
+        sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(8.3321608736e-3f));
+        sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, z), _mm_set1_ps(-1.6666654611e-1f));
+        sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, z), x), x);
+
+        const __m128 sinResult = _mm_or_ps(_mm_and_ps(sinPolyMask, sinPoly), _mm_andnot_ps(sinPolyMask, cosPoly));
+        const __m128 cosResult = _mm_or_ps(_mm_and_ps(sinPolyMask, cosPoly), _mm_andnot_ps(sinPolyMask, sinPoly));
+
+        *pSin = _mm_xor_ps(sinResult, signSin);
+        *pCos = _mm_xor_ps(cosResult, signCos);
+    }
+
+    /**
+     * Rounds four values towards minus infinity, exact for |x| < 2^31
+     */
+    static GS_FORCEINLINE __m128 floor4(__m128 x)
+    {
+        // truncation rounds negative values up, subtract 1 where that happened
+        const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, x), _mm_set1_ps(1.0f)));
+    }
+
+    /**
+     * Per lane mask ? a : b, the mask lanes are all ones or all zeros like the results of the compares
+     */
+    static GS_FORCEINLINE __m128 select4(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    /**
+     * Stores the pairs (first[i], second[i]) at pDest + i*stride, e.g. to write four complex
+     * values from separate real and imaginary registers into an interleaved array of structures
+     */
+    static GS_FORCEINLINE void storePairs4(float* pDest, unsigned int stride, __m128 first, __m128 second)
+    {
+        const __m128 low = _mm_unpacklo_ps(first, second);
+        const __m128 high = _mm_unpackhi_ps(first, second);
+
+        _mm_storel_pi((__m64*)(pDest), low);
+        _mm_storeh_pi((__m64*)(pDest + stride), low);
+        _mm_storel_pi((__m64*)(pDest + 2*stride), high);
+        _mm_storeh_pi((__m64*)(pDest + 3*stride), high);
+    }
+
+    /**
+     * Packs four pixels from separate channel registers into RGBA8 (r in the lowest byte),
+     * channels are saturated to [0, 255]
+     */
+    static GS_FORCEINLINE __m128i packRGBA8x4(__m128i r, __m128i g, __m128i b, __m128i a)
+    {
+        // r0-3 b0-3 g0-3 a0-3, then interleave the halves twice
+        const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(r, b), _mm_packs_epi32(g, a));
+        const __m128i pairs = _mm_unpacklo_epi8(bytes, _mm_srli_si128(bytes, 8));
+
+        return _mm_unpacklo_epi16(pairs, _mm_srli_si128(pairs, 8));
+    }
+
+#endif
+};
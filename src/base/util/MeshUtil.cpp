@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+
+#include "MeshUtil.h"
+
+#include "base/util/DebugUtil.h"
+
+/**
+ * Average cache miss ratio (transformed vertices per triangle) of an index buffer,
+ * simulated with a FIFO post-transform cache
+ *
+ * @param  pIndices  index buffer.
+ * @param  numIndices  number of indices including restart indices.
+ * @param  type  triangle list or triangle strip.
+ * @param  restartIndex  primitive restart index (strips only).
+ * @param  cacheSize  number of FIFO cache entries.
+ * @return ACMR, 0 if the buffer contains no triangles.
+ */
+float MeshUtil::computeACMR(const unsigned short* pIndices, unsigned int numIndices, PrimitiveType type, unsigned int restartIndex, unsigned int cacheSize)
+{
+    return computeACMRInternal(pIndices, numIndices, type, restartIndex, cacheSize);
+}
+
+float MeshUtil::computeACMR(const unsigned int* pIndices, unsigned int numIndices, PrimitiveType type, unsigned int restartIndex, unsigned int cacheSize)
+{
+    return computeACMRInternal(pIndices, numIndices, type, restartIndex, cacheSize);
+}
+
+template <class IndexType> float MeshUtil::computeACMRInternal(const IndexType* pIndices, unsigned int numIndices, PrimitiveType type, unsigned int restartIndex, unsigned int cacheSize)
+{
+    GS_ASSERT(cacheSize > 0);
+
+    std::vector<unsigned int> cache(cacheSize, 0xFFFFFFFF);
+    unsigned int cachePos = 0;
+    unsigned int numMisses = 0;
+    unsigned int numTriangles = 0;
+    unsigned int stripLength = 0;
+
+    for (unsigned int i=0; i<numIndices; i++) {
+        const unsigned int index = pIndices[i];
+
+        if (type == PRIMITIVE_TRIANGLE_STRIP) {
+            if (index == restartIndex) {
+                stripLength = 0;
+                continue;
+            }
+            stripLength++;
+            if (stripLength >= 3) {
+                numTriangles++;
+            }
+        } else if ((i % 3) == 2) {
+            numTriangles++;
+        }
+
+        bool hit = false;
+        for (unsigned int j=0; j<cacheSize; j++) {
+            if (cache[j] == index) {
+                hit = true;
+                break;
+            }
+        }
+
+        if (!hit) {
+            numMisses++;
+            cache[cachePos] = index;
+            cachePos = (cachePos+1) % cacheSize;
+        }
+    }
+
+    if (numTriangles == 0) {
+        return 0.0f;
+    }
+
+    return float(numMisses)/float(numTriangles);
+}
@@ -0,0 +1,31 @@
+/** \class MeshUtil
+ * Index buffer helpers (post-transform vertex cache statistics)
+ *
+ * @author  Rahul Mukhi
+ * @date  14/05/12
+ *
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+class MeshUtil
+{
+public:
+
+    enum PrimitiveType
+    {
+        PRIMITIVE_TRIANGLES,
+        PRIMITIVE_TRIANGLE_STRIP
+    };
+
+    static const unsigned int DEFAULT_CACHE_SIZE = 16; // FIFO entries, WaterSimulation::STRIP_BAND_WIDTH is sized for it
+
+    static float computeACMR(const unsigned short* pIndices, unsigned int numIndices, PrimitiveType type, unsigned int restartIndex, unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+    static float computeACMR(const unsigned int* pIndices, unsigned int numIndices, PrimitiveType type, unsigned int restartIndex, unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+
+private:
+
+    template <class IndexType> static float computeACMRInternal(const IndexType* pIndices, unsigned int numIndices, PrimitiveType type, unsigned int restartIndex, unsigned int cacheSize);
+};
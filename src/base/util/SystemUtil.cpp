@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+
+#include "SystemUtil.h"
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    #include <cpuid.h>
+#endif
+
+/**
+ * Processor brand string as reported by cpuid, e.g. "Intel(R) Core(TM) i7-2600 CPU @ 3.40GHz"
+ *
+ * @return brand string without leading spaces, "unknown" if it is not available.
+ */
+std::string SystemUtil::getCPUName()
+{
+    unsigned int registers[4];
+
+    if (!cpuid(0x80000000, registers) || registers[0] < 0x80000004) {
+        return "unknown";
+    }
+
+    char brand[49];
+    for (unsigned int i=0; i<3; i++) {
+        cpuid(0x80000002 + i, registers);
+        memcpy(brand + 16*i, registers, 16);
+    }
+    brand[48] = '\0';
+
+    const char* pStart = brand;
+    while (*pStart == ' ') {
+        pStart++;
+    }
+
+    return std::string(pStart);
+}
+
+/**
+ * CPU name reduced to characters that are safe in file names, to key caches that
+ * depend on the processor (e.g. FFTW wisdom)
+ *
+ * @return alphanumeric characters of the brand string, runs of other characters replaced by '_'.
+ */
+std::string SystemUtil::getCPUKey()
+{
+    const std::string name = getCPUName();
+    std::string key;
+
+    for (size_t i=0; i<name.size(); i++) {
+        const char c = name[i];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+            key += c;
+        } else if (!key.empty() && key[key.size()-1] != '_') {
+            key += '_';
+        }
+    }
+
+    while (!key.empty() && key[key.size()-1] == '_') {
+        key.erase(key.size()-1);
+    }
+
+    return key.empty() ? std::string("unknown") : key;
+}
+
+/**
+ * Number of logical processors available to the process
+ *
+ * @return at least 1.
+ */
+int SystemUtil::getNumProcessors()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    const int numProcessors = (int)info.dwNumberOfProcessors;
+#else
+    const int numProcessors = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return std::max(numProcessors, 1);
+}
+
+/**
+ * Executes cpuid
+ *
+ * @param  function  value of eax.
+ * @param  registers  receives eax, ebx, ecx, edx.
+ * @return false if cpuid is not available on this platform.
+ */
+bool SystemUtil::cpuid(unsigned int function, unsigned int registers[4])
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, (int)function);
+    for (int i=0; i<4; i++) {
+        registers[i] = (unsigned int)info[i];
+    }
+    return true;
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    return __get_cpuid(function, &registers[0], &registers[1], &registers[2], &registers[3]) != 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,26 @@
+/** \class SystemUtil
+ * Information about the machine the application runs on
+ *
+ * @author  Rahul Mukhi
+ * @date  04/06/12
+ *
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+#include <string>
+
+class SystemUtil
+{
+public:
+
+    static std::string getCPUName();
+    static std::string getCPUKey();
+    static int getNumProcessors();
+
+private:
+
+    static bool cpuid(unsigned int function, unsigned int registers[4]);
+};
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#include "PreCompiled.h"
+
+#include "TimeUtil.h"
+
+#if !defined(_WIN32)
+    #include <time.h>
+#endif
+
+/**
+ * Monotonic time with sub microsecond resolution
+ *
+ * @return time in seconds since an arbitrary start point.
+ */
+double TimeUtil::getTime()
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency = {0};
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+
+    return double(counter.QuadPart)/double(frequency.QuadPart);
+#else
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return double(time.tv_sec) + double(time.tv_nsec)*1.0e-9;
+#endif
+}
@@ -0,0 +1,18 @@
+/** \class TimeUtil
+ * High resolution wall clock for profiling
+ *
+ * @author  Rahul Mukhi
+ * @date  21/05/12
+ *
+ * Copyright (c) 2008-2012 GIANTS Software GmbH, Confidential, All Rights Reserved.
+ * Copyright (c) 2003-2012 Christian Ammann and Stefan Geiger, Confidential, All Rights Reserved.
+ */
+
+#pragma once
+
+class TimeUtil
+{
+public:
+
+    static double getTime();
+};